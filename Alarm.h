@@ -1,4 +1,5 @@
 #import <Foundation/Foundation.h>
+#import "AlarmRecurrence.h"
 
 #define ALARMTYPE_DEFAULT  0
 #define ALARMTYPE_TRACK    1
@@ -16,6 +17,12 @@
 	NSString *persistentTrackID;
 	NSString *persistentPlaylistID;
 	NSCalendarDate *time;
+	
+	// A recurrence rule (see AlarmRecurrence.h), which is used instead of the schedule if set
+	NSString *recurrenceRule;
+	
+	// The compiled recurrence rule, or weekly schedule (NULL if the alarm doesn't repeat)
+	AlarmRecurrence *recurrence;
 }
 
 // Global Class Methods
@@ -49,6 +56,9 @@
 - (int)schedule;
 - (void)setSchedule:(int)schedule;
 
+- (NSString *)recurrenceRule;
+- (void)setRecurrenceRule:(NSString *)rule;
+
 - (BOOL)isTrack;
 - (BOOL)isPlaylist;
 - (void)setType:(int)type;
@@ -64,4 +74,7 @@
 - (NSCalendarDate *)time;
 - (void)setTime:(NSCalendarDate *)time;
 
+// For going through the times the alarm goes off
+- (void)startOccurrences:(AlarmRecurrenceIterator *)iterator from:(NSDate *)start to:(NSDate *)end;
+
 @end
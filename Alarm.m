@@ -1,8 +1,6 @@
 #import "Alarm.h"
 #import "Prefs.h"
 #import "CalendarAdditions.h"
-
-// For calculating powers
 #import <math.h>
 
 // Declare keys to be used in userDefaults
@@ -11,6 +9,7 @@
 #define USES_SHUFFLE_KEY           @"shuffle"
 #define USES_EASY_WAKE_KEY         @"easyWake"
 #define SCHEDULE_KEY               @"schedule"
+#define RECURRENCE_KEY             @"recurrence"
 #define TYPE_KEY                   @"type"
 #define TRACK_ID_KEY               @"trackID"
 #define PLAYLIST_ID_KEY            @"playlistID"
@@ -20,6 +19,10 @@
 // For archiving, and unarchiving NSCalendarDates
 #define CALENDAR_FORMAT @"%Y-%m-%d %H:%M %z"
 
+// Declare private methods
+@interface Alarm (PrivateAPI)
+- (void)compileRecurrence;
+@end
 
 @implementation Alarm
 
@@ -33,6 +36,19 @@ static NSString *defaultAlarmFile;
 // Stores the index of the first day of the week for the user's locale
 static int firstDayOfWeek;
 
+// C STYLE METHODS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the offset from GMT of the given time zone (the context) at the given time, for AlarmRecurrenceNext.
+**/
+static int32_t ZoneOffset(void *context, int64_t time)
+{
+	NSDate *date = [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)time];
+	
+	return [(NSTimeZone *)context secondsFromGMTForDate:date];
+}
+
 // INITIALIZATION
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -99,6 +115,9 @@ static int firstDayOfWeek;
 		persistentTrackID = nil;
 		persistentPlaylistID = nil;
 		
+		recurrenceRule = nil;
+		recurrence = NULL;
+		
 		NSCalendarDate *now = [NSCalendarDate calendarDate];
 		
 		// Use a default time of NOW, but make sure to set the seconds to ZERO
@@ -169,6 +188,10 @@ static int firstDayOfWeek;
 			schedule -= 128;
 		}
 		
+		// Older versions only had the weekly schedule, without a recurrence rule
+		// A rule without a first day is pinned to the stored time's day, so it counts from there from now on
+		[self setRecurrenceRule:[dict objectForKey:RECURRENCE_KEY]];
+		
 		// Pre 2.2.1 versions didn't have a type variable
 		// Instead they relied on setting the trackID or playlistID to 0, when not in use
 		if((trackID > 0) && (playlistID <= 0))
@@ -206,10 +229,13 @@ static int firstDayOfWeek;
 	[alarmCopy setIsEnabled:[self isEnabled]];
 	[alarmCopy setUsesShuffle:[self usesShuffle]];
 	[alarmCopy setUsesEasyWake:[self usesEasyWake]];
-	[alarmCopy setSchedule:[self schedule]];
 	[alarmCopy setTrackID:[self trackID] withPersistentTrackID:[self persistentTrackID]];
 	[alarmCopy setPlaylistID:[self playlistID] withPersistentPlaylistID:[self persistentPlaylistID]];
+	
+	// The recurrence is compiled against the time, so it must be set first
 	[alarmCopy setTime:[self time]];
+	[alarmCopy setSchedule:[self schedule]];
+	[alarmCopy setRecurrenceRule:[self recurrenceRule]];
 	
 	// Don't forget to set the 'private' variables
 	// Make sure to set the type after setting the trackID and playlistID
@@ -229,6 +255,9 @@ static int firstDayOfWeek;
 	[persistentTrackID release];
 	[persistentPlaylistID release];
 	[time release];
+	[recurrenceRule release];
+	
+	AlarmRecurrenceFree(recurrence);
 	
 	// Move up the inheritance chain
 	[super dealloc];
@@ -261,6 +290,9 @@ static int firstDayOfWeek;
 	if(persistentPlaylistID != nil)
 		[dictionary setObject:persistentPlaylistID forKey:PERSISTENT_PLAYLIST_ID_KEY];
 	
+	if(recurrenceRule != nil)
+		[dictionary setObject:recurrenceRule forKey:RECURRENCE_KEY];
+	
 	// And finally, add the time to the dictionray
 	[dictionary setObject:[time descriptionWithCalendarFormat:CALENDAR_FORMAT] forKey:TIME_KEY];
 	
@@ -273,7 +305,7 @@ static int firstDayOfWeek;
 /**
  Updates the time and returns whether the alarm is expired or not.
   
- Updates the time of the alarm, based on the schedule, to be after now.
+ Updates the time of the alarm, based on the schedule (or recurrence rule), to be after now.
  If the alarm has no updates, or has updates but is now expired, 'No' is returned.
  If it has updates and isn't expired, the time is properly updated and 'Yes' is returned.
  
@@ -287,47 +319,26 @@ static int firstDayOfWeek;
 	if([time isLaterDate:now]) return YES;
 	
 	// If the alarm doesn't repeat, return NO
-	if(schedule == 0) return NO;
+	if(recurrence == NULL) return NO;
 	
-	// Calculate the nex date based on the repeat schedule
-	int scheduleCopy = schedule;
+	// Calculate the next date based on the repeat schedule
+	// This jumps straight to the first scheduled day after now, however long ago the alarm last went off
+	NSTimeZone *zone = [time timeZone];
+	NSTimeInterval interval = [time timeIntervalSince1970];
+	NSTimeInterval seconds = floor(interval);
 	
-	// Calculate weekday repeat schedule
-	// First get the days it is set to repeat
-	BOOL days[7];
-	int i;
-	for(i=6; i>=0; i--)
-	{
-		if(scheduleCopy >= pow(2, i))
-		{
-			days[i] = YES;
-			scheduleCopy -= pow(2, i);
-		}
-		else
-		{
-			days[i] = NO;
-		}
-	}
+	int64_t next = AlarmRecurrenceNext(recurrence, (int64_t)seconds, [zone secondsFromGMTForDate:time],
+	                                   (int64_t)floor([now timeIntervalSince1970]), ZoneOffset, zone);
 	
-	// Now increment the time until it's after now
-	BOOL found = YES;
-	while(![time isLaterDate:now] && found)
-	{
-		found = NO;
-		int daysChecked = 1;
-		int nextDay = [time dayOfWeek];
-		while(!found && daysChecked <= 7)
-		{
-			nextDay = (nextDay + 1) % 7;
-			if(days[nextDay] == YES)
-			{
-				[time autorelease];
-				time = [[time dateByAddingYears:0 months:0 days:daysChecked hours:0 minutes:0 seconds:0] retain];
-				found = YES;
-			}
-			daysChecked++;
-		}
-	}
+	// If the recurrence has ended (after a count, or end date), return NO
+	if(next == ALARM_RECURRENCE_NEVER) return NO;
+	
+	// Keep any fraction of a second, and the time zone and format of the old time
+	NSCalendarDate *nextTime = [NSCalendarDate dateWithTimeIntervalSince1970:(next + (interval - seconds))];
+	[nextTime setTimeZone:zone];
+	[nextTime setCalendarFormat:[time calendarFormat]];
+	
+	[self setTime:nextTime];
 	
 	return YES;
 }
@@ -420,6 +431,35 @@ static int firstDayOfWeek;
 - (void)setSchedule:(int)newSchedule
 {
 	schedule = newSchedule;
+	[self compileRecurrence];
+}
+
+/**
+ Returns the recurrence rule for the alarm, or nil if it only has a weekly schedule.
+ See AlarmRecurrence.h for the format of the rule.
+**/
+- (NSString *)recurrenceRule
+{
+	return recurrenceRule;
+}
+
+/**
+ Sets the recurrence rule for the alarm, which is used instead of the schedule. Nil removes it.
+ If the rule doesn't have a first day (DTSTART), the day of the alarm's time is added to it,
+ so intervals (such as every other week) keep counting from the same day as the alarm is updated.
+ If the rule isn't understood, it's logged, and the alarm is left without one.
+**/
+- (void)setRecurrenceRule:(NSString *)rule
+{
+	if((rule != nil) && ([rule rangeOfString:@"DTSTART=" options:NSCaseInsensitiveSearch].location == NSNotFound))
+	{
+		rule = [rule stringByAppendingFormat:@";DTSTART=%@", [time descriptionWithCalendarFormat:@"%Y%m%d"]];
+	}
+	
+	[recurrenceRule autorelease];
+	recurrenceRule = [rule copy];
+	
+	[self compileRecurrence];
 }
 
 /**
@@ -551,6 +591,21 @@ Returns whether or not the alarm is properly configured to play a playlist.
 	time = [newTime retain];
 }
 
+/**
+ Sets up the given iterator to go through the times the alarm goes off, from start up to (but not including) end.
+ The first is the alarm's time, followed by the times it repeats at.
+ The iterator may only be used until the alarm is changed, or released.
+**/
+- (void)startOccurrences:(AlarmRecurrenceIterator *)iterator from:(NSDate *)start to:(NSDate *)end
+{
+	NSTimeZone *zone = [time timeZone];
+	
+	AlarmRecurrenceIteratorInit(iterator, recurrence,
+	                            (int64_t)floor([time timeIntervalSince1970]), [zone secondsFromGMTForDate:time],
+	                            (int64_t)ceil([start timeIntervalSince1970]), (int64_t)ceil([end timeIntervalSince1970]),
+	                            ZoneOffset, zone);
+}
+
 
 // NSOBJECT METHODS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -575,6 +630,12 @@ Returns whether or not the alarm is properly configured to play a playlist.
 	if(trackID      != [anAlarm trackID])      return NO;
 	if(playlistID   != [anAlarm playlistID])   return NO;
 	
+	// Compare the recurrence rules (which may both be nil)
+	if(![recurrenceRule isEqualToString:[anAlarm recurrenceRule]] && recurrenceRule != [anAlarm recurrenceRule])
+	{
+		return NO;
+	}
+	
 	// Compare type
 	if([self isTrack] != [anAlarm isTrack]) return NO;
 	if([self isPlaylist] != [anAlarm isPlaylist]) return NO;
@@ -656,25 +717,9 @@ Returns whether or not the alarm is properly configured to play a playlist.
 	// And now it's time for the date...
 	
 	// Get date description
-	if(schedule > 0)
+	// Alarms repeating by a recurrence rule show the date they next go off on, as it varies
+	if((schedule > 0) && (recurrenceRule == nil))
 	{
-		int scheduleCopy = schedule;
-		
-		BOOL days[7];
-		int i;
-		for(i=6; i>=0; i--)
-		{
-			if(scheduleCopy >= pow(2, i))
-			{
-				days[i] = YES;
-				scheduleCopy -= pow(2, i);
-			}
-			else
-			{
-				days[i] = NO;
-			}
-		}
-		
 		NSArray *shortWeekDays = [[NSUserDefaults standardUserDefaults] arrayForKey:NSShortWeekDayNameArray];
 		
 		NSMutableString *temp = [NSMutableString string];
@@ -683,10 +728,10 @@ Returns whether or not the alarm is properly configured to play a playlist.
 		BOOL found = NO;
 		int daysChecked = 0;
 		
-		i = firstDayOfWeek;
+		int i = firstDayOfWeek;
 		while(daysChecked < 7)
 		{
-			if(days[i])
+			if(schedule & (1 << i))
 			{
 				if(found)
 					[temp appendString:@","];
@@ -729,5 +774,38 @@ Returns whether or not the alarm is properly configured to play a playlist.
 	}
 }
 
+// PRIVATE API
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Compiles the recurrence rule, or the weekly schedule if there isn't one.
+ If the rule isn't understood, it's removed.
+**/
+- (void)compileRecurrence
+{
+	AlarmRecurrenceFree(recurrence);
+	recurrence = NULL;
+	
+	if(recurrenceRule != nil)
+	{
+		int64_t startDay = AlarmRecurrenceDay([time yearOfCommonEra], [time monthOfYear], [time dayOfMonth]);
+		recurrence = AlarmRecurrenceCreate([recurrenceRule UTF8String], startDay);
+		
+		if(recurrence == NULL)
+		{
+			NSLog(@"Unable to use recurrence rule: %@", recurrenceRule);
+			
+			[recurrenceRule release];
+			recurrenceRule = nil;
+		}
+	}
+	
+	// Existing weekly schedules are the same as weekly rules, from any day
+	if(recurrence == NULL)
+	{
+		recurrence = AlarmRecurrenceCreateWeekly(schedule);
+	}
+}
+
 
 @end
@@ -1,5 +1,6 @@
 #import <Cocoa/Cocoa.h>
 #import "RoundedController.h"
+#import "GainRamp.h"
 @class  Alarm;
 @class  ITunesData;
 @class  ITunesPlayer;
@@ -34,6 +35,11 @@
 	BOOL isDataReady;
 	BOOL isPlayerReady;
 	
+	// Whether the library and player were prepared before the alarm went off,
+	// and whether the fire-to-first-audio latency has been recorded yet
+	BOOL isPrewarmed;
+	BOOL hasRecordedLatency;
+	
 	// Status line control
 	int statusOffset;
 	BOOL shouldDisplaySongInfo;
@@ -51,6 +57,15 @@
 	float minVolume;
 	float maxVolume;
 	
+	// Easy Wake volume ramp, which is advanced by the timer while the alarm is active
+	// If the player applies a copy of it to the sound it plays (see updatePlayerRamp), the volume isn't stepped
+	GainRamp easyWakeRamp;
+	NSTimeInterval rampUpdateTime;
+	BOOL isRampInPlayer;
+	
+	// Volume last written to the output device (negative until it's first written)
+	float deviceVolume;
+	
 	// Localized strings
 	NSString *anyKeyStopStr;
 	NSString *enterKeySnoozeStr;
@@ -73,6 +88,11 @@
     IBOutlet id roundedView;
 }
 
++ (void)prewarmForAlarm:(Alarm *)alarm;
+
 - (int)alarmStatus;
 
+- (NSCalendarDate *)nextDeadline;
+- (void)updateAndCheck:(NSTimer *)aTimer;
+
 @end
\ No newline at end of file
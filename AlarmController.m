@@ -4,20 +4,45 @@
 #import "Prefs.h"
 #import "ITunesData.h"
 #import "ITunesPlayer.h"
+#import "ITunesPlayabilityVerifier.h"
+#import "MemoryAudioOutput.h"
 #import "MTCoreAudioDevice.h"
 #import "AppleRemote.h"
+#import "WindowManager.h"
+#import "AlarmTasks.h"
+#import <math.h>
+
+// The Easy Wake ramp is driven by the timer, not by audio buffers, so it's positions are milliseconds
+// (the copy handed to the player is converted to the sound's sample rate)
+#define EASY_WAKE_RAMP_RATE  1000.0
+
+// The output device volume is only written when it changes by more than this
+#define VOLUME_TOLERANCE  0.001
 
 
 // Declare private methods
 @interface AlarmController (PrivateAPI)
++ (void)validateAlarm:(Alarm *)alarm withITunesData:(ITunesData *)iTunesData;
++ (void)configurePlayer:(ITunesPlayer *)iTunesPlayer forAlarm:(Alarm *)alarm;
++ (void)prewarmThread:(Alarm *)alarm;
++ (void)prewarmDidLoad:(NSDictionary *)prewarm;
++ (void)discardPrewarm;
+- (void)adoptPrewarm;
 - (void)parseITunesMusicLibrary;
+- (void)dataDidBecomeReady;
 - (void)setupPlayer;
+- (void)startPlayerIfReady;
+- (void)recordLatency;
 - (void)playerPlay;
+- (void)updatePlayerRamp;
 - (void)playerStop;
 - (void)playerNextTrack;
 - (void)playerPreviousTrack;
 - (void)snooze;
 - (void)stop;
+- (void)publishDeadline;
+- (void)updateTimer;
+- (void)applicationDidHideOrUnhide:(NSNotification *)notification;
 - (void)setVolume:(float)percent;
 - (void)runAppleScript:(NSObject *)obj;
 @end
@@ -25,6 +50,21 @@
 
 @implementation AlarmController
 
+// CLASS VARIABLES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The alarm the library and player are being (or have been) prepared for, ahead of it going off
+static Alarm *prewarmAlarm;
+
+// The library and player prepared for the prewarmAlarm (nil until they're ready)
+static ITunesData *prewarmData;
+static ITunesPlayer *prewarmPlayer;
+
+// Fire-to-first-audio latency of the alarms that have gone off since launch
+static int latencyCount;
+static NSTimeInterval latencyTotal;
+static NSTimeInterval latencyMax;
+
 // INIT, DEALLOC
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -36,6 +76,9 @@
 		// Get the alarm that is supposed to go off
 		lastAlarm = [[AlarmScheduler lastAlarmClone] retain];
 		
+		// If the library and player were prepared ahead of time, the alarm can start playing right away
+		[self adoptPrewarm];
+		
 		// Get preferences
 		anyKeyStops      = [Prefs anyKeyStops];
 		isDigitalAudio   = [Prefs digitalAudio];
@@ -46,6 +89,9 @@
 		minVolume        = [Prefs minVolume];
 		maxVolume        = [Prefs maxVolume];
 		
+		// Setup the Easy Wake ramp, from the min to the max volume
+		GainRampInit(&easyWakeRamp, [Prefs easyWakeCurve], minVolume, maxVolume, easyWakeDuration, EASY_WAKE_RAMP_RATE);
+		
 		// Initialize time formatter
 		timeFormatter = [[NSDateFormatter alloc] init];
 		[timeFormatter setFormatterBehavior:NSDateFormatterBehavior10_4];
@@ -54,8 +100,6 @@
 		
 		// Intialize the alarm status variables
 		alarmStatus = STATUS_ACTIVE;
-		isDataReady = NO;
-		isPlayerReady = NO;
 		
 		// Initialize status line variables
 		statusOffset = 0;
@@ -75,6 +119,7 @@
 		
 		// Initialize core audio device for changing system volume
 		outputDevice = [[MTCoreAudioDevice defaultOutputDevice] retain];
+		deviceVolume = -1.0;
 		
 		// Store the initial system volume
 		// These get restored after the alarm is stopped
@@ -104,12 +149,24 @@
 	// Record the starting time
 	startTime = [[lastAlarm time] retain];
 	
+	// The ramp starts from the time the alarm went off
+	rampUpdateTime = [startTime timeIntervalSinceReferenceDate];
+	
+	// The alarm is going off, so it keeps the system from sleeping
+	[self publishDeadline];
+	
 	// Start the timer
-	timer = [[NSTimer scheduledTimerWithTimeInterval:0.5
-											  target:self
-											selector:@selector(updateAndCheck:)
-											userInfo:nil
-											 repeats:YES] retain];
+	[self updateTimer];
+	
+	// While snoozing, the timer is only needed if the user can see the window
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(applicationDidHideOrUnhide:)
+												 name:NSApplicationDidHideNotification
+											   object:nil];
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(applicationDidHideOrUnhide:)
+												 name:NSApplicationDidUnhideNotification
+											   object:nil];
 	
 	// Initially set it's time
 	[roundedView setNeedsDisplay:YES];
@@ -169,8 +226,16 @@
 **/
 - (void)windowDidLoad
 {
-	// Start parsing iTunes Music Library in background thread
-	[NSThread detachNewThreadSelector:@selector(parseThread:) toTarget:self withObject:nil];
+	if(isPlayerReady)
+	{
+		// Pre-warmed, so there's nothing to wait for
+		[self playerPlay];
+	}
+	else
+	{
+		// Start parsing iTunes Music Library in background thread
+		[NSThread detachNewThreadSelector:@selector(parseThread:) toTarget:self withObject:nil];
+	}
 	
 	// Turn off the screen saver
 	[NSThread detachNewThreadSelector:@selector(runAppleScript:) toTarget:self withObject:nil];
@@ -194,6 +259,9 @@
 	// It would still be running if the user quit the app with this window still open
 	[timer invalidate];
 	
+	// Stop listening for the application being hidden or unhidden
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
 	// Post notification for stopped alarm
 	// This informs the WindowManager to remove the alarm from it's list of active alarm windows
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmClosed" object:self];
@@ -202,18 +270,237 @@
 	[self autorelease];
 }
 
+- (void)windowDidMiniaturize:(NSNotification *)aNotification
+{
+	[self updateTimer];
+}
+
+- (void)windowDidDeminiaturize:(NSNotification *)aNotification
+{
+	// The time shown may be out of date, if the timer was stopped while snoozing
+	if(alarmStatus == STATUS_SNOOZING)
+	{
+		[self updateAndCheck:nil];
+	}
+	[self updateTimer];
+}
+
+/**
+ Called when the application is hidden or unhidden, which hides or shows this window along with it.
+**/
+- (void)applicationDidHideOrUnhide:(NSNotification *)notification
+{
+	if((alarmStatus == STATUS_SNOOZING) && ![NSApp isHidden])
+	{
+		// The time shown may be out of date, if the timer was stopped
+		[self updateAndCheck:nil];
+	}
+	[self updateTimer];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Pre-warming
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Prepares the library and player for the given alarm, ahead of it going off.
+ Invoked (on the main thread) by AlarmTasks shortly before the next alarm is due (see [Prefs prewarmLeadTime]).
+
+ The library is loaded (or refreshed, if iTunes has changed it) on a background thread,
+ the alarm's trackID and playlistID are validated, and a player is set up with the first playable file.
+ When the alarm goes off, the alarm window takes over the library and player, and starts playing immediately.
+**/
++ (void)prewarmForAlarm:(Alarm *)alarm
+{
+	if(alarm == nil) return;
+	
+	// Already prepared (or being prepared) for this alarm
+	if([prewarmAlarm isEqualToAlarm:alarm]) return;
+	
+	[self discardPrewarm];
+	
+	NSLog(@"Pre-warming for alarm at: %@", [alarm time]);
+	
+	prewarmAlarm = [alarm copy];
+	[NSThread detachNewThreadSelector:@selector(prewarmThread:) toTarget:self withObject:prewarmAlarm];
+}
+
+/**
+ Background thread method.
+ Loads the library, and validates a copy of the alarm against it, handing both over to the main thread.
+ For a playlist alarm, the tracks of the playlist are verified as well.
+**/
++ (void)prewarmThread:(Alarm *)alarm
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	NSDate *start = [NSDate date];
+	
+	// If no window is using the current version of the library, it's loaded now
+	ITunesData *iTunesData = [[[ITunesData alloc] init] autorelease];
+	
+	Alarm *validAlarm = [[alarm copy] autorelease];
+	[self validateAlarm:validAlarm withITunesData:iTunesData];
+	
+	NSLog(@"Pre-warmed iTunes library (time: %f seconds)", [[NSDate date] timeIntervalSinceDate:start]);
+	
+	// The default alarm is played when no track is set, and whenever the alarm's track fails to play,
+	// so it's decoded into memory now (only the first time), rather than when something has already gone wrong
+	MemoryAudioOutputLoadSound([[Alarm defaultAlarmFile] fileSystemRepresentation]);
+	
+	// Check the tracks of the playlist ahead of time, so the player can skip the unplayable ones
+	// This is allowed at most half the lead time, so the player is still set up well before the alarm,
+	// and never past the alarm's time (the pre-warm may have started late, or the lead time been changed since)
+	if([validAlarm isPlaylist])
+	{
+		NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:([Prefs prewarmLeadTime] / 2.0)];
+		
+		if([validAlarm time] != nil)
+		{
+			deadline = [deadline earlierDate:[validAlarm time]];
+		}
+		
+		[ITunesPlayabilityVerifier verifyPlaylistWithID:[validAlarm playlistID]
+		                                   ofITunesData:iTunesData
+		                                     beforeDate:deadline];
+	}
+	
+	NSDictionary *prewarm = [NSDictionary dictionaryWithObjectsAndKeys:
+		alarm, @"Alarm",
+		validAlarm, @"ValidAlarm",
+		iTunesData, @"Data", nil];
+	
+	[self performSelectorOnMainThread:@selector(prewarmDidLoad:) withObject:prewarm waitUntilDone:NO];
+	
+	[pool release];
+}
+
+/**
+ Called on the main thread once the library has been loaded.
+ Sets up the player, unless the alarm has gone off (or been superseded by another) in the meantime.
+**/
++ (void)prewarmDidLoad:(NSDictionary *)prewarm
+{
+	if([prewarm objectForKey:@"Alarm"] != prewarmAlarm) return;
+	
+	prewarmData = [[prewarm objectForKey:@"Data"] retain];
+	prewarmPlayer = [[ITunesPlayer alloc] initWithITunesData:prewarmData];
+	
+	[self configurePlayer:prewarmPlayer forAlarm:[prewarm objectForKey:@"ValidAlarm"]];
+}
+
+/**
+ Releases the library and player prepared for the prewarmAlarm, if any.
+**/
++ (void)discardPrewarm
+{
+	[prewarmAlarm release];
+	prewarmAlarm = nil;
+	
+	[prewarmData release];
+	prewarmData = nil;
+	
+	[prewarmPlayer release];
+	prewarmPlayer = nil;
+}
+
+/**
+ Takes over the library and player, if they were prepared for the alarm that's going off, and are ready.
+ Otherwise, the library is parsed (or shared) and the player set up once the window has loaded.
+**/
+- (void)adoptPrewarm
+{
+	if(![prewarmAlarm isEqualToAlarm:lastAlarm]) return;
+	
+	if(prewarmPlayer != nil)
+	{
+		NSLog(@"Using pre-warmed iTunes library and player");
+		
+		data = [prewarmData retain];
+		player = [prewarmPlayer retain];
+		
+		// This is the same library the player was set up with, so the alarm validates to the same ID's
+		[AlarmController validateAlarm:lastAlarm withITunesData:data];
+		
+		[player setDelegate:self];
+		
+		isDataReady = YES;
+		isPlayerReady = YES;
+		isPrewarmed = YES;
+	}
+	
+	// Either way, the alarm has gone off
+	// If the library is still loading, the window's own parse will share it once it's loaded
+	[AlarmController discardPrewarm];
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark Parsing iTunes and Playing Alarm
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ Updates the alarm's trackID and playlistID, which may have changed since the alarm was set.
+ The persistent ID's stored with the alarm are used to find the current ID's.
+**/
++ (void)validateAlarm:(Alarm *)alarm withITunesData:(ITunesData *)iTunesData
+{
+	// The stored trackID may have changed
+	// Check this, and update the alarm if needed
+	int correctTrackID = [iTunesData validateTrackID:[alarm trackID]
+							   withPersistentTrackID:[alarm persistentTrackID]];
+	
+	if(correctTrackID != [alarm trackID])
+	{
+		[alarm setTrackID:correctTrackID withPersistentTrackID:[alarm persistentTrackID]];
+	}
+	
+	// The stored playlistID may have changed
+	// Check this, and update the alarm if needed
+	int correctPlaylistID = [iTunesData validatePlaylistID:[alarm playlistID]
+								  withPersistentPlaylistID:[alarm persistentPlaylistID]];
+	
+	if(correctPlaylistID != [alarm playlistID])
+	{
+		[alarm setPlaylistID:correctPlaylistID withPersistentPlaylistID:[alarm persistentPlaylistID]];
+	}
+}
+
+/**
+ Sets the given player to play the track, playlist, or default file of the given (validated) alarm.
+ This opens the first playable file, so it must be invoked on the main thread.
+**/
++ (void)configurePlayer:(ITunesPlayer *)iTunesPlayer forAlarm:(Alarm *)alarm
+{
+	if([alarm isPlaylist])
+	{
+		// Using a playlist
+		NSLog(@"Setting alarm with playlistID: %i", [alarm playlistID]);
+		[iTunesPlayer setPlaylistWithPlaylistID:[alarm playlistID] usesShuffle:[alarm usesShuffle]];
+	}
+	else if([alarm isTrack])
+	{
+		// Using a single track
+		NSLog(@"Setting alarm with trackID: %i", [alarm trackID]);
+		[iTunesPlayer setTrackWithTrackID:[alarm trackID]];
+	}
+	else
+	{
+		// No alarm file set, use default alarm file
+		NSLog(@"Setting alarm with defaultAlarmFile");
+		[iTunesPlayer setFileWithPath:[Alarm defaultAlarmFile]];
+	}
+}
+
 /**
  Background thread function to parse iTunes library.
  This method is run in a separate thread, allowing the GUI to remain responsive.
+ Once the data is ready, the player is started on the main thread (rather than waiting for the next timer event).
 **/
 - (void)parseThread:(NSObject *)obj
 {
 	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 	[self parseITunesMusicLibrary];
+	[self performSelectorOnMainThread:@selector(dataDidBecomeReady) withObject:nil waitUntilDone:NO];
     [pool release];
 }
 
@@ -236,27 +523,11 @@
 		NSDate *start = [NSDate date];
 		
 		// Parse the iTunes Music Library
+		// If another window (or the pre-warm) has already loaded this version of the library, it's shared
 		data = [[ITunesData alloc] init];
 		
-		// The stored trackID may have changed
-		// Check this, and update the alarm if needed
-		int correctTrackID = [data validateTrackID:[lastAlarm trackID]
-							 withPersistentTrackID:[lastAlarm persistentTrackID]];
-		
-		if(correctTrackID != [lastAlarm trackID])
-		{
-			[lastAlarm setTrackID:correctTrackID withPersistentTrackID:[lastAlarm persistentTrackID]];
-		}
-		
-		// The stored playlistID may have changed
-		// Check this, and update the alarm if needed
-		int correctPlaylistID = [data validatePlaylistID:[lastAlarm playlistID]
-								withPersistentPlaylistID:[lastAlarm persistentPlaylistID]];
-		
-		if(correctPlaylistID != [lastAlarm playlistID])
-		{
-			[lastAlarm setPlaylistID:correctPlaylistID withPersistentPlaylistID:[lastAlarm persistentPlaylistID]];
-		}
+		// Update the alarm if the stored trackID or playlistID has changed
+		[AlarmController validateAlarm:lastAlarm withITunesData:data];
 		
 		NSDate *end = [NSDate date];
 		NSLog(@"Done parsing (time: %f seconds)", [end timeIntervalSinceDate:start]);
@@ -269,6 +540,15 @@
 	[lock unlock];
 }
 
+/**
+ Called on the main thread once the background thread has parsed the library.
+**/
+- (void)dataDidBecomeReady
+{
+	[self startPlayerIfReady];
+	[roundedView setNeedsDisplay:YES];
+}
+
 /**
  This method initializes and configures the ITunesPlayer.
  Because the ITunesPlayer initializes a QTMovie, and QTMovie objects must be initialized in the main thread,
@@ -294,24 +574,7 @@
 		[player setDelegate:self];
 	
 		// Set the alarm
-		if([lastAlarm isPlaylist])
-		{
-			// Using a playlist
-			NSLog(@"Setting alarm with playlistID: %i", [lastAlarm playlistID]);
-			[player setPlaylistWithPlaylistID:[lastAlarm playlistID] usesShuffle:[lastAlarm usesShuffle]];
-		}
-		else if([lastAlarm isTrack])
-		{
-			// Using a single track
-			NSLog(@"Setting alarm with trackID: %i", [lastAlarm trackID]);
-			[player setTrackWithTrackID:[lastAlarm trackID]];
-		}
-		else
-		{
-			// No alarm file set, use default alarm file
-			NSLog(@"Setting alarm with defaultAlarmFile");
-			[player setFileWithPath:[Alarm defaultAlarmFile]];
-		}
+		[AlarmController configurePlayer:player forAlarm:lastAlarm];
 		
 		// Update the player status
 		// This lets the other methods know it's now safe to interact with the player
@@ -321,6 +584,22 @@
 	[lock unlock];
 }
 
+/**
+ Sets up the player once the data is ready, and starts it if the alarm is active.
+ Does nothing if the player has already been set up.
+**/
+- (void)startPlayerIfReady
+{
+	if(isDataReady && !isPlayerReady)
+	{
+		[self setupPlayer];
+		if(alarmStatus == STATUS_ACTIVE)
+		{
+			[self playerPlay];
+		}
+	}
+}
+
 /**
  This method starts the player, and verifies it's playing properly.
  If anything goes wrong, it reverts to the default alarm file.
@@ -341,9 +620,59 @@
 			[player setFileWithPath:[Alarm defaultAlarmFile]];
 			[player play];
 		}
+		
+		[self updatePlayerRamp];
+		[self recordLatency];
 	}
 }
 
+/**
+ Hands the Easy Wake ramp to the player, if it's playing a sound from memory (such as the default alarm).
+ The player applies it to every sample, so the sound fades in smoothly,
+ instead of the volume being stepped on every timer event, which it still is for movies (iTunes tracks).
+ 
+ The volume is then held at the end of the ramp, so the ramp given to the player rises
+ from the ratio of the start volume to the end volume, up to full scale.
+**/
+- (void)updatePlayerRamp
+{
+	isRampInPlayer = NO;
+	
+	if(![lastAlarm usesEasyWake]) return;
+	
+	if((easyWakeRamp.endGain > 0.0f) && (easyWakeRamp.startGain <= easyWakeRamp.endGain))
+	{
+		GainRamp playerRamp = easyWakeRamp;
+		playerRamp.startGain = easyWakeRamp.startGain / easyWakeRamp.endGain;
+		playerRamp.endGain = 1.0f;
+		
+		isRampInPlayer = [player setRamp:&playerRamp];
+	}
+	
+	[self setVolume:(isRampInPlayer ? easyWakeRamp.endGain : GainRampGain(&easyWakeRamp))];
+}
+
+/**
+ Records the time from when the alarm was due to go off, until it first started playing.
+ Only the first start is recorded, not the restarts after snoozing.
+**/
+- (void)recordLatency
+{
+	if(hasRecordedLatency || ![player isPlaying]) return;
+	
+	hasRecordedLatency = YES;
+	
+	NSTimeInterval latency = [[NSDate date] timeIntervalSinceDate:[lastAlarm time]];
+	
+	latencyCount++;
+	latencyTotal += latency;
+	latencyMax = MAX(latencyMax, latency);
+	
+	NSLog(@"Fire-to-first-audio latency: %.0f ms, pre-warmed: %@ (average %.0f ms, max %.0f ms, over %i alarms)",
+		  latency * 1000.0, (isPrewarmed ? @"YES" : @"NO"),
+		  (latencyTotal / latencyCount) * 1000.0, latencyMax * 1000.0, latencyCount);
+}
+
 /**
  This method stops the player from playing.
 **/
@@ -597,6 +926,9 @@
 		startTime = [newStartTime retain];
 	
 		NSLog(@"Increasing Snooze: %@", startTime);
+		
+		// The alarm goes off again at a different time
+		[self publishDeadline];
 	}
 	else if(alarmStatus == STATUS_ACTIVE)
 	{
@@ -625,6 +957,9 @@
 			startTime = [newStartTime retain];
 			
 			NSLog(@"Decreasing Snooze: %@", startTime);
+			
+			// The alarm goes off again at a different time
+			[self publishDeadline];
 		}
 	}
 	else if(alarmStatus == STATUS_ACTIVE)
@@ -687,6 +1022,57 @@
 	// The timer is still active, and will take care of setting off the alarm if needed.
 }
 
+/**
+ Returns the time at which this alarm stops snoozing, or nil if it isn't snoozing.
+ AlarmTasks wakes up at this time, and sets it off (via updateAndCheck:) without waiting for the next timer event.
+**/
+- (NSCalendarDate *)nextDeadline
+{
+	if(alarmStatus == STATUS_SNOOZING)
+		return [[startTime copy] autorelease];
+	else
+		return nil;
+}
+
+/**
+ Publishes the time this alarm stops snoozing, and whether it's keeping the system from sleeping,
+ into the WindowManager's deadline registry.
+ Called whenever the alarm status, or the time it stops snoozing, changes.
+**/
+- (void)publishDeadline
+{
+	[WindowManager setDeadline:[self nextDeadline] preventsSleep:![self canSystemSleep] forOwner:self];
+}
+
+/**
+ Starts or stops the timer, depending on whether it's needed.
+ It's needed while the alarm is going off (to ramp the volume, and terminate it after a while),
+ and while it's snoozing in a window the user can see (to keep the time shown up to date).
+ Otherwise nothing needs doing until the snooze is over, and AlarmTasks wakes up for that (see nextDeadline).
+ Called whenever the alarm status, or whether the window can be seen, changes.
+**/
+- (void)updateTimer
+{
+	BOOL isVisible = [[self window] isVisible] && ![[self window] isMiniaturized] && ![NSApp isHidden];
+	BOOL needsTimer = (alarmStatus == STATUS_ACTIVE) || ((alarmStatus == STATUS_SNOOZING) && isVisible);
+	
+	if(needsTimer && (timer == nil))
+	{
+		timer = [[NSTimer scheduledTimerWithTimeInterval:0.5
+												  target:self
+												selector:@selector(updateAndCheck:)
+												userInfo:nil
+												 repeats:YES] retain];
+	}
+	else if(!needsTimer && (timer != nil))
+	{
+		// This may be called from the timer itself, so it's autoreleased rather than released
+		[timer invalidate];
+		[timer autorelease];
+		timer = nil;
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark General Correspondence
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -720,14 +1106,24 @@
 		
 		NSLog(@"Snoozing til: %@", startTime);
 		
+		// The system needs to be awake when the snooze is over
+		[self publishDeadline];
+		
 		// Set window so it can be put in the background
 		[[self window] setLevel: NSNormalWindowLevel];
 		
+		// The timer now only keeps the time shown up to date, while the window can be seen
+		[self updateTimer];
+		
 		// Reset the volume if using easy wake
 		// This way you don't hear "You've Got Mail" really loud while you're snoozing
+		// The ramp is held at it's start until the alarm goes off again
 		if([lastAlarm usesEasyWake])
 		{
-			[self setVolume:minVolume];
+			GainRampRestart(&easyWakeRamp);
+			GainRampPause(&easyWakeRamp);
+			
+			[self setVolume:GainRampGain(&easyWakeRamp)];
 		}
 	}
 }
@@ -741,11 +1137,14 @@
 		// Update the alarm status
 		alarmStatus = STATUS_STOPPED;
 		
+		// A stopped alarm neither needs waking up for, nor keeps the system from sleeping
+		[self publishDeadline];
+		
 		// Stop playing the music
 		[self playerStop];
 		
 		// Stop the timer
-		[timer invalidate];
+		[self updateTimer];
 		
 		// Start a timer to fade out the window
 		// After the fade is complete, the window will automatically be closed
@@ -769,6 +1168,12 @@
 	// Get the current time
 	NSCalendarDate *now = [NSCalendarDate calendarDate];
 	
+	// Count the wakeup, unless we were called directly (by AlarmTasks, or to catch up the time shown)
+	if(aTimer != nil)
+	{
+		[AlarmTasks countWindowWakeup];
+	}
+	
 	// Update the timeStr
 	[timeStr release];
 	timeStr = [[timeFormatter stringFromDate:now] retain];
@@ -783,35 +1188,24 @@
 	}
 	
 	// Setup the player if needed
-	if(isDataReady && !isPlayerReady)
-	{
-		[self setupPlayer];
-		if(alarmStatus == STATUS_ACTIVE)
-		{
-			[self playerPlay];
-		}
-	}
+	[self startPlayerIfReady];
 	
 	if(alarmStatus == STATUS_ACTIVE)
 	{
 		// Set the volume to the proper level
 		if([lastAlarm usesEasyWake])
 		{
-			// typedef double NSTimeInterval: Always in seconds; yields submillisecond precision...
-			NSTimeInterval elapsed = [now timeIntervalSinceDate:startTime];
-			
-			float scale = (float)elapsed / (float)easyWakeDuration;
-			if(scale > 1.0)
-			{
-				// We have to make sure the scale doesn't get bigger than 100%
-				// If it does, the volume may end up higher than maxVolume
-				scale = 1.0;
-			}
+			// Advance the ramp by the time since it was last updated
+			// The ramp itself makes sure the volume doesn't go past maxVolume
+			NSTimeInterval updateTime = [now timeIntervalSinceReferenceDate];
+			GainRampAdvance(&easyWakeRamp, updateTime - rampUpdateTime);
+			rampUpdateTime = updateTime;
 			
-			float diff = maxVolume - minVolume;
-			float percent = minVolume + (diff * scale);
-			
-			[self setVolume:percent];
+			// If the player applies the ramp to the sound itself, the volume stays at the end of the ramp
+			if(isRampInPlayer)
+				[self setVolume:easyWakeRamp.endGain];
+			else
+				[self setVolume:GainRampGain(&easyWakeRamp)];
 		}
 		else
 		{
@@ -826,11 +1220,14 @@
 			// Update alarm status
 			alarmStatus = STATUS_TERMINATED;
 			
+			// It no longer keeps the system from sleeping
+			[self publishDeadline];
+			
 			// Stop playing the music
 			[self playerStop];
 			
 			// Stop the timer
-			[timer invalidate];
+			[self updateTimer];
 			
 			// Set window so it can be put in the background
 			[[self window] setLevel:NSNormalWindowLevel];
@@ -848,14 +1245,25 @@
 			[startTime release];
 			startTime = [now retain];
 			
+			// The snooze is over, and it's keeping the system from sleeping again
+			// Whichever of this timer and AlarmTasks got here first, the other doesn't need to wake up for it
+			[self publishDeadline];
+			
+			// If the window was hidden, AlarmTasks got here first, and the timer needs starting again
+			[self updateTimer];
+			
 			// Reset status line variables
 			statusOffset = 0;
 			shouldDisplaySongInfo = YES;
 			
-			// Reset the volume
+			// Reset the volume, and start the ramp over
 			// The setVolume method automatically takes care of unmuting the volume
+			GainRampRestart(&easyWakeRamp);
+			GainRampResume(&easyWakeRamp);
+			rampUpdateTime = [now timeIntervalSinceReferenceDate];
+			
 			if([lastAlarm usesEasyWake])
-				[self setVolume:minVolume];
+				[self setVolume:GainRampGain(&easyWakeRamp)];
 			else
 				[self setVolume:prefVolume];
 			
@@ -998,6 +1406,18 @@
 	}
 	else
 	{
+		// The volume is set on every timer event, but it's only written when it's actually changed
+		// (by the ramp, or by the user, since the alarm insists on it's volume, and on not being muted)
+		BOOL needsUnmute = (alteredPercent > 0.00) &&
+		                   [outputDevice isMutedForChannel:0 forDirection:kMTCoreAudioDevicePlaybackDirection];
+		
+		if(!needsUnmute && (fabsf(alteredPercent - deviceVolume) < VOLUME_TOLERANCE) &&
+		   (fabsf([outputDevice volumeForChannel:1 forDirection:kMTCoreAudioDevicePlaybackDirection] - alteredPercent) < VOLUME_TOLERANCE))
+		{
+			return;
+		}
+		deviceVolume = alteredPercent;
+		
 		// Make sure the volume is unmuted
 		if(alteredPercent > 0.00)
 		{
@@ -0,0 +1,296 @@
+#include "AlarmHeap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ Returns whether entry a goes before entry b.
+**/
+static inline int IsBefore(const AlarmHeapEntry *a, const AlarmHeapEntry *b)
+{
+	return (a->key < b->key) || ((a->key == b->key) && (a->sequence < b->sequence));
+}
+
+/**
+ Moves the entry at the given position up, until it's parent goes before it.
+**/
+static void SiftUp(AlarmHeap *heap, uint32_t position)
+{
+	AlarmHeapEntry entry = heap->entries[position];
+	
+	while(position > 0)
+	{
+		uint32_t parent = (position - 1) / 2;
+		if(!IsBefore(&entry, &heap->entries[parent])) break;
+		
+		heap->entries[position] = heap->entries[parent];
+		heap->positions[heap->entries[position].handle] = position;
+		position = parent;
+	}
+	
+	heap->entries[position] = entry;
+	heap->positions[entry.handle] = position;
+}
+
+/**
+ Moves the entry at the given position down, until it goes before both it's children.
+**/
+static void SiftDown(AlarmHeap *heap, uint32_t position)
+{
+	AlarmHeapEntry entry = heap->entries[position];
+	
+	while(1)
+	{
+		uint32_t child = (2 * position) + 1;
+		if(child >= heap->count) break;
+		
+		if((child + 1 < heap->count) && IsBefore(&heap->entries[child + 1], &heap->entries[child]))
+		{
+			child++;
+		}
+		if(!IsBefore(&heap->entries[child], &entry)) break;
+		
+		heap->entries[position] = heap->entries[child];
+		heap->positions[heap->entries[position].handle] = position;
+		position = child;
+	}
+	
+	heap->entries[position] = entry;
+	heap->positions[entry.handle] = position;
+}
+
+/**
+ Makes room for handles up to (and including) the given one.
+**/
+static int GrowPositions(AlarmHeap *heap, int32_t handle)
+{
+	uint32_t capacity = heap->positionsCapacity;
+	
+	while(capacity <= (uint32_t)handle)
+	{
+		capacity = (capacity > 0) ? (capacity * 2) : 16;
+	}
+	
+	int32_t *positions = realloc(heap->positions, capacity * sizeof(int32_t));
+	if(positions == NULL) return 0;
+	
+	// -1 (not in the heap) is all bits set
+	memset(positions + heap->positionsCapacity, 0xFF, (capacity - heap->positionsCapacity) * sizeof(int32_t));
+	
+	heap->positions = positions;
+	heap->positionsCapacity = capacity;
+	return 1;
+}
+
+// HEAP
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Creates an empty heap, with room for the given number of handles (it grows as needed).
+ Returns NULL if the memory can't be allocated.
+**/
+AlarmHeap * AlarmHeapCreate(uint32_t capacity)
+{
+	AlarmHeap *heap = calloc(1, sizeof(AlarmHeap));
+	if(heap == NULL) return NULL;
+	
+	if(capacity < 16) capacity = 16;
+	
+	heap->entries = malloc(capacity * sizeof(AlarmHeapEntry));
+	heap->entriesCapacity = capacity;
+	
+	if((heap->entries == NULL) || !GrowPositions(heap, (int32_t)capacity - 1))
+	{
+		AlarmHeapFree(heap);
+		return NULL;
+	}
+	
+	return heap;
+}
+
+void AlarmHeapFree(AlarmHeap *heap)
+{
+	if(heap == NULL) return;
+	
+	free(heap->entries);
+	free(heap->positions);
+	free(heap);
+}
+
+uint32_t AlarmHeapCount(const AlarmHeap *heap)
+{
+	return heap->count;
+}
+
+int AlarmHeapContains(const AlarmHeap *heap, int32_t handle)
+{
+	return (handle >= 0) && ((uint32_t)handle < heap->positionsCapacity) && (heap->positions[handle] >= 0);
+}
+
+/**
+ Adds the handle with the given key. If the handle is already in the heap, it's key is changed instead.
+ Returns 0 if the handle is negative, or the memory can't be allocated.
+**/
+int AlarmHeapInsert(AlarmHeap *heap, int32_t handle, int64_t key)
+{
+	if(handle < 0) return 0;
+	
+	if(AlarmHeapContains(heap, handle))
+	{
+		AlarmHeapUpdate(heap, handle, key);
+		return 1;
+	}
+	
+	if(((uint32_t)handle >= heap->positionsCapacity) && !GrowPositions(heap, handle)) return 0;
+	
+	if(heap->count == heap->entriesCapacity)
+	{
+		uint32_t capacity = heap->entriesCapacity * 2;
+		AlarmHeapEntry *entries = realloc(heap->entries, capacity * sizeof(AlarmHeapEntry));
+		if(entries == NULL) return 0;
+		
+		heap->entries = entries;
+		heap->entriesCapacity = capacity;
+	}
+	
+	AlarmHeapEntry *entry = &heap->entries[heap->count];
+	entry->key = key;
+	entry->sequence = heap->nextSequence++;
+	entry->handle = handle;
+	
+	heap->count++;
+	SiftUp(heap, heap->count - 1);
+	
+	return 1;
+}
+
+/**
+ Changes the key of the handle, which goes after any others with the same key.
+ Does nothing if the handle isn't in the heap.
+**/
+void AlarmHeapUpdate(AlarmHeap *heap, int32_t handle, int64_t key)
+{
+	if(!AlarmHeapContains(heap, handle)) return;
+	
+	uint32_t position = heap->positions[handle];
+	AlarmHeapEntry *entry = &heap->entries[position];
+	
+	int64_t oldKey = entry->key;
+	entry->key = key;
+	entry->sequence = heap->nextSequence++;
+	
+	// The new sequence puts it after entries of the same key, so it only moves up if the key decreased
+	if(key < oldKey)
+		SiftUp(heap, position);
+	else
+		SiftDown(heap, position);
+}
+
+/**
+ Removes the handle from the heap. Does nothing if it isn't in the heap.
+**/
+void AlarmHeapRemove(AlarmHeap *heap, int32_t handle)
+{
+	if(!AlarmHeapContains(heap, handle)) return;
+	
+	uint32_t position = heap->positions[handle];
+	heap->positions[handle] = -1;
+	heap->count--;
+	
+	if(position == heap->count) return;
+	
+	// Fill the hole with the last entry, which may have to move either way from there
+	AlarmHeapEntry *last = &heap->entries[heap->count];
+	int isBefore = IsBefore(last, &heap->entries[position]);
+	
+	heap->entries[position] = *last;
+	heap->positions[last->handle] = position;
+	
+	if(isBefore)
+		SiftUp(heap, position);
+	else
+		SiftDown(heap, position);
+}
+
+/**
+ Returns the handle with the smallest key, or -1 if the heap is empty.
+**/
+int32_t AlarmHeapPeek(const AlarmHeap *heap)
+{
+	return (heap->count > 0) ? heap->entries[0].handle : -1;
+}
+
+/**
+ Returns the key of the handle, which must be in the heap.
+**/
+int64_t AlarmHeapKey(const AlarmHeap *heap, int32_t handle)
+{
+	return heap->entries[heap->positions[handle]].key;
+}
+
+/**
+ Returns whether handle a goes after handle b (both must be in the heap).
+**/
+static inline int HandleIsAfter(const AlarmHeap *heap, int32_t a, int32_t b)
+{
+	return IsBefore(&heap->entries[heap->positions[b]], &heap->entries[heap->positions[a]]);
+}
+
+/**
+ Moves the handle at the given position of the array down, until it goes after both it's children.
+ Used by AlarmHeapSorted, which keeps the array as a heap with the last handle at the top.
+**/
+static void SiftHandleDown(const AlarmHeap *heap, int32_t *handles, uint32_t position, uint32_t count)
+{
+	int32_t handle = handles[position];
+	
+	while(1)
+	{
+		uint32_t child = (2 * position) + 1;
+		if(child >= count) break;
+		
+		if((child + 1 < count) && HandleIsAfter(heap, handles[child + 1], handles[child]))
+		{
+			child++;
+		}
+		if(!HandleIsAfter(heap, handles[child], handle)) break;
+		
+		handles[position] = handles[child];
+		position = child;
+	}
+	
+	handles[position] = handle;
+}
+
+/**
+ Fills the given array (which must have room for every handle in the heap) with the handles, in order.
+ The handles are sorted within the array itself (heapsort), so this doesn't allocate any memory, and can't fail.
+ Returns the number of handles.
+**/
+uint32_t AlarmHeapSorted(const AlarmHeap *heap, int32_t *handles)
+{
+	uint32_t count = heap->count;
+	uint32_t i;
+	
+	for(i = 0; i < count; i++)
+	{
+		handles[i] = heap->entries[i].handle;
+	}
+	
+	for(i = count / 2; i > 0; i--)
+	{
+		SiftHandleDown(heap, handles, i - 1, count);
+	}
+	
+	// Move the last handle to the end of the array, until only the first is left
+	for(i = count; i > 1; i--)
+	{
+		int32_t last = handles[0];
+		handles[0] = handles[i - 1];
+		handles[i - 1] = last;
+		
+		SiftHandleDown(heap, handles, 0, i - 1);
+	}
+	
+	return count;
+}
@@ -0,0 +1,57 @@
+/**
+ An indexed binary min-heap, ordering handles by a 64 bit key (the time of an alarm, in seconds since 1970).
+
+ Handles are small non-negative integers chosen by the caller (such as slots in it's own table of alarms),
+ and stay the same for as long as they're in the heap, however the heap is reordered around them.
+ This is what allows a handle's key to be changed, or the handle removed, in O(log n), without searching for it.
+
+ Handles with the same key are ordered by when their key was set, so an alarm rescheduled to the same time
+ as another goes after it (as when the alarms were kept in a sorted array).
+
+ - Insert, Update and Remove are O(log n)
+ - Peek (the handle with the smallest key) is O(1)
+ - Sorted (all handles in order) is O(n log n), and is meant for listing the alarms, not for scheduling them
+**/
+
+#ifndef ALARM_HEAP_H
+#define ALARM_HEAP_H
+
+#include <stdint.h>
+
+typedef struct AlarmHeapEntry
+{
+	int64_t  key;
+	uint64_t sequence;
+	int32_t  handle;
+} AlarmHeapEntry;
+
+typedef struct AlarmHeap
+{
+	// Entries in heap order
+	AlarmHeapEntry *entries;
+	uint32_t count;
+	uint32_t entriesCapacity;
+	
+	// Position of each handle in the entries (-1 if not in the heap)
+	int32_t *positions;
+	uint32_t positionsCapacity;
+	
+	uint64_t nextSequence;
+} AlarmHeap;
+
+AlarmHeap * AlarmHeapCreate(uint32_t capacity);
+void AlarmHeapFree(AlarmHeap *heap);
+
+uint32_t AlarmHeapCount(const AlarmHeap *heap);
+int AlarmHeapContains(const AlarmHeap *heap, int32_t handle);
+
+int AlarmHeapInsert(AlarmHeap *heap, int32_t handle, int64_t key);
+void AlarmHeapUpdate(AlarmHeap *heap, int32_t handle, int64_t key);
+void AlarmHeapRemove(AlarmHeap *heap, int32_t handle);
+
+int32_t AlarmHeapPeek(const AlarmHeap *heap);
+int64_t AlarmHeapKey(const AlarmHeap *heap, int32_t handle);
+
+uint32_t AlarmHeapSorted(const AlarmHeap *heap, int32_t *handles);
+
+#endif
@@ -0,0 +1,706 @@
+#include "AlarmRecurrence.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define DAY_SECONDS  86400
+
+// The Gregorian calendar repeats every 400 years, so a day of the month that isn't found in that many months never is
+#define MAX_MONTHS   4800
+
+static const char *weekdayNames[7] = { "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+
+/**
+ Divides, rounding towards negative infinity (so times before 1970 fall on the right day).
+**/
+static inline int64_t FloorDivide(int64_t a, int64_t b)
+{
+	int64_t quotient = a / b;
+	
+	if(((a % b) != 0) && ((a < 0) != (b < 0))) quotient--;
+	return quotient;
+}
+
+/**
+ Returns the day of the week (0 for Sunday, to 6 for Saturday) of the given day.
+**/
+static inline int Weekday(int64_t day)
+{
+	// January 1st 1970 was a Thursday
+	int weekday = (int)((day + 4) % 7);
+	
+	return (weekday < 0) ? (weekday + 7) : weekday;
+}
+
+static int MonthLength(int64_t year, int month)
+{
+	static const int lengths[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	
+	if((month == 2) && ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0))) return 29;
+	return lengths[month - 1];
+}
+
+// CALENDAR
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the day (since January 1st 1970) of the given date, in the Gregorian calendar.
+**/
+int64_t AlarmRecurrenceDay(int year, int month, int dayOfMonth)
+{
+	int64_t y = year - (month <= 2);
+	int64_t era = FloorDivide(y, 400);
+	int64_t yearOfEra = y - (era * 400);
+	int64_t dayOfYear = (((153 * (month + ((month > 2) ? -3 : 9))) + 2) / 5) + dayOfMonth - 1;
+	int64_t dayOfEra = (yearOfEra * 365) + (yearOfEra / 4) - (yearOfEra / 100) + dayOfYear;
+	
+	return (era * 146097) + dayOfEra - 719468;
+}
+
+/**
+ Gets the date of the given day (since January 1st 1970), in the Gregorian calendar.
+**/
+void AlarmRecurrenceDate(int64_t day, int *year, int *month, int *dayOfMonth)
+{
+	int64_t z = day + 719468;
+	int64_t era = FloorDivide(z, 146097);
+	int64_t dayOfEra = z - (era * 146097);
+	int64_t yearOfEra = (dayOfEra - (dayOfEra / 1460) + (dayOfEra / 36524) - (dayOfEra / 146096)) / 365;
+	int64_t dayOfYear = dayOfEra - ((365 * yearOfEra) + (yearOfEra / 4) - (yearOfEra / 100));
+	int64_t monthFromMarch = ((5 * dayOfYear) + 2) / 153;
+	
+	*dayOfMonth = (int)(dayOfYear - (((153 * monthFromMarch) + 2) / 5) + 1);
+	*month = (int)((monthFromMarch < 10) ? (monthFromMarch + 3) : (monthFromMarch - 9));
+	*year = (int)((yearOfEra + (era * 400)) + (*month <= 2));
+}
+
+// FINDING DAYS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the days of the given month it goes off on, as bits 1 to 31.
+**/
+static uint32_t MonthMask(const AlarmRecurrence *recurrence, int length, int firstWeekday)
+{
+	uint32_t valid = ((length == 31) ? 0xFFFFFFFF : ((1u << (length + 1)) - 1)) & ~1u;
+	uint32_t days = recurrence->monthDays;
+	uint32_t lastDays = recurrence->lastMonthDays;
+	
+	while(lastDays != 0)
+	{
+		int n = __builtin_ctz(lastDays);
+		lastDays &= lastDays - 1;
+		
+		if(n <= length) days |= 1u << (length + 1 - n);
+	}
+	days &= valid;
+	
+	uint32_t weekdays = 0;
+	int hasOrdinals = 0;
+	int weekday;
+	
+	for(weekday = 0; weekday < 7; weekday++)
+	{
+		uint32_t ordinals = recurrence->weekdayOrdinals[weekday];
+		if(ordinals == 0) continue;
+		
+		hasOrdinals = 1;
+		
+		// The first and last of this day of the week in the month
+		int first = 1 + ((weekday - firstWeekday + 7) % 7);
+		int last = first + (7 * ((length - first) / 7));
+		
+		while(ordinals != 0)
+		{
+			int n = __builtin_ctz(ordinals);
+			ordinals &= ordinals - 1;
+			
+			int dayOfMonth = (n < 5) ? (first + (7 * n)) : (last - (7 * (n - 5)));
+			if((dayOfMonth >= 1) && (dayOfMonth <= length)) weekdays |= 1u << dayOfMonth;
+		}
+	}
+	
+	// Days of the week limit days of the month, if both are given
+	if(!hasOrdinals) return days;
+	if((recurrence->monthDays | recurrence->lastMonthDays) == 0) return weekdays;
+	
+	return days & weekdays;
+}
+
+static int64_t NextDaily(const AlarmRecurrence *recurrence, int64_t day)
+{
+	int64_t remainder = (day - recurrence->startDay) % recurrence->interval;
+	if(remainder != 0) day += recurrence->interval - remainder;
+	
+	if(recurrence->weekdays == WEEKLY_SCHEDULE_MASK) return day;
+	
+	// The days of the week repeat at least every 7 intervals
+	int i;
+	for(i = 0; i < 7; i++)
+	{
+		if(recurrence->weekdays & (1 << Weekday(day))) return day;
+		day += recurrence->interval;
+	}
+	return ALARM_RECURRENCE_NEVER;
+}
+
+static int64_t NextWeekly(const AlarmRecurrence *recurrence, int64_t day)
+{
+	uint32_t weekdays = recurrence->weekdays & WEEKLY_SCHEDULE_MASK;
+	if(weekdays == 0) return ALARM_RECURRENCE_NEVER;
+	
+	// Rotate the days so bit 0 is the first day of the week
+	int weekStart = recurrence->weekStart;
+	uint32_t rotated = ((weekdays >> weekStart) | (weekdays << (7 - weekStart))) & WEEKLY_SCHEDULE_MASK;
+	
+	int64_t startWeek = recurrence->startDay - ((Weekday(recurrence->startDay) - weekStart + 7) % 7);
+	
+	while(1)
+	{
+		int64_t week = day - ((Weekday(day) - weekStart + 7) % 7);
+		int64_t remainder = ((week - startWeek) / 7) % recurrence->interval;
+		
+		if(remainder != 0)
+		{
+			day = week + (7 * (recurrence->interval - remainder));
+			continue;
+		}
+		
+		uint32_t later = rotated >> (day - week);
+		if(later != 0) return day + __builtin_ctz(later);
+		
+		day = week + (7 * recurrence->interval);
+	}
+}
+
+static int64_t NextMonthly(const AlarmRecurrence *recurrence, int64_t day)
+{
+	int year, month, dayOfMonth;
+	int startYear, startMonth, startDayOfMonth;
+	
+	AlarmRecurrenceDate(day, &year, &month, &dayOfMonth);
+	AlarmRecurrenceDate(recurrence->startDay, &startYear, &startMonth, &startDayOfMonth);
+	
+	int64_t startMonths = ((int64_t)startYear * 12) + (startMonth - 1);
+	int64_t months = (((int64_t)year * 12) + (month - 1)) - startMonths;
+	
+	int i;
+	for(i = 0; i < MAX_MONTHS; i++)
+	{
+		int64_t remainder = months % recurrence->interval;
+		if(remainder != 0)
+		{
+			months += recurrence->interval - remainder;
+			dayOfMonth = 1;
+		}
+		
+		year = (int)FloorDivide(startMonths + months, 12);
+		month = (int)(startMonths + months - ((int64_t)year * 12)) + 1;
+		
+		int64_t first = AlarmRecurrenceDay(year, month, 1);
+		uint32_t days = MonthMask(recurrence, MonthLength(year, month), Weekday(first));
+		days &= ~((1u << dayOfMonth) - 1);
+		
+		if(days != 0) return first + __builtin_ctz(days) - 1;
+		
+		months += recurrence->interval;
+		dayOfMonth = 1;
+	}
+	return ALARM_RECURRENCE_NEVER;
+}
+
+/**
+ Returns the first day on or after the given one that the rule goes off, ignoring the last day and exceptions.
+**/
+static int64_t NextRuleDay(const AlarmRecurrence *recurrence, int64_t day)
+{
+	if(day < recurrence->startDay) day = recurrence->startDay;
+	
+	switch(recurrence->frequency)
+	{
+		case ALARM_RECURRENCE_DAILY:  return NextDaily(recurrence, day);
+		case ALARM_RECURRENCE_WEEKLY: return NextWeekly(recurrence, day);
+		default:                      return NextMonthly(recurrence, day);
+	}
+}
+
+static int IsException(const AlarmRecurrence *recurrence, int64_t day)
+{
+	uint32_t low = 0;
+	uint32_t high = recurrence->exceptionsCount;
+	
+	while(low < high)
+	{
+		uint32_t middle = low + ((high - low) / 2);
+		
+		if(recurrence->exceptions[middle] < day)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return (low < recurrence->exceptionsCount) && (recurrence->exceptions[low] == day);
+}
+
+// PARSING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int ParseNumber(const char *value, uint32_t min, uint32_t max, uint32_t *number)
+{
+	char *end;
+	if((*value < '0') || (*value > '9')) return 0;
+	
+	unsigned long result = strtoul(value, &end, 10);
+	if((*end != '\0') || (result < min) || (result > max)) return 0;
+	
+	*number = (uint32_t)result;
+	return 1;
+}
+
+static int ParseWeekday(const char *value)
+{
+	int weekday;
+	for(weekday = 0; weekday < 7; weekday++)
+	{
+		if(strcasecmp(value, weekdayNames[weekday]) == 0) return weekday;
+	}
+	return -1;
+}
+
+/**
+ Parses a day as YYYYMMDD, which may be followed by a time (starting with T) that's ignored.
+**/
+static int ParseDate(const char *value, int64_t *day)
+{
+	int digits[8];
+	int i;
+	
+	for(i = 0; i < 8; i++)
+	{
+		if((value[i] < '0') || (value[i] > '9')) return 0;
+		digits[i] = value[i] - '0';
+	}
+	if((value[8] != '\0') && (value[8] != 'T') && (value[8] != 't')) return 0;
+	
+	int year = (digits[0] * 1000) + (digits[1] * 100) + (digits[2] * 10) + digits[3];
+	int month = (digits[4] * 10) + digits[5];
+	int dayOfMonth = (digits[6] * 10) + digits[7];
+	
+	if((month < 1) || (month > 12) || (dayOfMonth < 1) || (dayOfMonth > MonthLength(year, month))) return 0;
+	
+	*day = AlarmRecurrenceDay(year, month, dayOfMonth);
+	return 1;
+}
+
+/**
+ Parses BYDAY: days of the week, which may be numbered (as in 2MO or -1FR).
+**/
+static int ParseWeekdays(AlarmRecurrence *recurrence, char *value)
+{
+	char *state;
+	char *item;
+	
+	for(item = strtok_r(value, ",", &state); item != NULL; item = strtok_r(NULL, ",", &state))
+	{
+		int isFromEnd = (*item == '-');
+		if((*item == '-') || (*item == '+')) item++;
+		
+		uint32_t n = 0;
+		while((*item >= '0') && (*item <= '9'))
+		{
+			n = (n * 10) + (*item++ - '0');
+			if(n > 5) return 0;
+		}
+		
+		int weekday = ParseWeekday(item);
+		if(weekday < 0) return 0;
+		
+		if(n == 0)
+		{
+			if(isFromEnd) return 0;
+			recurrence->weekdays |= 1 << weekday;
+		}
+		else
+		{
+			recurrence->weekdayOrdinals[weekday] |= 1 << ((isFromEnd ? 5 : 0) + (n - 1));
+		}
+	}
+	return 1;
+}
+
+/**
+ Parses BYMONTHDAY: days of the month, from the start (1 to 31) or end (-1 to -31).
+**/
+static int ParseMonthDays(AlarmRecurrence *recurrence, char *value)
+{
+	char *state;
+	char *item;
+	
+	for(item = strtok_r(value, ",", &state); item != NULL; item = strtok_r(NULL, ",", &state))
+	{
+		int isFromEnd = (*item == '-');
+		if((*item == '-') || (*item == '+')) item++;
+		
+		uint32_t n;
+		if(!ParseNumber(item, 1, 31, &n)) return 0;
+		
+		if(isFromEnd)
+			recurrence->lastMonthDays |= 1u << n;
+		else
+			recurrence->monthDays |= 1u << n;
+	}
+	return 1;
+}
+
+static int CompareDays(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/**
+ Parses EXDATE: days as YYYYMMDD, which are kept in order (without repeats).
+**/
+static int ParseExceptions(AlarmRecurrence *recurrence, char *value)
+{
+	uint32_t capacity = recurrence->exceptionsCount + 1;
+	const char *c;
+	
+	for(c = value; *c != '\0'; c++)
+	{
+		if(*c == ',') capacity++;
+	}
+	
+	int64_t *exceptions = realloc(recurrence->exceptions, capacity * sizeof(int64_t));
+	if(exceptions == NULL) return 0;
+	recurrence->exceptions = exceptions;
+	
+	char *state;
+	char *item;
+	
+	for(item = strtok_r(value, ",", &state); item != NULL; item = strtok_r(NULL, ",", &state))
+	{
+		if(!ParseDate(item, &exceptions[recurrence->exceptionsCount])) return 0;
+		recurrence->exceptionsCount++;
+	}
+	
+	qsort(exceptions, recurrence->exceptionsCount, sizeof(int64_t), CompareDays);
+	
+	uint32_t i, count = 0;
+	for(i = 0; i < recurrence->exceptionsCount; i++)
+	{
+		if((count == 0) || (exceptions[count - 1] != exceptions[i])) exceptions[count++] = exceptions[i];
+	}
+	recurrence->exceptionsCount = count;
+	
+	return 1;
+}
+
+static int ParsePart(AlarmRecurrence *recurrence, char *name, char *value, uint32_t *count)
+{
+	if(strcasecmp(name, "FREQ") == 0)
+	{
+		if(strcasecmp(value, "DAILY") == 0)        recurrence->frequency = ALARM_RECURRENCE_DAILY;
+		else if(strcasecmp(value, "WEEKLY") == 0)  recurrence->frequency = ALARM_RECURRENCE_WEEKLY;
+		else if(strcasecmp(value, "MONTHLY") == 0) recurrence->frequency = ALARM_RECURRENCE_MONTHLY;
+		else return 0;
+		
+		return 1;
+	}
+	if(strcasecmp(name, "INTERVAL") == 0)   return ParseNumber(value, 1, 10000, &recurrence->interval);
+	if(strcasecmp(name, "BYDAY") == 0)      return ParseWeekdays(recurrence, value);
+	if(strcasecmp(name, "BYMONTHDAY") == 0) return ParseMonthDays(recurrence, value);
+	if(strcasecmp(name, "COUNT") == 0)      return ParseNumber(value, 1, 100000, count);
+	if(strcasecmp(name, "UNTIL") == 0)      return ParseDate(value, &recurrence->lastDay);
+	if(strcasecmp(name, "DTSTART") == 0)    return ParseDate(value, &recurrence->startDay);
+	if(strcasecmp(name, "EXDATE") == 0)     return ParseExceptions(recurrence, value);
+	
+	if(strcasecmp(name, "WKST") == 0)
+	{
+		recurrence->weekStart = ParseWeekday(value);
+		return (recurrence->weekStart >= 0);
+	}
+	
+	return 0;
+}
+
+/**
+ Checks the parts of the rule make sense together, and fills in what wasn't given from the first day.
+**/
+static int CompleteRule(AlarmRecurrence *recurrence)
+{
+	int hasOrdinals = 0;
+	int weekday;
+	
+	for(weekday = 0; weekday < 7; weekday++)
+	{
+		if(recurrence->weekdayOrdinals[weekday] != 0) hasOrdinals = 1;
+	}
+	int hasMonthDays = ((recurrence->monthDays | recurrence->lastMonthDays) != 0);
+	
+	switch(recurrence->frequency)
+	{
+		case ALARM_RECURRENCE_DAILY:
+			if(hasOrdinals || hasMonthDays) return 0;
+			if(recurrence->weekdays == 0) recurrence->weekdays = WEEKLY_SCHEDULE_MASK;
+			return 1;
+		
+		case ALARM_RECURRENCE_WEEKLY:
+			if(hasOrdinals || hasMonthDays) return 0;
+			if(recurrence->weekdays == 0) recurrence->weekdays = 1 << Weekday(recurrence->startDay);
+			return 1;
+		
+		case ALARM_RECURRENCE_MONTHLY:
+			// Days of the week without a number are every one of them in the month
+			for(weekday = 0; weekday < 7; weekday++)
+			{
+				if(recurrence->weekdays & (1 << weekday))
+				{
+					recurrence->weekdayOrdinals[weekday] |= 0x1F;
+					hasOrdinals = 1;
+				}
+			}
+			recurrence->weekdays = 0;
+			
+			if(!hasOrdinals && !hasMonthDays)
+			{
+				int year, month, dayOfMonth;
+				AlarmRecurrenceDate(recurrence->startDay, &year, &month, &dayOfMonth);
+				
+				recurrence->monthDays = 1u << dayOfMonth;
+			}
+			return 1;
+	}
+	return 0;
+}
+
+// RECURRENCE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Compiles the given rule (see AlarmRecurrence.h), starting on the given day unless the rule has a DTSTART.
+ Returns NULL if the rule isn't understood, or the memory can't be allocated.
+**/
+AlarmRecurrence * AlarmRecurrenceCreate(const char *rule, int64_t startDay)
+{
+	if(rule == NULL) return NULL;
+	
+	AlarmRecurrence *recurrence = calloc(1, sizeof(AlarmRecurrence));
+	char *copy = strdup(rule);
+	
+	if((recurrence == NULL) || (copy == NULL))
+	{
+		free(copy);
+		free(recurrence);
+		return NULL;
+	}
+	
+	recurrence->frequency = -1;
+	recurrence->interval = 1;
+	recurrence->startDay = startDay;
+	recurrence->lastDay = ALARM_RECURRENCE_NEVER;
+	recurrence->weekStart = 1;
+	
+	uint32_t count = 0;
+	int isValid = 1;
+	
+	char *state;
+	char *part;
+	
+	for(part = strtok_r(copy, ";", &state); (part != NULL) && isValid; part = strtok_r(NULL, ";", &state))
+	{
+		char *value = strchr(part, '=');
+		if(value == NULL)
+		{
+			isValid = 0;
+			break;
+		}
+		*value++ = '\0';
+		
+		isValid = ParsePart(recurrence, part, value, &count);
+	}
+	free(copy);
+	
+	if(!isValid || !CompleteRule(recurrence))
+	{
+		AlarmRecurrenceFree(recurrence);
+		return NULL;
+	}
+	
+	// Compile the count into the last day (exceptions still count, as in iCalendar)
+	if(count > 0)
+	{
+		int64_t day = recurrence->startDay;
+		int64_t last = recurrence->startDay - 1;
+		uint32_t i;
+		
+		for(i = 0; i < count; i++)
+		{
+			day = NextRuleDay(recurrence, day);
+			if((day == ALARM_RECURRENCE_NEVER) || (day > recurrence->lastDay)) break;
+			
+			last = day++;
+		}
+		recurrence->lastDay = last;
+	}
+	
+	return recurrence;
+}
+
+/**
+ Creates the recurrence of a weekly schedule (see WeeklySchedule.h), which has no first or last day.
+ Returns NULL if no day is scheduled, or the memory can't be allocated.
+**/
+AlarmRecurrence * AlarmRecurrenceCreateWeekly(uint32_t schedule)
+{
+	if((schedule & WEEKLY_SCHEDULE_MASK) == 0) return NULL;
+	
+	AlarmRecurrence *recurrence = calloc(1, sizeof(AlarmRecurrence));
+	if(recurrence == NULL) return NULL;
+	
+	recurrence->frequency = ALARM_RECURRENCE_WEEKLY;
+	recurrence->interval = 1;
+	recurrence->startDay = INT32_MIN;
+	recurrence->lastDay = ALARM_RECURRENCE_NEVER;
+	recurrence->weekdays = schedule & WEEKLY_SCHEDULE_MASK;
+	
+	return recurrence;
+}
+
+void AlarmRecurrenceFree(AlarmRecurrence *recurrence)
+{
+	if(recurrence == NULL) return;
+	
+	free(recurrence->exceptions);
+	free(recurrence);
+}
+
+/**
+ Returns the first day on or after the given one that it goes off,
+ or ALARM_RECURRENCE_NEVER if it doesn't go off again.
+**/
+int64_t AlarmRecurrenceNextDay(const AlarmRecurrence *recurrence, int64_t day)
+{
+	while(day <= recurrence->lastDay)
+	{
+		int64_t next = NextRuleDay(recurrence, day);
+		if((next == ALARM_RECURRENCE_NEVER) || (next > recurrence->lastDay)) break;
+		
+		if(!IsException(recurrence, next)) return next;
+		day = next + 1;
+	}
+	return ALARM_RECURRENCE_NEVER;
+}
+
+/**
+ Returns the first time after now that an alarm with the given recurrence goes off,
+ if it last went off (or was set to go off) at the given time, when the zone was at the given offset,
+ or ALARM_RECURRENCE_NEVER if it doesn't go off again.
+ It goes off at the same local time of day, on the first day after it's day that the recurrence goes off.
+ If that local time is repeated on the day, and the first of the two has passed, it goes off at the second.
+ If the given time is already after now, it's returned as it is.
+**/
+int64_t AlarmRecurrenceNext(const AlarmRecurrence *recurrence, int64_t time, int32_t offset, int64_t now,
+                            WeeklyScheduleOffsetFunction offsetAt, void *context)
+{
+	if(time > now) return time;
+	
+	int64_t localTime = time + offset;
+	int64_t day = FloorDivide(localTime, DAY_SECONDS);
+	int64_t timeOfDay = localTime - (day * DAY_SECONDS);
+	
+	int32_t nowOffset = offsetAt(context, now);
+	int64_t nowDay = FloorDivide(now + nowOffset, DAY_SECONDS);
+	
+	// The first day it can go off is the day after it last did, but not before today
+	int64_t firstDay = (nowDay > day) ? nowDay : (day + 1);
+	
+	while(1)
+	{
+		int64_t nextDay = AlarmRecurrenceNextDay(recurrence, firstDay);
+		if(nextDay == ALARM_RECURRENCE_NEVER) return ALARM_RECURRENCE_NEVER;
+		
+		int64_t next = WeeklyScheduleLocalToUTCAfter((nextDay * DAY_SECONDS) + timeOfDay, now, nowOffset,
+		                                             offsetAt, context);
+		if(next > now) return next;
+		
+		firstDay = nextDay + 1;
+	}
+}
+
+// ITERATING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Sets up the iterator to go through the times an alarm goes off from start (inclusive) to end (exclusive),
+ one at a time, without working them all out first.
+
+ The alarm goes off at the given time (when the zone was at the given offset), and then on the days after it's day
+ that the recurrence goes off, at the same local time. The recurrence may be NULL for an alarm that doesn't repeat.
+**/
+void AlarmRecurrenceIteratorInit(AlarmRecurrenceIterator *iterator, const AlarmRecurrence *recurrence,
+                                 int64_t time, int32_t offset, int64_t start, int64_t end,
+                                 WeeklyScheduleOffsetFunction offsetAt, void *context)
+{
+	int64_t localTime = time + offset;
+	int64_t day = FloorDivide(localTime, DAY_SECONDS);
+	
+	iterator->recurrence = recurrence;
+	iterator->first = time;
+	iterator->timeOfDay = localTime - (day * DAY_SECONDS);
+	iterator->offset = offset;
+	iterator->start = start;
+	iterator->end = end;
+	iterator->offsetAt = offsetAt;
+	iterator->context = context;
+	
+	// Skip straight to the day the window starts on
+	int64_t startDay = FloorDivide(start + offsetAt(context, start), DAY_SECONDS);
+	
+	iterator->day = (startDay > day) ? startDay : (day + 1);
+}
+
+/**
+ Gets the next time the alarm goes off.
+ Returns 0 if it doesn't go off again before the end.
+**/
+int AlarmRecurrenceIteratorNext(AlarmRecurrenceIterator *iterator, int64_t *time)
+{
+	if(iterator->first != ALARM_RECURRENCE_NEVER)
+	{
+		int64_t first = iterator->first;
+		iterator->first = ALARM_RECURRENCE_NEVER;
+		
+		if((first >= iterator->start) && (first < iterator->end))
+		{
+			*time = first;
+			return 1;
+		}
+	}
+	
+	if(iterator->recurrence == NULL) return 0;
+	
+	while(iterator->day != ALARM_RECURRENCE_NEVER)
+	{
+		int64_t day = AlarmRecurrenceNextDay(iterator->recurrence, iterator->day);
+		if(day == ALARM_RECURRENCE_NEVER) break;
+		
+		int64_t localTime = (day * DAY_SECONDS) + iterator->timeOfDay;
+		int64_t next = WeeklyScheduleLocalToUTC(localTime, iterator->offset, iterator->offsetAt, iterator->context);
+		
+		// The offset it was converted with is the best guess for the next day
+		iterator->offset = (int32_t)(localTime - next);
+		iterator->day = day + 1;
+		
+		if(next >= iterator->end) break;
+		if(next < iterator->start) continue;
+		
+		*time = next;
+		return 1;
+	}
+	
+	iterator->day = ALARM_RECURRENCE_NEVER;
+	return 0;
+}
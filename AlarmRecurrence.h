@@ -0,0 +1,99 @@
+/**
+ Recurrence rules for alarms, a subset of the iCalendar RRULE (RFC 5545), compiled to a compact form.
+
+ A rule is a list of parts separated by semicolons, such as "FREQ=MONTHLY;BYDAY=-1FR;UNTIL=20121231".
+ The parts understood are:
+ - FREQ:       DAILY, WEEKLY or MONTHLY (required)
+ - INTERVAL:   every so many days, weeks or months (default 1)
+ - BYDAY:      days of the week (SU, MO, TU, WE, TH, FR, SA). With MONTHLY, they may be numbered
+               from the start or end of the month: 2MO is the second Monday, -1FR is the last Friday.
+               With DAILY, only the given days of the week are kept.
+ - BYMONTHDAY: days of the month (MONTHLY only), from 1 to 31, or from -1 (the last day) to -31
+ - WKST:       the first day of the week, for weekly intervals (default MO)
+ - COUNT:      the number of times it goes off
+ - UNTIL:      the last day it may go off, as YYYYMMDD (any time after it is ignored)
+ - DTSTART:    the first day it may go off, as YYYYMMDD (it's the day of the week or month by default)
+ - EXDATE:     days it doesn't go off, as a comma separated list of YYYYMMDD (not part of RRULE in iCalendar)
+
+ The rule only says which days it goes off: on each of them, it goes off at the same local (wall clock) time,
+ as a weekly schedule does (see WeeklySchedule.h).
+
+ Days are numbered from January 1st 1970 (day 0), in local time.
+ The compiled form answers the first day on or after any day directly, with bit masks for the days of the
+ week and month, and a little arithmetic for intervals. COUNT is compiled into the last day, and exceptions
+ are kept sorted, so finding the next time an alarm goes off doesn't depend on how long it's been repeating,
+ and is logarithmic in the number of exceptions.
+**/
+
+#ifndef ALARM_RECURRENCE_H
+#define ALARM_RECURRENCE_H
+
+#include <stdint.h>
+#include "WeeklySchedule.h"
+
+#define ALARM_RECURRENCE_DAILY    0
+#define ALARM_RECURRENCE_WEEKLY   1
+#define ALARM_RECURRENCE_MONTHLY  2
+
+// Returned when there are no more occurrences
+#define ALARM_RECURRENCE_NEVER  INT64_MAX
+
+typedef struct AlarmRecurrence
+{
+	int frequency;
+	uint32_t interval;
+	
+	// First and last days it may go off
+	int64_t startDay;
+	int64_t lastDay;
+	
+	// Days of the week, as in a weekly schedule, and the first day of the week (for weekly intervals)
+	uint32_t weekdays;
+	int weekStart;
+	
+	// Days of the month: bit n of monthDays is the nth day, bit n of lastMonthDays is the nth day from the end
+	uint32_t monthDays;
+	uint32_t lastMonthDays;
+	
+	// For each day of the week, the numbered ones in the month:
+	// bits 0 to 4 are the first to fifth, bits 5 to 9 are the last to fifth from last
+	uint16_t weekdayOrdinals[7];
+	
+	// Days it doesn't go off, in order
+	int64_t *exceptions;
+	uint32_t exceptionsCount;
+} AlarmRecurrence;
+
+typedef struct AlarmRecurrenceIterator
+{
+	const AlarmRecurrence *recurrence;
+	
+	int64_t first;
+	int64_t day;
+	int64_t timeOfDay;
+	int32_t offset;
+	
+	int64_t start;
+	int64_t end;
+	
+	WeeklyScheduleOffsetFunction offsetAt;
+	void *context;
+} AlarmRecurrenceIterator;
+
+AlarmRecurrence * AlarmRecurrenceCreate(const char *rule, int64_t startDay);
+AlarmRecurrence * AlarmRecurrenceCreateWeekly(uint32_t schedule);
+void AlarmRecurrenceFree(AlarmRecurrence *recurrence);
+
+int64_t AlarmRecurrenceNextDay(const AlarmRecurrence *recurrence, int64_t day);
+int64_t AlarmRecurrenceNext(const AlarmRecurrence *recurrence, int64_t time, int32_t offset, int64_t now,
+                            WeeklyScheduleOffsetFunction offsetAt, void *context);
+
+void AlarmRecurrenceIteratorInit(AlarmRecurrenceIterator *iterator, const AlarmRecurrence *recurrence,
+                                 int64_t time, int32_t offset, int64_t start, int64_t end,
+                                 WeeklyScheduleOffsetFunction offsetAt, void *context);
+int AlarmRecurrenceIteratorNext(AlarmRecurrenceIterator *iterator, int64_t *time);
+
+int64_t AlarmRecurrenceDay(int year, int month, int dayOfMonth);
+void AlarmRecurrenceDate(int64_t day, int *year, int *month, int *dayOfMonth);
+
+#endif
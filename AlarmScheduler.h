@@ -26,9 +26,14 @@
 
 // Getting info about next and last alarm
 + (Alarm *)lastAlarmClone;
++ (Alarm *)nextAlarmClone;
 + (NSCalendarDate *)nextAlarmDate;
 
+// Getting the times alarms go off over a period
++ (NSArray *)alarmDatesFrom:(NSCalendarDate *)start to:(NSCalendarDate *)end limit:(int)limit;
+
 // Querying for sounding alarms
 + (int)alarmStatus:(NSCalendarDate *)now;
++ (NSCalendarDate *)nextStatusDate;
 
 @end
\ No newline at end of file
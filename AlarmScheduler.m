@@ -1,11 +1,19 @@
 #import "AlarmScheduler.h"
 #import "Alarm.h"
 #import "CalendarAdditions.h"
+#import "AlarmHeap.h"
+#import "WindowManager.h"
+#import <math.h>
 
 
 // Declare private methods
 @interface AlarmScheduler (PrivateAPI)
-+ (void)sortAndAddAlarm:(Alarm *)newAlarm;
++ (void)scheduleAlarm:(Alarm *)newAlarm;
++ (void)unscheduleAlarm:(Alarm *)oldAlarm;
++ (void)rescheduleSlot:(int32_t)slot;
++ (int32_t)slotForAlarm:(Alarm *)alarm;
++ (Alarm *)alarmAtIndex:(int)index;
++ (void)publishNextAlarm;
 @end
 
 
@@ -14,12 +22,37 @@
 // GLOBAL VARIABLES
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Alarm Array
-static NSMutableArray *alarms;
+// Alarms, each in a slot, whose index is the alarm's handle in the heaps below
+// The slots of removed alarms are reused, and each alarm's slot is found through the map table
+static Alarm **slots;
+static int32_t slotsCount;
+static int32_t slotsCapacity;
+static int32_t *freeSlots;
+static int32_t freeSlotsCount;
+static NSMapTable *slotsByAlarm;
+
+// All alarms ordered by time (for alarmStatus), and just the enabled ones (for nextAlarmClone and nextAlarmDate)
+static AlarmHeap *alarms;
+static AlarmHeap *enabledAlarms;
+
+// Slots of all the alarms in order of time, for the index based accessors (rebuilt after alarms are changed)
+static int32_t *sortedSlots;
+static BOOL isSortedValid;
 
 // Storage of last alarm to sound
 static Alarm *lastAlarm;
 
+// C STYLE METHODS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the key of the alarm in the heaps: it's time, in whole seconds since 1970.
+**/
+static int64_t KeyForAlarm(Alarm *alarm)
+{
+	return (int64_t)floor([[alarm time] timeIntervalSince1970]);
+}
+
 // INITIALIZATION, DEINITIALIZATION
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -48,7 +81,9 @@ static Alarm *lastAlarm;
 		// Initialize alarms
 		NSArray *alarmsPrefs = [[NSUserDefaults standardUserDefaults] arrayForKey:@"Alarms"];
 		
-		alarms = [[NSMutableArray alloc] initWithCapacity:[alarmsPrefs count]];
+		alarms = AlarmHeapCreate([alarmsPrefs count]);
+		enabledAlarms = AlarmHeapCreate([alarmsPrefs count]);
+		slotsByAlarm = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSIntMapValueCallBacks, [alarmsPrefs count]);
 		
 		int i;
 		for(i=0; i<[alarmsPrefs count]; i++)
@@ -56,20 +91,23 @@ static Alarm *lastAlarm;
 			// Create alarm from dictionary
 			Alarm *temp = [[Alarm alloc] initWithDict:[alarmsPrefs objectAtIndex:i]];
 			
-			// Update the alarm's time, and add into array if not expired
+			// Update the alarm's time, and schedule it if not expired
 			if([temp updateTime])
 			{
-				[self sortAndAddAlarm:temp];
+				[self scheduleAlarm:temp];
 			}
 			
 			// Release the alarm
-			// If it was added to the array, it will still be retained
+			// If it was scheduled, it will still be retained
 			[temp release];
 		}
 		
 		// Save changes to defaults
 		[self savePrefs];
 		
+		// Publish the time of the next alarm, for planning when to wake from sleep
+		[self publishNextAlarm];
+		
 		// Add listener for time zone change notifications
 		[[NSDistributedNotificationCenter defaultCenter] addObserver:self 
 															selector:@selector(timeZoneDidChange:) 
@@ -101,10 +139,11 @@ static Alarm *lastAlarm;
 {
 	NSMutableArray *alarmsPrefs = [NSMutableArray array];
 	
+	// The alarms are saved in order of time, as they're listed
 	int i;
-	for(i=0; i<[alarms count]; i++)
+	for(i = 0; i < [self numberOfAlarms]; i++)
 	{
-		[alarmsPrefs addObject:[[alarms objectAtIndex:i] prefsDictionary]];
+		[alarmsPrefs addObject:[[self alarmAtIndex:i] prefsDictionary]];
 	}
 	
 	[[NSUserDefaults standardUserDefaults] setObject:alarmsPrefs forKey:@"Alarms"];
@@ -126,7 +165,7 @@ static Alarm *lastAlarm;
 **/
 + (Alarm *)alarmReferenceForIndex:(int)index
 {
-	return [alarms objectAtIndex:index];
+	return [self alarmAtIndex:index];
 }
 
 /**
@@ -139,7 +178,7 @@ static Alarm *lastAlarm;
 **/
 + (Alarm *)alarmCloneForIndex:(int)index
 {
-	return [[[alarms objectAtIndex:index] copy] autorelease];
+	return [[[self alarmAtIndex:index] copy] autorelease];
 }
 
 // CHANGING ALARMS
@@ -147,40 +186,46 @@ static Alarm *lastAlarm;
 
 /**
  Sets the alarm.
- Since alarms may be changed, added, deleted or rescheduled, their position in an array is not constant.
+ Since alarms may be changed, added, deleted or rescheduled, their index is not constant.
  For this reason a reference is used instead of an index.
- The passed alarm is inserted directly into an array.
+ The passed alarm is scheduled directly.
  It is not copied, and therefore should not be altered after calling this method.
- The reference in the array is replaced by the passed alarm (and thus released).
+ The reference is replaced by the passed alarm (and thus released).
 **/
 + (void)setAlarm:(Alarm *)clone forReference:(Alarm *)reference
 {
 	// Remove the old alarm
-	[alarms removeObject:reference];
+	[self unscheduleAlarm:reference];
 	
 	// Add the new alarm
-	[self sortAndAddAlarm:clone];
+	[self scheduleAlarm:clone];
 	
 	// Save changes to defaults
 	[self savePrefs];
 	
+	// Publish the time of the next alarm, for planning when to wake from sleep
+	[self publishNextAlarm];
+	
 	// Post notification for changed alarm
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
 }
 
 /**
  Adds the alarm to the list of alarms.
- The passed alarm is inserted directly into an array.
+ The passed alarm is scheduled directly.
  It is not copied, and therefore should not be altered after calling this method.
 **/
 + (void)addAlarm:(Alarm *)newAlarm
 {
 	// Add the new alarm
-	[self sortAndAddAlarm:newAlarm];
+	[self scheduleAlarm:newAlarm];
 	
 	// Save changes to defaults
 	[self savePrefs];
 	
+	// Publish the time of the next alarm, for planning when to wake from sleep
+	[self publishNextAlarm];
+	
 	// Post notification for changed alarm
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
 }
@@ -192,12 +237,15 @@ static Alarm *lastAlarm;
 **/
 + (void)removeAlarm:(Alarm *)deletedAlarm
 {
-	// Remove alarm from array
-	[alarms removeObject:deletedAlarm];
+	// Remove alarm from the schedule
+	[self unscheduleAlarm:deletedAlarm];
 	
 	// Save changes to defaults
 	[self savePrefs];
 	
+	// Publish the time of the next alarm, for planning when to wake from sleep
+	[self publishNextAlarm];
+	
 	// Post notification for changed alarm
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
 }
@@ -212,28 +260,30 @@ static Alarm *lastAlarm;
 **/
 + (void)updateAllAlarms
 {
-	int i;
-	for(i=0; i<[alarms count]; i++)
+	// Alarms stay in their slots as they're rescheduled, so each is updated exactly once
+	int32_t slot;
+	for(slot = 0; slot < slotsCount; slot++)
 	{
-		// Remove the alarm from the array
-		// We retain it first so it doesn't get released when removed
-		Alarm *temp = [[alarms objectAtIndex:i] retain];
-		[alarms removeObjectAtIndex:i];
+		Alarm *temp = slots[slot];
+		if(temp == nil) continue;
 		
-		// Now update the alarm, and add it back into the array if not expired
+		// Update the alarm, and move it to it's new time, or remove it if expired
 		if([temp updateTime])
 		{
-			[self sortAndAddAlarm:temp];
+			[self rescheduleSlot:slot];
+		}
+		else
+		{
+			[self unscheduleAlarm:temp];
 		}
-		
-		// Release the alarm
-		// If it was added to the array, it will still be retained
-		[temp release];
 	}
 	
 	// Save changes to defaults
 	[self savePrefs];
 	
+	// Publish the time of the next alarm, for planning when to wake from sleep
+	[self publishNextAlarm];
+	
 	// Post notification for changed alarm
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
 }
@@ -251,16 +301,23 @@ static Alarm *lastAlarm;
 	
 	NSLog(@"Using Time Zone: %@", [[NSTimeZone systemTimeZone] name]);
 	
-	// Loop through all the alarms, and update them to the new time zone
-	int i;
-	for(i = 0; i < [alarms count]; i++)
+	// Loop through all the alarms, and update them to the new time zone (which moves them in time)
+	int32_t slot;
+	for(slot = 0; slot < slotsCount; slot++)
 	{
-		[[alarms objectAtIndex:i] updateTimeZone];
+		if(slots[slot] != nil)
+		{
+			[slots[slot] updateTimeZone];
+			[self rescheduleSlot:slot];
+		}
 	}
 	
 	// Since the time has changed for all the alarms, we should go ahead and update the user defaults system
 	[self savePrefs];
 	
+	// Publish the time of the next alarm, for planning when to wake from sleep
+	[self publishNextAlarm];
+	
 	// We might as well go ahead and update the menu too, just in case anything went wrong
 	// Post notification for changed alarm
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
@@ -272,7 +329,7 @@ static Alarm *lastAlarm;
 /* Returns the number of alarms that have been scheduled */
 + (int)numberOfAlarms
 {
-	return [alarms count];
+	return AlarmHeapCount(alarms);
 }
 
 // GETTING INFO ABOUT NEXT AND LAST ALARM
@@ -286,6 +343,23 @@ static Alarm *lastAlarm;
 	return [[lastAlarm copy] autorelease];
 }
 
+/**
+ Returns the alarm that is scheduled to go off next.
+ The returned alarm is a clone (autoreleased copy).
+ If no alarm is scheduled, nil is returned
+**/
++ (Alarm *)nextAlarmClone
+{
+	int32_t slot = AlarmHeapPeek(enabledAlarms);
+	
+	if(slot >= 0)
+	{
+		return [[slots[slot] copy] autorelease];
+	}
+	
+	return nil;
+}
+
 /**
  Returns the date of the alarm that is scheduled to go off next.
  The returned date is a clone (autoreleased copy).
@@ -293,16 +367,73 @@ static Alarm *lastAlarm;
 **/
 + (NSCalendarDate *)nextAlarmDate
 {
-	int i;
-	for(i = 0; i < [alarms count]; i++)
+	int32_t slot = AlarmHeapPeek(enabledAlarms);
+	
+	if(slot >= 0)
 	{
-		if([[alarms objectAtIndex:i] isEnabled])
+		return [[[slots[slot] time] copy] autorelease];
+	}
+	
+	return nil;
+}
+
+/**
+ Returns the dates (autoreleased) that enabled alarms go off on, from start up to (but not including) end,
+ in order, and at most the given number of them.
+
+ Each alarm's times are gone through one at a time (see AlarmRecurrence.h), and merged by keeping
+ each alarm's next time in a heap, so only as many times are worked out as are returned,
+ however far apart start and end are.
+**/
++ (NSArray *)alarmDatesFrom:(NSCalendarDate *)start to:(NSCalendarDate *)end limit:(int)limit
+{
+	NSMutableArray *dates = [NSMutableArray array];
+	if((slotsCount == 0) || (limit <= 0)) return dates;
+	
+	AlarmRecurrenceIterator *iterators = malloc(slotsCount * sizeof(AlarmRecurrenceIterator));
+	AlarmHeap *upcoming = AlarmHeapCreate(slotsCount);
+	
+	if((iterators == NULL) || (upcoming == NULL))
+	{
+		NSLog(@"Unable to allocate room for the times of %i alarms", slotsCount);
+		
+		free(iterators);
+		AlarmHeapFree(upcoming);
+		return dates;
+	}
+	
+	int32_t slot;
+	int64_t time;
+	
+	for(slot = 0; slot < slotsCount; slot++)
+	{
+		if((slots[slot] == nil) || ![slots[slot] isEnabled]) continue;
+		
+		[slots[slot] startOccurrences:&iterators[slot] from:start to:end];
+		
+		if(AlarmRecurrenceIteratorNext(&iterators[slot], &time))
 		{
-			return [[[[alarms objectAtIndex:i] time] copy] autorelease];
+			AlarmHeapInsert(upcoming, slot, time);
 		}
 	}
 	
-	return nil;
+	while(([dates count] < limit) && ((slot = AlarmHeapPeek(upcoming)) >= 0))
+	{
+		NSCalendarDate *date = [NSCalendarDate dateWithTimeIntervalSince1970:AlarmHeapKey(upcoming, slot)];
+		[date setTimeZone:[[slots[slot] time] timeZone]];
+		
+		[dates addObject:date];
+		
+		if(AlarmRecurrenceIteratorNext(&iterators[slot], &time))
+			AlarmHeapUpdate(upcoming, slot, time);
+		else
+			AlarmHeapRemove(upcoming, slot);
+	}
+	
+	AlarmHeapFree(upcoming);
+	free(iterators);
+	
+	return dates;
 }
 
 // QUERYING FOR SOUNDING ALARMS
@@ -320,9 +451,11 @@ static Alarm *lastAlarm;
 **/
 + (int)alarmStatus:(NSCalendarDate *)now
 {
-	if([alarms count] > 0)
+	int32_t slot = AlarmHeapPeek(alarms);
+	
+	if(slot >= 0)
 	{
-		Alarm *next = [alarms objectAtIndex:0];
+		Alarm *next = slots[slot];
 		
 		//NSString *format = @"%Y-%m-%d %H:%M:%S %z";
 		//NSLog(@"Currt time: %@", [now descriptionWithCalendarFormat:format]);
@@ -334,20 +467,18 @@ static Alarm *lastAlarm;
 			[lastAlarm autorelease];
 			lastAlarm = [next copy];
 			
-			// Remove the alarm from the array
-			// First retain it so it doesn't get released when removed
-			[next retain];
-			[alarms removeObject:next];
-			
-			// Update the alarm and resort in array if not expired
+			// Update the alarm and move it to it's next time, or remove it if expired
 			if([next updateTime])
 			{
-				[self sortAndAddAlarm:next];
+				[self rescheduleSlot:slot];
+			}
+			else
+			{
+				[self unscheduleAlarm:next];
 			}
 			
-			// Release the alarm
-			// If it was added to the array, it will still be retained
-			[next release];
+			// Publish the time of the next alarm, for planning when to wake from sleep
+			[self publishNextAlarm];
 			
 			// Post notification for changed alarm
 			[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
@@ -367,31 +498,147 @@ static Alarm *lastAlarm;
 	return -1;
 }
 
+/**
+ Returns the time at which alarmStatus: next has an alarm to report, enabled or not.
+ Nothing needs checking before then.
+ If no alarm is scheduled, nil is returned
+**/
++ (NSCalendarDate *)nextStatusDate
+{
+	int32_t slot = AlarmHeapPeek(alarms);
+	
+	if(slot >= 0)
+	{
+		return [[[slots[slot] time] copy] autorelease];
+	}
+	
+	return nil;
+}
+
 // PRIVATE API
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**
- Adds the given alarm to the list of alarms and sorts it into the correct position.
- Remember, we keep the alarms array sorted by alarm time.
+ Publishes the time of the next enabled alarm into the WindowManager's deadline registry,
+ so the system is woken up for it. Scheduled alarms never keep the system from sleeping.
+ Called whenever the alarms have changed.
 **/
-+ (void)sortAndAddAlarm:(Alarm *)newAlarm
++ (void)publishNextAlarm
 {
-	// Put it in the right place
-	int i = 0;
-	BOOL done = false;
-	NSCalendarDate *newTime = [newAlarm time];
+	[WindowManager setDeadline:[self nextAlarmDate] preventsSleep:NO forOwner:self];
+}
+
+/**
+ Adds the given alarm to the schedule, in a free slot.
+ The alarm is retained (until it's unscheduled).
+**/
++ (void)scheduleAlarm:(Alarm *)newAlarm
+{
+	int32_t slot;
 	
-	while(i<[alarms count] && !done)
+	if(freeSlotsCount > 0)
 	{
-		Alarm *temp = [alarms objectAtIndex:i];
-		
-		if([newTime isEarlierDate:[temp time]])
-			done = YES;
-		else
-			i++;
+		slot = freeSlots[--freeSlotsCount];
+	}
+	else
+	{
+		if(slotsCount == slotsCapacity)
+		{
+			int32_t capacity = (slotsCapacity > 0) ? (slotsCapacity * 2) : 16;
+			
+			Alarm **newSlots = realloc(slots, capacity * sizeof(Alarm *));
+			if(newSlots != NULL) slots = newSlots;
+			
+			int32_t *newFreeSlots = realloc(freeSlots, capacity * sizeof(int32_t));
+			if(newFreeSlots != NULL) freeSlots = newFreeSlots;
+			
+			int32_t *newSortedSlots = realloc(sortedSlots, capacity * sizeof(int32_t));
+			if(newSortedSlots != NULL) sortedSlots = newSortedSlots;
+			
+			if((newSlots == NULL) || (newFreeSlots == NULL) || (newSortedSlots == NULL))
+			{
+				NSLog(@"Unable to allocate room for %i alarms", capacity);
+				return;
+			}
+			slotsCapacity = capacity;
+		}
+		slot = slotsCount++;
+	}
+	
+	slots[slot] = [newAlarm retain];
+	NSMapInsert(slotsByAlarm, newAlarm, (void *)(intptr_t)(slot + 1));
+	
+	AlarmHeapInsert(alarms, slot, KeyForAlarm(newAlarm));
+	[self rescheduleSlot:slot];
+}
+
+/**
+ Removes the given alarm from the schedule, freeing it's slot, and releasing it.
+ Does nothing if the alarm isn't scheduled.
+**/
++ (void)unscheduleAlarm:(Alarm *)oldAlarm
+{
+	int32_t slot = [self slotForAlarm:oldAlarm];
+	if(slot < 0) return;
+	
+	AlarmHeapRemove(alarms, slot);
+	AlarmHeapRemove(enabledAlarms, slot);
+	NSMapRemove(slotsByAlarm, oldAlarm);
+	
+	freeSlots[freeSlotsCount++] = slot;
+	slots[slot] = nil;
+	isSortedValid = NO;
+	
+	[oldAlarm release];
+}
+
+/**
+ Moves the alarm in the given slot to it's (new) time,
+ and adds it to, or removes it from, the enabled alarms, depending on whether it's enabled.
+**/
++ (void)rescheduleSlot:(int32_t)slot
+{
+	Alarm *alarm = slots[slot];
+	int64_t key = KeyForAlarm(alarm);
+	
+	AlarmHeapUpdate(alarms, slot, key);
+	
+	if([alarm isEnabled])
+		AlarmHeapInsert(enabledAlarms, slot, key);
+	else
+		AlarmHeapRemove(enabledAlarms, slot);
+	
+	isSortedValid = NO;
+}
+
+/**
+ Returns the slot of the given alarm, or -1 if it isn't scheduled.
+**/
++ (int32_t)slotForAlarm:(Alarm *)alarm
+{
+	if(alarm == nil) return -1;
+	
+	return (int32_t)(intptr_t)NSMapGet(slotsByAlarm, alarm) - 1;
+}
+
+/**
+ Returns the alarm at the given index, with the alarms in order of time.
+ The order is worked out again the first time this is called after any alarm changed.
+**/
++ (Alarm *)alarmAtIndex:(int)index
+{
+	if(!isSortedValid)
+	{
+		AlarmHeapSorted(alarms, sortedSlots);
+		isSortedValid = YES;
+	}
+	
+	if((index < 0) || (index >= [self numberOfAlarms]))
+	{
+		[NSException raise:NSRangeException format:@"Alarm index %i beyond count %i", index, [self numberOfAlarms]];
 	}
 	
-	[alarms insertObject:newAlarm atIndex:i];
+	return slots[sortedSlots[index]];
 }
 
 @end
\ No newline at end of file
@@ -9,6 +9,11 @@
 + (void)prepareForSleep;
 + (void)wakeFromSleep;
 
++ (float)idleWakeupsPerHour;
+
++ (void)countWindowWakeup;
++ (float)windowWakeupsPerHour;
+
 + (BOOL)isAuthenticated;
 + (BOOL)authenticate;
 + (BOOL)deauthenticate;
@@ -2,7 +2,8 @@
 #import "Prefs.h"
 #import "AlarmScheduler.h"
 #import "WindowManager.h"
-#import "CalendarAdditions.h"
+#import "AlarmController.h"
+#import "Alarm.h"
 
 #import <mach/mach_port.h>
 #import <mach/mach_interface.h>
@@ -15,6 +16,7 @@
 
 #import <Security/Authorization.h>
 #import <unistd.h>
+#import <notify.h>
 
 // Callback function to be invoked by the OS for power notifications
 void callback(void * x,io_service_t y,natural_t messageType,void * messageArgument);
@@ -28,15 +30,25 @@ IONotificationPortRef notifyPortRef;
 // Notifier object, created when registering for power notifications, and used to deregister later
 io_object_t notifierObject;
 
+// Callback function to be invoked by the run loop when the system clock is set
+void clockSetCallback(CFMachPortRef port, void *message, CFIndex size, void *info);
+
+// Token, port and run loop source from registering with notify(3) for the system clock being set
+int clockSetToken;
+CFMachPortRef clockSetPort;
+CFRunLoopSourceRef clockSetSource;
+
 
 // Declare private methods
 @interface AlarmTasks (PrivateAPI)
 + (BOOL)md5Check:(NSString *)path;
 + (void)runHelperToolWithArg:(int)arg;
-+ (void)startTimers;
-+ (void)initialCheckForAlarm:(NSTimer *)aTimer;
++ (void)rescheduleTimer;
++ (void)updateDayChangeTime;
++ (void)clockChanged;
++ (void)deadlineChanged:(NSNotification *)notification;
 + (void)checkForAlarm:(NSTimer *)aTimer;
-+ (void)updateMenuItemsAtDayChange:(NSTimer *)aTimer;
++ (BOOL)prewarmForNextAlarm:(NSCalendarDate *)now;
 @end
 
 
@@ -45,11 +57,22 @@ io_object_t notifierObject;
 // CLASS VARIABLES
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Timer used to check for alarms every minute
+// Timer used to wake up at the next time anything needs doing (see rescheduleTimer)
 static NSTimer *timer;
 
-// Timer used to update the menu items when the day changes
-static NSTimer *dayTimer;
+// The time (since the reference date) at which the current day ends, and the menu items need updating
+static NSTimeInterval dayChangeTime;
+
+// Set while checking for alarms, as the notifications posted meanwhile needn't each re-arm the timer
+static BOOL isChecking;
+
+// The number of times the timer has gone off, and how many of those had nothing to do, since countStartTime
+static unsigned int wakeups;
+static unsigned int idleWakeups;
+static NSTimeInterval countStartTime;
+
+// The number of times open windows' own timers have gone off (to update the time they show), since countStartTime
+static unsigned int windowWakeups;
 
 // The time to schedule the computer to wake from sleep
 static NSCalendarDate *wakeDate;
@@ -85,8 +108,36 @@ static NSCalendarDate *wakeDate;
 		
 		CFRunLoopAddSource(CFRunLoopGetCurrent(), IONotificationPortGetRunLoopSource(notifyPortRef), kCFRunLoopDefaultMode);
 		
+		// Register for the system clock being set
+		// The timer is armed hours ahead at times, and would otherwise go off by the old clock
+		mach_port_t clockPort;
+		if(notify_register_mach_port("com.apple.system.clock_set", &clockPort, 0, &clockSetToken) == NOTIFY_STATUS_OK)
+		{
+			clockSetPort = CFMachPortCreateWithPort(NULL, clockPort, clockSetCallback, NULL, NULL);
+			clockSetSource = CFMachPortCreateRunLoopSource(NULL, clockSetPort, 0);
+			
+			CFRunLoopAddSource(CFRunLoopGetCurrent(), clockSetSource, kCFRunLoopDefaultMode);
+		}
+		else
+		{
+			NSLog(@"Unable to register for system clock changes!");
+		}
+		
+		// Register for notifications of anything that may change when the timer needs to go off
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(deadlineChanged:)
+													 name:@"AlarmChanged"
+												   object:nil];
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(deadlineChanged:)
+													 name:@"DeadlineChanged"
+												   object:nil];
+		
 		// Start the timer
-		[self startTimers];
+		countStartTime = [NSDate timeIntervalSinceReferenceDate];
+		[self updateDayChangeTime];
+		[self rescheduleTimer];
 		
 		// Update initialization status
 		initialized = YES;
@@ -99,11 +150,28 @@ static NSCalendarDate *wakeDate;
 **/
 + (void)deinitialize
 {
-	// Stop and release the timers
-	[timer release];
+	// Stop and release the timer
 	[timer invalidate];
-	[dayTimer release];
-	[dayTimer invalidate];
+	[timer release];
+	timer = nil;
+	
+	// Deregister for notifications
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	// Deregister for system clock changes
+	if(clockSetSource != NULL)
+	{
+		CFRunLoopRemoveSource(CFRunLoopGetCurrent(), clockSetSource, kCFRunLoopDefaultMode);
+		CFRelease(clockSetSource);
+		
+		CFMachPortInvalidate(clockSetPort);
+		CFRelease(clockSetPort);
+		
+		notify_cancel(clockSetToken);
+	}
+	
+	NSLog(@"AlarmTasks: %u wakeups, %u idle (%f idle wakeups per hour), %u window updates (%f per hour)",
+		  wakeups, idleWakeups, [self idleWakeupsPerHour], windowWakeups, [self windowWakeupsPerHour]);
 	
 	// Release next alarm date
 	[wakeDate release];
@@ -168,6 +236,17 @@ void callback(void * x, io_service_t y, natural_t messageType, void * messageArg
 	}
 }
 
+// CLOCK CHANGE CALLBACK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Called by the run loop when notify(3) posts that the system clock was set (by the user, or by network time).
+**/
+void clockSetCallback(CFMachPortRef port, void *message, CFIndex size, void *info)
+{
+	[AlarmTasks clockChanged];
+}
+
 // AUTHENTICATION METHODS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -358,42 +437,28 @@ void callback(void * x, io_service_t y, natural_t messageType, void * messageArg
 + (void)prepareForSleep
 {
 	// We need to figure out when we have to wake up
-	// Thus, we need to figure out when the next alarm is
+	// That's the earliest of the next scheduled alarm, an open alarm that's snoozing, a timer that's active, etc...
+	// The AlarmScheduler and the open windows publish these into the WindowManager's deadline registry
 	
 	// Release the previous wakeDate
 	[wakeDate release];
 	
-	// We get the time of the next scheduled alarm
-	wakeDate = [AlarmScheduler nextAlarmDate];
-	
-	// What if an open alarm is currently snoozing, or a timer is active, etc...
-	// So we also get the earliest date an open window may need to wake up
-	NSCalendarDate *nextWindowDate = [WindowManager systemWillSleep];
-	
-	if(nextWindowDate != nil)
-	{
-		if(wakeDate == nil)
-			wakeDate = nextWindowDate;
-		else
-			wakeDate = (NSCalendarDate*)[wakeDate earlierDate:nextWindowDate];
-	}
-	
 	// Don't forget to retain the wakeDate - we need to reference it after we wake from sleep
-	[wakeDate retain];
+	wakeDate = [[WindowManager systemWillSleep] retain];
 	
 	// Now that we know the wakeDate, we can configure the system to wakeup at that time
 	[self runHelperToolWithArg:1];
 	
-	// Stop the timers
+	// Stop the timer
+	// It's armed again after we wake up, as the time may have changed while sleeping
 	[timer invalidate];
-	[dayTimer invalidate];
 }
 
 /**
  Removes the scheduled event from the IOPMQueue.
  Additionally NSTimers do not seem to be on schedule after the computer wakes from sleep.
- Thus, this method is used to stop the timer, check for an alarm manually,
- and then start the timer again (thus resyncing it)
+ Thus, this method is used to check for an alarm manually,
+ and then arm the timer again for the next time anything needs doing (thus resyncing it)
 **/
 + (void)wakeFromSleep
 {
@@ -417,7 +482,9 @@ void callback(void * x, io_service_t y, natural_t messageType, void * messageArg
 	[WindowManager systemDidWake];
 	
 	// Start the timer again
-	[self startTimers];
+	// The day may have changed while we were sleeping
+	[self updateDayChangeTime];
+	[self rescheduleTimer];
 	
 	// Post notification for changed alarm
 	// This will prompt the MenuController to update it's menu
@@ -524,76 +591,126 @@ void callback(void * x, io_service_t y, natural_t messageType, void * messageArg
 // TIMER METHODS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-/* Starts the timer
-** An initial timer is started that will go off at the turn of the current minute
-** After that, a timer will go off every 60 seconds (effectivly at the turn of every minute thereafter)
+/**
+ Arms the timer for the earliest time anything needs doing:
+ - the next alarm going off (enabled or not, as disabled alarms move on to their next time too)
+ - the pre-warm lead time before the next enabled alarm
+ - an open window's deadline (a snooze being over, or a timer going off)
+ - the day changing (so the menu items get updated)
+ 
+ The timer doesn't repeat. It's armed again whenever any of these may have changed (see deadlineChanged:),
+ and when the system clock is set (see clockChanged), so it only goes off when something is due,
+ and at the exact time it's due rather than at the turn of a minute.
 **/
-+ (void)startTimers
++ (void)rescheduleTimer
 {
-	// Start the initial timer
-	// It shouldn't go off til the seconds (and milliseconds) are zero
-	double waitTime1 = 60.0 - [[NSCalendarDate calendarDate] intervalOfMinute];
-	timer = [[NSTimer scheduledTimerWithTimeInterval:waitTime1
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	
+	// The day changing is the latest the timer ever goes off
+	NSTimeInterval fireTime = dayChangeTime;
+	
+	NSCalendarDate *statusDate = [AlarmScheduler nextStatusDate];
+	if(statusDate != nil)
+	{
+		fireTime = MIN(fireTime, [statusDate timeIntervalSinceReferenceDate]);
+	}
+	
+	int leadTime = [Prefs prewarmLeadTime];
+	NSCalendarDate *alarmDate = [AlarmScheduler nextAlarmDate];
+	
+	if((leadTime > 0) && (alarmDate != nil))
+	{
+		// If we're already within the lead time, it was pre-warmed when we got there
+		NSTimeInterval prewarmTime = [alarmDate timeIntervalSinceReferenceDate] - leadTime;
+		if(prewarmTime > now)
+		{
+			fireTime = MIN(fireTime, prewarmTime);
+		}
+	}
+	
+	// This is the earliest of the next enabled alarm and the open windows' deadlines
+	NSCalendarDate *deadline = [WindowManager nextDeadline];
+	if(deadline != nil)
+	{
+		fireTime = MIN(fireTime, [deadline timeIntervalSinceReferenceDate]);
+	}
+	
+	// Replace the timer
+	// This may be called from the timer itself, so it's autoreleased rather than released
+	[timer invalidate];
+	[timer autorelease];
+	
+	timer = [[NSTimer scheduledTimerWithTimeInterval:MAX(fireTime - now, 0.0)
 											  target:self
-											selector:@selector(initialCheckForAlarm:)
+											selector:@selector(checkForAlarm:)
 											userInfo:nil
 											 repeats:NO] retain];
-	
-	// Start a timer to update menu items when the current day changes
-	// This is needed so that items with "Tomorrow" get properly updated to "Today"
-	double waitTime2 = 86400.0 - [[NSCalendarDate calendarDate] intervalOfDay];
-	dayTimer = [[NSTimer scheduledTimerWithTimeInterval:waitTime2
-												 target:self
-											   selector:@selector(updateMenuItemsAtDayChange:)
-											   userInfo:nil
-												repeats:NO] retain];
 }
 
+/**
+ Works out when the current day ends (the next midnight, local time).
+**/
++ (void)updateDayChangeTime
+{
+	NSCalendarDate *tomorrow = [[NSCalendarDate calendarDate] dateByAddingYears:0
+																		 months:0
+																		   days:1
+																		  hours:0
+																		minutes:0
+																		seconds:0];
+	
+	NSCalendarDate *midnight = [NSCalendarDate dateWithYear:[tomorrow yearOfCommonEra]
+													  month:[tomorrow monthOfYear]
+														day:[tomorrow dayOfMonth]
+													   hour:0
+													 minute:0
+													 second:0
+												   timeZone:[tomorrow timeZone]];
+	
+	dayChangeTime = [midnight timeIntervalSinceReferenceDate];
+}
 
 /**
- Called from the initial timer.  This timer does not repeat.
- It's interval was set based on the current time, so that it went off at zero seconds and zero milliseconds.
+ Called when the system clock is set.
+ The timer was armed for an interval from the old time, so the day change and the timer are worked out again.
+ If the clock moved past anything, the timer goes off right away.
 **/
-+ (void)initialCheckForAlarm:(NSTimer *)aTimer
++ (void)clockChanged
 {
-	// Start the regular timer
-	[timer autorelease];
-	timer = [[NSTimer scheduledTimerWithTimeInterval:60.0
-											  target:self
-											selector:@selector(checkForAlarm:)
-											userInfo:nil
-											 repeats:YES] retain];
-	// Check for alarms
-	[self checkForAlarm:nil];
+	NSLog(@"AlarmTasks: System clock changed");
+	
+	[self updateDayChangeTime];
+	[self rescheduleTimer];
 }
 
+/**
+ Called when notifications of "AlarmChanged" or "DeadlineChanged" are posted.
+ Either may change the next time anything needs doing, so the timer is armed again.
+**/
++ (void)deadlineChanged:(NSNotification *)notification
+{
+	// While checking for alarms, the timer is armed again once we're done
+	if(!isChecking)
+	{
+		[self rescheduleTimer];
+	}
+}
 
 /**
- Called from the regular timer every 60 seconds.
+ Called from the timer, at the earliest time anything needs doing.
  It's job is to check for an alarm, and sound it if necessary.
+ It also lets open windows know when their deadline is reached, and updates the menu items when the day changes.
+ Afterwards the timer is armed again, for the next time anything needs doing.
 **/
 + (void)checkForAlarm:(NSTimer *)aTimer
 {
 	// Immediately grab the time so we know exactly when this timer fired
 	NSCalendarDate *now = [NSCalendarDate calendarDate];
 	
-	// Timer Accuracy Check
-	if([timer isValid] && ([now secondOfMinute] > 0))
-	{
-		// The timer is either firing early (second is probably 59) or it's firing late (second is probably 1)
-		// The first is possible due to an OS bug (or timer API bug)
-		// The second is possible due to heavy cpu usage
-		// Realign the timer
-		[timer invalidate];
-		[timer autorelease];
-		
-		double waitTime = 60.0 - [now intervalOfMinute];
-		timer = [[NSTimer scheduledTimerWithTimeInterval:waitTime
-												  target:self
-												selector:@selector(initialCheckForAlarm:)
-												userInfo:nil
-												 repeats:NO] retain];
-	}
+	// Whether there was anything to do (the timer may go off a little early, or for something that has since changed)
+	BOOL isIdle = YES;
+	
+	isChecking = YES;
 	
 	// Check to see if an alarm should sound
 	// Continously check in case more than one alarm is scheduled at the same time
@@ -602,6 +719,11 @@ void callback(void * x, io_service_t y, natural_t messageType, void * messageArg
 	{
 		alarmStatus = [AlarmScheduler alarmStatus:now];
 		
+		if(alarmStatus >= 0)
+		{
+			isIdle = NO;
+		}
+		
 		if(alarmStatus > 0)
 		{
 			NSLog(@"AlarmTasks: Alarm should sound!");
@@ -609,24 +731,105 @@ void callback(void * x, io_service_t y, natural_t messageType, void * messageArg
 		}
 		
 	}while(alarmStatus >= 0);
+	
+	// Sound any snoozing alarms or timers that are due
+	if([WindowManager checkWindowDeadlines:now])
+	{
+		isIdle = NO;
+	}
+	
+	// Update the menu items if the day has changed
+	// This is needed so that items with "Tomorrow" get properly updated to "Today"
+	if([now timeIntervalSinceReferenceDate] >= dayChangeTime)
+	{
+		[self updateDayChangeTime];
+		isIdle = NO;
+		
+		NSLog(@"Updating menu items at day change");
+		NSLog(@"AlarmTasks: %u wakeups, %u idle (%f idle wakeups per hour), %u window updates (%f per hour)",
+			  wakeups, idleWakeups, [self idleWakeupsPerHour], windowWakeups, [self windowWakeupsPerHour]);
+		
+		// Post notification for changed alarm
+		// This will prompt the MenuController to update it's menu
+		[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
+	}
+	
+	// Get ready for the next alarm, if it's due soon
+	if([self prewarmForNextAlarm:now])
+	{
+		isIdle = NO;
+	}
+	
+	isChecking = NO;
+	
+	// Count the wakeup, unless we were called directly (after waking from sleep)
+	if(aTimer != nil)
+	{
+		wakeups++;
+		
+		if(isIdle)
+		{
+			idleWakeups++;
+		}
+	}
+	
+	[self rescheduleTimer];
 }
 
-+ (void)updateMenuItemsAtDayChange:(NSTimer *)aTimer
+/**
+ If the next alarm is due within the pre-warm lead time, prepares the library and player for it.
+ This way the alarm starts playing as soon as it goes off, instead of first waiting for the library to load.
+ Returns whether the next alarm is within the lead time.
+**/
++ (BOOL)prewarmForNextAlarm:(NSCalendarDate *)now
 {
-	[dayTimer autorelease];
+	int leadTime = [Prefs prewarmLeadTime];
+	if(leadTime <= 0) return NO;
 	
-	double waitTime = 86400.0 - [[NSCalendarDate calendarDate] intervalOfDay];
-	dayTimer = [[NSTimer scheduledTimerWithTimeInterval:waitTime
-												 target:self
-											   selector:@selector(updateMenuItemsAtDayChange:)
-											   userInfo:nil
-												repeats:NO] retain];
+	Alarm *nextAlarm = [AlarmScheduler nextAlarmClone];
 	
-	NSLog(@"Updating menu items at day change");
+	if((nextAlarm != nil) && ([[nextAlarm time] timeIntervalSinceDate:now] <= leadTime))
+	{
+		[AlarmController prewarmForAlarm:nextAlarm];
+		return YES;
+	}
 	
-	// Post notification for changed alarm
-	// This will prompt the MenuController to update it's menu
-	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmChanged" object:self];
+	return NO;
+}
+
+/**
+ Returns the number of times per hour the timer has gone off with nothing to do, since the application started.
+ With the timer armed for exactly when something is due, this should stay close to zero.
+**/
++ (float)idleWakeupsPerHour
+{
+	NSTimeInterval hours = ([NSDate timeIntervalSinceReferenceDate] - countStartTime) / 3600.0;
+	
+	if(hours <= 0.0) return 0.0;
+	
+	return idleWakeups / hours;
+}
+
+/**
+ Called by alarm and timer windows each time their own timer goes off.
+ These wake the application up too, while a window is showing the time going by.
+**/
++ (void)countWindowWakeup
+{
+	windowWakeups++;
+}
+
+/**
+ Returns the number of times per hour open windows' timers have gone off, since the application started.
+ Windows only run their timers while they can be seen (and while an alarm is going off), so this is zero otherwise.
+**/
++ (float)windowWakeupsPerHour
+{
+	NSTimeInterval hours = ([NSDate timeIntervalSinceReferenceDate] - countStartTime) / 3600.0;
+	
+	if(hours <= 0.0) return 0.0;
+	
+	return windowWakeups / hours;
 }
 
 @end
\ No newline at end of file
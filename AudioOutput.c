@@ -0,0 +1,557 @@
+#include "AudioOutput.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Frames the virtual backends render at a time, like an audio device asking for a buffer
+#define BUFFER_FRAMES  512
+
+typedef struct VirtualOutput
+{
+	AudioOutputDecoder decoder;
+	uint32_t sampleRate;
+	
+	// The WAV file being written (NULL for the null backend), and the size of it's audio data so far
+	FILE *file;
+	uint32_t dataSize;
+	
+	// The current track (a decoder handle), and where it is
+	void *track;
+	double duration;
+	uint64_t position;
+	
+	// Frames of silence still to be played before the track's audio, because opening it took that long
+	uint64_t latencyFrames;
+	
+	int isPlaying;
+	int isLooping;
+	float volume;
+	GainRamp *ramp;
+	
+	// Virtual clock, in frames, and the fraction of a frame it's been advanced by
+	uint64_t clockFrames;
+	double clockRemainder;
+	
+	int isUnderrun;
+	AudioOutputStats stats;
+	
+	float buffer[BUFFER_FRAMES * AUDIO_OUTPUT_CHANNELS];
+} VirtualOutput;
+
+// OUTPUT
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void AudioOutputFree(AudioOutput *output)
+{
+	if(output == NULL) return;
+	
+	output->backend->free(output);
+}
+
+void AudioOutputSetFinishedFunction(AudioOutput *output, AudioOutputFinishedFunction finished, void *context)
+{
+	output->finished = finished;
+	output->context = context;
+}
+
+/**
+ Opens the file at the given path, replacing the current track. The new track isn't playing.
+ Returns 0 if the file can't be played (in which case there is no current track).
+**/
+int AudioOutputOpen(AudioOutput *output, const char *path)
+{
+	if(path == NULL)
+	{
+		output->backend->close(output);
+		return 0;
+	}
+	return output->backend->open(output, path);
+}
+
+void AudioOutputClose(AudioOutput *output)
+{
+	output->backend->close(output);
+}
+
+void AudioOutputPlay(AudioOutput *output)
+{
+	output->backend->play(output);
+}
+
+void AudioOutputStop(AudioOutput *output)
+{
+	output->backend->stop(output);
+}
+
+int AudioOutputIsPlaying(AudioOutput *output)
+{
+	return output->backend->isPlaying(output);
+}
+
+double AudioOutputDuration(AudioOutput *output)
+{
+	return output->backend->duration(output);
+}
+
+double AudioOutputCurrentTime(AudioOutput *output)
+{
+	return output->backend->currentTime(output);
+}
+
+void AudioOutputSetCurrentTime(AudioOutput *output, double time)
+{
+	output->backend->setCurrentTime(output, time);
+}
+
+/**
+ Sets the volume of the output (from 0.0 to 1.0), which applies to every track played.
+**/
+void AudioOutputSetVolume(AudioOutput *output, float volume)
+{
+	if(volume < 0.0f) volume = 0.0f;
+	if(volume > 1.0f) volume = 1.0f;
+	
+	output->backend->setVolume(output, volume);
+}
+
+/**
+ Sets whether tracks start over when they end (instead of calling the finished function).
+**/
+void AudioOutputSetLooping(AudioOutput *output, int isLooping)
+{
+	output->backend->setLooping(output, isLooping);
+}
+
+/**
+ Returns whether the output runs on a virtual clock (which only moves with AudioOutputAdvance).
+**/
+int AudioOutputIsVirtual(AudioOutput *output)
+{
+	return (output->backend->advance != NULL);
+}
+
+/**
+ Advances the virtual clock by the given number of seconds, playing (or writing) the audio in between.
+ Does nothing for backends that play in real time.
+**/
+void AudioOutputAdvance(AudioOutput *output, double seconds)
+{
+	if(output->backend->advance != NULL)
+	{
+		output->backend->advance(output, seconds);
+	}
+}
+
+/**
+ Sets a gain ramp, which is applied (and advanced) while playing, along with the volume. NULL removes it.
+ The virtual backends use the given ramp, which isn't copied, so it must outlive the output (or be unset).
+ The memory backend plays on another thread, so it takes a copy of the ramp as it is.
+ Returns whether the backend applies the ramp: QuickTime doesn't, as it doesn't give access to the samples.
+**/
+int AudioOutputSetRamp(AudioOutput *output, GainRamp *ramp)
+{
+	if(output->backend->setRamp == NULL) return 0;
+	
+	return output->backend->setRamp(output, ramp);
+}
+
+/**
+ Gets what a virtual backend has played so far. Returns 0 for backends that play in real time.
+**/
+int AudioOutputGetStats(AudioOutput *output, AudioOutputStats *stats)
+{
+	if(!AudioOutputIsVirtual(output)) return 0;
+	
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	*stats = v->stats;
+	stats->clock = v->clockFrames / (double)v->sampleRate;
+	return 1;
+}
+
+// VIRTUAL BACKENDS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void VirtualClose(AudioOutput *output)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	if(v->track != NULL)
+	{
+		v->decoder.close(v->decoder.context, v->track);
+		v->track = NULL;
+	}
+	
+	v->duration = 0.0;
+	v->position = 0;
+	v->latencyFrames = 0;
+	v->isPlaying = 0;
+}
+
+static int VirtualOpen(AudioOutput *output, const char *path)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	VirtualClose(output);
+	
+	if(v->decoder.open == NULL) return 0;
+	
+	double duration = 0.0;
+	double latency = 0.0;
+	
+	v->track = v->decoder.open(v->decoder.context, path, v->sampleRate, &duration, &latency);
+	if(v->track == NULL) return 0;
+	
+	v->duration = duration;
+	v->latencyFrames = (latency > 0.0) ? (uint64_t)(latency * v->sampleRate + 0.5) : 0;
+	v->stats.tracksOpened++;
+	
+	return 1;
+}
+
+static void VirtualPlay(AudioOutput *output)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	v->isPlaying = (v->track != NULL);
+}
+
+static void VirtualStop(AudioOutput *output)
+{
+	((VirtualOutput *)output->state)->isPlaying = 0;
+}
+
+static int VirtualIsPlaying(AudioOutput *output)
+{
+	return ((VirtualOutput *)output->state)->isPlaying;
+}
+
+static double VirtualDuration(AudioOutput *output)
+{
+	return ((VirtualOutput *)output->state)->duration;
+}
+
+static double VirtualCurrentTime(AudioOutput *output)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	return v->position / (double)v->sampleRate;
+}
+
+static void VirtualSetCurrentTime(AudioOutput *output, double time)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	if(v->track == NULL) return;
+	
+	if(time < 0.0) time = 0.0;
+	if(time > v->duration) time = v->duration;
+	
+	v->decoder.seek(v->decoder.context, v->track, time);
+	v->position = (uint64_t)(time * v->sampleRate + 0.5);
+}
+
+static void VirtualSetVolume(AudioOutput *output, float volume)
+{
+	((VirtualOutput *)output->state)->volume = volume;
+}
+
+static void VirtualSetLooping(AudioOutput *output, int isLooping)
+{
+	((VirtualOutput *)output->state)->isLooping = isLooping;
+}
+
+static int VirtualSetRamp(AudioOutput *output, GainRamp *ramp)
+{
+	((VirtualOutput *)output->state)->ramp = ramp;
+	return 1;
+}
+
+/**
+ Writes the given frames to the WAV file (if any), as 16 bit PCM, in little endian byte order.
+**/
+static void WriteFrames(VirtualOutput *v, const float *samples, uint32_t frames)
+{
+	if(v->file == NULL) return;
+	
+	unsigned char pcm[BUFFER_FRAMES * AUDIO_OUTPUT_CHANNELS * 2];
+	uint32_t i;
+	
+	for(i = 0; i < frames * AUDIO_OUTPUT_CHANNELS; i++)
+	{
+		float sample = samples[i] * 32767.0f;
+		
+		if(sample > 32767.0f) sample = 32767.0f;
+		if(sample < -32768.0f) sample = -32768.0f;
+		
+		uint16_t value = (uint16_t)(int16_t)lrintf(sample);
+		pcm[i * 2] = value & 0xFF;
+		pcm[(i * 2) + 1] = value >> 8;
+	}
+	
+	uint32_t size = frames * AUDIO_OUTPUT_CHANNELS * 2;
+	if(fwrite(pcm, 1, size, v->file) == size)
+	{
+		v->dataSize += size;
+	}
+}
+
+/**
+ Plays the next frames (at most BUFFER_FRAMES) of the current track, and returns how many were played.
+ Handles the end of the track, which may call the finished function.
+**/
+static uint32_t PlayFrames(AudioOutput *output, uint32_t frames)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	float *buffer = v->buffer;
+	uint32_t played = frames;
+	uint32_t rendered = 0;
+	int isEnd = 0;
+	
+	if(v->latencyFrames > 0)
+	{
+		// The track is still being opened, so there's nothing to play yet
+		if(played > v->latencyFrames)
+		{
+			played = (uint32_t)v->latencyFrames;
+		}
+		v->latencyFrames -= played;
+	}
+	else
+	{
+		rendered = v->decoder.render(v->decoder.context, v->track, buffer, frames, &isEnd);
+		if(rendered > frames)
+		{
+			rendered = frames;
+		}
+		
+		// At the end of the track, only what was rendered is played, so the next track follows without a gap
+		if(isEnd)
+		{
+			played = rendered;
+		}
+		v->position += rendered;
+	}
+	
+	memset(buffer + (rendered * AUDIO_OUTPUT_CHANNELS), 0, (played - rendered) * AUDIO_OUTPUT_CHANNELS * sizeof(float));
+	
+	if(rendered < played)
+	{
+		if(!v->isUnderrun)
+		{
+			v->stats.underrunCount++;
+			v->isUnderrun = 1;
+		}
+		v->stats.underrunTime += (played - rendered) / (double)v->sampleRate;
+	}
+	else if(played > 0)
+	{
+		v->isUnderrun = 0;
+	}
+	
+	// Apply the volume, and the ramp
+	uint32_t i;
+	if(v->volume != 1.0f)
+	{
+		for(i = 0; i < played * AUDIO_OUTPUT_CHANNELS; i++)
+		{
+			buffer[i] *= v->volume;
+		}
+	}
+	if(v->ramp != NULL)
+	{
+		GainRampProcess(v->ramp, buffer, played, AUDIO_OUTPUT_CHANNELS);
+	}
+	
+	WriteFrames(v, buffer, played);
+	v->stats.playedTime += played / (double)v->sampleRate;
+	
+	if(isEnd)
+	{
+		if(v->isLooping && (v->position > 0))
+		{
+			v->decoder.seek(v->decoder.context, v->track, 0.0);
+			v->position = 0;
+			v->stats.loopsCompleted++;
+		}
+		else
+		{
+			v->isPlaying = 0;
+			v->stats.tracksFinished++;
+			
+			if(output->finished != NULL)
+			{
+				output->finished(output->context, output);
+			}
+		}
+	}
+	
+	return played;
+}
+
+static void VirtualAdvance(AudioOutput *output, double seconds)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	if(seconds <= 0.0) return;
+	
+	double total = (seconds * v->sampleRate) + v->clockRemainder;
+	uint64_t remaining = (uint64_t)total;
+	v->clockRemainder = total - remaining;
+	
+	// A track that ends straight away (and the track after it...) could keep this from advancing at all
+	uint32_t emptyCount = 0;
+	
+	while(remaining > 0)
+	{
+		uint32_t frames = (remaining < BUFFER_FRAMES) ? (uint32_t)remaining : BUFFER_FRAMES;
+		uint32_t played;
+		
+		if(v->isPlaying && (v->track != NULL) && (emptyCount < 1000))
+		{
+			played = PlayFrames(output, frames);
+			emptyCount = (played == 0) ? emptyCount + 1 : 0;
+		}
+		else
+		{
+			// Nothing is playing, so the device plays silence
+			memset(v->buffer, 0, frames * AUDIO_OUTPUT_CHANNELS * sizeof(float));
+			WriteFrames(v, v->buffer, frames);
+			
+			played = frames;
+			emptyCount = 0;
+		}
+		
+		v->clockFrames += played;
+		remaining -= played;
+	}
+}
+
+static void WriteLE32(unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = value & 0xFF;
+	bytes[1] = (value >> 8) & 0xFF;
+	bytes[2] = (value >> 16) & 0xFF;
+	bytes[3] = (value >> 24) & 0xFF;
+}
+
+/**
+ Writes the header of the WAV file, with the size of the audio data written so far.
+**/
+static int WriteWAVHeader(VirtualOutput *v)
+{
+	unsigned char header[44];
+	uint32_t bytesPerFrame = AUDIO_OUTPUT_CHANNELS * 2;
+	
+	memcpy(header, "RIFF", 4);
+	WriteLE32(header + 4, 36 + v->dataSize);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	WriteLE32(header + 16, 16);
+	header[20] = 1;                        // PCM
+	header[21] = 0;
+	header[22] = AUDIO_OUTPUT_CHANNELS;
+	header[23] = 0;
+	WriteLE32(header + 24, v->sampleRate);
+	WriteLE32(header + 28, v->sampleRate * bytesPerFrame);
+	header[32] = bytesPerFrame;
+	header[33] = 0;
+	header[34] = 16;                       // Bits per sample
+	header[35] = 0;
+	memcpy(header + 36, "data", 4);
+	WriteLE32(header + 40, v->dataSize);
+	
+	return (fseek(v->file, 0, SEEK_SET) == 0) && (fwrite(header, sizeof(header), 1, v->file) == 1);
+}
+
+static void VirtualFree(AudioOutput *output)
+{
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	VirtualClose(output);
+	
+	if(v->file != NULL)
+	{
+		if(!WriteWAVHeader(v))
+		{
+			fprintf(stderr, "AudioOutput: Unable to finish WAV file\n");
+		}
+		fclose(v->file);
+	}
+	
+	free(v);
+	free(output);
+}
+
+static const AudioOutputBackend nullBackend = {
+	"Null",
+	VirtualOpen, VirtualClose, VirtualPlay, VirtualStop, VirtualIsPlaying,
+	VirtualDuration, VirtualCurrentTime, VirtualSetCurrentTime, VirtualSetVolume, VirtualSetLooping,
+	VirtualSetRamp, VirtualAdvance, VirtualFree
+};
+
+static const AudioOutputBackend wavBackend = {
+	"WAV",
+	VirtualOpen, VirtualClose, VirtualPlay, VirtualStop, VirtualIsPlaying,
+	VirtualDuration, VirtualCurrentTime, VirtualSetCurrentTime, VirtualSetVolume, VirtualSetLooping,
+	VirtualSetRamp, VirtualAdvance, VirtualFree
+};
+
+static AudioOutput * CreateVirtual(const AudioOutputBackend *backend, const AudioOutputDecoder *decoder,
+                                   uint32_t sampleRate)
+{
+	AudioOutput *output = calloc(1, sizeof(AudioOutput));
+	VirtualOutput *v = calloc(1, sizeof(VirtualOutput));
+	
+	if((output == NULL) || (v == NULL))
+	{
+		free(output);
+		free(v);
+		return NULL;
+	}
+	
+	if(decoder != NULL)
+	{
+		v->decoder = *decoder;
+	}
+	v->sampleRate = (sampleRate > 0) ? sampleRate : 44100;
+	v->volume = 1.0f;
+	
+	output->backend = backend;
+	output->state = v;
+	
+	return output;
+}
+
+/**
+ Creates an output that plays nothing, on a virtual clock, with the given decoder (which is copied).
+**/
+AudioOutput * AudioOutputCreateNull(const AudioOutputDecoder *decoder, uint32_t sampleRate)
+{
+	return CreateVirtual(&nullBackend, decoder, sampleRate);
+}
+
+/**
+ Creates an output that writes what it plays to a WAV file (16 bit stereo), on a virtual clock.
+ The file is complete once the output is freed. Returns NULL if the file can't be created.
+**/
+AudioOutput * AudioOutputCreateWAV(const char *path, const AudioOutputDecoder *decoder, uint32_t sampleRate)
+{
+	AudioOutput *output = CreateVirtual(&wavBackend, decoder, sampleRate);
+	if(output == NULL) return NULL;
+	
+	VirtualOutput *v = (VirtualOutput *)output->state;
+	
+	v->file = fopen(path, "wb");
+	if((v->file == NULL) || !WriteWAVHeader(v))
+	{
+		if(v->file != NULL) fclose(v->file);
+		v->file = NULL;
+		
+		VirtualFree(output);
+		return NULL;
+	}
+	
+	return output;
+}
@@ -0,0 +1,125 @@
+/**
+ Audio output, with pluggable backends.
+
+ Playing a sound used to mean creating a QTMovie, and playing it on the audio hardware, in real time.
+ None of the logic around it (looping, moving through a playlist, the Easy Wake ramp) could run without a Mac,
+ an audio device, and as much time as the audio lasts.
+
+ An AudioOutput plays one track at a time, with a volume, and optionally looping.
+ When the track ends (and isn't looping), a function given by the owner is called, which may open the next one.
+
+ There are three backends:
+ - QuickTime (see QTAudioOutput.h), which the application uses to actually play sounds.
+ - Null, which plays nothing, on a virtual clock.
+ - WAV, which writes what would be played to a WAV file (16 bit stereo), on a virtual clock.
+
+ The virtual clock only moves when the owner advances it (AudioOutputAdvance), so a few minutes of playback
+ take a few milliseconds. The virtual backends get their audio from a decoder given by the owner,
+ which can simulate files that are missing, slow to open, or slow to decode.
+ They also apply a gain ramp (see GainRamp.h), if one is set, to every sample, as the memory backend
+ (see MemoryAudioOutput.h) does for real.
+
+ All functions must be called from the same thread.
+**/
+
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#include <stdint.h>
+#include "GainRamp.h"
+
+// Channels of the audio rendered by the virtual backends (interleaved float samples)
+#define AUDIO_OUTPUT_CHANNELS  2
+
+typedef struct AudioOutput AudioOutput;
+
+// Called when the track has played to it's end (and isn't looping). May open and play another track.
+typedef void (*AudioOutputFinishedFunction)(void *context, AudioOutput *output);
+
+typedef struct AudioOutputBackend
+{
+	const char *name;
+	
+	int    (*open)(AudioOutput *output, const char *path);
+	void   (*close)(AudioOutput *output);
+	void   (*play)(AudioOutput *output);
+	void   (*stop)(AudioOutput *output);
+	int    (*isPlaying)(AudioOutput *output);
+	double (*duration)(AudioOutput *output);
+	double (*currentTime)(AudioOutput *output);
+	void   (*setCurrentTime)(AudioOutput *output, double time);
+	void   (*setVolume)(AudioOutput *output, float volume);
+	void   (*setLooping)(AudioOutput *output, int isLooping);
+	
+	// Only for backends that have the samples they play (NULL otherwise)
+	int    (*setRamp)(AudioOutput *output, GainRamp *ramp);
+	
+	// Only for backends with a virtual clock (NULL otherwise)
+	void   (*advance)(AudioOutput *output, double seconds);
+	
+	void   (*free)(AudioOutput *output);
+} AudioOutputBackend;
+
+struct AudioOutput
+{
+	const AudioOutputBackend *backend;
+	void *state;
+	
+	AudioOutputFinishedFunction finished;
+	void *context;
+};
+
+// Decodes the tracks played by the virtual backends
+typedef struct AudioOutputDecoder
+{
+	// Opens the file at the given path. Returns NULL if it can't be played.
+	// Sets the duration (in seconds), and how long opening it took (simulated, in seconds).
+	void *   (*open)(void *context, const char *path, uint32_t sampleRate, double *duration, double *latency);
+	
+	// Renders the next frames. Returns the number rendered, which is fewer than asked for
+	// either at the end of the track (isEnd is set), or if decoding couldn't keep up (an underrun).
+	uint32_t (*render)(void *context, void *handle, float *samples, uint32_t frames, int *isEnd);
+	
+	// Moves to the given time (in seconds)
+	void     (*seek)(void *context, void *handle, double time);
+	
+	void     (*close)(void *context, void *handle);
+	
+	void *context;
+} AudioOutputDecoder;
+
+// What the virtual backends have played
+typedef struct AudioOutputStats
+{
+	double   clock;            // Virtual time since the output was created
+	double   playedTime;       // Time spent playing tracks (including underruns)
+	double   underrunTime;     // Time spent playing, but without audio (slow decoding, or opening a track)
+	uint32_t underrunCount;
+	uint32_t tracksOpened;
+	uint32_t tracksFinished;
+	uint32_t loopsCompleted;
+} AudioOutputStats;
+
+AudioOutput * AudioOutputCreateNull(const AudioOutputDecoder *decoder, uint32_t sampleRate);
+AudioOutput * AudioOutputCreateWAV(const char *path, const AudioOutputDecoder *decoder, uint32_t sampleRate);
+void AudioOutputFree(AudioOutput *output);
+
+void AudioOutputSetFinishedFunction(AudioOutput *output, AudioOutputFinishedFunction finished, void *context);
+
+int    AudioOutputOpen(AudioOutput *output, const char *path);
+void   AudioOutputClose(AudioOutput *output);
+void   AudioOutputPlay(AudioOutput *output);
+void   AudioOutputStop(AudioOutput *output);
+int    AudioOutputIsPlaying(AudioOutput *output);
+double AudioOutputDuration(AudioOutput *output);
+double AudioOutputCurrentTime(AudioOutput *output);
+void   AudioOutputSetCurrentTime(AudioOutput *output, double time);
+void   AudioOutputSetVolume(AudioOutput *output, float volume);
+void   AudioOutputSetLooping(AudioOutput *output, int isLooping);
+
+int    AudioOutputIsVirtual(AudioOutput *output);
+void   AudioOutputAdvance(AudioOutput *output, double seconds);
+int    AudioOutputSetRamp(AudioOutput *output, GainRamp *ramp);
+int    AudioOutputGetStats(AudioOutput *output, AudioOutputStats *stats);
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ Small helpers shared by the benchmarks.
+**/
+
+#ifndef BENCHMARK_SUPPORT_H
+#define BENCHMARK_SUPPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/**
+ Returns the current time in seconds.
+**/
+static inline double BenchmarkTime(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/**
+ Returns the next number from a (deterministic) xorshift64* sequence.
+ The seed must not be zero.
+**/
+static inline uint64_t BenchmarkRandom(uint64_t *seed)
+{
+	uint64_t x = *seed;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*seed = x;
+	
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ Returns the peak resident size of the process so far, in bytes.
+**/
+static inline uint64_t BenchmarkPeakRSS(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	// Linux reports kilobytes
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+#endif
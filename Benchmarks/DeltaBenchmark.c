@@ -0,0 +1,229 @@
+/**
+ Measures the cost of reloading the iTunes library incrementally.
+
+ A library of N tracks is built, and then K of it's tracks are changed (a mix of updates, inserts and deletes).
+ The time to compute the delta (which must look at every track) and the time to apply it are reported separately.
+ Applying the delta should scale with K, not with N.
+
+ As in ITunesSharedLibrary, the delta is applied to a copy of the library (the current version is in use elsewhere).
+ The copy scales with N, but is only a handful of memcpy's, so it's reported separately as well.
+
+ Every run is verified against the updated library, so this doubles as a check of the delta code.
+**/
+
+#include "BenchmarkSupport.h"
+#include "ITunesDelta.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct TrackSpec
+{
+	int32_t  trackID;
+	uint64_t persistentID;
+	uint32_t revision;
+} TrackSpec;
+
+#define PLAYLIST_COUNT  20
+
+/**
+ Builds a library from the given track specs.
+ The first playlist is the master library (every track), followed by playlists containing every n-th track.
+**/
+static ITunesLibrary * BuildLibrary(const TrackSpec *specs, uint32_t count)
+{
+	ITunesLibrary *lib = ITunesLibraryCreate();
+	char buffer[256];
+	uint32_t i, p;
+
+	for(i = 0; i < count; i++)
+	{
+		ITunesTrack *track = ITunesLibraryAddTrack(lib);
+		track->trackID = specs[i].trackID;
+		track->persistentID = specs[i].persistentID;
+		track->totalTime = 180000 + (int32_t)(specs[i].persistentID % 120000);
+		track->flags = ITUNES_TRACK_FILE;
+
+		int length = snprintf(buffer, sizeof(buffer), "Track %u rev %u", (unsigned)specs[i].trackID, specs[i].revision);
+		track->name = ITunesLibraryAddString(lib, buffer, length);
+
+		length = snprintf(buffer, sizeof(buffer), "Artist %u", (unsigned)(specs[i].persistentID % 997));
+		track->artist = ITunesLibraryAddString(lib, buffer, length);
+
+		length = snprintf(buffer, sizeof(buffer), "Album %u", (unsigned)(specs[i].persistentID % 4999));
+		track->album = ITunesLibraryAddString(lib, buffer, length);
+
+		length = snprintf(buffer, sizeof(buffer), "file://localhost/Music/%016llX.m4a",
+		                  (unsigned long long)specs[i].persistentID);
+		track->location = ITunesLibraryAddString(lib, buffer, length);
+	}
+
+	for(p = 0; p < PLAYLIST_COUNT; p++)
+	{
+		ITunesPlaylist *playlist = ITunesLibraryAddPlaylist(lib);
+		playlist->playlistID = 1000000 + p;
+		playlist->persistentID = 0xABCD000000000000ULL + p;
+		playlist->flags = (p == 0) ? ITUNES_PLAYLIST_MASTER : 0;
+
+		int length = snprintf(buffer, sizeof(buffer), "Playlist %u", p);
+		playlist->name = ITunesLibraryAddString(lib, buffer, length);
+
+		uint32_t itemsOffset = lib->itemsCount;
+		for(i = 0; i < count; i++)
+		{
+			if((p == 0) || ((specs[i].persistentID % (p + 1)) == 0))
+			{
+				ITunesLibraryAddItem(lib, specs[i].trackID);
+			}
+		}
+
+		// Adding items may have moved the playlists array, so look the record up again
+		lib->playlists[p].itemsOffset = itemsOffset;
+		lib->playlists[p].itemsCount = lib->itemsCount - itemsOffset;
+	}
+
+	ITunesLibraryFinish(lib);
+	return lib;
+}
+
+/**
+ Applies K random changes to the specs: one third updates, one third deletes, one third inserts.
+**/
+static TrackSpec * MutateSpecs(const TrackSpec *specs, uint32_t count, uint32_t changes, uint32_t *newCount,
+                               int32_t *nextTrackID, uint64_t *seed)
+{
+	TrackSpec *result = malloc((count + changes + 1) * sizeof(TrackSpec));
+	memcpy(result, specs, count * sizeof(TrackSpec));
+
+	uint32_t n = count;
+	uint32_t i;
+	for(i = 0; i < changes; i++)
+	{
+		uint32_t index = (uint32_t)(BenchmarkRandom(seed) % n);
+
+		switch(i % 3)
+		{
+			case 0:
+				result[index].revision++;
+				break;
+			case 1:
+				result[index] = result[--n];
+				break;
+			default:
+				result[n].trackID = (*nextTrackID)++;
+				result[n].persistentID = BenchmarkRandom(seed);
+				result[n].revision = 0;
+				n++;
+				break;
+		}
+	}
+
+	*newCount = n;
+	return result;
+}
+
+/**
+ Verifies the updated library contains exactly the same tracks and playlists as the source.
+**/
+static int Verify(const ITunesLibrary *lib, const ITunesLibrary *source)
+{
+	if(lib->tracksCount != source->tracksCount) return 0;
+	if(lib->playlistsCount != source->playlistsCount) return 0;
+
+	uint32_t i;
+	for(i = 0; i < source->tracksCount; i++)
+	{
+		const ITunesTrack *a = &source->tracks[i];
+		const ITunesTrack *b = ITunesLibraryTrackForPersistentID(lib, a->persistentID);
+
+		if((b == NULL) || (b->trackID != a->trackID)) return 0;
+		if(ITunesLibraryTrackForID(lib, a->trackID) != b) return 0;
+		if(strcmp(ITunesLibraryString(lib, b->name), ITunesLibraryString(source, a->name)) != 0) return 0;
+	}
+	for(i = 0; i < source->playlistsCount; i++)
+	{
+		const ITunesPlaylist *a = &source->playlists[i];
+		const ITunesPlaylist *b = &lib->playlists[i];
+
+		if((a->persistentID != b->persistentID) || (a->itemsCount != b->itemsCount)) return 0;
+		if(memcmp(source->items + a->itemsOffset, lib->items + b->itemsOffset, a->itemsCount * sizeof(int32_t)) != 0)
+		{
+			return 0;
+		}
+		if(ITunesLibraryPlaylistIndexForPersistentID(lib, a->persistentID) != (int32_t)i) return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t sizes[] = { 10000, 100000 };
+	uint32_t changes[] = { 1, 10, 100, 1000, 10000 };
+	int repeat = (argc > 1) ? atoi(argv[1]) : 5;
+
+	printf("%10s %8s %12s %12s %12s %8s\n", "tracks", "changes", "diff (ms)", "copy (ms)", "apply (ms)", "ok");
+
+	unsigned s, c;
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		uint32_t count = sizes[s];
+		uint64_t seed = 42;
+
+		TrackSpec *specs = malloc(count * sizeof(TrackSpec));
+		uint32_t i;
+		for(i = 0; i < count; i++)
+		{
+			specs[i].trackID = (int32_t)(i + 1);
+			specs[i].persistentID = BenchmarkRandom(&seed);
+			specs[i].revision = 0;
+		}
+		int32_t nextTrackID = (int32_t)count + 1;
+
+		for(c = 0; c < sizeof(changes) / sizeof(changes[0]); c++)
+		{
+			if(changes[c] > count / 2) continue;
+
+			double diffTime = 0, copyTime = 0, applyTime = 0;
+			int ok = 1;
+			int r;
+			for(r = 0; r < repeat; r++)
+			{
+				uint32_t newCount;
+				TrackSpec *newSpecs = MutateSpecs(specs, count, changes[c], &newCount, &nextTrackID, &seed);
+
+				ITunesLibrary *lib = BuildLibrary(specs, count);
+				ITunesLibrary *source = BuildLibrary(newSpecs, newCount);
+
+				double start = BenchmarkTime();
+				ITunesDelta *delta = ITunesDeltaCreate(lib, source);
+				double diffed = BenchmarkTime();
+				ITunesLibrary *copy = ITunesLibraryCopy(lib);
+				double copied = BenchmarkTime();
+				ok = ok && (copy != NULL) && ITunesDeltaApply(delta, copy);
+				double end = BenchmarkTime();
+
+				diffTime += diffed - start;
+				copyTime += copied - diffed;
+				applyTime += end - copied;
+				
+				ok = ok && Verify(copy, source);
+				
+				ITunesDeltaFree(delta);
+				ITunesLibraryFree(copy);
+				ITunesLibraryFree(lib);
+				ITunesLibraryFree(source);
+				free(newSpecs);
+			}
+
+			printf("%10u %8u %12.3f %12.3f %12.3f %8s\n", count, changes[c], diffTime * 1000.0 / repeat,
+			       copyTime * 1000.0 / repeat, applyTime * 1000.0 / repeat, ok ? "yes" : "FAILED");
+
+			if(!ok) return 1;
+		}
+
+		free(specs);
+	}
+
+	return 0;
+}
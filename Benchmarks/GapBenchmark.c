@@ -0,0 +1,617 @@
+/**
+ Measures the gap between tracks when playing a playlist, with and without the look-ahead queue (ITunesPrefetch).
+
+ A playlist of short tracks (WAV files with a tone each) is written to a temporary directory.
+ Every few entries of the playlist point to a missing file, as happens when files are moved or deleted.
+
+ The work is split between the threads the same way ITunesPlayer splits it:
+ - The look-ahead thread only checks the upcoming files, with the player's own ITunesPrefetchCheckFile
+   (a stat, and a read of the start of the file).
+ - The main thread opens the movie of a track, which is where QuickTime decodes and prerolls it.
+   This is the slow part, and it's charged on the main thread, as a fixed delay plus reading the whole file.
+ - A device thread plays the current track on it's own, as QuickTime does once a movie is started.
+   When the track ends, it tells the main thread, which starts the next one (see movieFinished:).
+
+ The device thread plays into a file based audio sink, which behaves like a sound card:
+ it consumes samples in real time, from a small buffer. Whenever the buffer isn't kept filled,
+ the sink plays (and writes) silence, which is the audible gap between tracks.
+
+ - synchronous: the next movie is opened when the current track has ended, as ITunesPlayer used to do
+ - prefetch: the next entries are checked in the background, skipping the missing files,
+   and the movie of the next playable one is opened on the main thread while the current track plays
+   (the app waits a second after the track starts before doing so, which is left out here, as the tracks are short)
+
+ Usage: GapBenchmark [-n tracks] [-l length] [-d delay] [-m missing] [-p depth] [-o directory]
+   -n tracks     number of entries in the playlist (default 20)
+   -l length     length of each track, in ms (default 250)
+   -d delay      time it takes to open and preroll a movie on the main thread, in ms (default 40)
+   -m missing    every m-th entry is a missing file (default 4, 0 for none)
+   -p depth      number of entries the look-ahead queue holds (default 3)
+   -o directory  keeps the rendered WAV files in the given directory
+**/
+
+#include "BenchmarkSupport.h"
+#include "ITunesPrefetch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SAMPLE_RATE     44100
+#define CHANNELS        2
+
+// The player writes this many frames at a time, and the sink buffers up to DEVICE_FRAMES frames (about 23 ms)
+#define WRITE_FRAMES    512
+#define DEVICE_FRAMES   1024
+
+static int openDelay = 40;
+
+// WAV FILES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void WriteLE32(unsigned char *p, uint32_t value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t ReadLE32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ Writes the header of a 16 bit PCM WAV file with the given number of frames.
+**/
+static void WriteWAVHeader(FILE *file, uint32_t frames)
+{
+	unsigned char header[44];
+	uint32_t dataSize = frames * CHANNELS * 2;
+	
+	memcpy(header, "RIFF", 4);
+	WriteLE32(header + 4, 36 + dataSize);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	WriteLE32(header + 16, 16);
+	header[20] = 1; header[21] = 0;                  // PCM
+	header[22] = CHANNELS; header[23] = 0;
+	WriteLE32(header + 24, SAMPLE_RATE);
+	WriteLE32(header + 28, SAMPLE_RATE * CHANNELS * 2);
+	header[32] = CHANNELS * 2; header[33] = 0;       // Bytes per frame
+	header[34] = 16; header[35] = 0;                 // Bits per sample
+	memcpy(header + 36, "data", 4);
+	WriteLE32(header + 40, dataSize);
+	
+	fwrite(header, sizeof(header), 1, file);
+}
+
+static int WriteToneFile(const char *path, double frequency, uint32_t frames)
+{
+	FILE *file = fopen(path, "wb");
+	if(file == NULL) return 0;
+	
+	WriteWAVHeader(file, frames);
+	
+	uint32_t i;
+	for(i = 0; i < frames; i++)
+	{
+		int16_t sample = (int16_t)(8000.0 * sin(2.0 * M_PI * frequency * i / SAMPLE_RATE));
+		unsigned char bytes[4] = { sample & 0xFF, (sample >> 8) & 0xFF, sample & 0xFF, (sample >> 8) & 0xFF };
+		fwrite(bytes, sizeof(bytes), 1, file);
+	}
+	
+	return (fclose(file) == 0);
+}
+
+// TRACKS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct Track
+{
+	unsigned char *data;
+	uint32_t frames;
+} Track;
+
+static void CloseTrack(void *context, void *handle)
+{
+	Track *track = (Track *)handle;
+	
+	free(track->data);
+	free(track);
+}
+
+/**
+ Opens (and reads) a WAV file, taking the configured delay once the file is found. Returns 1 if it's playable.
+ This stands in for opening and prerolling a movie, so it's always called on the main thread.
+ A missing file fails right away, as QuickTime does.
+**/
+static int OpenTrack(void *context, const char *path, void **handle)
+{
+	FILE *file = fopen(path, "rb");
+	if(file == NULL) return 0;
+	
+	usleep(openDelay * 1000);
+	
+	unsigned char header[44];
+	Track *track = NULL;
+	
+	if((fread(header, sizeof(header), 1, file) == 1) && (memcmp(header, "RIFF", 4) == 0) &&
+	   (memcmp(header + 36, "data", 4) == 0))
+	{
+		uint32_t dataSize = ReadLE32(header + 40);
+		
+		track = malloc(sizeof(Track));
+		if(track != NULL)
+		{
+			track->data = malloc(dataSize);
+			track->frames = dataSize / (CHANNELS * 2);
+			
+			if((track->data == NULL) || (fread(track->data, dataSize, 1, file) != 1))
+			{
+				CloseTrack(NULL, track);
+				track = NULL;
+			}
+		}
+	}
+	fclose(file);
+	
+	*handle = track;
+	return (track != NULL);
+}
+
+// AUDIO SINK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ A sound card that writes what it plays to a WAV file.
+ It plays SAMPLE_RATE frames per second (of real time) from the moment the first frame is written,
+ and buffers at most DEVICE_FRAMES frames ahead of what it has played.
+**/
+typedef struct FileSink
+{
+	FILE *file;
+	double startTime;
+	uint64_t written;         // Frames written to the file, including silence
+	uint64_t silentFrames;    // Frames of silence played because the buffer ran empty
+} FileSink;
+
+static int SinkOpen(FileSink *sink, const char *path)
+{
+	sink->file = fopen(path, "wb");
+	sink->startTime = 0;
+	sink->written = 0;
+	sink->silentFrames = 0;
+	
+	if(sink->file == NULL) return 0;
+	
+	WriteWAVHeader(sink->file, 0);
+	return 1;
+}
+
+static uint64_t SinkPlayedFrames(FileSink *sink)
+{
+	return (uint64_t)((BenchmarkTime() - sink->startTime) * SAMPLE_RATE);
+}
+
+/**
+ Writes frames to the sink, blocking while it's buffer is full.
+ Returns the number of silent frames the sink played since the previous write (because the buffer ran empty).
+**/
+static uint64_t SinkWrite(FileSink *sink, const unsigned char *data, uint32_t frames)
+{
+	uint64_t silence = 0;
+	
+	if(sink->written == 0)
+	{
+		sink->startTime = BenchmarkTime();
+	}
+	else
+	{
+		uint64_t played = SinkPlayedFrames(sink);
+		if(played > sink->written)
+		{
+			// Underrun: the card played silence, so the file gets it too, and the clock carries on from there
+			static const unsigned char zeros[WRITE_FRAMES * CHANNELS * 2];
+			
+			silence = played - sink->written;
+			
+			uint64_t remaining = silence;
+			while(remaining > 0)
+			{
+				uint32_t count = (remaining > WRITE_FRAMES) ? WRITE_FRAMES : (uint32_t)remaining;
+				fwrite(zeros, CHANNELS * 2, count, sink->file);
+				remaining -= count;
+			}
+			sink->written += silence;
+			sink->silentFrames += silence;
+		}
+		
+		while(sink->written > SinkPlayedFrames(sink) + DEVICE_FRAMES)
+		{
+			usleep(1000);
+		}
+	}
+	
+	fwrite(data, CHANNELS * 2, frames, sink->file);
+	sink->written += frames;
+	
+	return silence;
+}
+
+static void SinkClose(FileSink *sink)
+{
+	fseek(sink->file, 0, SEEK_SET);
+	WriteWAVHeader(sink->file, (uint32_t)sink->written);
+	fclose(sink->file);
+}
+
+// TRACK PLAYBACK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct Gaps
+{
+	double times[1024];
+	int count;
+} Gaps;
+
+/**
+ Writes the track to the sink, and records the silence before it's first frame (the gap), unless it's the first track.
+**/
+static void PlayTrack(FileSink *sink, Track *track, Gaps *gaps)
+{
+	uint32_t frame;
+	for(frame = 0; frame < track->frames; frame += WRITE_FRAMES)
+	{
+		uint32_t count = (track->frames - frame > WRITE_FRAMES) ? WRITE_FRAMES : (track->frames - frame);
+		uint64_t silence = SinkWrite(sink, track->data + frame * CHANNELS * 2, count);
+		
+		if((frame == 0) && (sink->written > count + silence) && (gaps->count < 1024))
+		{
+			gaps->times[gaps->count++] = (double)silence / SAMPLE_RATE;
+		}
+	}
+}
+
+// DEVICE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Plays tracks on it's own thread, one at a time, as QuickTime plays a started movie.
+ The main thread hands it the next track once the current one has ended.
+**/
+typedef struct Device
+{
+	FileSink *sink;
+	Gaps *gaps;
+	
+	Track *track;       // Handed over by the main thread, until the device thread starts playing it
+	int isPlaying;
+	int shouldQuit;
+	
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+} Device;
+
+static void * DeviceThread(void *arg)
+{
+	Device *device = (Device *)arg;
+	
+	pthread_mutex_lock(&device->mutex);
+	
+	while(1)
+	{
+		while((device->track == NULL) && !device->shouldQuit)
+		{
+			pthread_cond_wait(&device->changed, &device->mutex);
+		}
+		if(device->track == NULL) break;
+		
+		Track *track = device->track;
+		device->track = NULL;
+		device->isPlaying = 1;
+		
+		pthread_mutex_unlock(&device->mutex);
+		
+		PlayTrack(device->sink, track, device->gaps);
+		CloseTrack(NULL, track);
+		
+		pthread_mutex_lock(&device->mutex);
+		
+		device->isPlaying = 0;
+		pthread_cond_broadcast(&device->changed);
+	}
+	
+	pthread_mutex_unlock(&device->mutex);
+	return NULL;
+}
+
+static int DeviceStart(Device *device, FileSink *sink, Gaps *gaps)
+{
+	device->sink = sink;
+	device->gaps = gaps;
+	device->track = NULL;
+	device->isPlaying = 0;
+	device->shouldQuit = 0;
+	
+	pthread_mutex_init(&device->mutex, NULL);
+	pthread_cond_init(&device->changed, NULL);
+	
+	return (pthread_create(&device->thread, NULL, DeviceThread, device) == 0);
+}
+
+/**
+ Waits until the current track (if any) has ended.
+**/
+static void DeviceWait(Device *device)
+{
+	pthread_mutex_lock(&device->mutex);
+	
+	while(device->isPlaying || (device->track != NULL))
+	{
+		pthread_cond_wait(&device->changed, &device->mutex);
+	}
+	
+	pthread_mutex_unlock(&device->mutex);
+}
+
+/**
+ Waits until the current track (if any) has ended, and starts the given one.
+**/
+static void DevicePlay(Device *device, Track *track)
+{
+	pthread_mutex_lock(&device->mutex);
+	
+	while(device->isPlaying || (device->track != NULL))
+	{
+		pthread_cond_wait(&device->changed, &device->mutex);
+	}
+	
+	device->track = track;
+	pthread_cond_broadcast(&device->changed);
+	
+	pthread_mutex_unlock(&device->mutex);
+}
+
+static void DeviceStop(Device *device)
+{
+	DeviceWait(device);
+	
+	pthread_mutex_lock(&device->mutex);
+	device->shouldQuit = 1;
+	pthread_cond_broadcast(&device->changed);
+	pthread_mutex_unlock(&device->mutex);
+	
+	pthread_join(device->thread, NULL);
+	
+	pthread_cond_destroy(&device->changed);
+	pthread_mutex_destroy(&device->mutex);
+}
+
+// PLAYER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Plays the playlist, opening the movie of each entry on the main thread once the previous track has ended.
+**/
+static void PlaySynchronously(char **paths, int count, Device *device)
+{
+	int i;
+	for(i = 0; i < count; i++)
+	{
+		DeviceWait(device);
+		
+		void *handle = NULL;
+		if(OpenTrack(NULL, paths[i], &handle))
+		{
+			DevicePlay(device, (Track *)handle);
+		}
+	}
+}
+
+/**
+ Opens the movie of the next playable entry on the main thread, taking the entries the look-ahead queue has checked,
+ and keeping the queue filled. Returns NULL once the playlist is over.
+**/
+static Track * PrepareUpcomingTrack(ITunesPrefetch *prefetch, char **paths, int count, int *nextEntry)
+{
+	while(1)
+	{
+		while((*nextEntry < count) && ITunesPrefetchAdd(prefetch, *nextEntry, paths[*nextEntry]))
+		{
+			(*nextEntry)++;
+		}
+		
+		int32_t entry;
+		if(ITunesPrefetchTake(prefetch, 1, &entry, NULL) != ITUNES_PREFETCH_READY)
+		{
+			if(*nextEntry < count) continue;
+			return NULL;
+		}
+		
+		// Keep checking the entries after this one, while it's movie is opened
+		while((*nextEntry < count) && ITunesPrefetchAdd(prefetch, *nextEntry, paths[*nextEntry]))
+		{
+			(*nextEntry)++;
+		}
+		
+		void *handle = NULL;
+		if(OpenTrack(NULL, paths[entry], &handle))
+		{
+			return (Track *)handle;
+		}
+	}
+}
+
+/**
+ Plays the playlist, opening the movie of the next track while the current one plays,
+ and starting it as soon as the current one has ended.
+**/
+static void PlayWithPrefetch(char **paths, int count, uint32_t depth, Device *device)
+{
+	ITunesPrefetch *prefetch = ITunesPrefetchCreate(depth, ITunesPrefetchCheckFile, NULL, NULL);
+	int nextEntry = 0;
+	
+	Track *upcoming = PrepareUpcomingTrack(prefetch, paths, count, &nextEntry);
+	
+	while(upcoming != NULL)
+	{
+		DevicePlay(device, upcoming);
+		
+		upcoming = PrepareUpcomingTrack(prefetch, paths, count, &nextEntry);
+	}
+	
+	ITunesPrefetchFree(prefetch);
+}
+
+// BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static void PrintGaps(const char *label, Gaps *gaps, double elapsed)
+{
+	double total = 0;
+	int i;
+	for(i = 0; i < gaps->count; i++)
+	{
+		total += gaps->times[i];
+	}
+	
+	if(gaps->count == 0)
+	{
+		printf("  %-12s no track changes\n", label);
+		return;
+	}
+	qsort(gaps->times, gaps->count, sizeof(double), CompareDoubles);
+	
+	printf("  %-12s %2d track changes, gap mean %6.1f  p50 %6.1f  max %6.1f ms  (total silence %6.1f ms, played in %.2f s)\n",
+	       label, gaps->count, total * 1000.0 / gaps->count, gaps->times[gaps->count / 2] * 1000.0,
+	       gaps->times[gaps->count - 1] * 1000.0, total * 1000.0, elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+	int tracksCount = 20;
+	int trackLength = 250;
+	int missingEvery = 4;
+	uint32_t depth = 3;
+	const char *outputDirectory = NULL;
+	
+	int c;
+	while((c = getopt(argc, argv, "n:l:d:m:p:o:")) != -1)
+	{
+		switch(c)
+		{
+			case 'n': tracksCount = atoi(optarg); break;
+			case 'l': trackLength = atoi(optarg); break;
+			case 'd': openDelay = atoi(optarg); break;
+			case 'm': missingEvery = atoi(optarg); break;
+			case 'p': depth = (uint32_t)atoi(optarg); break;
+			case 'o': outputDirectory = optarg; break;
+			default:
+				printf("Usage: %s [-n tracks] [-l length] [-d delay] [-m missing] [-p depth] [-o directory]\n", argv[0]);
+				return 1;
+		}
+	}
+	
+	if((tracksCount <= 0) || (tracksCount > 1000) || (trackLength <= 0) || (openDelay < 0) || (depth == 0))
+	{
+		printf("Invalid options\n");
+		return 1;
+	}
+	
+	const char *tmp = getenv("TMPDIR");
+	char directory[1024];
+	snprintf(directory, sizeof(directory), "%s/GapBenchmark.XXXXXX", (tmp != NULL) ? tmp : "/tmp");
+	if(mkdtemp(directory) == NULL)
+	{
+		printf("Unable to create a temporary directory\n");
+		return 1;
+	}
+	
+	char **paths = calloc(tracksCount, sizeof(char *));
+	uint32_t frames = (uint32_t)(((uint64_t)trackLength * SAMPLE_RATE) / 1000);
+	int missingCount = 0;
+	int i;
+	
+	for(i = 0; i < tracksCount; i++)
+	{
+		paths[i] = malloc(1100);
+		snprintf(paths[i], 1100, "%s/Track %02d.wav", directory, i + 1);
+		
+		if((missingEvery > 0) && ((i % missingEvery) == missingEvery - 1))
+		{
+			missingCount++;
+			continue;
+		}
+		
+		if(!WriteToneFile(paths[i], 220.0 * (1 + (i % 4)), frames))
+		{
+			printf("Unable to write %s\n", paths[i]);
+			return 1;
+		}
+	}
+	
+	printf("%d entries (%d missing) of %d ms, %d ms to open a movie, look-ahead of %u entries\n",
+	       tracksCount, missingCount, trackLength, openDelay, depth);
+	
+	const char *modes[] = { "synchronous", "prefetch" };
+	int mode;
+	for(mode = 0; mode < 2; mode++)
+	{
+		char outputPath[1100];
+		snprintf(outputPath, sizeof(outputPath), "%s/%s.wav",
+		         (outputDirectory != NULL) ? outputDirectory : directory, modes[mode]);
+		
+		FileSink sink;
+		if(!SinkOpen(&sink, outputPath))
+		{
+			printf("Unable to write %s\n", outputPath);
+			return 1;
+		}
+		
+		Gaps gaps;
+		gaps.count = 0;
+		
+		Device device;
+		if(!DeviceStart(&device, &sink, &gaps))
+		{
+			printf("Unable to start the device thread\n");
+			return 1;
+		}
+		
+		double start = BenchmarkTime();
+		if(mode == 0)
+			PlaySynchronously(paths, tracksCount, &device);
+		else
+			PlayWithPrefetch(paths, tracksCount, depth, &device);
+		DeviceStop(&device);
+		double elapsed = BenchmarkTime() - start;
+		
+		SinkClose(&sink);
+		PrintGaps(modes[mode], &gaps, elapsed);
+		
+		if(outputDirectory == NULL) unlink(outputPath);
+	}
+	
+	for(i = 0; i < tracksCount; i++)
+	{
+		unlink(paths[i]);
+		free(paths[i]);
+	}
+	free(paths);
+	rmdir(directory);
+	
+	return 0;
+}
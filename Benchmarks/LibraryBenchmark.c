@@ -0,0 +1,553 @@
+/**
+ Measures loading and using a whole library xml file, the way the application does on startup.
+
+ Synthetic libraries are generated (see LibraryGenerator.h) for each requested number of tracks,
+ written to a temporary file, and then measured in a fresh process, so peak memory use is per library:
+
+ - parsing the xml file (time, throughput and peak resident size)
+ - validating stored track and playlist IDs against their persistent IDs, as alarms do when they fire,
+   when the ID is still current, when it has gone stale, and when the item no longer exists
+ - searching the library view while typing (scan and trigram index latency percentiles)
+
+ Everything is checked to produce the expected results.
+ No iTunes, Cocoa or GUI is needed; this runs as is on Linux.
+
+ Usage: LibraryBenchmark [options]
+   -t tracks[,tracks...]  number of tracks of each library (default 1000,10000,100000)
+   -p playlists           number of user playlists (default 200)
+   -s smart               number of those that are smart playlists (default 40)
+   -d depth               deepest level of nested folders (default 3, 0 for none)
+   -l short|mixed|long    distribution of name lengths (default mixed)
+   -r seed                seed of the generated libraries (default 42)
+   -w file                only writes the (first) generated library to the given file
+   -f file                measures the given library file instead of generated ones
+**/
+
+#include "BenchmarkSupport.h"
+#include "LibraryGenerator.h"
+#include "ITunesParser.h"
+#include "ITunesTrigram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_SIZES          16
+#define VALIDATION_COUNT   200000
+#define QUERY_COUNT        500
+#define MAX_QUERY_LENGTH   6
+
+#define MB(bytes)  ((bytes) / (1024.0 * 1024.0))
+
+static int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static void PrintPercentiles(const char *label, double *times, int count)
+{
+	qsort(times, count, sizeof(double), CompareDoubles);
+	
+	printf("  %-22s p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n", label,
+	       times[count / 2] * 1000.0, times[(count * 90) / 100] * 1000.0,
+	       times[(count * 99) / 100] * 1000.0, times[count - 1] * 1000.0);
+}
+
+// VALIDATION
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// A stored reference to a track or playlist, as an alarm keeps it (the persistent ID is stored as a hex string)
+typedef struct StoredID
+{
+	int32_t id;
+	int32_t expected;
+	char persistentID[17];
+} StoredID;
+
+/**
+ Same as -[ITunesData validateTrackID:withPersistentTrackID:]
+**/
+static int32_t ValidateTrackID(const ITunesLibrary *lib, int32_t trackID, const char *persistentTrackID)
+{
+	uint64_t persistentID = ITunesParsePersistentID(persistentTrackID, strlen(persistentTrackID));
+	
+	const ITunesTrack *track = ITunesLibraryTrackForID(lib, trackID);
+	if((track != NULL) && (track->persistentID == persistentID))
+	{
+		return trackID;
+	}
+	
+	track = ITunesLibraryTrackForPersistentID(lib, persistentID);
+	return (track != NULL) ? track->trackID : -1;
+}
+
+/**
+ Same as -[ITunesData validatePlaylistID:withPersistentPlaylistID:]
+**/
+static int32_t ValidatePlaylistID(const ITunesLibrary *lib, int32_t playlistID, const char *persistentPlaylistID)
+{
+	uint64_t persistentID = ITunesParsePersistentID(persistentPlaylistID, strlen(persistentPlaylistID));
+	
+	int32_t playlistIndex = ITunesLibraryPlaylistIndexForID(lib, playlistID);
+	if((playlistIndex >= 0) && (lib->playlists[playlistIndex].persistentID == persistentID))
+	{
+		return playlistID;
+	}
+	
+	playlistIndex = ITunesLibraryPlaylistIndexForPersistentID(lib, persistentID);
+	return (playlistIndex >= 0) ? lib->playlists[playlistIndex].playlistID : -1;
+}
+
+typedef enum StoredIDState
+{
+	StoredIDCurrent = 0,
+	StoredIDStale,
+	StoredIDMissing
+} StoredIDState;
+
+/**
+ Fills the given array with references to random tracks (or playlists) of the library.
+ Stale references carry the ID of another item, missing references a persistent ID that isn't in the library.
+**/
+static void MakeStoredIDs(const ITunesLibrary *lib, int playlists, StoredIDState state,
+                          StoredID *stored, uint32_t count, uint64_t *seed)
+{
+	uint32_t itemsCount = playlists ? lib->playlistsCount : lib->tracksCount;
+	uint32_t i;
+	
+	for(i = 0; i < count; i++)
+	{
+		uint32_t index = (uint32_t)(BenchmarkRandom(seed) % itemsCount);
+		uint32_t other = (uint32_t)(BenchmarkRandom(seed) % itemsCount);
+		if((other == index) && (itemsCount > 1)) other = (index + 1) % itemsCount;
+		
+		int32_t id = playlists ? lib->playlists[index].playlistID : lib->tracks[index].trackID;
+		int32_t otherID = playlists ? lib->playlists[other].playlistID : lib->tracks[other].trackID;
+		uint64_t persistentID = playlists ? lib->playlists[index].persistentID : lib->tracks[index].persistentID;
+		
+		stored[i].id = id;
+		stored[i].expected = id;
+		
+		if(state == StoredIDStale)
+		{
+			stored[i].id = otherID;
+		}
+		else if(state == StoredIDMissing)
+		{
+			persistentID = BenchmarkRandom(seed);
+			stored[i].expected = -1;
+		}
+		
+		ITunesFormatPersistentID(persistentID, stored[i].persistentID);
+	}
+}
+
+/**
+ Validates the stored references, and returns the time taken per reference (in seconds), or -1 if any result is wrong.
+**/
+static double TimeValidation(const ITunesLibrary *lib, int playlists, const StoredID *stored, uint32_t count)
+{
+	uint32_t wrong = 0;
+	uint32_t i;
+	
+	double start = BenchmarkTime();
+	for(i = 0; i < count; i++)
+	{
+		int32_t result;
+		if(playlists)
+			result = ValidatePlaylistID(lib, stored[i].id, stored[i].persistentID);
+		else
+			result = ValidateTrackID(lib, stored[i].id, stored[i].persistentID);
+		
+		wrong += (result != stored[i].expected);
+	}
+	double elapsed = BenchmarkTime() - start;
+	
+	return (wrong == 0) ? (elapsed / count) : -1;
+}
+
+static int MeasureValidation(const ITunesLibrary *lib, uint64_t *seed)
+{
+	const char *labels[] = { "current", "stale", "missing" };
+	StoredID *stored = malloc(VALIDATION_COUNT * sizeof(StoredID));
+	int playlists;
+	
+	if(stored == NULL) return 0;
+	
+	for(playlists = 0; playlists <= 1; playlists++)
+	{
+		if((playlists ? lib->playlistsCount : lib->tracksCount) == 0) continue;
+		
+		printf(" %s ID validation:", playlists ? "Playlist" : "Track");
+		
+		int state;
+		for(state = StoredIDCurrent; state <= StoredIDMissing; state++)
+		{
+			MakeStoredIDs(lib, playlists, state, stored, VALIDATION_COUNT, seed);
+			
+			double perID = TimeValidation(lib, playlists, stored, VALIDATION_COUNT);
+			if(perID < 0)
+			{
+				printf("\nWrong %s %s ID validation results\n", labels[state], playlists ? "playlist" : "track");
+				free(stored);
+				return 0;
+			}
+			printf("  %s %.0f ns", labels[state], perID * 1000000000.0);
+		}
+		printf("\n");
+	}
+	
+	free(stored);
+	return 1;
+}
+
+// SEARCH
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Picks a query, as typed into the search field: the start of a word (or substring) of a track's name, artist or album.
+ Queries don't contain spaces. Returns the length of the query.
+**/
+static size_t MakeQuery(const ITunesSearchCorpus *corpus, const int32_t *rows, uint32_t count,
+                        size_t wantedLength, char *query, uint64_t *seed)
+{
+	int attempt;
+	for(attempt = 0; attempt < 100; attempt++)
+	{
+		const ITunesSearchColumn *column = &corpus->columns[BenchmarkRandom(seed) % ITUNES_SEARCH_COLUMN_COUNT];
+		uint32_t row = (uint32_t)rows[BenchmarkRandom(seed) % count];
+		
+		const char *text = column->blob + column->offsets[row];
+		size_t textLength = strlen(text);
+		
+		if(textLength < wantedLength) continue;
+		
+		size_t offset = BenchmarkRandom(seed) % (textLength - wantedLength + 1);
+		if(memchr(text + offset, ' ', wantedLength)) continue;
+		
+		memcpy(query, text + offset, wantedLength);
+		query[wantedLength] = '\0';
+		return wantedLength;
+	}
+	
+	// Every name is shorter than that, so use a single letter that is bound to be found
+	query[0] = 'a';
+	query[1] = '\0';
+	return 1;
+}
+
+static int MeasureSearch(const ITunesLibrary *lib, uint64_t *seed)
+{
+	// The library view shows the master playlist
+	const ITunesPlaylist *master = NULL;
+	uint32_t i;
+	for(i = 0; i < lib->playlistsCount; i++)
+	{
+		if(lib->playlists[i].flags & ITUNES_PLAYLIST_MASTER)
+		{
+			master = &lib->playlists[i];
+			break;
+		}
+	}
+	
+	uint32_t count = 0;
+	int32_t *rows = malloc((lib->tracksCount + 1) * sizeof(int32_t));
+	int32_t *scanResult = malloc((lib->tracksCount + 1) * sizeof(int32_t));
+	int32_t *indexResult = malloc((lib->tracksCount + 1) * sizeof(int32_t));
+	double *scanTimes = malloc(QUERY_COUNT * sizeof(double));
+	double *indexTimes = malloc(QUERY_COUNT * sizeof(double));
+	int result = 0;
+	
+	if(!rows || !scanResult || !indexResult || !scanTimes || !indexTimes) goto done;
+	
+	if(master != NULL)
+	{
+		for(i = 0; i < master->itemsCount; i++)
+		{
+			const ITunesTrack *track = ITunesLibraryTrackForID(lib, lib->items[master->itemsOffset + i]);
+			if(track != NULL) rows[count++] = (int32_t)(track - lib->tracks);
+		}
+	}
+	else
+	{
+		for(i = 0; i < lib->tracksCount; i++)
+		{
+			rows[count++] = (int32_t)i;
+		}
+	}
+	
+	if(count == 0)
+	{
+		result = 1;
+		goto done;
+	}
+	
+	double start = BenchmarkTime();
+	ITunesSearchCorpus *corpus = ITunesSearchCorpusCreate(lib);
+	double corpusTime = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	ITunesTrigramIndex *index = ITunesTrigramIndexCreate(corpus);
+	double indexTime = BenchmarkTime() - start;
+	
+	printf(" Search: corpus built in %.1f ms, trigram index in %.1f ms (%.1f MB), peak RSS %.1f MB\n",
+	       corpusTime * 1000.0, indexTime * 1000.0, MB(ITunesTrigramIndexSize(index)), MB(BenchmarkPeakRSS()));
+	
+	uint64_t matches = 0;
+	int q;
+	for(q = 0; q < QUERY_COUNT; q++)
+	{
+		char query[MAX_QUERY_LENGTH + 1];
+		size_t queryLength = MakeQuery(corpus, rows, count, 1 + (q % MAX_QUERY_LENGTH), query, seed);
+		
+		double t0 = BenchmarkTime();
+		uint32_t scanCount = ITunesSearchFilter(corpus, NULL, query, queryLength, rows, count, scanResult);
+		double t1 = BenchmarkTime();
+		uint32_t indexCount = ITunesTrigramIndexFilter(index, corpus, NULL, query, queryLength, rows, count, indexResult);
+		double t2 = BenchmarkTime();
+		
+		if((scanCount != indexCount) || (memcmp(scanResult, indexResult, scanCount * sizeof(int32_t)) != 0))
+		{
+			printf("Results differ for \"%s\" (scan %u, index %u)\n", query, scanCount, indexCount);
+			goto failed;
+		}
+		
+		scanTimes[q] = t1 - t0;
+		indexTimes[q] = t2 - t1;
+		matches += scanCount;
+	}
+	
+	printf(" Search latency over %u rows (%d queries of 1 to %d characters, %llu matches on average)\n",
+	       count, QUERY_COUNT, MAX_QUERY_LENGTH, (unsigned long long)(matches / QUERY_COUNT));
+	PrintPercentiles("scan", scanTimes, QUERY_COUNT);
+	PrintPercentiles("trigram index", indexTimes, QUERY_COUNT);
+	result = 1;
+
+failed:
+	ITunesTrigramIndexFree(index);
+	ITunesSearchCorpusFree(corpus);
+
+done:
+	free(rows);
+	free(scanResult);
+	free(indexResult);
+	free(scanTimes);
+	free(indexTimes);
+	return result;
+}
+
+// BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Measures the given library file. Meant to run in a process of it's own, so the peak resident size is that of this file.
+ Returns 1 if everything checked out.
+**/
+static int MeasureLibraryFile(const char *path, uint64_t seed)
+{
+	uint64_t startRSS = BenchmarkPeakRSS();
+	
+	double start = BenchmarkTime();
+	ITunesLibrary *lib = ITunesParseLibraryFile(path);
+	double parseTime = BenchmarkTime() - start;
+	
+	if(lib == NULL)
+	{
+		printf("Unable to parse %s\n", path);
+		return 0;
+	}
+	
+	uint64_t parseRSS = BenchmarkPeakRSS();
+	
+	// The generator used the seed itself, so random persistent IDs would otherwise be the ones it generated
+	seed ^= 0x9E3779B97F4A7C15ULL;
+	
+	FILE *file = fopen(path, "rb");
+	long fileSize = 0;
+	if(file != NULL)
+	{
+		fseek(file, 0, SEEK_END);
+		fileSize = ftell(file);
+		fclose(file);
+	}
+	
+	printf("%u tracks, %u playlists, %u items (%.1f MB of xml)\n",
+	       lib->tracksCount, lib->playlistsCount, lib->itemsCount, MB(fileSize));
+	printf(" Parse: %.1f ms (%.1f MB/s), peak RSS %.1f MB (%.1f MB before parsing)\n",
+	       parseTime * 1000.0, (parseTime > 0) ? MB(fileSize) / parseTime : 0.0, MB(parseRSS), MB(startRSS));
+	
+	int result = MeasureValidation(lib, &seed) && MeasureSearch(lib, &seed);
+	
+	ITunesLibraryFree(lib);
+	return result;
+}
+
+/**
+ Generates a library with the given options to a temporary file, and measures it.
+**/
+static int MeasureGeneratedLibrary(const LibraryGeneratorOptions *options)
+{
+	const char *directory = getenv("TMPDIR");
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/LibraryBenchmark.XXXXXX", (directory != NULL) ? directory : "/tmp");
+	
+	int fd = mkstemp(path);
+	FILE *file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+	if(file == NULL)
+	{
+		printf("Unable to create a temporary file\n");
+		if(fd >= 0) close(fd);
+		return 0;
+	}
+	
+	double start = BenchmarkTime();
+	int written = GenerateLibrary(file, options);
+	written = (fclose(file) == 0) && written;
+	double generateTime = BenchmarkTime() - start;
+	
+	int result = 0;
+	if(written)
+	{
+		printf("Generated in %.1f s: ", generateTime);
+		fflush(stdout);
+		result = MeasureLibraryFile(path, options->seed);
+	}
+	else
+	{
+		printf("Unable to write %s\n", path);
+	}
+	
+	unlink(path);
+	return result;
+}
+
+/**
+ Runs the given measurement in a child process. Returns 1 if it succeeded.
+**/
+static int RunInChild(const LibraryGeneratorOptions *options, const char *path)
+{
+	fflush(stdout);
+	
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		int result = (path != NULL) ? MeasureLibraryFile(path, options->seed) : MeasureGeneratedLibrary(options);
+		fflush(stdout);
+		_exit(result ? 0 : 1);
+	}
+	else if(pid < 0)
+	{
+		printf("Unable to fork\n");
+		return 0;
+	}
+	
+	int status = 0;
+	waitpid(pid, &status, 0);
+	printf("\n");
+	
+	return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static void PrintUsage(const char *name)
+{
+	printf("Usage: %s [-t tracks[,tracks...]] [-p playlists] [-s smart] [-d depth] [-l short|mixed|long] [-r seed]\n"
+	       "       [-w file] [-f file]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t sizes[MAX_SIZES] = { 1000, 10000, 100000 };
+	unsigned sizesCount = 3;
+	const char *writePath = NULL;
+	const char *readPath = NULL;
+	
+	LibraryGeneratorOptions options;
+	options.tracksCount = 0;
+	options.playlistsCount = 200;
+	options.smartCount = 40;
+	options.folderDepth = 3;
+	options.stringLengths = LibraryStringsMixed;
+	options.seed = 42;
+	
+	int c;
+	while((c = getopt(argc, argv, "t:p:s:d:l:r:w:f:")) != -1)
+	{
+		switch(c)
+		{
+			case 't':
+			{
+				char *p = optarg;
+				sizesCount = 0;
+				while((*p != '\0') && (sizesCount < MAX_SIZES))
+				{
+					sizes[sizesCount++] = (uint32_t)strtoul(p, &p, 10);
+					if(*p == ',') p++;
+					else break;
+				}
+				break;
+			}
+			case 'p': options.playlistsCount = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 's': options.smartCount = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'd': options.folderDepth = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'r': options.seed = strtoull(optarg, NULL, 10); break;
+			case 'w': writePath = optarg; break;
+			case 'f': readPath = optarg; break;
+			case 'l':
+				if(strcmp(optarg, "short") == 0)      options.stringLengths = LibraryStringsShort;
+				else if(strcmp(optarg, "mixed") == 0) options.stringLengths = LibraryStringsMixed;
+				else if(strcmp(optarg, "long") == 0)  options.stringLengths = LibraryStringsLong;
+				else
+				{
+					PrintUsage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				PrintUsage(argv[0]);
+				return 1;
+		}
+	}
+	
+	if(options.seed == 0) options.seed = 1;
+	if(options.smartCount > options.playlistsCount) options.smartCount = options.playlistsCount;
+	
+	if(writePath != NULL)
+	{
+		options.tracksCount = sizes[0];
+		
+		FILE *file = fopen(writePath, "wb");
+		int written = (file != NULL) && GenerateLibrary(file, &options);
+		written = (file != NULL) && (fclose(file) == 0) && written;
+		
+		if(!written)
+		{
+			printf("Unable to write %s\n", writePath);
+			return 1;
+		}
+		return 0;
+	}
+	
+	if(readPath != NULL)
+	{
+		return RunInChild(&options, readPath) ? 0 : 1;
+	}
+	
+	const char *lengths[] = { "short", "mixed", "long" };
+	printf("Libraries with %u playlists (%u smart), folders %u deep, %s names\n\n",
+	       options.playlistsCount, options.smartCount, options.folderDepth, lengths[options.stringLengths]);
+	
+	unsigned s;
+	for(s = 0; s < sizesCount; s++)
+	{
+		options.tracksCount = sizes[s];
+		
+		if(!RunInChild(&options, NULL)) return 1;
+	}
+	
+	return 0;
+}
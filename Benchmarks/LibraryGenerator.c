@@ -0,0 +1,422 @@
+#include "LibraryGenerator.h"
+#include "BenchmarkSupport.h"
+#include "ITunesLibrary.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Track and playlist IDs are not contiguous in real libraries, and share the same range of numbers
+#define FIRST_TRACK_ID  1000
+#define ID_STRIDE       2
+
+// Longest phrase (in bytes) that MakePhrase may write
+#define PHRASE_CAPACITY  1024
+
+static const char *syllables[] = {
+	"ka", "lo", "mi", "ne", "ru", "sa", "ti", "vo", "den", "mar", "sol", "tre", "bel", "cor", "fin", "gal",
+	"har", "jun", "lis", "mon", "nor", "pel", "qui", "ros", "sig", "tor", "ul", "ven", "wes", "xa", "yor", "zen",
+	"\xC3\xA9", "b\xC3\xB6", "\xC3\xA6r", "\xC3\xB1o"
+};
+#define SYLLABLE_COUNT  (sizeof(syllables) / sizeof(syllables[0]))
+
+static const char *connectors[] = { "&", "and", "<live>", "\"the\"", "-", "feat." };
+#define CONNECTOR_COUNT  (sizeof(connectors) / sizeof(connectors[0]))
+
+// Smart Info and Smart Criteria are opaque to the parser, but are always written by iTunes
+static const char *smartInfo =
+	"AQEAAwAAAAIAAAAZAAAAAAAAAAcAAAABAAAAAAAAAAAAAAAAAAAAAAAAAAAA\n"
+	"AAAAAAAAAAAAAAAAAAAAAAAAAAAA";
+static const char *smartCriteria =
+	"U0xzdAABAAEAAAADAAAAAQAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\n"
+	"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\n"
+	"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
+
+// STRINGS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the number of words a name should have, according to the given distribution.
+**/
+static int WordsCount(LibraryStringLengths lengths, uint64_t *seed)
+{
+	uint64_t r = BenchmarkRandom(seed);
+	
+	switch(lengths)
+	{
+		case LibraryStringsShort:
+			return 1 + (int)(r % 3);
+		case LibraryStringsMixed:
+			if((r % 100) < 85)
+				return 1 + (int)((r >> 8) % 4);
+			else
+				return 6 + (int)((r >> 8) % 15);
+		default:
+			return 8 + (int)(r % 23);
+	}
+}
+
+/**
+ Writes a made up phrase of the given number of words (each 1 to 3 syllables) to the buffer.
+ Longer phrases are sprinkled with connectors, which include characters that have to be escaped in XML.
+**/
+static int MakePhrase(char *buffer, int words, uint64_t *seed)
+{
+	int length = 0;
+	int w;
+	for(w = 0; w < words; w++)
+	{
+		if(length > PHRASE_CAPACITY - 32) break;
+		
+		if(w > 0)
+		{
+			buffer[length++] = ' ';
+			
+			if((words > 2) && ((BenchmarkRandom(seed) % 8) == 0))
+			{
+				const char *connector = connectors[BenchmarkRandom(seed) % CONNECTOR_COUNT];
+				size_t connectorLength = strlen(connector);
+				
+				memcpy(buffer + length, connector, connectorLength);
+				length += connectorLength;
+				buffer[length++] = ' ';
+			}
+		}
+		
+		int start = length;
+		int count = 1 + (int)(BenchmarkRandom(seed) % 3);
+		int s;
+		for(s = 0; s < count; s++)
+		{
+			const char *syllable = syllables[BenchmarkRandom(seed) % SYLLABLE_COUNT];
+			size_t syllableLength = strlen(syllable);
+			
+			memcpy(buffer + length, syllable, syllableLength);
+			length += syllableLength;
+		}
+		if((buffer[start] >= 'a') && (buffer[start] <= 'z')) buffer[start] &= ~0x20;
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+/**
+ Writes the given text as the contents of an XML element, escaping it as iTunes does.
+**/
+static void WriteEscaped(FILE *file, const char *text)
+{
+	const char *p;
+	for(p = text; *p != '\0'; p++)
+	{
+		switch(*p)
+		{
+			case '&': fputs("&#38;", file); break;
+			case '<': fputs("&#60;", file); break;
+			case '>': fputs("&#62;", file); break;
+			case '"': fputs("&#34;", file); break;
+			default : fputc(*p, file);
+		}
+	}
+}
+
+/**
+ Writes the given text as a component of a file URL, percent encoding everything but letters and digits.
+**/
+static void WriteURLComponent(FILE *file, const char *text)
+{
+	const unsigned char *p;
+	for(p = (const unsigned char *)text; *p != '\0'; p++)
+	{
+		if(((*p >= 'a') && (*p <= 'z')) || ((*p >= 'A') && (*p <= 'Z')) || ((*p >= '0') && (*p <= '9')))
+			fputc(*p, file);
+		else
+			fprintf(file, "%%%02X", *p);
+	}
+}
+
+static void WriteStringKey(FILE *file, const char *indent, const char *key, const char *value)
+{
+	fprintf(file, "%s<key>%s</key><string>", indent, key);
+	WriteEscaped(file, value);
+	fputs("</string>\n", file);
+}
+
+static void WritePersistentIDKey(FILE *file, const char *indent, const char *key, uint64_t persistentID)
+{
+	char buffer[17];
+	ITunesFormatPersistentID(persistentID, buffer);
+	
+	fprintf(file, "%s<key>%s</key><string>%s</string>\n", indent, key, buffer);
+}
+
+// TRACKS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void WriteTracks(FILE *file, const LibraryGeneratorOptions *options, uint64_t *seed)
+{
+	// Artists and albums repeat, as they do in real libraries.
+	// Each is generated from it's own seed, picked from a small range, so the same seed gives the same name.
+	uint32_t artistsCount = options->tracksCount / 20 + 1;
+	uint32_t albumsCount  = options->tracksCount / 10 + 1;
+	
+	char name[PHRASE_CAPACITY], artist[PHRASE_CAPACITY], album[PHRASE_CAPACITY];
+	const char *indent = "\t\t\t";
+	uint32_t i;
+	
+	fputs("\t<key>Tracks</key>\n\t<dict>\n", file);
+	
+	for(i = 0; i < options->tracksCount; i++)
+	{
+		int32_t trackID = FIRST_TRACK_ID + (int32_t)(i * ID_STRIDE);
+		
+		MakePhrase(name, WordsCount(options->stringLengths, seed), seed);
+		
+		uint64_t artistSeed = 1 + (BenchmarkRandom(seed) % artistsCount);
+		MakePhrase(artist, WordsCount(options->stringLengths, &artistSeed), &artistSeed);
+		
+		uint64_t albumSeed = 1000000 + (BenchmarkRandom(seed) % albumsCount);
+		MakePhrase(album, WordsCount(options->stringLengths, &albumSeed), &albumSeed);
+		
+		int32_t totalTime = 60000 + (int32_t)(BenchmarkRandom(seed) % 540000);
+		int32_t trackCount = 8 + (int32_t)(albumSeed % 10);
+		int32_t trackNumber = 1 + (int32_t)(BenchmarkRandom(seed) % trackCount);
+		
+		fprintf(file, "\t\t<key>%d</key>\n\t\t<dict>\n", trackID);
+		fprintf(file, "%s<key>Track ID</key><integer>%d</integer>\n", indent, trackID);
+		WriteStringKey(file, indent, "Name", name);
+		WriteStringKey(file, indent, "Artist", artist);
+		WriteStringKey(file, indent, "Album", album);
+		WriteStringKey(file, indent, "Kind", "MPEG audio file");
+		fprintf(file, "%s<key>Size</key><integer>%d</integer>\n", indent, totalTime * 16);
+		fprintf(file, "%s<key>Total Time</key><integer>%d</integer>\n", indent, totalTime);
+		fprintf(file, "%s<key>Track Number</key><integer>%d</integer>\n", indent, trackNumber);
+		fprintf(file, "%s<key>Track Count</key><integer>%d</integer>\n", indent, trackCount);
+		fprintf(file, "%s<key>Date Added</key><date>2007-%02d-%02dT12:00:00Z</date>\n", indent,
+		        1 + (int)(i % 12), 1 + (int)(i % 28));
+		fprintf(file, "%s<key>Bit Rate</key><integer>192</integer>\n", indent);
+		fprintf(file, "%s<key>Sample Rate</key><integer>44100</integer>\n", indent);
+		if((BenchmarkRandom(seed) % 4) == 0)
+		{
+			fprintf(file, "%s<key>Play Count</key><integer>%d</integer>\n", indent, (int)(BenchmarkRandom(seed) % 50));
+		}
+		if((BenchmarkRandom(seed) % 20) == 0)
+		{
+			fprintf(file, "%s<key>Protected</key><true/>\n", indent);
+		}
+		WritePersistentIDKey(file, indent, "Persistent ID", BenchmarkRandom(seed));
+		WriteStringKey(file, indent, "Track Type", "File");
+		
+		fprintf(file, "%s<key>Location</key><string>file://localhost/Users/bench/Music/iTunes/iTunes%%20Music/", indent);
+		WriteURLComponent(file, artist);
+		fputc('/', file);
+		WriteURLComponent(file, album);
+		fprintf(file, "/%02d%%20", trackNumber);
+		WriteURLComponent(file, name);
+		fputs(".mp3</string>\n", file);
+		
+		fputs("\t\t</dict>\n", file);
+	}
+	
+	fputs("\t</dict>\n", file);
+}
+
+// PLAYLISTS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void WritePlaylistItems(FILE *file, const int32_t *trackIDs, uint32_t count)
+{
+	uint32_t i;
+	
+	if(count == 0) return;
+	
+	fputs("\t\t\t<key>Playlist Items</key>\n\t\t\t<array>\n", file);
+	for(i = 0; i < count; i++)
+	{
+		fprintf(file, "\t\t\t\t<dict>\n\t\t\t\t\t<key>Track ID</key><integer>%d</integer>\n\t\t\t\t</dict>\n", trackIDs[i]);
+	}
+	fputs("\t\t\t</array>\n", file);
+}
+
+/**
+ Writes the keys every playlist starts with.
+**/
+static void WritePlaylistHeader(FILE *file, const char *name, int32_t playlistID, uint64_t persistentID,
+                                uint64_t parentPersistentID)
+{
+	const char *indent = "\t\t\t";
+	
+	fputs("\t\t<dict>\n", file);
+	WriteStringKey(file, indent, "Name", name);
+	fprintf(file, "%s<key>Playlist ID</key><integer>%d</integer>\n", indent, playlistID);
+	WritePersistentIDKey(file, indent, "Playlist Persistent ID", persistentID);
+	if(parentPersistentID != 0)
+	{
+		WritePersistentIDKey(file, indent, "Parent Persistent ID", parentPersistentID);
+	}
+}
+
+static int WritePlaylists(FILE *file, const LibraryGeneratorOptions *options, uint64_t *seed)
+{
+	uint32_t tracksCount = options->tracksCount;
+	int32_t nextID = FIRST_TRACK_ID + (int32_t)(tracksCount * ID_STRIDE);
+	char name[PHRASE_CAPACITY];
+	uint32_t i;
+	
+	// Folders: the first ones form a chain that reaches the full depth, the others hang off random folders above it.
+	uint32_t foldersCount = 0;
+	if(options->folderDepth > 0)
+	{
+		foldersCount = options->playlistsCount / 8;
+		if(foldersCount < options->folderDepth) foldersCount = options->folderDepth;
+	}
+	
+	int32_t *trackIDs = malloc((tracksCount > 0 ? tracksCount : 1) * sizeof(int32_t));
+	uint64_t *folderIDs = malloc((foldersCount > 0 ? foldersCount : 1) * sizeof(uint64_t));
+	uint32_t *folderDepths = malloc((foldersCount > 0 ? foldersCount : 1) * sizeof(uint32_t));
+	
+	if((trackIDs == NULL) || (folderIDs == NULL) || (folderDepths == NULL))
+	{
+		free(trackIDs);
+		free(folderIDs);
+		free(folderDepths);
+		return 0;
+	}
+	
+	for(i = 0; i < tracksCount; i++)
+	{
+		trackIDs[i] = FIRST_TRACK_ID + (int32_t)(i * ID_STRIDE);
+	}
+	
+	fputs("\t<key>Playlists</key>\n\t<array>\n", file);
+	
+	WritePlaylistHeader(file, "Library", nextID, BenchmarkRandom(seed), 0);
+	fputs("\t\t\t<key>Master</key><true/>\n\t\t\t<key>Visible</key><false/>\n\t\t\t<key>All Items</key><true/>\n", file);
+	WritePlaylistItems(file, trackIDs, tracksCount);
+	fputs("\t\t</dict>\n", file);
+	nextID += ID_STRIDE;
+	
+	WritePlaylistHeader(file, "Music", nextID, BenchmarkRandom(seed), 0);
+	fputs("\t\t\t<key>Music</key><true/>\n\t\t\t<key>All Items</key><true/>\n", file);
+	fprintf(file, "\t\t\t<key>Smart Info</key>\n\t\t\t<data>\n\t\t\t%s\n\t\t\t</data>\n", smartInfo);
+	WritePlaylistItems(file, trackIDs, tracksCount);
+	fputs("\t\t</dict>\n", file);
+	nextID += ID_STRIDE;
+	
+	for(i = 0; i < foldersCount; i++)
+	{
+		uint64_t parentID = 0;
+		
+		if(i < options->folderDepth)
+		{
+			folderDepths[i] = i + 1;
+			if(i > 0) parentID = folderIDs[i - 1];
+		}
+		else
+		{
+			uint32_t parent = (uint32_t)(BenchmarkRandom(seed) % (i + 1));
+			if((parent < i) && (folderDepths[parent] < options->folderDepth))
+			{
+				folderDepths[i] = folderDepths[parent] + 1;
+				parentID = folderIDs[parent];
+			}
+			else
+			{
+				folderDepths[i] = 1;
+			}
+		}
+		folderIDs[i] = BenchmarkRandom(seed);
+		
+		MakePhrase(name, 1 + (int)(BenchmarkRandom(seed) % 2), seed);
+		WritePlaylistHeader(file, name, nextID, folderIDs[i], parentID);
+		fputs("\t\t\t<key>Folder</key><true/>\n\t\t\t<key>All Items</key><true/>\n", file);
+		fputs("\t\t</dict>\n", file);
+		nextID += ID_STRIDE;
+	}
+	
+	for(i = 0; i < options->playlistsCount; i++)
+	{
+		// Three quarters of the playlists are filed in folders, when there are any
+		uint64_t parentID = 0;
+		if((foldersCount > 0) && ((BenchmarkRandom(seed) % 4) != 0))
+		{
+			parentID = folderIDs[BenchmarkRandom(seed) % foldersCount];
+		}
+		
+		MakePhrase(name, WordsCount(options->stringLengths, seed), seed);
+		WritePlaylistHeader(file, name, nextID, BenchmarkRandom(seed), parentID);
+		fputs("\t\t\t<key>All Items</key><true/>\n", file);
+		
+		// Most playlists are small, a few are a sizeable part of the library
+		uint32_t itemsCount = 0;
+		if(tracksCount > 0)
+		{
+			uint32_t maxItems = ((BenchmarkRandom(seed) % 10) == 0) ? tracksCount / 4 : 100;
+			if(maxItems > tracksCount) maxItems = tracksCount;
+			itemsCount = 1 + (uint32_t)(BenchmarkRandom(seed) % (maxItems > 0 ? maxItems : 1));
+		}
+		
+		if(i < options->smartCount)
+		{
+			// Smart playlists hold tracks matching a rule, which here is a run of consecutive tracks
+			fprintf(file, "\t\t\t<key>Smart Info</key>\n\t\t\t<data>\n\t\t\t%s\n\t\t\t</data>\n", smartInfo);
+			fprintf(file, "\t\t\t<key>Smart Criteria</key>\n\t\t\t<data>\n\t\t\t%s\n\t\t\t</data>\n", smartCriteria);
+			
+			uint32_t start = (tracksCount > itemsCount) ? (uint32_t)(BenchmarkRandom(seed) % (tracksCount - itemsCount)) : 0;
+			WritePlaylistItems(file, trackIDs + start, itemsCount);
+		}
+		else
+		{
+			// The track IDs are shuffled in place, so the items are picked without repeats
+			uint32_t j;
+			for(j = 0; j < itemsCount; j++)
+			{
+				uint32_t k = j + (uint32_t)(BenchmarkRandom(seed) % (tracksCount - j));
+				int32_t swap = trackIDs[j];
+				trackIDs[j] = trackIDs[k];
+				trackIDs[k] = swap;
+			}
+			WritePlaylistItems(file, trackIDs, itemsCount);
+		}
+		
+		fputs("\t\t</dict>\n", file);
+		nextID += ID_STRIDE;
+	}
+	
+	fputs("\t</array>\n", file);
+	
+	free(trackIDs);
+	free(folderIDs);
+	free(folderDepths);
+	return 1;
+}
+
+// GENERATOR
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Writes a complete library xml file with the given options.
+ Returns 1 on success, or 0 if the file couldn't be written.
+**/
+int GenerateLibrary(FILE *file, const LibraryGeneratorOptions *options)
+{
+	uint64_t seed = (options->seed != 0) ? options->seed : 1;
+	
+	fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	      "<!DOCTYPE plist PUBLIC \"-//Apple Computer//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+	      "<plist version=\"1.0\">\n"
+	      "<dict>\n"
+	      "\t<key>Major Version</key><integer>1</integer>\n"
+	      "\t<key>Minor Version</key><integer>1</integer>\n"
+	      "\t<key>Application Version</key><string>7.6</string>\n"
+	      "\t<key>Features</key><integer>5</integer>\n"
+	      "\t<key>Show Content Ratings</key><true/>\n"
+	      "\t<key>Music Folder</key><string>file://localhost/Users/bench/Music/iTunes/iTunes%20Music/</string>\n", file);
+	WritePersistentIDKey(file, "\t", "Library Persistent ID", BenchmarkRandom(&seed));
+	
+	WriteTracks(file, options, &seed);
+	
+	if(!WritePlaylists(file, options, &seed)) return 0;
+	
+	fputs("</dict>\n</plist>\n", file);
+	
+	return (ferror(file) == 0);
+}
@@ -0,0 +1,53 @@
+/**
+ Writes synthetic, but valid, "iTunes Music Library.xml" files.
+
+ The generated file has the same layout as the ones written by iTunes:
+ a tracks dictionary keyed by track ID, followed by an array of playlists,
+ starting with the master library playlist and the Music playlist.
+ Tracks carry the keys iTunes writes (including the ones the parser skips),
+ and names contain escaped XML characters and accented letters, so every part of the parser is exercised.
+
+ User playlists may be organized in nested folders, and some of them may be smart playlists.
+ The same options (and seed) always produce the same file.
+**/
+
+#ifndef LIBRARY_GENERATOR_H
+#define LIBRARY_GENERATOR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum LibraryStringLengths
+{
+	// Names of 1 to 3 words
+	LibraryStringsShort = 0,
+	
+	// Mostly short names, with a tail of long (classical music style) names
+	LibraryStringsMixed,
+	
+	// Names of 8 to 30 words
+	LibraryStringsLong
+} LibraryStringLengths;
+
+typedef struct LibraryGeneratorOptions
+{
+	uint32_t tracksCount;
+	
+	// Number of user playlists (not counting the master playlist, the Music playlist, or folders)
+	uint32_t playlistsCount;
+	
+	// Number of user playlists that are smart playlists
+	uint32_t smartCount;
+	
+	// Deepest level of nested folders (0 for no folders at all)
+	uint32_t folderDepth;
+	
+	LibraryStringLengths stringLengths;
+	
+	// Must not be zero
+	uint64_t seed;
+} LibraryGeneratorOptions;
+
+int GenerateLibrary(FILE *file, const LibraryGeneratorOptions *options);
+
+#endif
@@ -0,0 +1,463 @@
+/**
+ Plays alarms headlessly, on the virtual clock of the null and WAV audio outputs (see AudioOutput.h).
+
+ Three scenarios are played, each much faster than real time:
+ - A playlist alarm, moving through a (shuffled) playlist with the player's own cursor (see ITunesPlaylistCursor.h):
+   when a track finishes, the next one is opened, skipping the ones that can't be played.
+   ITunesPlayer opens the tracks as QuickTime movies, which is left out here: they're played on the virtual output.
+ - The default alarm sound, looping until the alarm is killed,
+   both decoded as it plays, and decoded once into memory and played from a ring (see SoundBuffer.h).
+ - An Easy Wake ramp applied to every sample of the looping alarm sound, checked against the curve, across a snooze.
+   This is what MemoryAudioOutput does when the alarm plays the default sound. For iTunes tracks,
+   AlarmController still steps the device volume instead, as QuickTime doesn't give access to the samples.
+
+ Tracks come from a synthetic decoder, which can simulate missing files, slow opens, and slow decoding,
+ so the time lost to each (in audio without sound) can be measured.
+**/
+
+#include "BenchmarkSupport.h"
+#include "AudioOutput.h"
+#include "ITunesShuffle.h"
+#include "ITunesPlaylistCursor.h"
+#include "SoundBuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+typedef struct DecoderOptions
+{
+	double missingRate;     // Fraction of the tracks whose files are missing
+	double openLatency;     // Seconds it takes to open a track
+	double decodeLoad;      // Time to decode a buffer, relative to it's duration (above 1.0 can't keep up)
+	double stallRate;       // Fraction of the buffers that can't be decoded in time at all
+	uint64_t seed;
+} DecoderOptions;
+
+typedef struct Track
+{
+	uint64_t frames;
+	uint64_t position;
+	double   frequency;
+	uint32_t sampleRate;
+	
+	// The tone is a rotating phasor, which is much cheaper than calling sin() for every sample
+	double   real, imaginary;
+	double   stepReal, stepImaginary;
+} Track;
+
+// SYNTHETIC DECODER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void TrackSetPosition(Track *track, uint64_t position)
+{
+	double phase = 2.0 * M_PI * track->frequency * position / track->sampleRate;
+	
+	track->position = position;
+	track->real = cos(phase);
+	track->imaginary = sin(phase);
+}
+
+/**
+ Returns a number in [0, 1) derived from the path, so a given track is always the same (length, missing or not).
+**/
+static double PathRandom(const char *path, uint64_t seed, uint64_t salt)
+{
+	uint64_t hash = 14695981039346656037ULL ^ seed ^ (salt * 0x9E3779B97F4A7C15ULL);
+	const char *c;
+	
+	for(c = path; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+	}
+	if(hash == 0) hash = 1;
+	
+	return (BenchmarkRandom(&hash) >> 11) / 9007199254740992.0;
+}
+
+static void * DecoderOpen(void *context, const char *path, uint32_t sampleRate, double *duration, double *latency)
+{
+	DecoderOptions *options = (DecoderOptions *)context;
+	
+	*latency = options->openLatency;
+	
+	if(PathRandom(path, options->seed, 1) < options->missingRate) return NULL;
+	
+	Track *track = calloc(1, sizeof(Track));
+	if(track == NULL) return NULL;
+	
+	// "alarm" is the default alarm sound, which is short, everything else is 2 to 6 minutes long
+	double seconds = (strcmp(path, "alarm") == 0) ? 7.5 : 120.0 + (PathRandom(path, options->seed, 2) * 240.0);
+	
+	track->frames = (uint64_t)(seconds * sampleRate);
+	track->frequency = 220.0 + (PathRandom(path, options->seed, 3) * 440.0);
+	track->sampleRate = sampleRate;
+	track->stepReal = cos(2.0 * M_PI * track->frequency / sampleRate);
+	track->stepImaginary = sin(2.0 * M_PI * track->frequency / sampleRate);
+	TrackSetPosition(track, 0);
+	
+	*duration = seconds;
+	return track;
+}
+
+static uint32_t DecoderRender(void *context, void *handle, float *samples, uint32_t frames, int *isEnd)
+{
+	DecoderOptions *options = (DecoderOptions *)context;
+	Track *track = (Track *)handle;
+	
+	uint64_t left = track->frames - track->position;
+	uint32_t count = (left < frames) ? (uint32_t)left : frames;
+	
+	*isEnd = (left <= frames);
+	
+	if(!*isEnd)
+	{
+		// A slow decoder only gets part of the buffer done in time
+		if((options->stallRate > 0.0) && ((double)rand() / RAND_MAX < options->stallRate))
+		{
+			count = 0;
+		}
+		else if(options->decodeLoad > 1.0)
+		{
+			count = (uint32_t)(count / options->decodeLoad);
+		}
+	}
+	
+	double real = track->real;
+	double imaginary = track->imaginary;
+	uint32_t i;
+	
+	for(i = 0; i < count; i++)
+	{
+		float sample = 0.5f * (float)imaginary;
+		
+		samples[i * 2] = sample;
+		samples[(i * 2) + 1] = sample;
+		
+		double next = (real * track->stepReal) - (imaginary * track->stepImaginary);
+		imaginary = (real * track->stepImaginary) + (imaginary * track->stepReal);
+		real = next;
+	}
+	
+	// Keeps the phasor on the unit circle, as rounding errors add up
+	double magnitude = sqrt((real * real) + (imaginary * imaginary));
+	
+	track->real = real / magnitude;
+	track->imaginary = imaginary / magnitude;
+	track->position += count;
+	return count;
+}
+
+static void DecoderSeek(void *context, void *handle, double time)
+{
+	Track *track = (Track *)handle;
+	uint64_t position = (uint64_t)(time * track->sampleRate);
+	
+	TrackSetPosition(track, (position < track->frames) ? position : track->frames);
+}
+
+static void DecoderClose(void *context, void *handle)
+{
+	free(handle);
+}
+
+/**
+ Decodes a whole track into memory, like MemoryAudioOutput does with the application's own sounds.
+**/
+static SoundBuffer * DecodeSound(const AudioOutputDecoder *decoder, const char *path, uint32_t sampleRate)
+{
+	double duration, latency;
+	
+	void *track = decoder->open(decoder->context, path, sampleRate, &duration, &latency);
+	if(track == NULL) return NULL;
+	
+	SoundBuffer *buffer = SoundBufferCreate((uint32_t)(duration * sampleRate), AUDIO_OUTPUT_CHANNELS, sampleRate);
+	float samples[512 * AUDIO_OUTPUT_CHANNELS];
+	uint32_t decoded = 0;
+	int isEnd = 0;
+	
+	while((buffer != NULL) && !isEnd && (decoded < buffer->frames))
+	{
+		uint32_t frames = buffer->frames - decoded;
+		if(frames > 512) frames = 512;
+		
+		uint32_t count = decoder->render(decoder->context, track, samples, frames, &isEnd);
+		uint32_t i;
+		
+		for(i = 0; i < count * AUDIO_OUTPUT_CHANNELS; i++)
+		{
+			float sample = samples[i] * 32767.0f;
+			buffer->samples[(decoded * AUDIO_OUTPUT_CHANNELS) + i] = (int16_t)lrintf(sample);
+		}
+		decoded += count;
+	}
+	
+	decoder->close(decoder->context, track);
+	return buffer;
+}
+
+// PLAYLIST
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Open function of the playlist cursor: opens the track of the given entry on the output, and starts playing it.
+**/
+static int OpenPlaylistEntry(void *context, int32_t entry)
+{
+	AudioOutput *output = (AudioOutput *)context;
+	char path[32];
+	
+	snprintf(path, sizeof(path), "track-%d", entry);
+	
+	if(!AudioOutputOpen(output, path)) return 0;
+	
+	AudioOutputPlay(output);
+	return 1;
+}
+
+/**
+ Moves to the next track when the current one finishes, like ITunesPlayer -movieFinished:.
+**/
+static void PlaylistTrackFinished(void *context, AudioOutput *output)
+{
+	ITunesPlaylistCursorNext((ITunesPlaylistCursor *)context, OpenPlaylistEntry, output);
+}
+
+// SCENARIOS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void PrintStats(const char *name, AudioOutput *output, double wallTime)
+{
+	AudioOutputStats stats;
+	AudioOutputGetStats(output, &stats);
+	
+	printf("%-10s %10.1f %9.2f %9.0fx %7u %7u %7u %10.3f %9u\n", name,
+	       stats.clock / 60.0, wallTime * 1000.0, (wallTime > 0) ? stats.clock / wallTime : 0.0,
+	       stats.tracksOpened, stats.tracksFinished, stats.loopsCompleted, stats.underrunTime, stats.underrunCount);
+}
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n tracks] [-t minutes] [-m missing] [-l ms] [-k load] [-s stalls] [-S] [-r seed] [-w file.wav]\n", name);
+	fprintf(stderr, "  -n  tracks in the playlist (default 100)\n");
+	fprintf(stderr, "  -t  minutes the playlist alarm plays (default 120)\n");
+	fprintf(stderr, "  -m  fraction of tracks that are missing (default 0.1)\n");
+	fprintf(stderr, "  -l  time to open a track, in milliseconds (default 40)\n");
+	fprintf(stderr, "  -k  decode time relative to real time; above 1.0 underruns (default 0.2)\n");
+	fprintf(stderr, "  -s  fraction of buffers that stall (default 0)\n");
+	fprintf(stderr, "  -S  shuffles the playlist\n");
+	fprintf(stderr, "  -r  seed (default 1)\n");
+	fprintf(stderr, "  -w  writes the Easy Wake scenario to a WAV file\n");
+}
+
+int main(int argc, char **argv)
+{
+	DecoderOptions options = { 0.1, 0.040, 0.2, 0.0, 1 };
+	uint32_t tracksCount = 100;
+	double minutes = 120.0;
+	int shouldShuffle = 0;
+	const char *wavPath = NULL;
+	uint32_t sampleRate = 44100;
+	int c;
+	
+	while((c = getopt(argc, argv, "n:t:m:l:k:s:Sr:w:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'n': tracksCount = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 't': minutes = atof(optarg); break;
+			case 'm': options.missingRate = atof(optarg); break;
+			case 'l': options.openLatency = atof(optarg) / 1000.0; break;
+			case 'k': options.decodeLoad = atof(optarg); break;
+			case 's': options.stallRate = atof(optarg); break;
+			case 'S': shouldShuffle = 1; break;
+			case 'r': options.seed = strtoull(optarg, NULL, 0); break;
+			case 'w': wavPath = optarg; break;
+			default:
+				PrintUsage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if((tracksCount == 0) || (minutes <= 0.0))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	srand((unsigned)options.seed);
+	
+	AudioOutputDecoder decoder = { DecoderOpen, DecoderRender, DecoderSeek, DecoderClose, &options };
+	int failed = 0;
+	
+	printf("%u tracks, %.0f%% missing, %.0f ms to open, decode load %.2f, %.1f%% stalls%s\n\n",
+	       tracksCount, options.missingRate * 100.0, options.openLatency * 1000.0,
+	       options.decodeLoad, options.stallRate * 100.0, shouldShuffle ? ", shuffled" : "");
+	printf("%-10s %10s %9s %10s %7s %7s %7s %10s %9s\n",
+	       "scenario", "minutes", "wall ms", "speed", "opened", "ended", "loops", "silence s", "underruns");
+	
+	// Playlist alarm
+	int32_t *entries = malloc(tracksCount * sizeof(int32_t));
+	ITunesShuffle *shuffle = ITunesShuffleCreate(options.seed);
+	uint32_t i;
+	
+	if((entries == NULL) || (shuffle == NULL))
+	{
+		fprintf(stderr, "Unable to allocate the playlist\n");
+		return 1;
+	}
+	for(i = 0; i < tracksCount; i++)
+	{
+		entries[i] = (int32_t)i;
+	}
+	
+	ITunesPlaylistCursor cursor;
+	ITunesPlaylistCursorInit(&cursor, entries, tracksCount, shouldShuffle ? shuffle : NULL);
+	
+	AudioOutput *output = AudioOutputCreateNull(&decoder, sampleRate);
+	AudioOutputSetFinishedFunction(output, PlaylistTrackFinished, &cursor);
+	
+	double start = BenchmarkTime();
+	if(ITunesPlaylistCursorNext(&cursor, OpenPlaylistEntry, output))
+	{
+		AudioOutputAdvance(output, minutes * 60.0);
+	}
+	PrintStats("playlist", output, BenchmarkTime() - start);
+	
+	AudioOutputStats stats;
+	AudioOutputGetStats(output, &stats);
+	
+	// Every track opened, but the current one, was played to it's end, and each open cost it's latency in silence
+	if((stats.tracksOpened > 0) && (stats.tracksFinished + 1 != stats.tracksOpened))
+	{
+		fprintf(stderr, "Playlist: %u tracks opened, but %u finished\n", stats.tracksOpened, stats.tracksFinished);
+		failed = 1;
+	}
+	if((options.decodeLoad <= 1.0) && (options.stallRate == 0.0) &&
+	   (fabs(stats.underrunTime - (stats.tracksOpened * options.openLatency)) > 0.001 * stats.tracksOpened))
+	{
+		fprintf(stderr, "Playlist: %.3f s of silence, expected %.3f s\n",
+		        stats.underrunTime, stats.tracksOpened * options.openLatency);
+		failed = 1;
+	}
+	AudioOutputFree(output);
+	
+	// Default alarm sound, looping until the alarm is killed (after 15 minutes)
+	DecoderOptions alarmOptions = options;
+	alarmOptions.missingRate = 0.0;
+	decoder.context = &alarmOptions;
+	
+	output = AudioOutputCreateNull(&decoder, sampleRate);
+	AudioOutputSetLooping(output, 1);
+	
+	start = BenchmarkTime();
+	if(AudioOutputOpen(output, "alarm"))
+	{
+		AudioOutputPlay(output);
+		AudioOutputAdvance(output, 15 * 60.0);
+	}
+	PrintStats("loop", output, BenchmarkTime() - start);
+	
+	AudioOutputGetStats(output, &stats);
+	if((stats.tracksFinished != 0) || (stats.loopsCompleted == 0) || !AudioOutputIsPlaying(output))
+	{
+		fprintf(stderr, "Loop: the alarm sound stopped looping\n");
+		failed = 1;
+	}
+	AudioOutputFree(output);
+	
+	// The same, with the alarm sound decoded once, up front, and played from memory
+	// Decoding ahead of time isn't racing the audio device, so it's never too slow
+	alarmOptions.decodeLoad = 0.0;
+	alarmOptions.stallRate = 0.0;
+	start = BenchmarkTime();
+	
+	SoundBuffer *alarmSound = DecodeSound(&decoder, "alarm", sampleRate);
+	if(alarmSound == NULL)
+	{
+		fprintf(stderr, "Unable to decode the alarm sound\n");
+		return 1;
+	}
+	
+	AudioOutputDecoder memoryDecoder;
+	SoundBufferGetDecoder(alarmSound, &memoryDecoder);
+	
+	output = AudioOutputCreateNull(&memoryDecoder, sampleRate);
+	AudioOutputSetLooping(output, 1);
+	
+	if(AudioOutputOpen(output, "alarm"))
+	{
+		AudioOutputPlay(output);
+		AudioOutputAdvance(output, 15 * 60.0);
+	}
+	PrintStats("memory", output, BenchmarkTime() - start);
+	
+	AudioOutputStats memoryStats;
+	AudioOutputGetStats(output, &memoryStats);
+	
+	// Nothing is decoded while playing, so there's no silence at all, and the sound loops a little more often
+	if((memoryStats.underrunTime != 0.0) || (memoryStats.loopsCompleted < stats.loopsCompleted))
+	{
+		fprintf(stderr, "Memory: %.3f s of silence, %u loops\n", memoryStats.underrunTime, memoryStats.loopsCompleted);
+		failed = 1;
+	}
+	AudioOutputFree(output);
+	SoundBufferFree(alarmSound);
+	
+	// Easy Wake ramp over 2 minutes, on the looping alarm sound
+	GainRamp ramp;
+	GainRampInit(&ramp, GAIN_RAMP_DECIBEL, 0.25f, 1.0f, 120.0, sampleRate);
+	
+	output = (wavPath != NULL) ? AudioOutputCreateWAV(wavPath, &decoder, sampleRate)
+	                           : AudioOutputCreateNull(&decoder, sampleRate);
+	if(output == NULL)
+	{
+		fprintf(stderr, "Unable to create %s\n", wavPath);
+		return 1;
+	}
+	AudioOutputSetLooping(output, 1);
+	AudioOutputSetVolume(output, 0.8f);
+	AudioOutputSetRamp(output, &ramp);
+	
+	start = BenchmarkTime();
+	if(AudioOutputOpen(output, "alarm"))
+	{
+		AudioOutputPlay(output);
+		AudioOutputAdvance(output, 60.0);
+		
+		// Halfway through, the ramp is where the curve says (less the time it took to open the sound)
+		double expected = GainRampCurve(&ramp, (60.0 - alarmOptions.openLatency) / 120.0);
+		if(fabs(GainRampGain(&ramp) - expected) > 0.001)
+		{
+			fprintf(stderr, "Ramp: gain %.4f halfway, expected %.4f\n", GainRampGain(&ramp), expected);
+			failed = 1;
+		}
+		
+		// Snoozing holds the ramp
+		AudioOutputStop(output);
+		GainRampPause(&ramp);
+		AudioOutputAdvance(output, 8 * 60.0);
+		GainRampResume(&ramp);
+		AudioOutputPlay(output);
+		
+		AudioOutputAdvance(output, 90.0);
+		if(!GainRampIsFinished(&ramp))
+		{
+			fprintf(stderr, "Ramp: not finished after the snooze\n");
+			failed = 1;
+		}
+	}
+	PrintStats("easy wake", output, BenchmarkTime() - start);
+	AudioOutputFree(output);
+	
+	if(wavPath != NULL)
+	{
+		printf("\nWrote the Easy Wake scenario to %s\n", wavPath);
+	}
+	
+	printf("\n%u tracks skipped as missing, playlist wrapped %u times\n", cursor.skipped, cursor.wraps);
+	
+	ITunesShuffleFree(shuffle);
+	free(entries);
+	return failed;
+}
@@ -0,0 +1,264 @@
+/**
+ Checks and measures the Easy Wake gain ramp.
+
+ Every curve is rendered offline (GainRampRender), as 16 bit PCM, and each sample is compared with the exact curve.
+ The largest jump between consecutive samples is compared with the jumps of the old approach, which set the
+ volume every half a second, and the ramp is paused and resumed halfway through, as it is during a snooze.
+ Finally, the cost of applying a ramp to audio buffers is measured.
+
+ A rendered ramp can be written to a WAV file (-w) to be inspected in any audio editor.
+**/
+
+#include "BenchmarkSupport.h"
+#include "GainRamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+// How often the old approach set the volume
+#define STEP_INTERVAL  0.5
+
+static const char *curveNames[GAIN_RAMP_CURVE_COUNT] = { "linear", "exponential", "s-curve", "decibel" };
+
+static void WriteLE16(FILE *f, uint16_t value)
+{
+	fputc(value & 0xFF, f);
+	fputc(value >> 8, f);
+}
+
+static void WriteLE32(FILE *f, uint32_t value)
+{
+	WriteLE16(f, value & 0xFFFF);
+	WriteLE16(f, value >> 16);
+}
+
+/**
+ Writes 16 bit PCM to a WAV file. Returns 0 on failure.
+**/
+static int WriteWAV(const char *path, const int16_t *pcm, uint32_t frames, uint32_t channels, uint32_t rate)
+{
+	FILE *f = fopen(path, "wb");
+	if(f == NULL) return 0;
+	
+	uint32_t dataSize = frames * channels * 2;
+	
+	fwrite("RIFF", 1, 4, f);
+	WriteLE32(f, 36 + dataSize);
+	fwrite("WAVEfmt ", 1, 8, f);
+	WriteLE32(f, 16);
+	WriteLE16(f, 1);
+	WriteLE16(f, channels);
+	WriteLE32(f, rate);
+	WriteLE32(f, rate * channels * 2);
+	WriteLE16(f, channels * 2);
+	WriteLE16(f, 16);
+	fwrite("data", 1, 4, f);
+	WriteLE32(f, dataSize);
+	
+	uint32_t i;
+	for(i = 0; i < frames * channels; i++)
+	{
+		WriteLE16(f, (uint16_t)pcm[i]);
+	}
+	
+	return (fclose(f) == 0);
+}
+
+/**
+ Renders the given ramp, and reports how far the output is from the exact curve, and it's largest step.
+ Returns non-zero if the output doesn't match the curve.
+**/
+static int CheckCurve(int curve, double duration, uint32_t rate, int16_t *pcm, uint32_t frames)
+{
+	GainRamp ramp;
+	GainRampInit(&ramp, curve, 0.25f, 1.0f, duration, rate);
+	GainRampRender(&ramp, pcm, frames, 2);
+	
+	int maxError = 0;
+	int maxStep = 0;
+	int failed = 0;
+	uint32_t i;
+	
+	for(i = 0; i < frames; i++)
+	{
+		int expected = (int)lrint(GainRampCurve(&ramp, (double)i / ramp.duration) * 32767.0);
+		int error = abs(pcm[i * 2] - expected);
+		
+		if(error > maxError) maxError = error;
+		if(pcm[i * 2] != pcm[(i * 2) + 1]) failed = 1;
+		
+		if(i > 0)
+		{
+			int step = abs(pcm[i * 2] - pcm[(i - 1) * 2]);
+			if(step > maxStep) maxStep = step;
+		}
+	}
+	
+	// The old approach held each value for STEP_INTERVAL, and then jumped to the next one
+	int maxOldStep = 0;
+	double t;
+	for(t = STEP_INTERVAL; t <= duration; t += STEP_INTERVAL)
+	{
+		int before = (int)lrint(GainRampCurve(&ramp, (t - STEP_INTERVAL) / duration) * 32767.0);
+		int after = (int)lrint(GainRampCurve(&ramp, t / duration) * 32767.0);
+		
+		if(abs(after - before) > maxOldStep) maxOldStep = abs(after - before);
+	}
+	
+	// A couple of LSB of rounding is expected from the interpolation
+	if(maxError > 2) failed = 1;
+	
+	printf("%-12s %10d %14d %14d %12u %s\n", curveNames[curve], maxError, maxStep, maxOldStep,
+	       (unsigned)(duration / STEP_INTERVAL), failed ? "FAILED" : "ok");
+	
+	return failed;
+}
+
+/**
+ Pauses the ramp halfway through, checks it holds it's gain, and that it carries on from there once resumed.
+ Returns non-zero on failure.
+**/
+static int CheckPause(double duration, uint32_t rate)
+{
+	GainRamp ramp;
+	GainRampInit(&ramp, GAIN_RAMP_LINEAR, 0.25f, 1.0f, duration, rate);
+	
+	float buffer[1024 * 2];
+	uint32_t half = (uint32_t)(ramp.duration / 2);
+	uint32_t done = 0;
+	
+	while(done < half)
+	{
+		uint32_t count = ((half - done) < 1024) ? (half - done) : 1024;
+		uint32_t i;
+		for(i = 0; i < count * 2; i++) buffer[i] = 1.0f;
+		
+		GainRampProcess(&ramp, buffer, count, 2);
+		done += count;
+	}
+	
+	float held = GainRampGain(&ramp);
+	GainRampPause(&ramp);
+	
+	int failed = 0;
+	uint32_t i, b;
+	
+	for(b = 0; b < 100; b++)
+	{
+		for(i = 0; i < 1024 * 2; i++) buffer[i] = 1.0f;
+		GainRampProcess(&ramp, buffer, 1024, 2);
+		GainRampAdvance(&ramp, 1.0);
+		
+		for(i = 0; i < 1024 * 2; i++)
+		{
+			if(buffer[i] != held) failed = 1;
+		}
+	}
+	
+	GainRampResume(&ramp);
+	GainRampAdvance(&ramp, duration);
+	
+	if(!GainRampIsFinished(&ramp) || (GainRampGain(&ramp) != 1.0f)) failed = 1;
+	
+	GainRampRestart(&ramp);
+	if(GainRampGain(&ramp) != 0.25f) failed = 1;
+	
+	printf("\nPause/resume: held gain %.4f over 100 buffers, %s\n", held, failed ? "FAILED" : "ok");
+	return failed;
+}
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-d seconds] [-r rate] [-c curve] [-w file.wav]\n", name);
+	fprintf(stderr, "  -d  duration of the ramp (default 120)\n");
+	fprintf(stderr, "  -r  sample rate (default 44100)\n");
+	fprintf(stderr, "  -c  curve written with -w: 0 linear, 1 exponential, 2 s-curve, 3 decibel (default 0)\n");
+	fprintf(stderr, "  -w  writes the rendered ramp (stereo, 16 bit) to a WAV file\n");
+}
+
+int main(int argc, char **argv)
+{
+	double duration = 120.0;
+	uint32_t rate = 44100;
+	int wavCurve = GAIN_RAMP_LINEAR;
+	const char *wavPath = NULL;
+	int c;
+	
+	while((c = getopt(argc, argv, "d:r:c:w:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'd': duration = atof(optarg); break;
+			case 'r': rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'c': wavCurve = atoi(optarg); break;
+			case 'w': wavPath = optarg; break;
+			default:
+				PrintUsage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if((duration <= 0.0) || (rate == 0) || (wavCurve < 0) || (wavCurve >= GAIN_RAMP_CURVE_COUNT))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	
+	uint32_t frames = (uint32_t)(duration * rate);
+	int16_t *pcm = malloc((size_t)frames * 2 * sizeof(int16_t));
+	if(pcm == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	
+	printf("Ramp from 0.25 to 1.0 over %.0f seconds, %u Hz stereo (errors and steps in 16 bit LSB)\n\n", duration, rate);
+	printf("%-12s %10s %14s %14s %12s\n", "curve", "max error", "max step", "0.5s step", "old updates");
+	
+	int failed = 0;
+	int curve;
+	
+	for(curve = 0; curve < GAIN_RAMP_CURVE_COUNT; curve++)
+	{
+		failed |= CheckCurve(curve, duration, rate, pcm, frames);
+	}
+	
+	failed |= CheckPause(duration, rate);
+	
+	if(wavPath != NULL)
+	{
+		GainRamp ramp;
+		GainRampInit(&ramp, wavCurve, 0.25f, 1.0f, duration, rate);
+		GainRampRender(&ramp, pcm, frames, 2);
+		
+		if(WriteWAV(wavPath, pcm, frames, 2, rate))
+			printf("Wrote %s ramp to %s\n", curveNames[wavCurve], wavPath);
+		else
+			fprintf(stderr, "Unable to write %s\n", wavPath);
+	}
+	
+	// Throughput of applying a ramp to 512 frame stereo buffers
+	GainRamp ramp;
+	GainRampInit(&ramp, GAIN_RAMP_DECIBEL, 0.25f, 1.0f, duration, rate);
+	
+	float buffer[512 * 2];
+	memset(buffer, 0, sizeof(buffer));
+	
+	uint32_t buffers = frames / 512;
+	uint32_t b;
+	double start = BenchmarkTime();
+	
+	for(b = 0; b < buffers; b++)
+	{
+		GainRampProcess(&ramp, buffer, 512, 2);
+	}
+	
+	double elapsed = BenchmarkTime() - start;
+	printf("\nProcessing: %.2f ms for %.0f seconds of audio (%.0fx real time)\n",
+	       elapsed * 1000.0, duration, (elapsed > 0) ? duration / elapsed : 0.0);
+	
+	free(pcm);
+	return failed;
+}
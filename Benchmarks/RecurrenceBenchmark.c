@@ -0,0 +1,546 @@
+/**
+ Benchmarks the recurrence rules alarms may repeat by (see AlarmRecurrence.h), over years long horizons.
+
+ Random rules are made up (every few days, some days of the week every few weeks, days of the month,
+ numbered days of the week such as the last Friday, with counts, end days and exceptions), written out
+ as rule text, and compiled. Every day of the horizon is then checked against the rule the slow way,
+ straight from what it says, to list all the days it goes off.
+
+ For each rule, the benchmark times:
+ - next:    finding the first day it goes off on or after random days, compared with checking day by day
+ - expand:  going through every time it goes off over the horizon, with an iterator
+ - window:  going through the times it goes off in random weeks, with an iterator
+
+ Everything found must match the list.
+**/
+
+#include "BenchmarkSupport.h"
+#include "AlarmRecurrence.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DAY_SECONDS     86400
+#define ALARM_TIME      (7 * 3600)
+#define ZONE_OFFSET     (-5 * 3600)
+#define MAX_EXCEPTIONS  8
+
+static const char *weekdayNames[7] = { "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+static const char *frequencyNames[3] = { "DAILY", "WEEKLY", "MONTHLY" };
+
+typedef struct Rule
+{
+	int frequency;
+	int interval;
+	int weekStart;
+	uint32_t weekdays;
+	
+	// Numbered days of the week, such as 2 (second) or -1 (last), for each day of the week
+	int ordinals[7][2];
+	int ordinalsCount[7];
+	
+	int monthDays[2];
+	int monthDaysCount;
+	
+	int64_t startDay;
+	int64_t untilDay;
+	int count;
+	
+	int64_t exceptions[MAX_EXCEPTIONS];
+	int exceptionsCount;
+} Rule;
+
+static int Weekday(int64_t day)
+{
+	int weekday = (int)((day + 4) % 7);
+	return (weekday < 0) ? (weekday + 7) : weekday;
+}
+
+static int RandomInt(uint64_t *seed, int min, int max)
+{
+	return min + (int)(BenchmarkRandom(seed) % (uint64_t)(max - min + 1));
+}
+
+// RULES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void MakeRule(Rule *rule, uint64_t *seed, int64_t firstDay, int64_t lastDay)
+{
+	memset(rule, 0, sizeof(Rule));
+	
+	rule->startDay = firstDay + RandomInt(seed, 0, (int)(lastDay - firstDay) / 2);
+	rule->untilDay = ALARM_RECURRENCE_NEVER;
+	rule->interval = 1;
+	rule->weekStart = 1;
+	
+	int weekday;
+	
+	switch(RandomInt(seed, 0, 5))
+	{
+		case 0:
+			// Every few days (shift rotations)
+			rule->frequency = ALARM_RECURRENCE_DAILY;
+			rule->interval = RandomInt(seed, 1, 10);
+			break;
+		case 1:
+			// Every day or two, on some days of the week
+			rule->frequency = ALARM_RECURRENCE_DAILY;
+			rule->interval = RandomInt(seed, 1, 2);
+			rule->weekdays = RandomInt(seed, 1, 0x7F);
+			break;
+		case 2:
+			rule->frequency = ALARM_RECURRENCE_WEEKLY;
+			rule->interval = RandomInt(seed, 1, 4);
+			rule->weekStart = RandomInt(seed, 0, 6);
+			if(RandomInt(seed, 0, 3) > 0) rule->weekdays = RandomInt(seed, 1, 0x7F);
+			break;
+		case 3:
+			rule->frequency = ALARM_RECURRENCE_MONTHLY;
+			rule->interval = RandomInt(seed, 1, 3);
+			rule->monthDaysCount = RandomInt(seed, 0, 2);
+			break;
+		case 4:
+			// Such as the second Monday, or the last Friday
+			rule->frequency = ALARM_RECURRENCE_MONTHLY;
+			rule->interval = RandomInt(seed, 1, 3);
+			weekday = RandomInt(seed, 0, 6);
+			rule->ordinalsCount[weekday] = RandomInt(seed, 1, 2);
+			break;
+		default:
+			// Such as Friday the 13th
+			rule->frequency = ALARM_RECURRENCE_MONTHLY;
+			rule->weekdays = 1 << RandomInt(seed, 0, 6);
+			rule->monthDaysCount = 1;
+			break;
+	}
+	
+	int i;
+	for(i = 0; i < rule->monthDaysCount; i++)
+	{
+		int n = RandomInt(seed, 1, 31);
+		rule->monthDays[i] = RandomInt(seed, 0, 3) ? n : -n;
+	}
+	for(weekday = 0; weekday < 7; weekday++)
+	{
+		for(i = 0; i < rule->ordinalsCount[weekday]; i++)
+		{
+			int n = RandomInt(seed, 1, 5);
+			rule->ordinals[weekday][i] = RandomInt(seed, 0, 2) ? n : -n;
+		}
+	}
+	
+	switch(RandomInt(seed, 0, 3))
+	{
+		case 0: rule->count = RandomInt(seed, 1, 500); break;
+		case 1: rule->untilDay = rule->startDay + RandomInt(seed, 0, 5 * 365); break;
+	}
+	
+	rule->exceptionsCount = RandomInt(seed, 0, MAX_EXCEPTIONS);
+	for(i = 0; i < rule->exceptionsCount; i++)
+	{
+		rule->exceptions[i] = rule->startDay + RandomInt(seed, 0, 2 * 365);
+	}
+}
+
+static int FormatDay(char *text, int64_t day)
+{
+	int year, month, dayOfMonth;
+	AlarmRecurrenceDate(day, &year, &month, &dayOfMonth);
+	
+	return sprintf(text, "%04d%02d%02d", year, month, dayOfMonth);
+}
+
+static void FormatRule(const Rule *rule, char *text)
+{
+	int i, weekday;
+	const char *separator = ";BYDAY=";
+	
+	text += sprintf(text, "FREQ=%s;INTERVAL=%d;WKST=%s;DTSTART=", frequencyNames[rule->frequency],
+	                rule->interval, weekdayNames[rule->weekStart]);
+	text += FormatDay(text, rule->startDay);
+	
+	for(weekday = 0; weekday < 7; weekday++)
+	{
+		if(rule->weekdays & (1 << weekday))
+		{
+			text += sprintf(text, "%s%s", separator, weekdayNames[weekday]);
+			separator = ",";
+		}
+		for(i = 0; i < rule->ordinalsCount[weekday]; i++)
+		{
+			text += sprintf(text, "%s%d%s", separator, rule->ordinals[weekday][i], weekdayNames[weekday]);
+			separator = ",";
+		}
+	}
+	for(i = 0; i < rule->monthDaysCount; i++)
+	{
+		text += sprintf(text, (i == 0) ? ";BYMONTHDAY=%d" : ",%d", rule->monthDays[i]);
+	}
+	
+	if(rule->count > 0) text += sprintf(text, ";COUNT=%d", rule->count);
+	if(rule->untilDay != ALARM_RECURRENCE_NEVER)
+	{
+		text += sprintf(text, ";UNTIL=");
+		text += FormatDay(text, rule->untilDay);
+		text += sprintf(text, "T235959Z");
+	}
+	
+	for(i = 0; i < rule->exceptionsCount; i++)
+	{
+		text += sprintf(text, (i == 0) ? ";EXDATE=" : ",");
+		text += FormatDay(text, rule->exceptions[i]);
+	}
+}
+
+/**
+ Returns whether the rule goes off on the given day, straight from what it says (ignoring the count and exceptions).
+**/
+static int IsRuleDay(const Rule *rule, int64_t day)
+{
+	if((day < rule->startDay) || (day > rule->untilDay)) return 0;
+	
+	int weekday = Weekday(day);
+	int startWeekday = Weekday(rule->startDay);
+	int i;
+	
+	if(rule->frequency == ALARM_RECURRENCE_DAILY)
+	{
+		if(((day - rule->startDay) % rule->interval) != 0) return 0;
+		return (rule->weekdays == 0) || (rule->weekdays & (1 << weekday));
+	}
+	
+	if(rule->frequency == ALARM_RECURRENCE_WEEKLY)
+	{
+		uint32_t weekdays = (rule->weekdays != 0) ? rule->weekdays : (1u << startWeekday);
+		if(!(weekdays & (1 << weekday))) return 0;
+		
+		// Count the weeks between the starts of the two weeks
+		int64_t week = day - ((weekday - rule->weekStart + 7) % 7);
+		int64_t startWeek = rule->startDay - ((startWeekday - rule->weekStart + 7) % 7);
+		
+		return ((((week - startWeek) / 7) % rule->interval) == 0);
+	}
+	
+	int year, month, dayOfMonth;
+	int startYear, startMonth, startDayOfMonth;
+	
+	AlarmRecurrenceDate(day, &year, &month, &dayOfMonth);
+	AlarmRecurrenceDate(rule->startDay, &startYear, &startMonth, &startDayOfMonth);
+	
+	int months = ((year - startYear) * 12) + (month - startMonth);
+	if((months % rule->interval) != 0) return 0;
+	
+	int length = (int)(AlarmRecurrenceDay(year + (month == 12), (month % 12) + 1, 1) - AlarmRecurrenceDay(year, month, 1));
+	int fromEnd = length + 1 - dayOfMonth;
+	
+	int isMonthDay = 0;
+	for(i = 0; i < rule->monthDaysCount; i++)
+	{
+		if((rule->monthDays[i] == dayOfMonth) || (rule->monthDays[i] == -fromEnd)) isMonthDay = 1;
+	}
+	
+	int hasWeekdays = (rule->weekdays != 0);
+	int isWeekday = (rule->weekdays & (1 << weekday)) != 0;
+	
+	for(i = 0; i < 7; i++)
+	{
+		if(rule->ordinalsCount[i] > 0) hasWeekdays = 1;
+	}
+	for(i = 0; i < rule->ordinalsCount[weekday]; i++)
+	{
+		int n = rule->ordinals[weekday][i];
+		if((n == ((dayOfMonth - 1) / 7) + 1) || (n == -(((length - dayOfMonth) / 7) + 1))) isWeekday = 1;
+	}
+	
+	if(hasWeekdays && (rule->monthDaysCount > 0)) return isWeekday && isMonthDay;
+	if(hasWeekdays) return isWeekday;
+	if(rule->monthDaysCount > 0) return isMonthDay;
+	
+	return (dayOfMonth == startDayOfMonth);
+}
+
+/**
+ Lists the days the rule goes off, up to the given day. Returns the number of days.
+ Also gets the last day it can go off (after the count or end day), or ALARM_RECURRENCE_NEVER.
+**/
+static uint32_t ListDays(const Rule *rule, int64_t lastDay, int64_t *days, int64_t *endDay)
+{
+	uint32_t count = 0;
+	int occurrences = 0;
+	int64_t day;
+	int i;
+	
+	*endDay = rule->untilDay;
+	
+	for(day = rule->startDay; day <= lastDay; day++)
+	{
+		if(!IsRuleDay(rule, day)) continue;
+		
+		// Exceptions still count towards the count
+		if((rule->count > 0) && (++occurrences == rule->count)) *endDay = day;
+		if(day > *endDay) break;
+		
+		int isException = 0;
+		for(i = 0; i < rule->exceptionsCount; i++)
+		{
+			if(rule->exceptions[i] == day) isException = 1;
+		}
+		if(!isException) days[count++] = day;
+	}
+	return count;
+}
+
+/**
+ Returns the first day on or after the given one that's in the list,
+ or ALARM_RECURRENCE_NEVER if there's none.
+**/
+static int64_t FindDay(const int64_t *days, uint32_t count, int64_t day)
+{
+	uint32_t low = 0, high = count;
+	
+	while(low < high)
+	{
+		uint32_t middle = low + ((high - low) / 2);
+		if(days[middle] < day) low = middle + 1; else high = middle;
+	}
+	return (low < count) ? days[low] : ALARM_RECURRENCE_NEVER;
+}
+
+/**
+ Returns the first day on or after the given one that the rule goes off, checking one day at a time,
+ up to the last day it can go off. The list is only used to know whether the day is an exception or past the count.
+**/
+static int64_t ScanDay(const Rule *rule, const int64_t *days, uint32_t count, int64_t day, int64_t lastDay)
+{
+	if(day < rule->startDay) day = rule->startDay;
+	
+	for(; day <= lastDay; day++)
+	{
+		if(IsRuleDay(rule, day) && (FindDay(days, count, day) == day)) return day;
+	}
+	return ALARM_RECURRENCE_NEVER;
+}
+
+static int32_t ZoneOffset(void *context, int64_t time)
+{
+	return ZONE_OFFSET;
+}
+
+// BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n rules] [-y years] [-q queries] [-r seed]\n", name);
+	fprintf(stderr, "  -n  number of rules (default 2000)\n");
+	fprintf(stderr, "  -y  length of the horizon, in years (default 30)\n");
+	fprintf(stderr, "  -q  next day queries and windows for each rule (default 100)\n");
+	fprintf(stderr, "  -r  seed (default 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t ruleCount = 2000;
+	uint32_t years = 30;
+	uint32_t queries = 100;
+	uint64_t seed = 1;
+	int c;
+	
+	while((c = getopt(argc, argv, "n:y:q:r:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'n': ruleCount = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'y': years = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'q': queries = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'r': seed = strtoull(optarg, NULL, 0); break;
+			default:
+				PrintUsage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if((ruleCount == 0) || (years == 0) || (queries == 0))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	if(seed == 0) seed = 1;
+	
+	// The horizon starts on January 1st 2000
+	int64_t firstDay = AlarmRecurrenceDay(2000, 1, 1);
+	int64_t lastDay = AlarmRecurrenceDay(2000 + years, 1, 1) - 1;
+	
+	int64_t *days = malloc((lastDay - firstDay + 1) * sizeof(int64_t));
+	int64_t *queryDays = malloc(queries * sizeof(int64_t));
+	char text[512];
+	
+	double compileTime = 0, nextTime = 0, scanTime = 0, expandTime = 0, windowTime = 0;
+	uint64_t occurrences = 0, windowOccurrences = 0;
+	uint32_t mismatches = 0, invalid = 0;
+	uint32_t r, q;
+	
+	for(r = 0; r < ruleCount; r++)
+	{
+		Rule rule;
+		MakeRule(&rule, &seed, firstDay, lastDay);
+		FormatRule(&rule, text);
+		
+		double start = BenchmarkTime();
+		AlarmRecurrence *recurrence = AlarmRecurrenceCreate(text, firstDay);
+		compileTime += BenchmarkTime() - start;
+		
+		if(recurrence == NULL)
+		{
+			fprintf(stderr, "Not understood: %s\n", text);
+			invalid++;
+			continue;
+		}
+		
+		int64_t endDay;
+		uint32_t count = ListDays(&rule, lastDay, days, &endDay);
+		
+		// It may go off after the horizon, unless it's ended within it
+		int hasEnded = (endDay <= lastDay);
+		int64_t scanLastDay = hasEnded ? endDay : lastDay;
+		
+		for(q = 0; q < queries; q++)
+		{
+			queryDays[q] = rule.startDay - 30 + RandomInt(&seed, 0, (int)(lastDay - rule.startDay));
+		}
+		
+		// Next day
+		// The checksum wraps around (the sentinel is INT64_MAX), so it's unsigned
+		uint64_t result = 0;
+		start = BenchmarkTime();
+		for(q = 0; q < queries; q++)
+		{
+			int64_t next = AlarmRecurrenceNextDay(recurrence, queryDays[q]);
+			int64_t expected = FindDay(days, count, queryDays[q]);
+			
+			if((next != expected) && ((expected != ALARM_RECURRENCE_NEVER) || hasEnded || (next <= lastDay)))
+			{
+				if(mismatches++ < 10)
+				{
+					fprintf(stderr, "%s\n  from day %lld: next %lld, expected %lld\n", text,
+					        (long long)queryDays[q], (long long)next, (long long)expected);
+				}
+			}
+			// Checking day by day stops at the end of the horizon
+			result += (uint64_t)((next > lastDay) ? ALARM_RECURRENCE_NEVER : next);
+		}
+		nextTime += BenchmarkTime() - start;
+		
+		start = BenchmarkTime();
+		for(q = 0; q < queries; q++)
+		{
+			result -= (uint64_t)ScanDay(&rule, days, count, queryDays[q], scanLastDay);
+		}
+		scanTime += BenchmarkTime() - start;
+		
+		// Expanding the whole horizon, from the first time it goes off
+		if(count > 0)
+		{
+			AlarmRecurrenceIterator iterator;
+			int64_t firstTime = (days[0] * DAY_SECONDS) + ALARM_TIME - ZONE_OFFSET;
+			int64_t end = ((lastDay + 1) * DAY_SECONDS) - ZONE_OFFSET;
+			int64_t time;
+			uint32_t i = 0;
+			
+			start = BenchmarkTime();
+			AlarmRecurrenceIteratorInit(&iterator, recurrence, firstTime, ZONE_OFFSET, firstTime, end, ZoneOffset, NULL);
+			
+			while(AlarmRecurrenceIteratorNext(&iterator, &time))
+			{
+				if((i >= count) || (time != (days[i] * DAY_SECONDS) + ALARM_TIME - ZONE_OFFSET))
+				{
+					if(mismatches++ < 10) fprintf(stderr, "%s\n  expanded time %u is wrong\n", text, i);
+					break;
+				}
+				i++;
+			}
+			expandTime += BenchmarkTime() - start;
+			
+			if(i != count)
+			{
+				if(mismatches++ < 10) fprintf(stderr, "%s\n  expanded %u times, expected %u\n", text, i, count);
+			}
+			occurrences += i;
+			
+			// Random weeks
+			start = BenchmarkTime();
+			for(q = 0; q < queries; q++)
+			{
+				int64_t windowStart = (queryDays[q] * DAY_SECONDS) - ZONE_OFFSET;
+				uint32_t found = 0;
+				
+				AlarmRecurrenceIteratorInit(&iterator, recurrence, firstTime, ZONE_OFFSET,
+				                            windowStart, windowStart + (7 * DAY_SECONDS), ZoneOffset, NULL);
+				
+				while(AlarmRecurrenceIteratorNext(&iterator, &time))
+				{
+					found++;
+				}
+				windowOccurrences += found;
+				
+				int64_t day = FindDay(days, count, queryDays[q]);
+				uint32_t expected = 0;
+				while((day < queryDays[q] + 7) && (day <= lastDay))
+				{
+					expected++;
+					day = FindDay(days, count, day + 1);
+				}
+				if((found != expected) && (queryDays[q] + 7 <= lastDay) && (mismatches++ < 10))
+				{
+					fprintf(stderr, "%s\n  week from day %lld: %u times, expected %u\n", text,
+					        (long long)queryDays[q], found, expected);
+				}
+			}
+			windowTime += BenchmarkTime() - start;
+			
+			// The next time after now, as an alarm that first went off on the first day is updated
+			for(q = 0; q < queries; q++)
+			{
+				if(queryDays[q] < days[0]) continue;
+				
+				int64_t now = (queryDays[q] * DAY_SECONDS) + ALARM_TIME - ZONE_OFFSET;
+				int64_t next = AlarmRecurrenceNext(recurrence, firstTime, ZONE_OFFSET, now, ZoneOffset, NULL);
+				int64_t day = FindDay(days, count, queryDays[q] + 1);
+				int64_t expected = (day == ALARM_RECURRENCE_NEVER) ? day : ((day * DAY_SECONDS) + ALARM_TIME - ZONE_OFFSET);
+				
+				if((next != expected) && ((expected != ALARM_RECURRENCE_NEVER) || hasEnded || (next <= end)))
+				{
+					if(mismatches++ < 10) fprintf(stderr, "%s\n  next time after day %lld is wrong\n", text, (long long)queryDays[q]);
+				}
+			}
+		}
+		
+		if(result != 0)
+		{
+			if(mismatches++ < 10) fprintf(stderr, "%s\n  checking day by day found other days\n", text);
+		}
+		
+		AlarmRecurrenceFree(recurrence);
+	}
+	
+	uint32_t totalQueries = ruleCount * queries;
+	
+	printf("%u rules over %u years, %u queries each\n\n", ruleCount, years, queries);
+	printf("%-18s %12s %14s\n", "", "time (ms)", "ns each");
+	printf("%-18s %12.2f %14.1f\n", "compile", compileTime * 1000.0, compileTime * 1e9 / ruleCount);
+	printf("%-18s %12.2f %14.1f\n", "next day", nextTime * 1000.0, nextTime * 1e9 / totalQueries);
+	printf("%-18s %12.2f %14.1f\n", "next day (scan)", scanTime * 1000.0, scanTime * 1e9 / totalQueries);
+	printf("%-18s %12.2f %14.1f   (%llu times)\n", "expand", expandTime * 1000.0,
+	       (occurrences > 0) ? (expandTime * 1e9 / occurrences) : 0.0, (unsigned long long)occurrences);
+	printf("%-18s %12.2f %14.1f   (per week, %llu times)\n", "week", windowTime * 1000.0,
+	       windowTime * 1e9 / totalQueries, (unsigned long long)windowOccurrences);
+	
+	if(mismatches > 0) fprintf(stderr, "%u mismatches\n", mismatches);
+	if(invalid > 0) fprintf(stderr, "%u rules not understood\n", invalid);
+	
+	free(days);
+	free(queryDays);
+	
+	return ((mismatches > 0) || (invalid > 0));
+}
@@ -0,0 +1,255 @@
+/**
+ Compares finding the next time of weekly alarms as Alarm -updateTime does, with the recurrence of their schedule
+ (see AlarmRecurrence.h), with moving them forward one scheduled day at a time, as -updateTime used to.
+
+ Alarms are spread over random schedules and times of day, and have been stale (the computer was asleep,
+ or the application wasn't running) for up to a given number of days. Times are in US Eastern time,
+ so the alarms cross daylight saving time changes, including times of day that are skipped or repeated.
+ Both ways must find the same next time for every alarm.
+**/
+
+#include "BenchmarkSupport.h"
+#include "AlarmRecurrence.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DAY_SECONDS   86400
+#define HOUR_SECONDS  3600
+
+// From January 1st 2007 (when the current US daylight saving time rules started)
+#define BASE_TIME     1167609600LL
+
+/**
+ Divides, rounding towards negative infinity (so times before 1970 fall on the right day).
+**/
+static inline int64_t FloorDivide(int64_t a, int64_t b)
+{
+	int64_t quotient = a / b;
+	
+	if(((a % b) != 0) && ((a < 0) != (b < 0))) quotient--;
+	return quotient;
+}
+
+/**
+ Returns the day of the week (0 for Sunday, to 6 for Saturday) of the given local time.
+**/
+static int Weekday(int64_t localTime)
+{
+	// January 1st 1970 was a Thursday
+	int weekday = (int)((FloorDivide(localTime, DAY_SECONDS) + 4) % 7);
+	
+	return (weekday < 0) ? (weekday + 7) : weekday;
+}
+
+/**
+ Returns the number of days (0 to 6) from the given day of the week, to the first scheduled day on or after it.
+**/
+static int DaysUntil(uint32_t schedule, int weekday)
+{
+	int days = 0;
+	
+	while((schedule & (1 << ((weekday + days) % 7))) == 0) days++;
+	return days;
+}
+
+// TIME ZONE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the number of days from January 1st 1970 to the given date (in the proleptic Gregorian calendar).
+**/
+static int64_t DaysFromCivil(int64_t year, int month, int day)
+{
+	year -= (month <= 2);
+	
+	int64_t era = ((year >= 0) ? year : (year - 399)) / 400;
+	int64_t yearOfEra = year - (era * 400);
+	int64_t dayOfYear = ((153 * (month + ((month > 2) ? -3 : 9))) + 2) / 5 + day - 1;
+	int64_t dayOfEra = (yearOfEra * 365) + (yearOfEra / 4) - (yearOfEra / 100) + dayOfYear;
+	
+	return (era * 146097) + dayOfEra - 719468;
+}
+
+/**
+ Returns the day (since 1970) of the nth Sunday of the given month.
+**/
+static int64_t NthSunday(int64_t year, int month, int n)
+{
+	int64_t first = DaysFromCivil(year, month, 1);
+	int weekday = (int)((first + 4) % 7);
+	
+	return first + ((7 - weekday) % 7) + ((n - 1) * 7);
+}
+
+/**
+ US Eastern time: UTC-5, and UTC-4 from 2AM on the second Sunday of March, until 2AM on the first Sunday of November.
+**/
+static int32_t EasternOffset(void *context, int64_t time)
+{
+	int64_t *calls = (int64_t *)context;
+	(*calls)++;
+	
+	// The year is near enough from the average length of a year, as the changes are far from new year
+	int64_t year = 1970 + (time / 31556952);
+	
+	int64_t start = (NthSunday(year, 3, 2) * DAY_SECONDS) + (2 * HOUR_SECONDS) + (5 * HOUR_SECONDS);
+	int64_t end   = (NthSunday(year, 11, 1) * DAY_SECONDS) + (2 * HOUR_SECONDS) + (4 * HOUR_SECONDS);
+	
+	return ((time >= start) && (time < end)) ? (-4 * HOUR_SECONDS) : (-5 * HOUR_SECONDS);
+}
+
+// STEPPING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Moves the alarm forward to the next scheduled day, until it's after now, like the old -updateTime.
+ Each step adds whole days to the local time, as adding days to an NSCalendarDate does.
+
+ The old -updateTime skipped a day if the computer woke in between the two times of a repeated hour,
+ after the first. Here, as with AlarmRecurrenceNext, the alarm goes off at the second one instead.
+**/
+static int64_t StepToNext(uint32_t schedule, int64_t time, int64_t now, int64_t *steps, int64_t *calls)
+{
+	int32_t offset = EasternOffset(calls, time);
+	int64_t localTime = time + offset;
+	
+	while(time <= now)
+	{
+		int weekday = Weekday(localTime);
+		int days = DaysUntil(schedule, (weekday + 1) % 7) + 1;
+		
+		localTime += days * DAY_SECONDS;
+		time = WeeklyScheduleLocalToUTC(localTime, offset, EasternOffset, calls);
+		offset = EasternOffset(calls, time);
+		
+		if(time <= now)
+		{
+			int32_t laterOffset = EasternOffset(calls, time + HOUR_SECONDS);
+			
+			if((localTime - laterOffset > now) && (EasternOffset(calls, localTime - laterOffset) == laterOffset))
+			{
+				time = localTime - laterOffset;
+				offset = laterOffset;
+			}
+		}
+		
+		(*steps)++;
+	}
+	
+	return time;
+}
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n alarms] [-d days] [-r seed]\n", name);
+	fprintf(stderr, "  -n  number of alarms (default 100000)\n");
+	fprintf(stderr, "  -d  longest time the alarms have been stale, in days (default 365)\n");
+	fprintf(stderr, "  -r  seed (default 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t count = 100000;
+	uint32_t maxDays = 365;
+	uint64_t seed = 1;
+	int c;
+	
+	while((c = getopt(argc, argv, "n:d:r:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'n': count = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'd': maxDays = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'r': seed = strtoull(optarg, NULL, 0); break;
+			default:
+				PrintUsage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if((count == 0) || (maxDays == 0))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	if(seed == 0) seed = 1;
+	
+	uint32_t *schedules = malloc(count * sizeof(uint32_t));
+	int64_t *times = malloc(count * sizeof(int64_t));
+	int64_t *nows = malloc(count * sizeof(int64_t));
+	int64_t *stepped = malloc(count * sizeof(int64_t));
+	uint32_t i;
+	
+	// The recurrence of each schedule, as alarms keep it
+	AlarmRecurrence *recurrences[WEEKLY_SCHEDULE_MASK + 1];
+	for(i = 0; i <= WEEKLY_SCHEDULE_MASK; i++)
+	{
+		recurrences[i] = AlarmRecurrenceCreateWeekly(i);
+	}
+	
+	for(i = 0; i < count; i++)
+	{
+		// Any schedule but none, at a whole minute of the day (half past 1 and 2 are skipped or repeated at times)
+		schedules[i] = 1 + (uint32_t)(BenchmarkRandom(&seed) % WEEKLY_SCHEDULE_MASK);
+		
+		int64_t day = (int64_t)(BenchmarkRandom(&seed) % (4 * 365));
+		int64_t minute = (int64_t)(BenchmarkRandom(&seed) % (24 * 60));
+		int64_t localTime = BASE_TIME + (day * DAY_SECONDS) + (minute * 60);
+		
+		int64_t calls = 0;
+		times[i] = WeeklyScheduleLocalToUTC(localTime, -5 * HOUR_SECONDS, EasternOffset, &calls);
+		nows[i] = times[i] + (int64_t)(BenchmarkRandom(&seed) % ((int64_t)maxDays * DAY_SECONDS));
+	}
+	
+	int64_t steps = 0, stepCalls = 0;
+	double start = BenchmarkTime();
+	for(i = 0; i < count; i++)
+	{
+		stepped[i] = StepToNext(schedules[i], times[i], nows[i], &steps, &stepCalls);
+	}
+	double stepTime = BenchmarkTime() - start;
+	
+	int64_t nextCalls = 0;
+	uint32_t mismatches = 0;
+	start = BenchmarkTime();
+	for(i = 0; i < count; i++)
+	{
+		int32_t offset = EasternOffset(&nextCalls, times[i]);
+		int64_t next = AlarmRecurrenceNext(recurrences[schedules[i]], times[i], offset, nows[i],
+		                                   EasternOffset, &nextCalls);
+		
+		if(next != stepped[i])
+		{
+			if(mismatches < 10)
+			{
+				fprintf(stderr, "Schedule 0x%02x from %lld, now %lld: stepped to %lld, next is %lld\n",
+				        schedules[i], (long long)times[i], (long long)nows[i], (long long)stepped[i], (long long)next);
+			}
+			mismatches++;
+		}
+	}
+	double nextTime = BenchmarkTime() - start;
+	
+	printf("%u alarms, stale for up to %u days\n\n", count, maxDays);
+	printf("%-10s %12s %14s %14s\n", "method", "time (ms)", "ns per alarm", "zone lookups");
+	printf("%-10s %12.2f %14.1f %14.2f   (%.1f steps per alarm)\n", "stepping",
+	       stepTime * 1000.0, stepTime * 1e9 / count, (double)stepCalls / count, (double)steps / count);
+	printf("%-10s %12.2f %14.1f %14.2f\n", "recurrence", nextTime * 1000.0, nextTime * 1e9 / count, (double)nextCalls / count);
+	
+	if(mismatches > 0)
+	{
+		fprintf(stderr, "%u alarms got a different next time\n", mismatches);
+	}
+	
+	for(i = 0; i <= WEEKLY_SCHEDULE_MASK; i++)
+	{
+		AlarmRecurrenceFree(recurrences[i]);
+	}
+	free(schedules);
+	free(times);
+	free(nows);
+	free(stepped);
+	
+	return (mismatches > 0);
+}
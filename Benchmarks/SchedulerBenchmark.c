@@ -0,0 +1,306 @@
+/**
+ Compares the alarm heap used by AlarmScheduler (see AlarmHeap.h) with the sorted array it replaced.
+
+ The sorted array is modeled on the old AlarmScheduler: alarms were inserted by walking the array
+ to the first later alarm, removed by searching the array for them, and everything after the insertion
+ or removal point was moved along.
+
+ For each number of alarms, the same operations are timed on both:
+ - build:   adding every alarm (as when the alarms are read from the preferences)
+ - fire:    the next alarm going off, and being rescheduled a week later (alarmStatus)
+ - edit:    changing the time of random alarms (setAlarm:forReference:)
+ - update:  updating the time of every alarm (updateAllAlarms, after waking from sleep)
+ - remove:  removing random alarms (removeAlarm:)
+
+ The sorted array is quadratic, so by default it's only run up to 20,000 alarms (see -o).
+**/
+
+#include "BenchmarkSupport.h"
+#include "AlarmHeap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Alarms are spread over a week of whole minutes (so many share a time), from Monday, January 1st 2007
+#define BASE_TIME     1167609600LL
+#define WEEK_SECONDS  (7 * 24 * 60 * 60)
+
+typedef struct SortedAlarm
+{
+	int64_t key;
+	int32_t handle;
+} SortedAlarm;
+
+typedef struct SortedArray
+{
+	SortedAlarm *alarms;
+	uint32_t count;
+} SortedArray;
+
+// SORTED ARRAY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Inserts the alarm before the first one with a later time, like the old sortAndAddAlarm:.
+**/
+static void SortedInsert(SortedArray *array, int32_t handle, int64_t key)
+{
+	uint32_t i = 0;
+	while((i < array->count) && !(key < array->alarms[i].key))
+	{
+		i++;
+	}
+	
+	memmove(&array->alarms[i + 1], &array->alarms[i], (array->count - i) * sizeof(SortedAlarm));
+	array->alarms[i].key = key;
+	array->alarms[i].handle = handle;
+	array->count++;
+}
+
+/**
+ Searches for the alarm and removes it, like removeObject: did.
+**/
+static void SortedRemove(SortedArray *array, int32_t handle)
+{
+	uint32_t i = 0;
+	while((i < array->count) && (array->alarms[i].handle != handle))
+	{
+		i++;
+	}
+	if(i == array->count) return;
+	
+	array->count--;
+	memmove(&array->alarms[i], &array->alarms[i + 1], (array->count - i) * sizeof(SortedAlarm));
+}
+
+// BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct Times
+{
+	double build, fire, edit, update, remove;
+} Times;
+
+static int64_t RandomKey(uint64_t *seed)
+{
+	return BASE_TIME + ((int64_t)(BenchmarkRandom(seed) % (WEEK_SECONDS / 60)) * 60);
+}
+
+/**
+ Returns 0 if the heap doesn't give it's handles in order of key, or doesn't match the given keys.
+**/
+static int CheckHeap(const AlarmHeap *heap, const int64_t *keys, int32_t *sorted)
+{
+	uint32_t count = AlarmHeapSorted(heap, sorted);
+	uint32_t i;
+	
+	if(count != AlarmHeapCount(heap)) return 0;
+	if((count > 0) && (AlarmHeapPeek(heap) != sorted[0])) return 0;
+	
+	for(i = 0; i < count; i++)
+	{
+		if(AlarmHeapKey(heap, sorted[i]) != keys[sorted[i]]) return 0;
+		if((i > 0) && (keys[sorted[i - 1]] > keys[sorted[i]])) return 0;
+	}
+	return 1;
+}
+
+static int RunHeap(uint32_t n, uint32_t operations, uint64_t seed, Times *times)
+{
+	int64_t *keys = malloc(n * sizeof(int64_t));
+	int32_t *sorted = malloc(n * sizeof(int32_t));
+	AlarmHeap *heap = AlarmHeapCreate(n);
+	uint32_t i;
+	int isValid = 1;
+	
+	double start = BenchmarkTime();
+	for(i = 0; i < n; i++)
+	{
+		keys[i] = RandomKey(&seed);
+		AlarmHeapInsert(heap, i, keys[i]);
+	}
+	times->build = BenchmarkTime() - start;
+	
+	isValid &= CheckHeap(heap, keys, sorted);
+	
+	start = BenchmarkTime();
+	for(i = 0; i < operations; i++)
+	{
+		int32_t next = AlarmHeapPeek(heap);
+		
+		keys[next] += WEEK_SECONDS;
+		AlarmHeapUpdate(heap, next, keys[next]);
+	}
+	times->fire = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	for(i = 0; i < operations; i++)
+	{
+		int32_t handle = (int32_t)(BenchmarkRandom(&seed) % n);
+		
+		keys[handle] = RandomKey(&seed);
+		AlarmHeapUpdate(heap, handle, keys[handle]);
+	}
+	times->edit = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	for(i = 0; i < n; i++)
+	{
+		keys[i] += WEEK_SECONDS;
+		AlarmHeapUpdate(heap, i, keys[i]);
+	}
+	times->update = BenchmarkTime() - start;
+	
+	isValid &= CheckHeap(heap, keys, sorted);
+	
+	start = BenchmarkTime();
+	for(i = 0; i < operations; i++)
+	{
+		AlarmHeapRemove(heap, (int32_t)(BenchmarkRandom(&seed) % n));
+	}
+	times->remove = BenchmarkTime() - start;
+	
+	isValid &= CheckHeap(heap, keys, sorted);
+	
+	// What's left must come out in order
+	int64_t last = 0;
+	while(AlarmHeapCount(heap) > 0)
+	{
+		int32_t next = AlarmHeapPeek(heap);
+		
+		if(keys[next] < last) isValid = 0;
+		last = keys[next];
+		
+		AlarmHeapRemove(heap, next);
+	}
+	
+	AlarmHeapFree(heap);
+	free(keys);
+	free(sorted);
+	
+	return isValid;
+}
+
+static void RunSorted(uint32_t n, uint32_t operations, uint64_t seed, Times *times)
+{
+	int64_t *keys = malloc(n * sizeof(int64_t));
+	SortedArray array;
+	uint32_t i;
+	
+	array.alarms = malloc((n + 1) * sizeof(SortedAlarm));
+	array.count = 0;
+	
+	double start = BenchmarkTime();
+	for(i = 0; i < n; i++)
+	{
+		keys[i] = RandomKey(&seed);
+		SortedInsert(&array, i, keys[i]);
+	}
+	times->build = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	for(i = 0; i < operations; i++)
+	{
+		int32_t next = array.alarms[0].handle;
+		
+		keys[next] += WEEK_SECONDS;
+		SortedRemove(&array, next);
+		SortedInsert(&array, next, keys[next]);
+	}
+	times->fire = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	for(i = 0; i < operations; i++)
+	{
+		int32_t handle = (int32_t)(BenchmarkRandom(&seed) % n);
+		
+		keys[handle] = RandomKey(&seed);
+		SortedRemove(&array, handle);
+		SortedInsert(&array, handle, keys[handle]);
+	}
+	times->edit = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	for(i = 0; i < n; i++)
+	{
+		keys[i] += WEEK_SECONDS;
+		SortedRemove(&array, i);
+		SortedInsert(&array, i, keys[i]);
+	}
+	times->update = BenchmarkTime() - start;
+	
+	start = BenchmarkTime();
+	for(i = 0; i < operations; i++)
+	{
+		SortedRemove(&array, (int32_t)(BenchmarkRandom(&seed) % n));
+	}
+	times->remove = BenchmarkTime() - start;
+	
+	free(array.alarms);
+	free(keys);
+}
+
+static void PrintTimes(const char *name, uint32_t n, const Times *times)
+{
+	printf("%9u  %-6s %10.2f %10.2f %10.2f %10.2f %10.2f\n", n, name,
+	       times->build * 1000.0, times->fire * 1000.0, times->edit * 1000.0,
+	       times->update * 1000.0, times->remove * 1000.0);
+}
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-o max] [-k operations] [-r seed]\n", name);
+	fprintf(stderr, "  -o  largest number of alarms to run the sorted array with (default 20000)\n");
+	fprintf(stderr, "  -k  alarms fired, edited and removed for each size (default 10000)\n");
+	fprintf(stderr, "  -r  seed (default 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t sizes[] = { 10000, 100000, 1000000 };
+	uint32_t sortedMax = 20000;
+	uint32_t operations = 10000;
+	uint64_t seed = 1;
+	int failed = 0;
+	int c;
+	
+	while((c = getopt(argc, argv, "o:k:r:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'o': sortedMax = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'k': operations = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'r': seed = strtoull(optarg, NULL, 0); break;
+			default:
+				PrintUsage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if(seed == 0) seed = 1;
+	
+	printf("%u operations of each kind, times in ms\n\n", operations);
+	printf("%9s  %-6s %10s %10s %10s %10s %10s\n", "alarms", "store", "build", "fire", "edit", "update", "remove");
+	
+	uint32_t s;
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		Times times;
+		
+		if(sizes[s] <= sortedMax)
+		{
+			RunSorted(sizes[s], operations, seed, &times);
+			PrintTimes("array", sizes[s], &times);
+		}
+		
+		if(!RunHeap(sizes[s], operations, seed, &times))
+		{
+			fprintf(stderr, "Heap out of order with %u alarms\n", sizes[s]);
+			failed = 1;
+		}
+		PrintTimes("heap", sizes[s], &times);
+	}
+	
+	return failed;
+}
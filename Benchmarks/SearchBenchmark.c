@@ -0,0 +1,229 @@
+/**
+ Compares searching the library with the trigram index against scanning the search corpus.
+
+ A library of N tracks is built with made up names, artists and albums.
+ For each query length (1 to 4 characters), random substrings of the track names are searched for,
+ both by scanning and with the index, across the entire library, on one thread and on every processor.
+ The mean, median and 95th percentile latencies are reported.
+
+ Every query is checked to return identical results every way.
+
+ Usage: SearchBenchmark [threads]  (defaults to the number of processors)
+**/
+
+#include "BenchmarkSupport.h"
+#include "ITunesTrigram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define QUERY_COUNT  200
+
+static const char *syllables[] = {
+	"ka", "lo", "mi", "ne", "ru", "sa", "ti", "vo", "den", "mar", "sol", "tre", "bel", "cor", "fin", "gal",
+	"har", "jun", "lis", "mon", "nor", "pel", "qui", "ros", "sig", "tor", "ul", "ven", "wes", "xa", "yor", "zen"
+};
+#define SYLLABLE_COUNT  (sizeof(syllables) / sizeof(syllables[0]))
+
+/**
+ Writes a made up phrase of the given number of words (each 1 to 3 syllables) to the buffer.
+**/
+static int MakePhrase(char *buffer, int words, uint64_t *seed)
+{
+	int length = 0;
+	int w;
+	for(w = 0; w < words; w++)
+	{
+		if(w > 0) buffer[length++] = ' ';
+		
+		int count = 1 + (int)(BenchmarkRandom(seed) % 3);
+		int s;
+		for(s = 0; s < count; s++)
+		{
+			const char *syllable = syllables[BenchmarkRandom(seed) % SYLLABLE_COUNT];
+			size_t syllableLength = strlen(syllable);
+			
+			memcpy(buffer + length, syllable, syllableLength);
+			length += syllableLength;
+		}
+		if(s == 1) buffer[0] &= ~0x20;
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+static ITunesLibrary * BuildLibrary(uint32_t count, uint64_t *seed)
+{
+	ITunesLibrary *lib = ITunesLibraryCreate();
+	char buffer[256];
+	uint32_t i;
+	
+	for(i = 0; i < count; i++)
+	{
+		ITunesTrack *track = ITunesLibraryAddTrack(lib);
+		track->trackID = (int32_t)(i + 1);
+		track->persistentID = BenchmarkRandom(seed);
+		
+		int length = MakePhrase(buffer, 1 + (int)(BenchmarkRandom(seed) % 4), seed);
+		track->name = ITunesLibraryAddString(lib, buffer, length);
+		
+		// Artists and albums repeat, as they do in real libraries
+		uint64_t artistSeed = 1 + (BenchmarkRandom(seed) % (count / 20 + 1));
+		length = MakePhrase(buffer, 2, &artistSeed);
+		track->artist = ITunesLibraryAddString(lib, buffer, length);
+		
+		uint64_t albumSeed = 1000000 + (BenchmarkRandom(seed) % (count / 10 + 1));
+		length = MakePhrase(buffer, 3, &albumSeed);
+		track->album = ITunesLibraryAddString(lib, buffer, length);
+	}
+	
+	ITunesLibraryFinish(lib);
+	return lib;
+}
+
+static int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static void PrintTimes(const char *label, double *times, int count)
+{
+	double total = 0;
+	int i;
+	for(i = 0; i < count; i++)
+	{
+		total += times[i];
+	}
+	qsort(times, count, sizeof(double), CompareDoubles);
+	
+	printf("  %-16s mean %8.3f  p50 %8.3f  p95 %8.3f ms\n", label,
+	       total * 1000.0 / count, times[count / 2] * 1000.0, times[(count * 95) / 100] * 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t sizes[] = { 10000, 100000, 250000 };
+	
+	ITunesSearchOptions parallel = { 1, NULL, 0 };
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if(processors > 1) parallel.threadsCount = (uint32_t)processors;
+	if(argc > 1) parallel.threadsCount = (uint32_t)atoi(argv[1]);
+	
+	printf("Parallel searches use %u threads\n", parallel.threadsCount);
+	
+	unsigned s;
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		uint32_t count = sizes[s];
+		uint64_t seed = 42;
+		
+		ITunesLibrary *lib = BuildLibrary(count, &seed);
+		ITunesSearchCorpus *corpus = ITunesSearchCorpusCreate(lib);
+		
+		double start = BenchmarkTime();
+		ITunesTrigramIndex *index = ITunesTrigramIndexCreate(corpus);
+		double buildTime = BenchmarkTime() - start;
+		
+		printf("%u tracks: index built in %.1f ms, %.1f KB (corpus %.1f KB)\n", count, buildTime * 1000.0,
+		       ITunesTrigramIndexSize(index) / 1024.0,
+		       (corpus->columns[0].length + corpus->columns[1].length + corpus->columns[2].length) / 1024.0);
+		
+		int32_t *rows = malloc(count * sizeof(int32_t));
+		int32_t *scanResult = malloc(count * sizeof(int32_t));
+		int32_t *indexResult = malloc(count * sizeof(int32_t));
+		int32_t *parallelResult = malloc(count * sizeof(int32_t));
+		double scanTimes[QUERY_COUNT], indexTimes[QUERY_COUNT];
+		double parallelScanTimes[QUERY_COUNT], parallelIndexTimes[QUERY_COUNT];
+		uint32_t i;
+		
+		for(i = 0; i < count; i++)
+		{
+			rows[i] = i;
+		}
+		
+		size_t queryLength;
+		for(queryLength = 1; queryLength <= 4; queryLength++)
+		{
+			uint64_t matches = 0;
+			int q;
+			for(q = 0; q < QUERY_COUNT; q++)
+			{
+				// Pick a substring of a random track name (that doesn't contain a space)
+				char query[8];
+				const char *name;
+				size_t nameLength, offset;
+				do
+				{
+					uint32_t row = (uint32_t)(BenchmarkRandom(&seed) % count);
+					name = corpus->columns[ITUNES_SEARCH_COLUMN_NAME].blob + corpus->columns[0].offsets[row];
+					nameLength = strlen(name);
+					offset = (nameLength > queryLength) ? (BenchmarkRandom(&seed) % (nameLength - queryLength + 1)) : 0;
+				}
+				while((nameLength < queryLength) || memchr(name + offset, ' ', queryLength));
+				
+				memcpy(query, name + offset, queryLength);
+				query[queryLength] = '\0';
+				
+				double t0 = BenchmarkTime();
+				uint32_t scanCount = ITunesSearchFilter(corpus, NULL, query, queryLength, rows, count, scanResult);
+				double t1 = BenchmarkTime();
+				uint32_t indexCount = ITunesTrigramIndexFilter(index, corpus, NULL, query, queryLength, rows, count, indexResult);
+				double t2 = BenchmarkTime();
+				
+				if((scanCount != indexCount) || (memcmp(scanResult, indexResult, scanCount * sizeof(int32_t)) != 0))
+				{
+					printf("Results differ for \"%s\" (scan %u, index %u)\n", query, scanCount, indexCount);
+					return 1;
+				}
+				
+				double t3 = BenchmarkTime();
+				uint32_t parallelCount = ITunesSearchFilter(corpus, &parallel, query, queryLength, rows, count, parallelResult);
+				double t4 = BenchmarkTime();
+				
+				if((parallelCount != scanCount) || (memcmp(scanResult, parallelResult, scanCount * sizeof(int32_t)) != 0))
+				{
+					printf("Parallel scan results differ for \"%s\" (%u, %u)\n", query, scanCount, parallelCount);
+					return 1;
+				}
+				
+				double t5 = BenchmarkTime();
+				parallelCount = ITunesTrigramIndexFilter(index, corpus, &parallel, query, queryLength, rows, count, parallelResult);
+				double t6 = BenchmarkTime();
+				
+				if((parallelCount != scanCount) || (memcmp(scanResult, parallelResult, scanCount * sizeof(int32_t)) != 0))
+				{
+					printf("Parallel index results differ for \"%s\" (%u, %u)\n", query, scanCount, parallelCount);
+					return 1;
+				}
+				
+				scanTimes[q] = t1 - t0;
+				indexTimes[q] = t2 - t1;
+				parallelScanTimes[q] = t4 - t3;
+				parallelIndexTimes[q] = t6 - t5;
+				matches += scanCount;
+			}
+			
+			printf(" %u character queries (%llu matches on average)\n", (unsigned)queryLength,
+			       (unsigned long long)(matches / QUERY_COUNT));
+			PrintTimes("scan", scanTimes, QUERY_COUNT);
+			PrintTimes("index", indexTimes, QUERY_COUNT);
+			PrintTimes("scan  (parallel)", parallelScanTimes, QUERY_COUNT);
+			PrintTimes("index (parallel)", parallelIndexTimes, QUERY_COUNT);
+		}
+		
+		free(rows);
+		free(scanResult);
+		free(indexResult);
+		free(parallelResult);
+		ITunesTrigramIndexFree(index);
+		ITunesSearchCorpusFree(corpus);
+		ITunesLibraryFree(lib);
+	}
+	
+	return 0;
+}
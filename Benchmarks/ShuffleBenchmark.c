@@ -0,0 +1,250 @@
+/**
+ Measures the cost of shuffling a playlist.
+
+ The player used to shuffle by removing random items from an array one at a time, which moves O(n^2) items
+ (simulated here with memmove on an array of trackIDs, like NSMutableArray does).
+ This is compared with a complete Fisher-Yates shuffle, and with the lazy reshuffle the player now uses,
+ which only draws the next few positions (the current track plus the look-ahead).
+
+ Each run also checks that the shuffles are permutations, that a seed always gives the same order,
+ and that every item is equally likely to end up in every position.
+**/
+
+#include "BenchmarkSupport.h"
+#include "ITunesShuffle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_SEED  0x5EEDULL
+
+/**
+ Shuffles the way the player used to: picks a random item, appends it to the result, and removes it.
+**/
+static void RemovalShuffle(int32_t *items, int32_t *result, uint32_t count, ITunesRandom *random)
+{
+	uint32_t remaining = count;
+	uint32_t i;
+	
+	for(i = 0; i < count; i++)
+	{
+		uint32_t r = ITunesRandomBelow(random, remaining);
+		
+		result[i] = items[r];
+		memmove(items + r, items + r + 1, (remaining - r - 1) * sizeof(int32_t));
+		remaining--;
+	}
+}
+
+/**
+ Returns non-zero if the first count entries of order are a permutation of 0 ..< count.
+**/
+static int IsPermutation(const int32_t *order, uint32_t count)
+{
+	unsigned char *seen = calloc(count, 1);
+	uint32_t i;
+	int result = (seen != NULL);
+	
+	for(i = 0; result && (i < count); i++)
+	{
+		if((order[i] < 0) || ((uint32_t)order[i] >= count) || seen[order[i]])
+		{
+			result = 0;
+		}
+		else
+		{
+			seen[order[i]] = 1;
+		}
+	}
+	
+	free(seen);
+	return result;
+}
+
+/**
+ Shuffles a small playlist many times, and returns the largest deviation (in percent) of how often
+ an item lands in a position from how often it should.
+**/
+static double MaxDeviation(uint64_t seed)
+{
+	enum { ITEMS = 8, ROUNDS = 200000 };
+	
+	uint32_t counts[ITEMS][ITEMS];
+	memset(counts, 0, sizeof(counts));
+	
+	ITunesShuffle *shuffle = ITunesShuffleCreate(seed);
+	ITunesShuffleSetCount(shuffle, ITEMS);
+	
+	uint32_t round, p;
+	for(round = 0; round < ROUNDS; round++)
+	{
+		// Reshuffles start from the previous order, like they do in the player
+		ITunesShuffleReshuffle(shuffle);
+		
+		for(p = 0; p < ITEMS; p++)
+		{
+			counts[ITunesShuffleIndex(shuffle, p)][p]++;
+		}
+	}
+	ITunesShuffleFree(shuffle);
+	
+	double expected = (double)ROUNDS / ITEMS;
+	double maxDeviation = 0;
+	uint32_t i;
+	
+	for(i = 0; i < ITEMS; i++)
+	{
+		for(p = 0; p < ITEMS; p++)
+		{
+			double deviation = 100.0 * (counts[i][p] - expected) / expected;
+			if(deviation < 0) deviation = -deviation;
+			if(deviation > maxDeviation) maxDeviation = deviation;
+		}
+	}
+	
+	return maxDeviation;
+}
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n counts] [-k lookahead] [-r rounds] [-s seed]\n", name);
+	fprintf(stderr, "  -n  comma separated playlist sizes (default 1000,10000,100000)\n");
+	fprintf(stderr, "  -k  positions drawn after each lazy reshuffle (default 4)\n");
+	fprintf(stderr, "  -r  reshuffles timed per size (default 20)\n");
+	fprintf(stderr, "  -s  seed (default 0x5EED)\n");
+}
+
+int main(int argc, char **argv)
+{
+	char sizes[256] = "1000,10000,100000";
+	uint32_t lookahead = 4;
+	uint32_t rounds = 20;
+	uint64_t seed = DEFAULT_SEED;
+	int c;
+	
+	while((c = getopt(argc, argv, "n:k:r:s:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'n': snprintf(sizes, sizeof(sizes), "%s", optarg); break;
+			case 'k': lookahead = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'r': rounds = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			default:
+				PrintUsage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if(rounds == 0) rounds = 1;
+	
+	int failed = 0;
+	
+	printf("%10s %14s %14s %14s\n", "items", "removal (ms)", "full FY (ms)", "lazy (us)");
+	
+	char *token = strtok(sizes, ",");
+	while(token != NULL)
+	{
+		uint32_t count = (uint32_t)strtoul(token, NULL, 0);
+		token = strtok(NULL, ",");
+		
+		if(count == 0) continue;
+		
+		int32_t *items = malloc(count * sizeof(int32_t));
+		int32_t *result = malloc(count * sizeof(int32_t));
+		ITunesShuffle *shuffle = ITunesShuffleCreate(seed);
+		
+		if((items == NULL) || (result == NULL) || (shuffle == NULL) || !ITunesShuffleSetCount(shuffle, count))
+		{
+			fprintf(stderr, "Out of memory at %u items\n", count);
+			return 1;
+		}
+		
+		// The old shuffle is quadratic, so it's only timed once
+		uint32_t i, r;
+		ITunesRandom random;
+		ITunesRandomSeed(&random, seed);
+		
+		for(i = 0; i < count; i++)
+		{
+			items[i] = (int32_t)i;
+		}
+		
+		double start = BenchmarkTime();
+		RemovalShuffle(items, result, count, &random);
+		double removalTime = BenchmarkTime() - start;
+		
+		if(!IsPermutation(result, count))
+		{
+			fprintf(stderr, "Removal shuffle of %u items isn't a permutation\n", count);
+			failed = 1;
+		}
+		
+		// Complete Fisher-Yates shuffles
+		start = BenchmarkTime();
+		for(r = 0; r < rounds; r++)
+		{
+			ITunesShuffleReshuffle(shuffle);
+			ITunesShuffleDraw(shuffle, count);
+		}
+		double fullTime = (BenchmarkTime() - start) / rounds;
+		
+		if(!IsPermutation(shuffle->order, count))
+		{
+			fprintf(stderr, "Fisher-Yates shuffle of %u items isn't a permutation\n", count);
+			failed = 1;
+		}
+		
+		// Lazy reshuffles, drawing only the positions the player looks at
+		start = BenchmarkTime();
+		for(r = 0; r < rounds; r++)
+		{
+			ITunesShuffleReshuffle(shuffle);
+			for(i = 0; i < lookahead; i++)
+			{
+				ITunesShuffleIndex(shuffle, i);
+			}
+		}
+		double lazyTime = (BenchmarkTime() - start) / rounds;
+		
+		if(!IsPermutation(shuffle->order, count))
+		{
+			fprintf(stderr, "Lazy shuffle of %u items isn't a permutation\n", count);
+			failed = 1;
+		}
+		
+		// The same seed must give the same order
+		ITunesShuffle *other = ITunesShuffleCreate(seed);
+		ITunesShuffleSetCount(other, count);
+		ITunesShuffleSeed(shuffle, seed);
+		
+		for(i = 0; i < count; i++)
+		{
+			if(ITunesShuffleIndex(shuffle, i) != ITunesShuffleIndex(other, i))
+			{
+				fprintf(stderr, "Seeded shuffles of %u items differ at position %u\n", count, i);
+				failed = 1;
+				break;
+			}
+		}
+		ITunesShuffleFree(other);
+		
+		printf("%10u %14.3f %14.3f %14.3f\n", count, removalTime * 1000.0, fullTime * 1000.0, lazyTime * 1000000.0);
+		
+		ITunesShuffleFree(shuffle);
+		free(items);
+		free(result);
+	}
+	
+	double deviation = MaxDeviation(seed);
+	printf("\nUniformity: max deviation from expected position frequency %.2f%%\n", deviation);
+	
+	if(deviation > 3.0)
+	{
+		fprintf(stderr, "Shuffle isn't uniform\n");
+		failed = 1;
+	}
+	
+	return failed;
+}
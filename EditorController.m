@@ -9,8 +9,12 @@
 
 @interface EditorController (PrivateAPI)
 - (void)parseITunesMusicLibrary;
+- (void)validateAlarmIDs;
+- (void)startWatchingLibrary;
+- (void)iTunesLibraryDidChange:(NSNotification *)notification;
+- (void)iTunesTableSearchDidFinish:(NSNotification *)notification;
 - (void)setupPlaylistMenu;
-- (void)addPlaylistItemsWithFolder:(NSString *)parentID indentation:(int)level;
+- (void)addPlaylistItemsInFolder:(int)folderIndex indentation:(int)level;
 - (void)setIsEnabled:(BOOL)status;
 - (void)updateTimeImage;
 - (void)updateSearchLabel;
@@ -89,7 +93,7 @@
 	[dateField setDateValue:[alarm time]];
 	
 	// Set repeat type (One-time or Repeating)
-	if([alarm schedule] > 0)
+	if(([alarm schedule] > 0) || ([alarm recurrenceRule] != nil))
 		[repeatType selectCellAtRow:1 column:0];
 	else
 		[repeatType selectCellAtRow:0 column:0];
@@ -127,6 +131,9 @@
 			[repeatSchedule selectCellWithTag:0];
 	}
 	
+	// Alarms repeating by a recurrence rule can't show it with the days of the week, so show it when hovering over them
+	[repeatSchedule setToolTip:[alarm recurrenceRule]];
+	
 	// Set easyWake
 	[easyWakeButton setState:([alarm usesEasyWake] ? NSOnState : NSOffState)];
 	
@@ -225,6 +232,11 @@
 **/
 - (void)windowWillClose:(NSNotification *)aNotification
 {
+	// Stop watching the iTunes library (the polling timer retains the data)
+	[[NSNotificationCenter defaultCenter] removeObserver:self name:ITunesLibraryDidChangeNotification object:nil];
+	[[NSNotificationCenter defaultCenter] removeObserver:self name:ITunesTableSearchDidFinishNotification object:nil];
+	[data stopWatchingLibrary];
+	
 	// Post notification for closed alarm editor window
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"AlarmEditorWindowClosed" object:self];
 	
@@ -383,25 +395,8 @@
 		// Initialize player
 		player = [[ITunesPlayer alloc] initWithITunesData:data];
 		
-		// The stored trackID may have changed
-		// Check this, and update the alarm if needed
-		// Also update the alarm reference, so we don't have to continually fix this everytime
-		int correctTrackID = [data validateTrackID:[alarm trackID] withPersistentTrackID:[alarm persistentTrackID]];
-		if(correctTrackID != [alarm trackID])
-		{
-			[alarm setTrackID:correctTrackID withPersistentTrackID:[alarm persistentTrackID]];
-			[alarmReference setTrackID:correctTrackID withPersistentTrackID:[alarm persistentTrackID]];
-		}
-		
-		// The stored playlistID may have changed
-		// Check this, and update the alarm if needed
-		// Also update the alarm reference, so we don't have to continually fix this everytime
-		int correctPlaylistID = [data validatePlaylistID:[alarm playlistID] withPersistentPlaylistID:[alarm persistentPlaylistID]];
-		if(correctPlaylistID != [alarm playlistID])
-		{
-			[alarm setPlaylistID:correctPlaylistID withPersistentPlaylistID:[alarm persistentPlaylistID]];
-			[alarmReference setPlaylistID:correctPlaylistID withPersistentPlaylistID:[alarm persistentPlaylistID]];
-		}
+		// The stored trackID and playlistID may have changed
+		[self validateAlarmIDs];
 		
 		NSDate *end = [NSDate date];
 		NSLog(@"Done parsing (time: %f seconds)", [end timeIntervalSinceDate:start]);
@@ -417,216 +412,150 @@
 		
 		// Update search label
 		[self updateSearchLabel];
+		
+		// Reload the library if iTunes changes it while the editor is open
+		// The polling timer must be scheduled on the main run loop, as this thread will soon exit
+		[self performSelectorOnMainThread:@selector(startWatchingLibrary) withObject:nil waitUntilDone:NO];
 	}
 	
 	[lock unlock];
 }
 
 /**
- Configures the playlist using the fetched iTunes data.
- Everything is added in the proper order, with proper icons and tags.
+ Checks the alarm's trackID and playlistID against their persistent ID's.
+
+ Track and playlist ID's may change whenever iTunes rewrites it's library file.
+ If they've changed, the alarm is updated.
+ Also update the alarm reference, so we don't have to continually fix this everytime.
 **/
-- (void)setupPlaylistMenu
+- (void)validateAlarmIDs
 {
-	// Update playlist menu
-	[playlists removeAllItems];
-	
-	int i;
-	
-	// Playlist Order, as set in iTunes:
-	// 
-	// #define PLAYLIST_TYPE_MASTER        @"Master"
-	// #define PLAYLIST_TYPE_MUSIC         @"Music"
-	// #define PLAYLIST_TYPE_MOVIES        @"Movies"
-	// #define PLAYLIST_TYPE_TVSHOWS       @"TV Shows"
-	// #define PLAYLIST_TYPE_PODCASTS      @"Podcasts"
-	// #define PLAYLIST_TYPE_VIDEOS        @"Videos"
-	// #define PLAYLIST_TYPE_AUDIOBOOKS    @"Audiobooks"
-	// #define PLAYLIST_TYPE_PURCHASED     @"Purchased Music"
-	// #define PLAYLIST_TYPE_PARTYSHUFFLE  @"Party Shuffle"
-	// #define PLAYLIST_TYPE_FOLDER        @"Folder"
-	// #define PLAYLIST_TYPE_SMART         @"Smart Info"
-	// Normal playlists...
-	
-	// Library
-	for(i = 0; i < [[data playlists] count]; i++)
+	int correctTrackID = [data validateTrackID:[alarm trackID] withPersistentTrackID:[alarm persistentTrackID]];
+	if(correctTrackID != [alarm trackID])
 	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_MASTER])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesLibrary.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
+		[alarm setTrackID:correctTrackID withPersistentTrackID:[alarm persistentTrackID]];
+		[alarmReference setTrackID:correctTrackID withPersistentTrackID:[alarm persistentTrackID]];
 	}
 	
-	// Music
-	for(i = 0; i < [[data playlists] count]; i++)
+	int correctPlaylistID = [data validatePlaylistID:[alarm playlistID] withPersistentPlaylistID:[alarm persistentPlaylistID]];
+	if(correctPlaylistID != [alarm playlistID])
 	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_MUSIC])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesMusic.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
+		[alarm setPlaylistID:correctPlaylistID withPersistentPlaylistID:[alarm persistentPlaylistID]];
+		[alarmReference setPlaylistID:correctPlaylistID withPersistentPlaylistID:[alarm persistentPlaylistID]];
 	}
+}
+
+/**
+ Starts watching the iTunes library for changes, and our data for finished searches.
+ Must be invoked on the main thread.
+**/
+- (void)startWatchingLibrary
+{
+	// The window may have been closed while the library was being parsed
+	if(![[self window] isVisible]) return;
+	
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(iTunesLibraryDidChange:)
+												 name:ITunesLibraryDidChangeNotification
+											   object:data];
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(iTunesTableSearchDidFinish:)
+												 name:ITunesTableSearchDidFinishNotification
+											   object:data];
+	[data startWatchingLibrary];
+}
+
+/**
+ Called after iTunes has changed it's library, and the changes have been applied to our data.
+ The data has already followed the selected playlist (and search), so we just need to update the display.
+**/
+- (void)iTunesLibraryDidChange:(NSNotification *)notification
+{
+	[self validateAlarmIDs];
 	
-	// Movies
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_MOVIES])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesMovies.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	[self setupPlaylistMenu];
+	[playlists selectItemWithTag:[data playlistIndex]];
 	
-	// TV Shows
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_TVSHOWS])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesTVShows.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	[table reloadData];
 	
-	// Podcasts
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_PODCASTS])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesPodcasts.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	[self updateSearchLabel];
+	[self updateSongLabelAndShuffleButton];
+}
+
+/**
+ Called after a search started by the search field has finished, and it's results have been put into the table.
+ Searches that were superseded by later typing never get here.
+**/
+- (void)iTunesTableSearchDidFinish:(NSNotification *)notification
+{
+	// Update search label
+	[self updateSearchLabel];
 	
-	// Videos
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_VIDEOS])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesVideos.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	// Notify table of changes
+	[table reloadData];
+}
+
+/**
+ Configures the playlist using the fetched iTunes data.
+ Everything is added in the proper order, with proper icons and tags.
+
+ Playlist Order, as set in iTunes:
+ Library, Music, Movies, TV Shows, Podcasts, Videos, Audiobooks, Purchased Music, Party Shuffle,
+ Folders (each followed by it's contents), Smart Playlists, and finally normal playlists.
+
+ The playlists of each category (and the contents of each folder) come from the playlist tree,
+ which is built once per library load, so the menu is built in a single walk over the playlists.
+**/
+- (void)setupPlaylistMenu
+{
+	// Icons for each category, in the order of the ITUNES_PLAYLIST_CATEGORY_* constants
+	static NSString *categoryImages[ITUNES_PLAYLIST_CATEGORY_COUNT] = {
+		@"iTunesLibrary.png",
+		@"iTunesMusic.png",
+		@"iTunesMovies.png",
+		@"iTunesTVShows.png",
+		@"iTunesPodcasts.png",
+		@"iTunesVideos.png",
+		@"iTunesAudiobooks.png",
+		@"iTunesPurchasedMusic.png",
+		@"iTunesPartyShuffle.png",
+		@"iTunesFolder.png",
+		@"iTunesSmartPlaylist.png",
+		@"iTunesPlaylist.png"
+	};
 	
-	// Audiobooks
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_AUDIOBOOKS])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesAudiobooks.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	// Update playlist menu
+	[playlists removeAllItems];
 	
-	// Purchased Music
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_PURCHASED])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesPurchasedMusic.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	const ITunesPlaylistTree *tree = [data playlistTree];
+	if(tree == NULL) return;
 	
-	// Party Shuffle
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_PARTYSHUFFLE])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesPartyShuffle.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
+	NSArray *allPlaylists = [data playlists];
 	
-	// Folders
-	for(i = 0; i < [[data playlists] count]; i++)
+	int category;
+	for(category = 0; category < ITUNES_PLAYLIST_CATEGORY_COUNT; category++)
 	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_FOLDER] && ![currentPlaylist objectForKey:PLAYLIST_PARENT_PERSISTENTID])
+		NSImage *image = [NSImage imageNamed:categoryImages[category]];
+		
+		uint32_t count;
+		const uint32_t *playlistIndexes = ITunesPlaylistTreeCategory(tree, category, &count);
+		
+		uint32_t i;
+		for(i = 0; i < count; i++)
 		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesFolder.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
+			NSDictionary *currentPlaylist = [allPlaylists objectAtIndex:playlistIndexes[i]];
 			
-			// Add sub-folders and folder items
-			[self addPlaylistItemsWithFolder:[currentPlaylist objectForKey:PLAYLIST_PERSISTENTID] indentation:1];
-		}
-	}
-	
-	// Smart Playlists
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if([currentPlaylist objectForKey:PLAYLIST_TYPE_SMART])
-		{
 			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
 			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesSmartPlaylist.png"]];
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-		}
-	}
-	
-	// Normal Playlists
-	for(i = 0; i < [[data playlists] count]; i++)
-	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
-		if(![currentPlaylist objectForKey:PLAYLIST_TYPE_MASTER] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_MUSIC] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_MOVIES] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_TVSHOWS] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_PODCASTS] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_VIDEOS] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_AUDIOBOOKS] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_PURCHASED] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_PARTYSHUFFLE] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_FOLDER] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_PARENT_PERSISTENTID] &&
-		   ![currentPlaylist objectForKey:PLAYLIST_TYPE_SMART])
-		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setImage:[NSImage imageNamed:@"iTunesPlaylist.png"]];
-			[temp setTag:i];
+			[temp setImage:image];
+			[temp setTag:playlistIndexes[i]];
 			[[playlists menu] addItem:temp];
+			
+			if(category == ITUNES_PLAYLIST_CATEGORY_FOLDER)
+			{
+				// Add sub-folders and folder items
+				[self addPlaylistItemsInFolder:playlistIndexes[i] indentation:1];
+			}
 		}
 	}
 }
@@ -634,34 +563,36 @@
 /**
  Recursively adds folders (since folders may be nested), and their internal playlists
 **/
-- (void)addPlaylistItemsWithFolder:(NSString *)parentID indentation:(int)level
+- (void)addPlaylistItemsInFolder:(int)folderIndex indentation:(int)level
 {
-	int i;
+	const ITunesPlaylistTree *tree = [data playlistTree];
+	NSArray *allPlaylists = [data playlists];
 	
-	for(i = 0; i < [[data playlists] count]; i++)
+	uint32_t count;
+	const uint32_t *children = ITunesPlaylistTreeChildren(tree, folderIndex, &count);
+	
+	uint32_t i;
+	for(i = 0; i < count; i++)
 	{
-		NSDictionary *currentPlaylist = [[data playlists] objectAtIndex:i];
+		NSDictionary *currentPlaylist = [allPlaylists objectAtIndex:children[i]];
+		
+		NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
+		[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
+		[temp setIndentationLevel:level];
+		
+		if([currentPlaylist objectForKey:PLAYLIST_TYPE_FOLDER])
+			[temp setImage:[NSImage imageNamed:@"iTunesFolder.png"]];
+		else if([currentPlaylist objectForKey:PLAYLIST_TYPE_SMART])
+			[temp setImage:[NSImage imageNamed:@"iTunesSmartPlaylist.png"]];
+		else
+			[temp setImage:[NSImage imageNamed:@"iTunesPlaylist.png"]];
 		
-		if([[currentPlaylist objectForKey:PLAYLIST_PARENT_PERSISTENTID] isEqualToString:parentID])
+		[temp setTag:children[i]];
+		[[playlists menu] addItem:temp];
+		
+		if([currentPlaylist objectForKey:PLAYLIST_TYPE_FOLDER])
 		{
-			NSMenuItem *temp = [[[NSMenuItem alloc] init] autorelease];
-			[temp setTitle:[currentPlaylist objectForKey:PLAYLIST_NAME]];
-			[temp setIndentationLevel:level];
-			
-			if([currentPlaylist objectForKey:PLAYLIST_TYPE_FOLDER])
-				[temp setImage:[NSImage imageNamed:@"iTunesFolder.png"]];
-			else if([currentPlaylist objectForKey:PLAYLIST_TYPE_SMART])
-				[temp setImage:[NSImage imageNamed:@"iTunesSmartPlaylist.png"]];
-			else
-				[temp setImage:[NSImage imageNamed:@"iTunesPlaylist.png"]];
-			
-			[temp setTag:i];
-			[[playlists menu] addItem:temp];
-			
-			if([currentPlaylist objectForKey:PLAYLIST_TYPE_FOLDER])
-			{
-				[self addPlaylistItemsWithFolder:[currentPlaylist objectForKey:PLAYLIST_PERSISTENTID] indentation:(level+1)];
-			}
+			[self addPlaylistItemsInFolder:children[i] indentation:(level+1)];
 		}
 	}
 }
@@ -735,6 +666,10 @@
 		[dateButton     setEnabled:!isRepeating];
 		[repeatSchedule setEnabled:isRepeating];
 		
+		// Choosing the days by hand replaces any recurrence rule
+		[alarm setRecurrenceRule:nil];
+		[repeatSchedule setToolTip:nil];
+		
 		if(!isRepeating)
 		{
 			[alarm setSchedule:0];
@@ -952,14 +887,10 @@
 */
 - (IBAction)search:(id)sender
 {
-	// Perform search
-	[data setSearchCriteria:[searchField stringValue]];
-		
-	// Update search label
-	[self updateSearchLabel];
-		
-	// Notify table of changes
-	[table reloadData];
+	// Perform search in the background, so typing isn't held up by large playlists
+	// Each keystroke supersedes the search of the previous one
+	// The label and table are updated once the latest search finishes (see iTunesTableSearchDidFinish:)
+	[data searchInBackground:[searchField stringValue]];
 }
 
 - (IBAction)preview:(id)sender
@@ -1006,7 +937,7 @@
 **/
 - (int)numberOfRowsInTableView:(NSTableView *)aTableView
 {
-	return [[data table] count];
+	return [data numberOfRows];
 }
 
 /**
@@ -1015,29 +946,18 @@
 **/
 - (id)tableView:(NSTableView *)tableView objectValueForTableColumn:(NSTableColumn *)col row:(int)rowIndex
 {
-	int trackID = [[[data table] objectAtIndex:rowIndex] intValue];
-	NSDictionary *track = [data trackForID:trackID];
-	
+	// The strings are cached by the data, so scrolling doesn't create any objects
 	if([@"Song" isEqualToString:[col identifier]])
 	{
-		return [track objectForKey:TRACK_NAME];
+		return [data nameAtRow:rowIndex];
 	}
 	else if([@"Artist" isEqualToString:[col identifier]])
 	{
-		return [track objectForKey:TRACK_ARTIST];
+		return [data artistAtRow:rowIndex];
 	}
 	else
 	{
-		NSNumber *time = [track objectForKey:TRACK_TOTALTIME];
-		int millis = [time intValue];
-		int totalSeconds = millis / 1000;
-		int minutes = totalSeconds / 60;
-		int seconds = totalSeconds % 60;
-		
-		if(seconds < 10)
-			return [NSString stringWithFormat:@"%i:0%i",minutes,seconds];
-		else
-			return [NSString stringWithFormat:@"%i:%i", minutes,seconds];
+		return [data durationAtRow:rowIndex];
 	}
 }
 
@@ -1085,7 +1005,7 @@
 	{
 		// User selected a song
 		// Grab the trackID, which is simply the object at that index in the table
-		int trackID = [[[data table] objectAtIndex:[table selectedRow]] intValue];
+		int trackID = [data trackIDAtRow:[table selectedRow]];
 		
 		// Now grab the Track dictionary
 		NSDictionary *track = [data trackForID:trackID];
@@ -1216,7 +1136,7 @@
 	// Date, repeat type, and repeat schedule
 	[repeatType     setEnabled:isEnabled];
 	
-	BOOL isRepeating = [alarm schedule] > 0;
+	BOOL isRepeating = ([alarm schedule] > 0) || ([alarm recurrenceRule] != nil);
 	
 	[dateField      setEnabled:(isEnabled && !isRepeating)];
 	[dateButton     setEnabled:(isEnabled && !isRepeating)];
@@ -1275,7 +1195,7 @@
 **/
 - (void)updateSearchLabel
 {
-	int tableCount = [[data table] count];
+	int tableCount = [data numberOfRows];
 	
 	if(tableCount == 1)
 	{
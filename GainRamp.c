@@ -0,0 +1,275 @@
+#include "GainRamp.h"
+
+#include <math.h>
+
+// The gain is computed from the curve once per segment, and interpolated linearly within it.
+// Ramps last minutes, so the difference with the exact curve is far below what 16 bit audio can represent.
+#define SEGMENT_FRAMES  64
+
+// How steep the exponential curve is (the gain is 1/e^STEEPNESS of the way up at the start)
+#define EXPONENTIAL_STEEPNESS  5.0
+
+// The decibel curve starts from this level when the start gain is silent (or quieter)
+#define DECIBEL_FLOOR  -60.0
+
+// CURVES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double ToDecibels(double gain)
+{
+	double floorGain = pow(10.0, DECIBEL_FLOOR / 20.0);
+	
+	return 20.0 * log10((gain > floorGain) ? gain : floorGain);
+}
+
+/**
+ Returns the gain of the ramp at the given fraction (from 0.0 to 1.0) of it's duration.
+**/
+float GainRampCurve(const GainRamp *ramp, double fraction)
+{
+	double start = ramp->startGain;
+	double end = ramp->endGain;
+	
+	if(fraction <= 0.0) return ramp->startGain;
+	if(fraction >= 1.0) return ramp->endGain;
+	
+	double gain;
+	
+	switch(ramp->curve)
+	{
+		case GAIN_RAMP_EXPONENTIAL:
+			gain = start + (end - start) * (exp(EXPONENTIAL_STEEPNESS * fraction) - 1.0) / (exp(EXPONENTIAL_STEEPNESS) - 1.0);
+			break;
+		
+		case GAIN_RAMP_SCURVE:
+			gain = start + (end - start) * fraction * fraction * (3.0 - 2.0 * fraction);
+			break;
+		
+		case GAIN_RAMP_DECIBEL:
+		{
+			double startDB = ToDecibels(start);
+			double endDB = ToDecibels(end);
+			
+			gain = pow(10.0, (startDB + (endDB - startDB) * fraction) / 20.0);
+			break;
+		}
+		
+		default:
+			gain = start + (end - start) * fraction;
+			break;
+	}
+	
+	return (float)gain;
+}
+
+/**
+ Returns the gain at the given position (in frames).
+**/
+static float GainAtPosition(const GainRamp *ramp, uint64_t position)
+{
+	if(position >= ramp->duration) return ramp->endGain;
+	
+	return GainRampCurve(ramp, (double)position / (double)ramp->duration);
+}
+
+// RAMP
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Sets up a ramp from the start gain to the end gain, over the given duration (in seconds),
+ for audio at the given sample rate. The ramp starts at the beginning, and isn't paused.
+
+ An unknown curve is treated as linear. A duration of zero (or less) goes straight to the end gain.
+**/
+void GainRampInit(GainRamp *ramp, int curve, float startGain, float endGain, double duration, double sampleRate)
+{
+	ramp->curve = ((curve >= 0) && (curve < GAIN_RAMP_CURVE_COUNT)) ? curve : GAIN_RAMP_LINEAR;
+	ramp->startGain = startGain;
+	ramp->endGain = endGain;
+	
+	ramp->sampleRate = (sampleRate > 0.0) ? sampleRate : 44100.0;
+	ramp->duration = (duration > 0.0) ? (uint64_t)(duration * ramp->sampleRate + 0.5) : 0;
+	ramp->position = 0;
+	
+	ramp->isPaused = 0;
+}
+
+/**
+ Returns the current gain of the ramp.
+**/
+float GainRampGain(const GainRamp *ramp)
+{
+	return GainAtPosition(ramp, ramp->position);
+}
+
+int GainRampIsFinished(const GainRamp *ramp)
+{
+	return (ramp->position >= ramp->duration);
+}
+
+/**
+ Moves the ramp back to it's start gain. Whether it's paused is left unchanged.
+**/
+void GainRampRestart(GainRamp *ramp)
+{
+	ramp->position = 0;
+}
+
+/**
+ While paused, the ramp holds it's current gain: audio is still scaled by it, but the ramp doesn't advance.
+**/
+void GainRampPause(GainRamp *ramp)
+{
+	ramp->isPaused = 1;
+}
+
+void GainRampResume(GainRamp *ramp)
+{
+	ramp->isPaused = 0;
+}
+
+/**
+ Advances the ramp by the given number of seconds, for when it's driven by a clock rather than by audio buffers.
+ Does nothing while paused.
+**/
+void GainRampAdvance(GainRamp *ramp, double seconds)
+{
+	if(ramp->isPaused || (seconds <= 0.0)) return;
+	
+	uint64_t frames = (uint64_t)(seconds * ramp->sampleRate + 0.5);
+	
+	if(frames >= ramp->duration - ramp->position)
+		ramp->position = ramp->duration;
+	else
+		ramp->position += frames;
+}
+
+/**
+ Changes the sample rate the ramp is counted in, keeping it's duration and position the same in seconds.
+ This is for applying a ramp that was driven by a clock (see GainRampAdvance) to audio buffers, at the audio's rate.
+**/
+void GainRampSetSampleRate(GainRamp *ramp, double sampleRate)
+{
+	if((sampleRate <= 0.0) || (sampleRate == ramp->sampleRate)) return;
+	
+	double scale = sampleRate / ramp->sampleRate;
+	uint64_t duration = (uint64_t)(ramp->duration * scale + 0.5);
+	uint64_t position = (uint64_t)(ramp->position * scale + 0.5);
+	
+	// A finished ramp stays finished
+	if((ramp->position >= ramp->duration) || (position > duration))
+	{
+		position = duration;
+	}
+	
+	ramp->sampleRate = sampleRate;
+	ramp->duration = duration;
+	ramp->position = position;
+}
+
+// PROCESSING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Applies the ramp to the given interleaved audio, and advances the ramp past it.
+ The gain is interpolated for every frame, so consecutive buffers join up without steps.
+**/
+void GainRampProcess(GainRamp *ramp, float *samples, uint32_t frames, uint32_t channels)
+{
+	uint32_t done = 0;
+	
+	while(done < frames)
+	{
+		uint32_t count = frames - done;
+		float *segment = samples + (done * channels);
+		uint32_t i, c;
+		
+		if(ramp->isPaused || (ramp->position >= ramp->duration))
+		{
+			// The gain is constant, whether the ramp is held or over
+			float gain = GainRampGain(ramp);
+			
+			if(gain != 1.0f)
+			{
+				for(i = 0; i < count * channels; i++)
+				{
+					segment[i] *= gain;
+				}
+			}
+		}
+		else
+		{
+			if(count > SEGMENT_FRAMES)
+			{
+				count = SEGMENT_FRAMES;
+			}
+			if(count > ramp->duration - ramp->position)
+			{
+				count = (uint32_t)(ramp->duration - ramp->position);
+			}
+			
+			float startGain = GainAtPosition(ramp, ramp->position);
+			float endGain = GainAtPosition(ramp, ramp->position + count);
+			float step = (endGain - startGain) / count;
+			
+			for(i = 0; i < count; i++)
+			{
+				float gain = startGain + (step * i);
+				
+				for(c = 0; c < channels; c++)
+				{
+					segment[(i * channels) + c] *= gain;
+				}
+			}
+			
+			ramp->position += count;
+		}
+		
+		done += count;
+	}
+}
+
+/**
+ Renders the ramp offline, as 16 bit interleaved PCM, and advances the ramp past it.
+
+ The ramp is applied to a full scale constant signal, so every sample is the gain at that frame (times 32767).
+ This goes through GainRampProcess, in buffers of the size an audio device would ask for,
+ so the output is exactly what playback would produce, and can be compared with GainRampCurve.
+**/
+void GainRampRender(GainRamp *ramp, int16_t *pcm, uint32_t frames, uint32_t channels)
+{
+	float buffer[512 * 2];
+	uint32_t framesPerBuffer = (channels > 0) ? (512 * 2) / channels : 0;
+	uint32_t done = 0;
+	
+	if(framesPerBuffer == 0) return;
+	
+	while(done < frames)
+	{
+		uint32_t count = frames - done;
+		if(count > framesPerBuffer)
+		{
+			count = framesPerBuffer;
+		}
+		
+		uint32_t i;
+		for(i = 0; i < count * channels; i++)
+		{
+			buffer[i] = 1.0f;
+		}
+		
+		GainRampProcess(ramp, buffer, count, channels);
+		
+		for(i = 0; i < count * channels; i++)
+		{
+			float sample = buffer[i] * 32767.0f;
+			
+			if(sample > 32767.0f) sample = 32767.0f;
+			if(sample < -32768.0f) sample = -32768.0f;
+			
+			pcm[(done * channels) + i] = (int16_t)lrintf(sample);
+		}
+		
+		done += count;
+	}
+}
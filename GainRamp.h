@@ -0,0 +1,58 @@
+/**
+ Volume envelope for Easy Wake.
+
+ Easy Wake raises the volume from the minimum to the maximum volume over a number of minutes.
+ This used to be done by setting the volume of the output device (or the player) every half a second,
+ with a linear curve, which gives audible steps at the start of the ramp, where the ear is most sensitive.
+
+ A ramp is a curve from a start gain to an end gain, over a duration, with a position that advances
+ as audio is played (or as time passes). It can be applied to audio buffers, in which case the gain
+ is interpolated for every sample, so there are no steps at all, or simply be asked for it's current gain.
+ The ramp is paused while the alarm is snoozing, and restarted when it goes off again.
+
+ Gains are linear amplitudes, from 0.0 to 1.0, like the volume percentages used elsewhere.
+ Nothing here touches audio hardware, so the envelope can be rendered offline (see GainRampRender) and checked.
+**/
+
+#ifndef GAIN_RAMP_H
+#define GAIN_RAMP_H
+
+#include <stdint.h>
+
+#define GAIN_RAMP_LINEAR       0   // Gain rises at a constant rate
+#define GAIN_RAMP_EXPONENTIAL  1   // Gain rises slowly at first, and quickly towards the end
+#define GAIN_RAMP_SCURVE       2   // Gain eases in and out (smoothstep)
+#define GAIN_RAMP_DECIBEL      3   // Loudness (in dB) rises at a constant rate
+
+#define GAIN_RAMP_CURVE_COUNT  4
+
+typedef struct GainRamp
+{
+	int   curve;
+	float startGain;
+	float endGain;
+	
+	// Duration and position, in frames (samples per channel) at the sample rate
+	double   sampleRate;
+	uint64_t duration;
+	uint64_t position;
+	
+	int isPaused;
+} GainRamp;
+
+void  GainRampInit(GainRamp *ramp, int curve, float startGain, float endGain, double duration, double sampleRate);
+
+float GainRampCurve(const GainRamp *ramp, double fraction);
+float GainRampGain(const GainRamp *ramp);
+int   GainRampIsFinished(const GainRamp *ramp);
+
+void  GainRampRestart(GainRamp *ramp);
+void  GainRampPause(GainRamp *ramp);
+void  GainRampResume(GainRamp *ramp);
+void  GainRampAdvance(GainRamp *ramp, double seconds);
+void  GainRampSetSampleRate(GainRamp *ramp, double sampleRate);
+
+void  GainRampProcess(GainRamp *ramp, float *samples, uint32_t frames, uint32_t channels);
+void  GainRampRender(GainRamp *ramp, int16_t *pcm, uint32_t frames, uint32_t channels);
+
+#endif
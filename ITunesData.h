@@ -1,4 +1,8 @@
 #import <Cocoa/Cocoa.h>
+#import "ITunesLibrary.h"
+#import "ITunesDelta.h"
+#import "ITunesPlaylistTree.h"
+#import "ITunesSharedLibrary.h"
 
 #define LIBRARY_PERSISTENTID          @"Library Persistent ID"
 #define MUSIC_FOLDER                  @"Music Folder"
@@ -13,6 +17,7 @@
 #define TRACK_TRACKNUMBER             @"Track Number"
 #define TRACK_TRACKCOUNT              @"Track Count"
 #define TRACK_ISPROTECTED             @"Protected"
+#define TRACK_TYPE                    @"Track Type"
 
 #define PLAYLIST_ID                   @"Playlist ID"
 #define PLAYLIST_PERSISTENTID         @"Playlist Persistent ID"
@@ -33,16 +38,38 @@
 #define PLAYLIST_TYPE_FOLDER          @"Folder"
 #define PLAYLIST_TYPE_SMART           @"Smart Info"
 
+// Posted (on the main thread) after the library has been reloaded because iTunes changed the xml file
+#define ITunesLibraryDidChangeNotification  @"ITunesLibraryDidChange"
+
 
 @interface ITunesData : NSObject
 {
-	// Dictionary with contents of music library xml file
-	NSDictionary *library;
+	// The version of the library we're using, which is shared with every other window
+	ITunesSharedLibrary *sharedLibrary;
+	
+	// Compact records of the shared library (never modified)
+	const ITunesLibrary *library;
+	
+	// Lazily created array of playlist dictionaries (views of the playlist records)
+	NSArray *playlists;
+	
+	// Polls the xml file for changes while we're watching the library
+	NSTimer *watchTimer;
 }
 
 - (id)init;
 
+- (const ITunesLibrary *)library;
+- (ITunesSharedLibrary *)sharedLibrary;
+- (void)setSharedLibrary:(ITunesSharedLibrary *)newSharedLibrary;
+
 - (NSArray *)playlists;
+- (const ITunesPlaylistTree *)playlistTree;
+
+- (int)numberOfPlaylists;
+- (int)numberOfTracksInPlaylistIndex:(int)playlistIndex;
+- (int)trackIDAtIndex:(int)trackIndex inPlaylistIndex:(int)playlistIndex;
+- (const int32_t *)trackIDsForPlaylistIndex:(int)playlistIndex count:(int *)countPtr;
 
 - (int)playlistIndexForID:(int)playlistID;
 
@@ -58,4 +85,10 @@
 - (int)validateTrackID:(int)trackID withPersistentTrackID:(NSString *)persistentTrackID;
 - (int)validatePlaylistID:(int)playlistID withPersistentPlaylistID:(NSString *)persistentPlaylistID;
 
+- (BOOL)reloadIfNeeded;
+- (void)startWatchingLibrary;
+- (void)stopWatchingLibrary;
+
+- (void)libraryDidChange:(ITunesDelta *)delta;
+
 @end
\ No newline at end of file
@@ -1,39 +1,312 @@
 #import "ITunesData.h"
-#import "Prefs.h"
-#import "RHAliasHandler.h"
 
 // Declare private API
 @interface ITunesData (PrivateAPI)
-- (NSString *)locateITunesMusicLibrary;
+- (void)watchTimerFired:(NSTimer *)aTimer;
 @end
 
-@implementation ITunesData
+// C STYLE HELPERS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// INIT, DEALLOC
+/**
+ Returns the string for the given reference in the library's string pool, or nil for missing (empty) strings.
+**/
+static NSString * StringForRef(const ITunesLibrary *lib, ITunesStringRef ref)
+{
+	if(ref == 0) return nil;
+	return [NSString stringWithUTF8String:ITunesLibraryString(lib, ref)];
+}
+
+/**
+ Returns the persistent ID formatted the same way iTunes writes it, or nil for missing persistent ID's.
+**/
+static NSString * StringForPersistentID(uint64_t persistentID)
+{
+	if(persistentID == 0) return nil;
+	
+	char buffer[17];
+	ITunesFormatPersistentID(persistentID, buffer);
+	
+	return [NSString stringWithUTF8String:buffer];
+}
+
+static uint64_t PersistentIDForString(NSString *str)
+{
+	const char *utf8 = [str UTF8String];
+	return ITunesParsePersistentID(utf8, strlen(utf8));
+}
+
+// Playlist type keys, and their corresponding playlist flags
+static NSString *playlistTypeKeys[] = {
+	PLAYLIST_TYPE_MASTER,
+	PLAYLIST_TYPE_MUSIC,
+	PLAYLIST_TYPE_MOVIES,
+	PLAYLIST_TYPE_TVSHOWS,
+	PLAYLIST_TYPE_PODCASTS,
+	PLAYLIST_TYPE_VIDEOS,
+	PLAYLIST_TYPE_AUDIOBOOKS,
+	PLAYLIST_TYPE_PURCHASED,
+	PLAYLIST_TYPE_PARTYSHUFFLE,
+	PLAYLIST_TYPE_FOLDER,
+	PLAYLIST_TYPE_SMART
+};
+static uint32_t playlistTypeFlags[] = {
+	ITUNES_PLAYLIST_MASTER,
+	ITUNES_PLAYLIST_MUSIC,
+	ITUNES_PLAYLIST_MOVIES,
+	ITUNES_PLAYLIST_TVSHOWS,
+	ITUNES_PLAYLIST_PODCASTS,
+	ITUNES_PLAYLIST_VIDEOS,
+	ITUNES_PLAYLIST_AUDIOBOOKS,
+	ITUNES_PLAYLIST_PURCHASED,
+	ITUNES_PLAYLIST_PARTYSHUFFLE,
+	ITUNES_PLAYLIST_FOLDER,
+	ITUNES_PLAYLIST_SMART
+};
+#define PLAYLIST_TYPE_COUNT  (sizeof(playlistTypeFlags) / sizeof(playlistTypeFlags[0]))
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Track Dictionary:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-- (id)init
+/**
+ An immutable dictionary view of a single track record.
+
+ The library no longer keeps a dictionary for every track.
+ Instead, this lightweight object is handed out, and the values are created on demand from the native record.
+ It supports the same TRACK_* keys that the dictionaries in the XML file contained.
+
+ The view retains the version of the library it came from, and always reads from it.
+ So it may safely outlive it's creator (IE - the player's current track),
+ and keeps describing the same track after the ITunesData switches over to a newer version (where the ID may be reused).
+**/
+@interface ITunesTrackDictionary : NSDictionary
+{
+	ITunesSharedLibrary *sharedLibrary;
+	int trackID;
+}
+- (id)initWithSharedLibrary:(ITunesSharedLibrary *)version trackID:(int)trackID;
+@end
+
+@implementation ITunesTrackDictionary
+
+- (id)initWithSharedLibrary:(ITunesSharedLibrary *)version trackID:(int)aTrackID
 {
 	if(self = [super init])
 	{
-		// Get path of iTunes Music Library file
-		
-		// First we check the preferences to see if an override exists
-		NSString *xmlPath = [Prefs xmlPath];
-		
-		// If an override doesn't exist, we search for the location of the file
-		if([xmlPath isEqualToString:@""])
+		sharedLibrary = [version retain];
+		trackID = aTrackID;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[sharedLibrary release];
+	[super dealloc];
+}
+
+- (id)objectForKey:(id)key
+{
+	if(![key isKindOfClass:[NSString class]]) return nil;
+	
+	const ITunesLibrary *lib = [sharedLibrary library];
+	const ITunesTrack *track = ITunesLibraryTrackForID(lib, trackID);
+	
+	if(track == NULL) return nil;
+	
+	if([key isEqualToString:TRACK_NAME])
+		return StringForRef(lib, track->name);
+	if([key isEqualToString:TRACK_ARTIST])
+		return StringForRef(lib, track->artist);
+	if([key isEqualToString:TRACK_ALBUM])
+		return StringForRef(lib, track->album);
+	if([key isEqualToString:TRACK_ID])
+		return [NSNumber numberWithInt:track->trackID];
+	if([key isEqualToString:TRACK_TOTALTIME])
+		return (track->totalTime == 0) ? nil : [NSNumber numberWithInt:track->totalTime];
+	if([key isEqualToString:TRACK_LOCATION])
+		return StringForRef(lib, track->location);
+	if([key isEqualToString:TRACK_PERSISTENTID])
+		return StringForPersistentID(track->persistentID);
+	if([key isEqualToString:TRACK_TRACKNUMBER])
+		return (track->trackNumber == 0) ? nil : [NSNumber numberWithInt:track->trackNumber];
+	if([key isEqualToString:TRACK_TRACKCOUNT])
+		return (track->trackCount == 0) ? nil : [NSNumber numberWithInt:track->trackCount];
+	if([key isEqualToString:TRACK_ISPROTECTED])
+		return (track->flags & ITUNES_TRACK_PROTECTED) ? [NSNumber numberWithBool:YES] : nil;
+	if([key isEqualToString:TRACK_TYPE])
+		return (track->flags & ITUNES_TRACK_FILE) ? @"File" : nil;
+	
+	return nil;
+}
+
+- (NSArray *)presentKeys
+{
+	NSArray *allKeys = [NSArray arrayWithObjects:TRACK_ID, TRACK_PERSISTENTID, TRACK_LOCATION, TRACK_TOTALTIME,
+	                                             TRACK_NAME, TRACK_ARTIST, TRACK_ALBUM, TRACK_TRACKNUMBER,
+	                                             TRACK_TRACKCOUNT, TRACK_ISPROTECTED, TRACK_TYPE, nil];
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:[allKeys count]];
+	
+	int i;
+	for(i = 0; i < [allKeys count]; i++)
+	{
+		if([self objectForKey:[allKeys objectAtIndex:i]] != nil)
 		{
-			xmlPath = [self locateITunesMusicLibrary];
-			NSLog(@"Found iTunes library: %@", xmlPath);
+			[result addObject:[allKeys objectAtIndex:i]];
 		}
+	}
+	return result;
+}
+
+- (unsigned)count
+{
+	return [[self presentKeys] count];
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+	return [[self presentKeys] objectEnumerator];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Playlist Dictionary:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ An immutable dictionary view of a single playlist record.
+
+ Supports the same PLAYLIST_* keys that the dictionaries in the XML file contained.
+ The playlist type keys (Master, Folder, etc) return an NSNumber (YES) if set, and nil otherwise.
+ The playlist items array is created on demand, so native accessors in ITunesData should be preferred.
+
+ These views are cached by the ITunesData (until it switches over to another version of the library).
+ Like the track views, each one retains the version of the library it came from, and always reads from it,
+ as playlist indexes (and the playlists array) differ between versions.
+**/
+@interface ITunesPlaylistDictionary : NSDictionary
+{
+	ITunesSharedLibrary *sharedLibrary;
+	int playlistIndex;
+}
+- (id)initWithSharedLibrary:(ITunesSharedLibrary *)version playlistIndex:(int)playlistIndex;
+@end
+
+@implementation ITunesPlaylistDictionary
+
+- (id)initWithSharedLibrary:(ITunesSharedLibrary *)version playlistIndex:(int)index
+{
+	if(self = [super init])
+	{
+		sharedLibrary = [version retain];
+		playlistIndex = index;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[sharedLibrary release];
+	[super dealloc];
+}
+
+- (id)objectForKey:(id)key
+{
+	if(![key isKindOfClass:[NSString class]]) return nil;
+	
+	const ITunesLibrary *lib = [sharedLibrary library];
+	const ITunesPlaylist *playlist = &lib->playlists[playlistIndex];
+	
+	if([key isEqualToString:PLAYLIST_NAME])
+		return StringForRef(lib, playlist->name);
+	if([key isEqualToString:PLAYLIST_ID])
+		return [NSNumber numberWithInt:playlist->playlistID];
+	if([key isEqualToString:PLAYLIST_PERSISTENTID])
+		return StringForPersistentID(playlist->persistentID);
+	if([key isEqualToString:PLAYLIST_PARENT_PERSISTENTID])
+	{
+		if(playlist->flags & ITUNES_PLAYLIST_HAS_PARENT)
+			return StringForPersistentID(playlist->parentPersistentID);
 		else
+			return nil;
+	}
+	if([key isEqualToString:PLAYLIST_ITEMS])
+	{
+		NSMutableArray *items = [NSMutableArray arrayWithCapacity:playlist->itemsCount];
+		
+		uint32_t i;
+		for(i = 0; i < playlist->itemsCount; i++)
 		{
-			NSLog(@"Using configured XMLPath: %@", xmlPath);
+			NSNumber *trackID = [NSNumber numberWithInt:lib->items[playlist->itemsOffset + i]];
+			[items addObject:[NSDictionary dictionaryWithObject:trackID forKey:TRACK_ID]];
 		}
-		
-		// Load iTunes Music Library xml/plist file
-		library = [[NSDictionary alloc] initWithContentsOfFile:xmlPath];
+		return items;
+	}
+	
+	unsigned int i;
+	for(i = 0; i < PLAYLIST_TYPE_COUNT; i++)
+	{
+		if([key isEqualToString:playlistTypeKeys[i]])
+		{
+			return (playlist->flags & playlistTypeFlags[i]) ? [NSNumber numberWithBool:YES] : nil;
+		}
+	}
+	
+	return nil;
+}
+
+- (NSArray *)presentKeys
+{
+	NSMutableArray *result = [NSMutableArray arrayWithObjects:PLAYLIST_ID, PLAYLIST_NAME, PLAYLIST_ITEMS, nil];
+	
+	const ITunesPlaylist *playlist = &[sharedLibrary library]->playlists[playlistIndex];
+	
+	if(playlist->persistentID != 0)
+		[result addObject:PLAYLIST_PERSISTENTID];
+	if(playlist->flags & ITUNES_PLAYLIST_HAS_PARENT)
+		[result addObject:PLAYLIST_PARENT_PERSISTENTID];
+	
+	unsigned int i;
+	for(i = 0; i < PLAYLIST_TYPE_COUNT; i++)
+	{
+		if(playlist->flags & playlistTypeFlags[i])
+		{
+			[result addObject:playlistTypeKeys[i]];
+		}
+	}
+	return result;
+}
+
+- (unsigned)count
+{
+	return [[self presentKeys] count];
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+	return [[self presentKeys] objectEnumerator];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark ITunesData:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@implementation ITunesData
+
+// INIT, DEALLOC
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (id)init
+{
+	if(self = [super init])
+	{
+		// Use the current version of the library, which is only loaded if no other window has loaded it already
+		sharedLibrary = [[ITunesSharedLibrary currentLibrary] retain];
+		library = [sharedLibrary library];
 	}
 	return self;
 }
@@ -41,39 +314,145 @@
 - (void)dealloc
 {
 	NSLog(@"Destroying %@", self);
-	[library release];
+	[watchTimer invalidate];
+	[watchTimer release];
+	[playlists release];
+	[sharedLibrary release];
 	[super dealloc];
 }
 
-// SEARCHING FOR ITUNES MUSIC LIBRARY
+// LIBRARY
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**
- Searches for the location of the "iTunes Music Library.xml" file.
- In order to do this, it follows the same search pattern that iTunes follows.
- Most of the logic behind this search is based on the information from here:
- http://www.indyjt.com/blog/?p=51
-*/
-- (NSString *)locateITunesMusicLibrary
+ Returns the native library records, for subclasses that work with the records directly.
+ (The dictionary views above read from the version they came from instead, see sharedLibrary.)
+
+ The records are shared with every other window, and must not be modified.
+ The library may be replaced by reloadIfNeeded, so pointers into it should not be kept across a libraryDidChange:.
+**/
+- (const ITunesLibrary *)library
 {
-	NSString *xmlPath1 = [@"~/Music/iTunes/iTunes Music Library.xml" stringByExpandingTildeInPath];
-	NSString *xmlPath2 = [@"~/Documents/iTunes/iTunes Music Library.xml" stringByExpandingTildeInPath];
-	NSArray *locations = [NSArray arrayWithObjects:xmlPath1, xmlPath2, nil];
+	return library;
+}
 	
-	int i;
-	BOOL found = NO;
-	NSString *xmlPath = nil;
-	for(i = 0; i < [locations count] && !found; i++)
+/**
+ Returns the shared version of the library we're using.
+**/
+- (ITunesSharedLibrary *)sharedLibrary
+{
+	return sharedLibrary;
+}
+
+/**
+ Switches over to the given version of the library.
+ Subclasses that use the shared library from background threads should override this method,
+ and stop using the old version before invoking super.
+**/
+- (void)setSharedLibrary:(ITunesSharedLibrary *)newSharedLibrary
+{
+	if(sharedLibrary == newSharedLibrary) return;
+	
+	[sharedLibrary release];
+	sharedLibrary = [newSharedLibrary retain];
+	library = [sharedLibrary library];
+	
+	// The playlist views are indexed, and the indexes may have changed
+	[playlists release];
+	playlists = nil;
+}
+
+// RELOADING ITUNES MUSIC LIBRARY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Switches over to the current version of the library, if iTunes has changed the xml file since we loaded it.
+
+ The new version of the file is parsed (once, for every window) by ITunesSharedLibrary on a background thread,
+ so this returns NO until it's ready, and the window switches over on a later check.
+ The new version is compared against the version we're using by persistent ID.
+ The differences are used to map the track ID's and playlist indexes that are in use onto the new version.
+
+ After switching, libraryDidChange: is invoked, and an ITunesLibraryDidChangeNotification posted.
+
+ Returns YES if the library changed, NO otherwise.
+**/
+- (BOOL)reloadIfNeeded
+{
+	if([sharedLibrary xmlPath] == nil) return NO;
+	
+	ITunesSharedLibrary *latest = [ITunesSharedLibrary libraryWithXMLPath:[sharedLibrary xmlPath]];
+	
+	if(latest == sharedLibrary)
 	{
-		xmlPath = [RHAliasHandler resolvePath:[locations objectAtIndex:i]];
-				
-		found = [[NSFileManager defaultManager] fileExistsAtPath:xmlPath];
+		return NO;
 	}
 	
-	if(found)
-		return xmlPath;
+	ITunesDelta *delta = [latest createDeltaFromLibrary:sharedLibrary];
+	
+	if(delta == NULL)
+	{
+		// We couldn't map the changes (most likely out of memory), so nothing stored may be assumed to be valid
+		NSLog(@"Unable to map iTunes library changes");
+	}
 	else
-		return nil;
+	{
+		NSLog(@"Reloaded iTunes library (%u changes)", ITunesDeltaChangeCount(delta));
+	}
+	
+	[self setSharedLibrary:latest];
+	
+	[self libraryDidChange:delta];
+	
+	ITunesDeltaFree(delta);
+	
+	[[NSNotificationCenter defaultCenter] postNotificationName:ITunesLibraryDidChangeNotification object:self];
+	
+	return YES;
+}
+
+/**
+ Invoked after the library has been reloaded, and before the ITunesLibraryDidChangeNotification is posted.
+ Subclasses which store track ID's or playlist indexes should override this method to update them.
+
+ The delta may be used to map old track ID's and playlist indexes onto the new ones.
+ If the delta is NULL, the library was replaced wholesale, and nothing stored may be assumed to be valid.
+**/
+- (void)libraryDidChange:(ITunesDelta *)delta
+{
+	// Nothing to do here
+}
+
+/**
+ Starts polling the xml file for changes, reloading the library when iTunes rewrites it.
+ This must be invoked on the main thread, as the timer is scheduled in the current run loop.
+
+ Note: The timer retains this object, so stopWatchingLibrary must be invoked before it can be deallocated.
+**/
+- (void)startWatchingLibrary
+{
+	if(watchTimer != nil) return;
+	
+	watchTimer = [[NSTimer scheduledTimerWithTimeInterval:5.0
+												   target:self
+												 selector:@selector(watchTimerFired:)
+												 userInfo:nil
+												  repeats:YES] retain];
+}
+
+/**
+ Stops polling the xml file for changes.
+**/
+- (void)stopWatchingLibrary
+{
+	[watchTimer invalidate];
+	[watchTimer release];
+	watchTimer = nil;
+}
+
+- (void)watchTimerFired:(NSTimer *)aTimer
+{
+	[self reloadIfNeeded];
 }
 
 // DATA EXTRACTION
@@ -88,10 +467,99 @@
  Name - Name of playlist
  Playlist ID - Unique ID number of playlist, which should be used as name and index in array may change over time.
  Playlist Items - Array of dictionaries, each containing a track ID number.
+
+ Note: The Playlist Items array is created every time it's requested.
+ Use numberOfTracksInPlaylistIndex: and trackIDAtIndex:inPlaylistIndex: instead.
 **/
 - (NSArray *)playlists
 {
-	return [library objectForKey:@"Playlists"];
+	if(playlists == nil)
+	{
+		NSMutableArray *temp = [NSMutableArray arrayWithCapacity:library->playlistsCount];
+		
+		uint32_t i;
+		for(i = 0; i < library->playlistsCount; i++)
+		{
+			ITunesPlaylistDictionary *playlist = [[ITunesPlaylistDictionary alloc] initWithSharedLibrary:sharedLibrary
+			                                                                              playlistIndex:i];
+			[temp addObject:playlist];
+			[playlist release];
+		}
+		
+		playlists = [temp copy];
+	}
+	return playlists;
+}
+
+/**
+ Returns the hierarchy index of the playlists, used to list them by category, and folders by their contents.
+ The index is shared, and built the first time any window requests it,
+ so it may be NULL if the memory could not be allocated.
+**/
+- (const ITunesPlaylistTree *)playlistTree
+{
+	return [sharedLibrary playlistTree];
+}
+
+/**
+ Returns the number of playlists in the library.
+**/
+- (int)numberOfPlaylists
+{
+	return library->playlistsCount;
+}
+
+/**
+ Returns the number of tracks in the playlist at the given index, or zero if the index is invalid.
+**/
+- (int)numberOfTracksInPlaylistIndex:(int)playlistIndex
+{
+	if((playlistIndex < 0) || (playlistIndex >= library->playlistsCount))
+	{
+		return 0;
+	}
+	return library->playlists[playlistIndex].itemsCount;
+}
+
+/**
+ Returns the trackID at the given position within the playlist at the given index.
+ If either index is invalid, -1 is returned.
+**/
+- (int)trackIDAtIndex:(int)trackIndex inPlaylistIndex:(int)playlistIndex
+{
+	if((playlistIndex < 0) || (playlistIndex >= library->playlistsCount))
+	{
+		return -1;
+	}
+	
+	const ITunesPlaylist *playlist = &library->playlists[playlistIndex];
+	
+	if((trackIndex < 0) || (trackIndex >= playlist->itemsCount))
+	{
+		return -1;
+	}
+	return library->items[playlist->itemsOffset + trackIndex];
+}
+
+/**
+ Returns a pointer to the trackIDs of the playlist at the given index, in playlist order.
+ The number of trackIDs is returned via countPtr.
+
+ The returned array is owned by this object, and must not be modified or freed.
+ If the playlistIndex is invalid, NULL is returned, and the count is zero.
+**/
+- (const int32_t *)trackIDsForPlaylistIndex:(int)playlistIndex count:(int *)countPtr
+{
+	if((playlistIndex < 0) || (playlistIndex >= library->playlistsCount))
+	{
+		if(countPtr) *countPtr = 0;
+		return NULL;
+	}
+	
+	const ITunesPlaylist *playlist = &library->playlists[playlistIndex];
+	
+	if(countPtr) *countPtr = playlist->itemsCount;
+	return library->items + playlist->itemsOffset;
 }
 
 /**
@@ -105,24 +573,7 @@
 **/
 - (int)playlistIndexForID:(int)playlistID
 {
-	NSArray *playlists = [self playlists];
-	
-	int index = 0;
-	BOOL found = NO;
-	while(!found && (index < [playlists count]))
-	{
-		NSDictionary *playlist = [playlists objectAtIndex:index];
-		
-		if([[playlist objectForKey:PLAYLIST_ID] intValue] == playlistID)
-			found = YES;
-		else
-			index++;
-	}
-	
-	if(found)
-		return index;
-	else
-		return -1;
+	return ITunesLibraryPlaylistIndexForID(library, playlistID);
 }
 
 /**
@@ -166,11 +617,17 @@ Returns the playlist that has the given playlist ID.
  Total Time - Number of milliseconds in song
  Location - File URL
  
+ If the track doesn't exist, nil is returned.
+
  @param trackID - The ID of the desired track in the XML database.
 **/
 - (NSDictionary *)trackForID:(int)trackID
 {
-	return [[library objectForKey:@"Tracks"] objectForKey:[NSString stringWithFormat:@"%i",trackID]];
+	if(ITunesLibraryTrackForID(library, trackID) == NULL)
+	{
+		return nil;
+	}
+	return [[[ITunesTrackDictionary alloc] initWithSharedLibrary:sharedLibrary trackID:trackID] autorelease];
 }
 
 /**
@@ -226,29 +683,13 @@ Returns the playlist that has the given playlist ID.
 - (int)trackIndexForID:(int)trackID withPlaylistIndex:(int)playlistIndex
 {
 	// First make sure the playlistIndex is valid
-	if((playlistIndex < 0) || (playlistIndex >= [[self playlists] count]))
+	if((playlistIndex < 0) || (playlistIndex >= library->playlistsCount))
 	{
 		return -1;
 	}
 	
-	NSArray *playlist = [[self playlistForIndex:playlistIndex] objectForKey:PLAYLIST_ITEMS];
-	
-	int index = 0;
-	BOOL found = NO;
-	while(!found && (index < [playlist count]))
-	{
-		NSString *trackRef = [[playlist objectAtIndex:index] objectForKey:TRACK_ID];
-		
-		if(trackID == [trackRef intValue])
-			found = YES;
-		else
-			index++;
-	}
-	
-	if(found)
-		return index;
-	else
-		return -1;
+	// The first lookup within a playlist builds a trackID -> position table, used by all following lookups
+	return [sharedLibrary positionOfTrackID:trackID inPlaylistIndex:playlistIndex];
 }
 
 
@@ -282,29 +723,24 @@ Returns the playlist that has the given playlist ID.
 		return trackID;
 	}
 	
+	uint64_t persistentID = PersistentIDForString(persistentTrackID);
+	
 	// Get the track for the specified trackID
-	NSDictionary *dict = [self trackForID:trackID];
+	const ITunesTrack *track = ITunesLibraryTrackForID(library, trackID);
 	
 	// Does the persistentID match the one given
-	if((dict != nil) && [[dict objectForKey:TRACK_PERSISTENTID] isEqualToString:persistentTrackID])
+	if((track != NULL) && (track->persistentID == persistentID))
 	{
 		// It's a match.! Just return the original trackID.
 		return trackID;
 	}
 	
 	// The trackID has changed!
-	// Now we have to loop through the tracks, and find the one with the correct persistentID
-	NSEnumerator *enumerator = [[library objectForKey:@"Tracks"] objectEnumerator];
-	NSDictionary *currentTrack;
-	BOOL found = NO;
+	// Now we have to lookup the track with the correct persistentID
+	track = ITunesLibraryTrackForPersistentID(library, persistentID);
 		
-	while(!found && (currentTrack = [enumerator nextObject]))
-	{
-		found = [[currentTrack objectForKey:TRACK_PERSISTENTID] isEqualToString:persistentTrackID];
-	}
-	
-	if(found)
-		return [[currentTrack objectForKey:TRACK_ID] intValue];
+	if(track != NULL)
+		return track->trackID;
 	else
 		return -1;
 }
@@ -336,31 +772,26 @@ Returns the playlist that has the given playlist ID.
 		return playlistID;
 	}
 	
-	// Get the track for the specified trackID
-	NSDictionary *dict = [self playlistForID:playlistID];
+	uint64_t persistentID = PersistentIDForString(persistentPlaylistID);
+	
+	// Get the playlist for the specified playlistID
+	int playlistIndex = [self playlistIndexForID:playlistID];
 	
 	// Does the persistentID match the one given
-	if((dict != nil) && [[dict objectForKey:PLAYLIST_PERSISTENTID] isEqualToString:persistentPlaylistID])
+	if((playlistIndex >= 0) && (library->playlists[playlistIndex].persistentID == persistentID))
 	{
-		// It's a match.! Just return the original trackID.
+		// It's a match.! Just return the original playlistID.
 		return playlistID;
 	}
 	
-	// The trackID has changed!
-	// Now we have to loop through the tracks, and find the one with the correct persistentID
-	NSEnumerator *enumerator = [[library objectForKey:@"Playlists"] objectEnumerator];
-	NSDictionary *currentPlaylist;
-	BOOL found = NO;
-	
-	while(!found && (currentPlaylist = [enumerator nextObject]))
-	{
-		found = [[currentPlaylist objectForKey:PLAYLIST_PERSISTENTID] isEqualToString:persistentPlaylistID];
-	}
+	// The playlistID has changed!
+	// Now we have to lookup the playlist with the correct persistentID
+	playlistIndex = ITunesLibraryPlaylistIndexForPersistentID(library, persistentID);
 	
-	if(found)
-		return [[currentPlaylist objectForKey:PLAYLIST_ID] intValue];
+	if(playlistIndex >= 0)
+		return library->playlists[playlistIndex].playlistID;
 	else
 		return -1;
 }
 
-@end
\ No newline at end of file
+@end
@@ -0,0 +1,594 @@
+#include "ITunesDelta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Value stored in the trackIDMap for deleted tracks
+#define TRACK_DELETED  0xFFFFFFFE
+
+// The items array is compacted once it's more than half garbage (and the garbage is worth reclaiming)
+#define ITEMS_COMPACT_MIN  4096
+
+// COMPARISONS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int StringsEqual(const ITunesLibrary *libA, ITunesStringRef a, const ITunesLibrary *libB, ITunesStringRef b)
+{
+	return strcmp(ITunesLibraryString(libA, a), ITunesLibraryString(libB, b)) == 0;
+}
+
+static int TracksEqual(const ITunesLibrary *libA, const ITunesTrack *a, const ITunesLibrary *libB, const ITunesTrack *b)
+{
+	return (a->trackID      == b->trackID)      &&
+	       (a->totalTime    == b->totalTime)    &&
+	       (a->trackNumber  == b->trackNumber)  &&
+	       (a->trackCount   == b->trackCount)   &&
+	       (a->persistentID == b->persistentID) &&
+	       (a->flags        == b->flags)        &&
+	       StringsEqual(libA, a->name,     libB, b->name)   &&
+	       StringsEqual(libA, a->artist,   libB, b->artist) &&
+	       StringsEqual(libA, a->album,    libB, b->album)  &&
+	       StringsEqual(libA, a->location, libB, b->location);
+}
+
+static int PlaylistsEqual(const ITunesLibrary *libA, const ITunesPlaylist *a,
+                          const ITunesLibrary *libB, const ITunesPlaylist *b)
+{
+	return (a->playlistID         == b->playlistID)         &&
+	       (a->flags              == b->flags)              &&
+	       (a->persistentID       == b->persistentID)       &&
+	       (a->parentPersistentID == b->parentPersistentID) &&
+	       (a->itemsCount         == b->itemsCount)         &&
+	       StringsEqual(libA, a->name, libB, b->name)       &&
+	       (memcmp(libA->items + a->itemsOffset, libB->items + b->itemsOffset, a->itemsCount * sizeof(int32_t)) == 0);
+}
+
+// CREATING DELTAS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Compares the current library with the source (a fresh parse of the updated XML file),
+ and returns the list of changes needed to bring the library up to date.
+
+ Tracks and playlists are matched by their persistent ID (falling back to their ID if they don't have one).
+ The source library must stay alive until the delta has been applied and freed.
+ Returns NULL if the memory could not be allocated.
+**/
+ITunesDelta * ITunesDeltaCreate(const ITunesLibrary *lib, const ITunesLibrary *source)
+{
+	ITunesDelta *delta = calloc(1, sizeof(ITunesDelta));
+	if(delta == NULL) return NULL;
+	
+	delta->source = source;
+	delta->oldPlaylistsCount = lib->playlistsCount;
+	delta->playlistsCount = source->playlistsCount;
+	
+	uint8_t *seen = calloc(lib->tracksCount + 1, 1);
+	
+	delta->insertedTracks    = malloc((source->tracksCount + 1) * sizeof(uint32_t));
+	delta->updatedTracks     = malloc((source->tracksCount + 1) * 2 * sizeof(uint32_t));
+	delta->deletedTracks     = malloc((lib->tracksCount + 1) * sizeof(uint32_t));
+	delta->playlistOrigins   = malloc((source->playlistsCount + 1) * sizeof(int32_t));
+	delta->playlistUnchanged = malloc(source->playlistsCount + 1);
+	
+	if(!seen || !delta->insertedTracks || !delta->updatedTracks || !delta->deletedTracks ||
+	   !delta->playlistOrigins || !delta->playlistUnchanged)
+	{
+		free(seen);
+		ITunesDeltaFree(delta);
+		return NULL;
+	}
+	
+	// Tracks
+	
+	uint32_t i;
+	for(i = 0; i < source->tracksCount; i++)
+	{
+		const ITunesTrack *track = &source->tracks[i];
+		const ITunesTrack *old;
+		
+		if(track->persistentID != 0)
+		{
+			old = ITunesLibraryTrackForPersistentID(lib, track->persistentID);
+		}
+		else
+		{
+			old = ITunesLibraryTrackForID(lib, track->trackID);
+			if((old != NULL) && (old->persistentID != 0)) old = NULL;
+		}
+		
+		uint32_t oldIndex = (old != NULL) ? (uint32_t)(old - lib->tracks) : 0;
+		
+		if((old == NULL) || seen[oldIndex])
+		{
+			delta->insertedTracks[delta->insertedTracksCount++] = i;
+			continue;
+		}
+		
+		seen[oldIndex] = 1;
+		
+		if(!TracksEqual(lib, old, source, track))
+		{
+			delta->updatedTracks[(delta->updatedTracksCount * 2) + 0] = oldIndex;
+			delta->updatedTracks[(delta->updatedTracksCount * 2) + 1] = i;
+			delta->updatedTracksCount++;
+		}
+	}
+	
+	for(i = 0; i < lib->tracksCount; i++)
+	{
+		if(!seen[i])
+		{
+			delta->deletedTracks[delta->deletedTracksCount++] = i;
+		}
+	}
+	
+	free(seen);
+	
+	// Playlists
+	// There are relatively few of these, so we simply note which ones are unchanged
+	
+	delta->playlistsChanged = (lib->playlistsCount != source->playlistsCount);
+	
+	// Each old playlist may be claimed at most once, as applying the delta hands over it's items and position index
+	uint8_t *claimed = calloc(lib->playlistsCount + 1, 1);
+	if(claimed == NULL)
+	{
+		ITunesDeltaFree(delta);
+		return NULL;
+	}
+	
+	for(i = 0; i < source->playlistsCount; i++)
+	{
+		const ITunesPlaylist *playlist = &source->playlists[i];
+		int32_t oldIndex;
+		
+		if(playlist->persistentID != 0)
+		{
+			oldIndex = ITunesLibraryPlaylistIndexForPersistentID(lib, playlist->persistentID);
+		}
+		else
+		{
+			oldIndex = ITunesLibraryPlaylistIndexForID(lib, playlist->playlistID);
+			if((oldIndex >= 0) && (lib->playlists[oldIndex].persistentID != 0)) oldIndex = -1;
+		}
+		
+		if(oldIndex >= 0)
+		{
+			if(claimed[oldIndex]) oldIndex = -1;
+			else claimed[oldIndex] = 1;
+		}
+		
+		delta->playlistOrigins[i] = oldIndex;
+		delta->playlistUnchanged[i] = (oldIndex >= 0) &&
+		                              PlaylistsEqual(lib, &lib->playlists[oldIndex], source, playlist);
+		
+		if((oldIndex != (int32_t)i) || !delta->playlistUnchanged[i])
+		{
+			delta->playlistsChanged = 1;
+		}
+	}
+	
+	free(claimed);
+	return delta;
+}
+
+void ITunesDeltaFree(ITunesDelta *delta)
+{
+	if(delta == NULL) return;
+	
+	free(delta->insertedTracks);
+	free(delta->updatedTracks);
+	free(delta->deletedTracks);
+	free(delta->playlistOrigins);
+	free(delta->playlistUnchanged);
+	free(delta->playlistMap);
+	free(delta->trackIDMap.slots);
+	free(delta);
+}
+
+/**
+ Returns the number of changed entries (tracks and playlists) in the delta.
+ If zero, the library is already up to date.
+**/
+uint32_t ITunesDeltaChangeCount(const ITunesDelta *delta)
+{
+	uint32_t count = delta->insertedTracksCount + delta->updatedTracksCount + delta->deletedTracksCount;
+	
+	if(delta->playlistsChanged)
+	{
+		uint32_t i;
+		for(i = 0; i < delta->playlistsCount; i++)
+		{
+			if(!delta->playlistUnchanged[i]) count++;
+		}
+		if(delta->oldPlaylistsCount > delta->playlistsCount)
+		{
+			count += delta->oldPlaylistsCount - delta->playlistsCount;
+		}
+		if(count == 0) count = 1;
+	}
+	return count;
+}
+
+// APPLYING DELTAS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the given string as a reference within the library's string pool.
+ If the string hasn't changed, the existing reference is reused.
+**/
+static ITunesStringRef CopyString(ITunesLibrary *lib, ITunesStringRef current, const ITunesLibrary *source, ITunesStringRef ref)
+{
+	if(StringsEqual(lib, current, source, ref)) return current;
+	
+	const char *str = ITunesLibraryString(source, ref);
+	return ITunesLibraryAddString(lib, str, strlen(str));
+}
+
+static void CopyTrack(ITunesLibrary *lib, ITunesTrack *dst, const ITunesLibrary *source, const ITunesTrack *src)
+{
+	dst->trackID      = src->trackID;
+	dst->totalTime    = src->totalTime;
+	dst->trackNumber  = src->trackNumber;
+	dst->trackCount   = src->trackCount;
+	dst->persistentID = src->persistentID;
+	dst->flags        = src->flags;
+	
+	dst->name     = CopyString(lib, dst->name,     source, src->name);
+	dst->artist   = CopyString(lib, dst->artist,   source, src->artist);
+	dst->album    = CopyString(lib, dst->album,    source, src->album);
+	dst->location = CopyString(lib, dst->location, source, src->location);
+}
+
+static int ApplyTracks(ITunesDelta *delta, ITunesLibrary *lib)
+{
+	const ITunesLibrary *source = delta->source;
+	uint32_t i;
+	
+	// First remove the keys that are going away.
+	// This must happen before any new keys are added, as track ID's may be reused.
+	
+	for(i = 0; i < delta->updatedTracksCount; i++)
+	{
+		const ITunesTrack *old = &lib->tracks[delta->updatedTracks[i * 2]];
+		const ITunesTrack *src = &source->tracks[delta->updatedTracks[(i * 2) + 1]];
+		
+		if(old->trackID != src->trackID)
+		{
+			ITunesHashTableRemove(&lib->trackIndex, (uint32_t)old->trackID);
+		}
+	}
+	for(i = 0; i < delta->deletedTracksCount; i++)
+	{
+		uint32_t index = delta->deletedTracks[i];
+		const ITunesTrack *old = &lib->tracks[index];
+		
+		ITunesHashTableRemove(&lib->trackIndex, (uint32_t)old->trackID);
+		
+		if((old->persistentID != 0) && (ITunesHashTableFind(&lib->trackPersistentIndex, old->persistentID) == index))
+		{
+			ITunesHashTableRemove(&lib->trackPersistentIndex, old->persistentID);
+		}
+	}
+	
+	// Updates
+	
+	for(i = 0; i < delta->updatedTracksCount; i++)
+	{
+		uint32_t index = delta->updatedTracks[i * 2];
+		ITunesTrack *track = &lib->tracks[index];
+		const ITunesTrack *src = &source->tracks[delta->updatedTracks[(i * 2) + 1]];
+		
+		int idChanged = (track->trackID != src->trackID);
+		
+		CopyTrack(lib, track, source, src);
+		
+		if(idChanged)
+		{
+			ITunesHashTableSet(&lib->trackIndex, (uint32_t)track->trackID, index);
+		}
+	}
+	
+	// Inserts
+	
+	for(i = 0; i < delta->insertedTracksCount; i++)
+	{
+		const ITunesTrack *src = &source->tracks[delta->insertedTracks[i]];
+		
+		ITunesTrack *track = ITunesLibraryAddTrack(lib);
+		if(track == NULL) return 0;
+		
+		CopyTrack(lib, track, source, src);
+		
+		uint32_t index = lib->tracksCount - 1;
+		
+		ITunesHashTableSet(&lib->trackIndex, (uint32_t)track->trackID, index);
+		
+		if(track->persistentID != 0)
+		{
+			ITunesHashTableInsert(&lib->trackPersistentIndex, track->persistentID, index);
+		}
+	}
+	
+	// Deletes
+	// Each deleted track is replaced by the last track in the array.
+	// Going from the highest index to the lowest guarantees we never move a track that is still to be deleted.
+	
+	i = delta->deletedTracksCount;
+	while(i > 0)
+	{
+		uint32_t index = delta->deletedTracks[--i];
+		uint32_t last = lib->tracksCount - 1;
+		
+		if(index != last)
+		{
+			lib->tracks[index] = lib->tracks[last];
+			
+			const ITunesTrack *moved = &lib->tracks[index];
+			
+			ITunesHashTableSet(&lib->trackIndex, (uint32_t)moved->trackID, index);
+			
+			if((moved->persistentID != 0) && (ITunesHashTableFind(&lib->trackPersistentIndex, moved->persistentID) == last))
+			{
+				ITunesHashTableSet(&lib->trackPersistentIndex, moved->persistentID, index);
+			}
+		}
+		lib->tracksCount--;
+	}
+	
+	return 1;
+}
+
+/**
+ Moves the items of every playlist to the front of a fresh items array, dropping the items of old playlist versions.
+**/
+static int CompactItems(ITunesLibrary *lib, uint32_t liveCount)
+{
+	int32_t *items = malloc((liveCount + 1) * sizeof(int32_t));
+	if(items == NULL) return 0;
+	
+	uint32_t offset = 0;
+	uint32_t i;
+	for(i = 0; i < lib->playlistsCount; i++)
+	{
+		ITunesPlaylist *playlist = &lib->playlists[i];
+		
+		memcpy(items + offset, lib->items + playlist->itemsOffset, playlist->itemsCount * sizeof(int32_t));
+		playlist->itemsOffset = offset;
+		offset += playlist->itemsCount;
+	}
+	
+	free(lib->items);
+	lib->items = items;
+	lib->itemsCount = offset;
+	lib->itemsCapacity = liveCount + 1;
+	
+	return 1;
+}
+
+/**
+ Rebuilds the playlists array in the order of the source library.
+ Unchanged playlists keep their items (and position index), while changed playlists get a fresh copy of their items.
+**/
+static int ApplyPlaylists(ITunesDelta *delta, ITunesLibrary *lib)
+{
+	const ITunesLibrary *source = delta->source;
+	uint32_t count = source->playlistsCount;
+	uint32_t i;
+	
+	if(!delta->playlistsChanged) return 1;
+	
+	ITunesPlaylist *playlists = malloc((count + 1) * sizeof(ITunesPlaylist));
+	ITunesHashTable *positionIndexes = (lib->positionIndexes != NULL) ? calloc(count + 1, sizeof(ITunesHashTable)) : NULL;
+	
+	if((playlists == NULL) || ((lib->positionIndexes != NULL) && (positionIndexes == NULL)))
+	{
+		free(playlists);
+		free(positionIndexes);
+		return 0;
+	}
+	
+	uint32_t liveCount = 0;
+	
+	for(i = 0; i < count; i++)
+	{
+		int32_t oldIndex = delta->playlistOrigins[i];
+		
+		if(delta->playlistUnchanged[i])
+		{
+			playlists[i] = lib->playlists[oldIndex];
+			
+			if(positionIndexes != NULL)
+			{
+				positionIndexes[i] = lib->positionIndexes[oldIndex];
+				memset(&lib->positionIndexes[oldIndex], 0, sizeof(ITunesHashTable));
+			}
+		}
+		else
+		{
+			const ITunesPlaylist *src = &source->playlists[i];
+			const char *name = ITunesLibraryString(source, src->name);
+			
+			playlists[i] = *src;
+			playlists[i].name = (oldIndex >= 0) ? CopyString(lib, lib->playlists[oldIndex].name, source, src->name)
+			                                    : ITunesLibraryAddString(lib, name, strlen(name));
+			
+			// The old version of the playlist is going away, so it's items may be overwritten if the new ones fit
+			const int32_t *srcItems = source->items + src->itemsOffset;
+			
+			if((oldIndex >= 0) && (src->itemsCount <= lib->playlists[oldIndex].itemsCount))
+			{
+				playlists[i].itemsOffset = lib->playlists[oldIndex].itemsOffset;
+				memcpy(lib->items + playlists[i].itemsOffset, srcItems, src->itemsCount * sizeof(int32_t));
+			}
+			else
+			{
+				playlists[i].itemsOffset = lib->itemsCount;
+				
+				if(!ITunesLibraryAddItems(lib, srcItems, src->itemsCount))
+				{
+					free(playlists);
+					free(positionIndexes);
+					return 0;
+				}
+			}
+		}
+		
+		liveCount += playlists[i].itemsCount;
+	}
+	
+	// Free the position indexes of playlists that changed or were deleted
+	ITunesLibraryClearPositionIndexes(lib);
+	
+	free(lib->playlists);
+	lib->playlists = playlists;
+	lib->playlistsCount = count;
+	lib->playlistsCapacity = count + 1;
+	lib->positionIndexes = positionIndexes;
+	
+	if((lib->itemsCount > ITEMS_COMPACT_MIN) && (lib->itemsCount > liveCount * 2))
+	{
+		CompactItems(lib, liveCount);
+	}
+	
+	// There are relatively few playlists, so we simply rebuild their indexes
+	ITunesHashTable playlistIndex, playlistPersistentIndex;
+	
+	if(!ITunesHashTableCreate(&playlistIndex, count) || !ITunesHashTableCreate(&playlistPersistentIndex, count))
+	{
+		free(playlistIndex.slots);
+		return 0;
+	}
+	
+	for(i = 0; i < count; i++)
+	{
+		ITunesHashTableInsert(&playlistIndex, (uint32_t)playlists[i].playlistID, i);
+		
+		if(playlists[i].persistentID != 0)
+		{
+			ITunesHashTableInsert(&playlistPersistentIndex, playlists[i].persistentID, i);
+		}
+	}
+	
+	free(lib->playlistIndex.slots);
+	free(lib->playlistPersistentIndex.slots);
+	lib->playlistIndex = playlistIndex;
+	lib->playlistPersistentIndex = playlistPersistentIndex;
+	
+	return 1;
+}
+
+/**
+ Fills in the maps from the track ID's and playlist indexes of the old library onto those of the source library,
+ without modifying the old library.
+
+ ITunesDeltaApply does this itself. It's only needed on it's own when the source library replaces the old one,
+ rather than being applied to it (IE - the old library is shared, and may not be modified).
+ Returns 0 if the memory could not be allocated.
+**/
+int ITunesDeltaMap(ITunesDelta *delta, const ITunesLibrary *lib)
+{
+	if(delta->playlistMap != NULL) return 1;
+	
+	const ITunesLibrary *source = delta->source;
+	uint32_t i;
+	
+	uint32_t changedTracks = delta->updatedTracksCount + delta->deletedTracksCount;
+	if(!ITunesHashTableCreate(&delta->trackIDMap, changedTracks)) return 0;
+	
+	for(i = 0; i < delta->updatedTracksCount; i++)
+	{
+		const ITunesTrack *old = &lib->tracks[delta->updatedTracks[i * 2]];
+		const ITunesTrack *src = &source->tracks[delta->updatedTracks[(i * 2) + 1]];
+		
+		if(old->trackID != src->trackID)
+		{
+			ITunesHashTableSet(&delta->trackIDMap, (uint32_t)old->trackID, (uint32_t)src->trackID);
+		}
+	}
+	for(i = 0; i < delta->deletedTracksCount; i++)
+	{
+		const ITunesTrack *old = &lib->tracks[delta->deletedTracks[i]];
+		
+		ITunesHashTableSet(&delta->trackIDMap, (uint32_t)old->trackID, TRACK_DELETED);
+	}
+	
+	int32_t *playlistMap = malloc((lib->playlistsCount + 1) * sizeof(int32_t));
+	if(playlistMap == NULL)
+	{
+		free(delta->trackIDMap.slots);
+		memset(&delta->trackIDMap, 0, sizeof(ITunesHashTable));
+		return 0;
+	}
+	
+	for(i = 0; i < lib->playlistsCount; i++)
+	{
+		playlistMap[i] = delta->playlistsChanged ? -1 : (int32_t)i;
+	}
+	
+	if(delta->playlistsChanged)
+	{
+		for(i = 0; i < delta->playlistsCount; i++)
+		{
+			if(delta->playlistOrigins[i] >= 0)
+			{
+				playlistMap[delta->playlistOrigins[i]] = i;
+			}
+		}
+	}
+	
+	delta->playlistMap = playlistMap;
+	return 1;
+}
+
+/**
+ Applies the changes in the delta to the given library (which must be the library the delta was created with).
+ The cost is proportional to the number of changes, not to the size of the library.
+
+ If the library was opened from a snapshot, it is first copied onto the heap.
+ Returns 0 if the memory could not be allocated, in which case the library may be partially updated,
+ and should be replaced by the source library.
+**/
+int ITunesDeltaApply(ITunesDelta *delta, ITunesLibrary *lib)
+{
+	if(!ITunesLibraryMakeMutable(lib)) return 0;
+	
+	// The maps are taken from the library before it's changed
+	if(!ITunesDeltaMap(delta, lib)) return 0;
+	
+	if(!ApplyTracks(delta, lib)) return 0;
+	if(!ApplyPlaylists(delta, lib)) return 0;
+	
+	return 1;
+}
+
+// MAPPING OLD VALUES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the current trackID of the track that had the given trackID before the delta was applied (or mapped).
+ Returns -1 if the track was deleted.
+**/
+int32_t ITunesDeltaTrackIDForOldTrackID(const ITunesDelta *delta, int32_t trackID)
+{
+	uint32_t value = ITunesHashTableFind(&delta->trackIDMap, (uint32_t)trackID);
+	
+	if(value == ITUNES_HASH_EMPTY) return trackID;
+	if(value == TRACK_DELETED) return -1;
+	
+	return (int32_t)value;
+}
+
+/**
+ Returns the current index of the playlist that had the given index before the delta was applied (or mapped).
+ Returns -1 if the playlist was deleted.
+**/
+int32_t ITunesDeltaPlaylistIndexForOldIndex(const ITunesDelta *delta, int32_t playlistIndex)
+{
+	if((playlistIndex < 0) || (playlistIndex >= delta->oldPlaylistsCount) || (delta->playlistMap == NULL))
+	{
+		return -1;
+	}
+	return delta->playlistMap[playlistIndex];
+}
@@ -0,0 +1,63 @@
+/**
+ Incremental updates of a parsed iTunes library.
+
+ When iTunes rewrites the "iTunes Music Library.xml" file, usually only a handful of tracks and playlists have changed.
+ Rather than throwing away the library (and everything built on top of it), the new version of the file is compared
+ against the current library by persistent ID, and only the differences (inserts, deletes and updates) are applied.
+
+ Track ID's and playlist indexes may change between versions of the file.
+ The delta may be queried to map the old values onto the new ones.
+**/
+
+#ifndef ITUNES_DELTA_H
+#define ITUNES_DELTA_H
+
+#include "ITunesLibrary.h"
+
+typedef struct ITunesDelta
+{
+	// The library the changes are taken from
+	const ITunesLibrary *source;
+	
+	// Indexes of tracks in the source library that are new
+	uint32_t *insertedTracks;
+	uint32_t insertedTracksCount;
+	
+	// Pairs of (old index, source index) for tracks that have changed
+	uint32_t *updatedTracks;
+	uint32_t updatedTracksCount;
+	
+	// Indexes of tracks in the old library that no longer exist (ascending)
+	uint32_t *deletedTracks;
+	uint32_t deletedTracksCount;
+	
+	// For each playlist in the source library, the index of the same playlist in the old library (or -1 if new),
+	// and whether the playlist (including it's items) is unchanged
+	int32_t *playlistOrigins;
+	uint8_t *playlistUnchanged;
+	uint32_t playlistsCount;
+	
+	// Whether the playlists (order, records, or items) have changed at all
+	int playlistsChanged;
+	
+	// For each playlist in the old library, it's index in the source library (or -1 if deleted)
+	// Filled in by ITunesDeltaMap (or ITunesDeltaApply)
+	int32_t *playlistMap;
+	uint32_t oldPlaylistsCount;
+	
+	// Track ID's that have changed or been deleted (old trackID -> new trackID)
+	// Filled in by ITunesDeltaMap (or ITunesDeltaApply)
+	ITunesHashTable trackIDMap;
+} ITunesDelta;
+
+ITunesDelta * ITunesDeltaCreate(const ITunesLibrary *lib, const ITunesLibrary *source);
+int ITunesDeltaMap(ITunesDelta *delta, const ITunesLibrary *lib);
+int ITunesDeltaApply(ITunesDelta *delta, ITunesLibrary *lib);
+void ITunesDeltaFree(ITunesDelta *delta);
+
+uint32_t ITunesDeltaChangeCount(const ITunesDelta *delta);
+
+int32_t ITunesDeltaTrackIDForOldTrackID(const ITunesDelta *delta, int32_t trackID);
+int32_t ITunesDeltaPlaylistIndexForOldIndex(const ITunesDelta *delta, int32_t playlistIndex);
+
+#endif
@@ -0,0 +1,918 @@
+#include "ITunesLibrary.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+// Initial capacities, chosen so small libraries never need to grow
+#define INITIAL_TRACKS     1024
+#define INITIAL_PLAYLISTS  64
+#define INITIAL_ITEMS      4096
+#define INITIAL_STRINGS    (64 * 1024)
+
+/**
+ Grows the given array (if needed) so that it can hold at least one more element.
+ Returns 0 if the memory could not be allocated.
+**/
+static int Grow(void **array, uint32_t *capacity, uint32_t count, size_t elementSize, uint32_t initial)
+{
+	if(count < *capacity) return 1;
+	
+	uint32_t newCapacity = (*capacity == 0) ? initial : (*capacity * 2);
+	void *newArray = realloc(*array, newCapacity * elementSize);
+	if(newArray == NULL) return 0;
+	
+	*array = newArray;
+	*capacity = newCapacity;
+	return 1;
+}
+
+static void FreeIndexes(ITunesLibrary *lib);
+
+// INIT, DEALLOC
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Creates a new empty library.
+ The string pool is initialized with the empty string at offset zero.
+**/
+ITunesLibrary * ITunesLibraryCreate(void)
+{
+	ITunesLibrary *lib = calloc(1, sizeof(ITunesLibrary));
+	if(lib == NULL) return NULL;
+	
+	lib->strings = malloc(INITIAL_STRINGS);
+	if(lib->strings == NULL)
+	{
+		free(lib);
+		return NULL;
+	}
+	lib->strings[0] = '\0';
+	lib->stringsLength = 1;
+	lib->stringsCapacity = INITIAL_STRINGS;
+	
+	return lib;
+}
+
+void ITunesLibraryFree(ITunesLibrary *lib)
+{
+	if(lib == NULL) return;
+	
+	ITunesLibraryClearPositionIndexes(lib);
+	
+	if(lib->mapping != NULL)
+	{
+		munmap(lib->mapping, lib->mappingLength);
+		free(lib);
+		return;
+	}
+	
+	FreeIndexes(lib);
+	free(lib->tracks);
+	free(lib->playlists);
+	free(lib->items);
+	free(lib->strings);
+	free(lib);
+}
+
+/**
+ Returns a heap allocated copy of the given bytes, with room for the given capacity.
+**/
+static void * CopyArray(const void *array, size_t length, size_t capacity)
+{
+	void *copy = malloc((capacity > 0) ? capacity : 1);
+	if((copy != NULL) && (length > 0))
+	{
+		memcpy(copy, array, length);
+	}
+	return copy;
+}
+
+/**
+ Returns a heap allocated copy of the given hash table's slots, or NULL if the table is empty or can't be copied.
+**/
+static ITunesHashSlot * CopySlots(const ITunesHashTable *table)
+{
+	if(table->slots == NULL) return NULL;
+	
+	size_t length = ((size_t)table->mask + 1) * sizeof(ITunesHashSlot);
+	return CopyArray(table->slots, length, length);
+}
+
+/**
+ Copies the records, strings and indexes of the library onto the heap, storing them in the given copy.
+ The indexes must have been built (see ITunesLibraryFinish).
+ Returns 0 if the memory could not be allocated, in which case nothing is stored in the copy.
+**/
+static int CopyRecords(const ITunesLibrary *lib, ITunesLibrary *copy)
+{
+	ITunesTrack *tracks = CopyArray(lib->tracks, lib->tracksCount * sizeof(ITunesTrack),
+	                                lib->tracksCount * sizeof(ITunesTrack));
+	ITunesPlaylist *playlists = CopyArray(lib->playlists, lib->playlistsCount * sizeof(ITunesPlaylist),
+	                                      lib->playlistsCount * sizeof(ITunesPlaylist));
+	int32_t *items = CopyArray(lib->items, lib->itemsCount * sizeof(int32_t), lib->itemsCount * sizeof(int32_t));
+	char *strings = CopyArray(lib->strings, lib->stringsLength, lib->stringsLength);
+	
+	ITunesHashSlot *trackSlots              = CopySlots(&lib->trackIndex);
+	ITunesHashSlot *trackPersistentSlots    = CopySlots(&lib->trackPersistentIndex);
+	ITunesHashSlot *playlistSlots           = CopySlots(&lib->playlistIndex);
+	ITunesHashSlot *playlistPersistentSlots = CopySlots(&lib->playlistPersistentIndex);
+	
+	if(!tracks || !playlists || !items || !strings ||
+	   !trackSlots || !trackPersistentSlots || !playlistSlots || !playlistPersistentSlots)
+	{
+		free(tracks);
+		free(playlists);
+		free(items);
+		free(strings);
+		free(trackSlots);
+		free(trackPersistentSlots);
+		free(playlistSlots);
+		free(playlistPersistentSlots);
+		return 0;
+	}
+	
+	copy->tracks    = tracks;
+	copy->playlists = playlists;
+	copy->items     = items;
+	copy->strings   = strings;
+	
+	copy->tracksCapacity    = lib->tracksCount;
+	copy->playlistsCapacity = lib->playlistsCount;
+	copy->itemsCapacity     = lib->itemsCount;
+	copy->stringsCapacity   = lib->stringsLength;
+	
+	copy->trackIndex.slots              = trackSlots;
+	copy->trackPersistentIndex.slots    = trackPersistentSlots;
+	copy->playlistIndex.slots           = playlistSlots;
+	copy->playlistPersistentIndex.slots = playlistPersistentSlots;
+	
+	return 1;
+}
+
+/**
+ Ensures the library may be modified.
+
+ A library opened from a snapshot references the read-only mapping directly.
+ In this case, the records, strings and indexes are copied onto the heap, and the mapping is released.
+ Returns 0 if the memory could not be allocated, in which case the library is left untouched.
+**/
+int ITunesLibraryMakeMutable(ITunesLibrary *lib)
+{
+	if(lib->mapping == NULL) return 1;
+	
+	ITunesLibrary copy = *lib;
+	if(!CopyRecords(lib, &copy)) return 0;
+	
+	munmap(lib->mapping, lib->mappingLength);
+	copy.mapping = NULL;
+	copy.mappingLength = 0;
+	
+	*lib = copy;
+	return 1;
+}
+
+/**
+ Returns a modifiable copy of the library (which may have been opened from a snapshot).
+ The indexes must have been built (see ITunesLibraryFinish).
+
+ The position indexes aren't copied, so they may be in use (by another thread) while the copy is made.
+ Returns NULL if the memory could not be allocated.
+**/
+ITunesLibrary * ITunesLibraryCopy(const ITunesLibrary *lib)
+{
+	ITunesLibrary *copy = calloc(1, sizeof(ITunesLibrary));
+	if(copy == NULL) return NULL;
+	
+	copy->tracksCount         = lib->tracksCount;
+	copy->playlistsCount      = lib->playlistsCount;
+	copy->itemsCount          = lib->itemsCount;
+	copy->stringsLength       = lib->stringsLength;
+	copy->libraryPersistentID = lib->libraryPersistentID;
+	copy->musicFolder         = lib->musicFolder;
+	
+	copy->trackIndex              = lib->trackIndex;
+	copy->trackPersistentIndex    = lib->trackPersistentIndex;
+	copy->playlistIndex           = lib->playlistIndex;
+	copy->playlistPersistentIndex = lib->playlistPersistentIndex;
+	
+	if(!CopyRecords(lib, copy))
+	{
+		free(copy);
+		return NULL;
+	}
+	return copy;
+}
+
+// ADDING RECORDS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Appends a new zeroed track record, and returns a pointer to it.
+ The pointer is only valid until the next track is added.
+**/
+ITunesTrack * ITunesLibraryAddTrack(ITunesLibrary *lib)
+{
+	if(!Grow((void **)&lib->tracks, &lib->tracksCapacity, lib->tracksCount, sizeof(ITunesTrack), INITIAL_TRACKS))
+	{
+		return NULL;
+	}
+	
+	ITunesTrack *track = &lib->tracks[lib->tracksCount++];
+	memset(track, 0, sizeof(ITunesTrack));
+	
+	return track;
+}
+
+/**
+ Appends a new zeroed playlist record, and returns a pointer to it.
+ The pointer is only valid until the next playlist is added.
+ The playlist's items start at the current end of the items array.
+**/
+ITunesPlaylist * ITunesLibraryAddPlaylist(ITunesLibrary *lib)
+{
+	if(!Grow((void **)&lib->playlists, &lib->playlistsCapacity, lib->playlistsCount, sizeof(ITunesPlaylist), INITIAL_PLAYLISTS))
+	{
+		return NULL;
+	}
+	
+	ITunesPlaylist *playlist = &lib->playlists[lib->playlistsCount++];
+	memset(playlist, 0, sizeof(ITunesPlaylist));
+	playlist->itemsOffset = lib->itemsCount;
+	
+	return playlist;
+}
+
+int ITunesLibraryAddItem(ITunesLibrary *lib, int32_t trackID)
+{
+	if(!Grow((void **)&lib->items, &lib->itemsCapacity, lib->itemsCount, sizeof(int32_t), INITIAL_ITEMS))
+	{
+		return 0;
+	}
+	
+	lib->items[lib->itemsCount++] = trackID;
+	return 1;
+}
+
+/**
+ Appends the given trackIDs to the items array.
+**/
+int ITunesLibraryAddItems(ITunesLibrary *lib, const int32_t *trackIDs, uint32_t count)
+{
+	uint64_t needed = (uint64_t)lib->itemsCount + count;
+	if(needed > UINT32_MAX / sizeof(int32_t)) return 0;
+	
+	if(needed > lib->itemsCapacity)
+	{
+		uint32_t newCapacity = (lib->itemsCapacity == 0) ? INITIAL_ITEMS : lib->itemsCapacity;
+		while(newCapacity < needed)
+		{
+			newCapacity *= 2;
+		}
+		
+		int32_t *newItems = realloc(lib->items, newCapacity * sizeof(int32_t));
+		if(newItems == NULL) return 0;
+		
+		lib->items = newItems;
+		lib->itemsCapacity = newCapacity;
+	}
+	
+	memcpy(lib->items + lib->itemsCount, trackIDs, count * sizeof(int32_t));
+	lib->itemsCount += count;
+	
+	return 1;
+}
+
+// STRING POOL
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Ensures the string pool has room for the given number of additional bytes.
+**/
+static int ReserveStrings(ITunesLibrary *lib, size_t length)
+{
+	size_t needed = (size_t)lib->stringsLength + length;
+	if(needed <= lib->stringsCapacity) return 1;
+	
+	// The pool is referenced with 32 bit offsets
+	if(needed > UINT32_MAX) return 0;
+	
+	size_t newCapacity = lib->stringsCapacity;
+	while(newCapacity < needed)
+	{
+		newCapacity *= 2;
+	}
+	if(newCapacity > UINT32_MAX) newCapacity = UINT32_MAX;
+	
+	char *newStrings = realloc(lib->strings, newCapacity);
+	if(newStrings == NULL) return 0;
+	
+	lib->strings = newStrings;
+	lib->stringsCapacity = (uint32_t)newCapacity;
+	return 1;
+}
+
+/**
+ Copies the given UTF-8 bytes into the string pool, and returns a reference to the copy.
+ Empty strings are not copied, and simply return the reference to the shared empty string.
+**/
+ITunesStringRef ITunesLibraryAddString(ITunesLibrary *lib, const char *utf8, size_t length)
+{
+	if(length == 0) return 0;
+	if(!ReserveStrings(lib, length + 1)) return 0;
+	
+	ITunesStringRef ref = lib->stringsLength;
+	
+	memcpy(lib->strings + ref, utf8, length);
+	lib->strings[ref + length] = '\0';
+	lib->stringsLength += (uint32_t)(length + 1);
+	
+	return ref;
+}
+
+/**
+ Returns the code point of a numeric character reference, given the text between '&' and ';' (such as "#233").
+ Returns zero if it isn't a valid character: it has no digits, or anything but digits, or it's NUL,
+ a UTF-16 surrogate, or past the last code point. Decoding NUL would cut the string short.
+**/
+static uint32_t CharacterReference(const char *name, size_t nameLength)
+{
+	uint32_t cp = 0;
+	size_t j = 1;
+	uint32_t base = 10;
+	
+	if((name[1] == 'x') || (name[1] == 'X'))
+	{
+		base = 16;
+		j = 2;
+	}
+	if(j == nameLength) return 0;
+	
+	for(; j < nameLength; j++)
+	{
+		char d = name[j];
+		uint32_t v;
+		if(d >= '0' && d <= '9')                    v = d - '0';
+		else if(base == 16 && d >= 'a' && d <= 'f') v = d - 'a' + 10;
+		else if(base == 16 && d >= 'A' && d <= 'F') v = d - 'A' + 10;
+		else return 0;
+		
+		cp = (cp * base) + v;
+		if(cp > 0x10FFFF) return 0;
+	}
+	
+	if((cp >= 0xD800) && (cp <= 0xDFFF)) return 0;
+	
+	return cp;
+}
+
+/**
+ Appends the given UTF-8 bytes to the string pool, resolving XML character entities along the way.
+
+ The text between <string> and </string> tags in the XML file is escaped.
+ Ampersands show up as &amp; and non-ASCII characters may show up as &#233; or &#xE9;
+ The decoded string is never longer than the escaped string, so the pool is sized for the raw length.
+**/
+ITunesStringRef ITunesLibraryAddXMLString(ITunesLibrary *lib, const char *xml, size_t length)
+{
+	if(length == 0) return 0;
+	
+	// Fast path: most strings contain no entities at all
+	if(memchr(xml, '&', length) == NULL)
+	{
+		return ITunesLibraryAddString(lib, xml, length);
+	}
+	
+	if(!ReserveStrings(lib, length + 1)) return 0;
+	
+	ITunesStringRef ref = lib->stringsLength;
+	char *out = lib->strings + ref;
+	size_t i = 0;
+	uint32_t cp;
+	
+	while(i < length)
+	{
+		char c = xml[i];
+		
+		if(c != '&')
+		{
+			*out++ = c;
+			i++;
+			continue;
+		}
+		
+		// Find the end of the entity
+		size_t end = i + 1;
+		while((end < length) && (xml[end] != ';') && (end - i < 12))
+		{
+			end++;
+		}
+		
+		if((end >= length) || (xml[end] != ';'))
+		{
+			// Malformed entity - copy it verbatim
+			*out++ = c;
+			i++;
+			continue;
+		}
+		
+		const char *name = xml + i + 1;
+		size_t nameLength = end - i - 1;
+		
+		if((nameLength == 3) && (strncmp(name, "amp", 3) == 0))
+			*out++ = '&';
+		else if((nameLength == 2) && (strncmp(name, "lt", 2) == 0))
+			*out++ = '<';
+		else if((nameLength == 2) && (strncmp(name, "gt", 2) == 0))
+			*out++ = '>';
+		else if((nameLength == 4) && (strncmp(name, "quot", 4) == 0))
+			*out++ = '"';
+		else if((nameLength == 4) && (strncmp(name, "apos", 4) == 0))
+			*out++ = '\'';
+		else if((nameLength > 1) && (name[0] == '#') && ((cp = CharacterReference(name, nameLength)) != 0))
+		{
+			// Numeric character reference - encode the code point as UTF-8
+			// An escaped code point never needs more bytes than its escape sequence (at least 4 bytes: &#N;)
+			if(cp < 0x80)
+			{
+				*out++ = (char)cp;
+			}
+			else if(cp < 0x800)
+			{
+				*out++ = (char)(0xC0 | (cp >> 6));
+				*out++ = (char)(0x80 | (cp & 0x3F));
+			}
+			else if(cp < 0x10000)
+			{
+				*out++ = (char)(0xE0 | (cp >> 12));
+				*out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+				*out++ = (char)(0x80 | (cp & 0x3F));
+			}
+			else
+			{
+				*out++ = (char)(0xF0 | ((cp >> 18) & 0x07));
+				*out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+				*out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+				*out++ = (char)(0x80 | (cp & 0x3F));
+			}
+		}
+		else
+		{
+			// Unknown entity, or invalid character reference - copy it verbatim
+			memcpy(out, xml + i, end - i + 1);
+			out += end - i + 1;
+		}
+		
+		i = end + 1;
+	}
+	
+	*out = '\0';
+	lib->stringsLength = (uint32_t)(out - lib->strings) + 1;
+	
+	return ref;
+}
+
+// HASH INDEXES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Scrambles the bits of the key, so sequential ID's are spread evenly across the table.
+ This is the finalizer from MurmurHash3.
+**/
+static inline uint32_t HashKey(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	key *= 0xC4CEB9FE1A85EC53ULL;
+	key ^= key >> 33;
+	
+	return (uint32_t)key;
+}
+
+/**
+ Allocates an empty table with room for the given number of keys.
+ The table is kept at most half full, so probe sequences stay short.
+**/
+int ITunesHashTableCreate(ITunesHashTable *table, uint32_t count)
+{
+	uint32_t capacity = 16;
+	while(capacity < count * 2)
+	{
+		capacity *= 2;
+	}
+	
+	table->slots = malloc(capacity * sizeof(ITunesHashSlot));
+	if(table->slots == NULL) return 0;
+	
+	uint32_t i;
+	for(i = 0; i < capacity; i++)
+	{
+		table->slots[i].key = 0;
+		table->slots[i].value = ITUNES_HASH_EMPTY;
+		table->slots[i].reserved = 0;
+	}
+	
+	table->mask = capacity - 1;
+	table->count = 0;
+	return 1;
+}
+
+/**
+ Doubles the size of the table, rehashing all keys.
+**/
+static int HashTableGrow(ITunesHashTable *table)
+{
+	ITunesHashTable bigger;
+	if(!ITunesHashTableCreate(&bigger, (table->mask + 1))) return 0;
+	
+	uint32_t i;
+	for(i = 0; i <= table->mask; i++)
+	{
+		if(table->slots[i].value != ITUNES_HASH_EMPTY)
+		{
+			ITunesHashTableInsert(&bigger, table->slots[i].key, table->slots[i].value);
+		}
+	}
+	
+	free(table->slots);
+	*table = bigger;
+	return 1;
+}
+
+/**
+ Adds the key to the table, unless it's already in there.
+ If a key is used more than once (IE - duplicate persistent ID's), the first value wins.
+ The table grows as needed to stay at most half full.
+ Returns 0 if the key isn't in the table afterwards (it was full, and couldn't grow).
+**/
+int ITunesHashTableInsert(ITunesHashTable *table, uint64_t key, uint32_t value)
+{
+	if((table->count + 1) * 2 > (table->mask + 1))
+	{
+		// If the table can't grow, it's still usable (just slower) until it's completely full
+		if(!HashTableGrow(table) && (table->count >= table->mask))
+		{
+			return (ITunesHashTableFind(table, key) != ITUNES_HASH_EMPTY);
+		}
+	}
+	
+	uint32_t i = HashKey(key) & table->mask;
+	
+	while(table->slots[i].value != ITUNES_HASH_EMPTY)
+	{
+		if(table->slots[i].key == key) return 1;
+		i = (i + 1) & table->mask;
+	}
+	
+	table->slots[i].key = key;
+	table->slots[i].value = value;
+	table->count++;
+	return 1;
+}
+
+/**
+ Returns the value for the given key, or ITUNES_HASH_EMPTY if the key isn't in the table.
+**/
+uint32_t ITunesHashTableFind(const ITunesHashTable *table, uint64_t key)
+{
+	if(table->slots == NULL) return ITUNES_HASH_EMPTY;
+	
+	uint32_t i = HashKey(key) & table->mask;
+	uint32_t probes = 0;
+	
+	while(table->slots[i].value != ITUNES_HASH_EMPTY)
+	{
+		if(table->slots[i].key == key) return table->slots[i].value;
+		
+		// A table read from disk may be corrupt, and have no empty slots at all
+		if(++probes > table->mask) break;
+		
+		i = (i + 1) & table->mask;
+	}
+	return ITUNES_HASH_EMPTY;
+}
+
+/**
+ Changes the value of the given key, or adds the key if it isn't in the table yet.
+**/
+void ITunesHashTableSet(ITunesHashTable *table, uint64_t key, uint32_t value)
+{
+	uint32_t i = HashKey(key) & table->mask;
+	
+	while(table->slots[i].value != ITUNES_HASH_EMPTY)
+	{
+		if(table->slots[i].key == key)
+		{
+			table->slots[i].value = value;
+			return;
+		}
+		i = (i + 1) & table->mask;
+	}
+	
+	ITunesHashTableInsert(table, key, value);
+}
+
+/**
+ Removes the given key from the table.
+
+ Rather than leaving a tombstone behind, the following keys in the probe sequence are shifted back.
+ This keeps lookups just as fast after many removals.
+**/
+void ITunesHashTableRemove(ITunesHashTable *table, uint64_t key)
+{
+	uint32_t mask = table->mask;
+	uint32_t i = HashKey(key) & mask;
+	
+	while(table->slots[i].value != ITUNES_HASH_EMPTY)
+	{
+		if(table->slots[i].key == key) break;
+		i = (i + 1) & mask;
+	}
+	if(table->slots[i].value == ITUNES_HASH_EMPTY) return;
+	
+	uint32_t hole = i;
+	uint32_t j = i;
+	while(1)
+	{
+		j = (j + 1) & mask;
+		if(table->slots[j].value == ITUNES_HASH_EMPTY) break;
+		
+		// Only move the key back if the hole lies between it's home slot and it's current slot
+		uint32_t home = HashKey(table->slots[j].key) & mask;
+		if(((j - home) & mask) >= ((j - hole) & mask))
+		{
+			table->slots[hole] = table->slots[j];
+			hole = j;
+		}
+	}
+	
+	table->slots[hole].key = 0;
+	table->slots[hole].value = ITUNES_HASH_EMPTY;
+	table->count--;
+}
+
+static void FreeIndexes(ITunesLibrary *lib)
+{
+	free(lib->trackIndex.slots);
+	free(lib->playlistIndex.slots);
+	free(lib->trackPersistentIndex.slots);
+	free(lib->playlistPersistentIndex.slots);
+	
+	memset(&lib->trackIndex, 0, sizeof(ITunesHashTable));
+	memset(&lib->playlistIndex, 0, sizeof(ITunesHashTable));
+	memset(&lib->trackPersistentIndex, 0, sizeof(ITunesHashTable));
+	memset(&lib->playlistPersistentIndex, 0, sizeof(ITunesHashTable));
+}
+
+/**
+ Builds the hash indexes for the tracks and playlists.
+ Returns 0 if the memory could not be allocated.
+**/
+static int BuildIndexes(ITunesLibrary *lib)
+{
+	FreeIndexes(lib);
+	
+	if(!ITunesHashTableCreate(&lib->trackIndex, lib->tracksCount) ||
+	   !ITunesHashTableCreate(&lib->trackPersistentIndex, lib->tracksCount) ||
+	   !ITunesHashTableCreate(&lib->playlistIndex, lib->playlistsCount) ||
+	   !ITunesHashTableCreate(&lib->playlistPersistentIndex, lib->playlistsCount))
+	{
+		FreeIndexes(lib);
+		return 0;
+	}
+	
+	uint32_t i;
+	for(i = 0; i < lib->tracksCount; i++)
+	{
+		const ITunesTrack *track = &lib->tracks[i];
+		
+		ITunesHashTableInsert(&lib->trackIndex, (uint32_t)track->trackID, i);
+		
+		if(track->persistentID != 0)
+		{
+			ITunesHashTableInsert(&lib->trackPersistentIndex, track->persistentID, i);
+		}
+	}
+	for(i = 0; i < lib->playlistsCount; i++)
+	{
+		const ITunesPlaylist *playlist = &lib->playlists[i];
+		
+		ITunesHashTableInsert(&lib->playlistIndex, (uint32_t)playlist->playlistID, i);
+		
+		if(playlist->persistentID != 0)
+		{
+			ITunesHashTableInsert(&lib->playlistPersistentIndex, playlist->persistentID, i);
+		}
+	}
+	
+	return 1;
+}
+
+// LOOKUPS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CompareTracks(const void *a, const void *b)
+{
+	int32_t idA = ((const ITunesTrack *)a)->trackID;
+	int32_t idB = ((const ITunesTrack *)b)->trackID;
+	
+	if(idA < idB) return -1;
+	if(idA > idB) return  1;
+	return 0;
+}
+
+/**
+ Called after the library has been fully parsed.
+ Sorts the tracks by track ID (iTunes already writes them in ascending order, so this is usually a no-op check),
+ and builds the hash indexes used for all lookups.
+ Returns 0 if the memory for the indexes could not be allocated.
+**/
+int ITunesLibraryFinish(ITunesLibrary *lib)
+{
+	uint32_t i;
+	for(i = 1; i < lib->tracksCount; i++)
+	{
+		if(lib->tracks[i-1].trackID > lib->tracks[i].trackID)
+		{
+			qsort(lib->tracks, lib->tracksCount, sizeof(ITunesTrack), CompareTracks);
+			break;
+		}
+	}
+	
+	return BuildIndexes(lib);
+}
+
+/**
+ Returns the track record with the given ID, or NULL if it doesn't exist.
+**/
+const ITunesTrack * ITunesLibraryTrackForID(const ITunesLibrary *lib, int32_t trackID)
+{
+	uint32_t index = ITunesHashTableFind(&lib->trackIndex, (uint32_t)trackID);
+	
+	if((index < lib->tracksCount) && (lib->tracks[index].trackID == trackID))
+	{
+		return &lib->tracks[index];
+	}
+	return NULL;
+}
+
+/**
+ Returns the track record with the given persistent ID, or NULL if it doesn't exist.
+**/
+const ITunesTrack * ITunesLibraryTrackForPersistentID(const ITunesLibrary *lib, uint64_t persistentID)
+{
+	if(persistentID == 0) return NULL;
+	
+	uint32_t index = ITunesHashTableFind(&lib->trackPersistentIndex, persistentID);
+	
+	if((index < lib->tracksCount) && (lib->tracks[index].persistentID == persistentID))
+	{
+		return &lib->tracks[index];
+	}
+	return NULL;
+}
+
+/**
+ Returns the index of the playlist with the given ID, or -1 if it doesn't exist.
+**/
+int32_t ITunesLibraryPlaylistIndexForID(const ITunesLibrary *lib, int32_t playlistID)
+{
+	uint32_t index = ITunesHashTableFind(&lib->playlistIndex, (uint32_t)playlistID);
+	
+	if((index < lib->playlistsCount) && (lib->playlists[index].playlistID == playlistID))
+	{
+		return (int32_t)index;
+	}
+	return -1;
+}
+
+/**
+ Returns the index of the playlist with the given persistent ID, or -1 if it doesn't exist.
+**/
+int32_t ITunesLibraryPlaylistIndexForPersistentID(const ITunesLibrary *lib, uint64_t persistentID)
+{
+	if(persistentID == 0) return -1;
+	
+	uint32_t index = ITunesHashTableFind(&lib->playlistPersistentIndex, persistentID);
+	
+	if((index < lib->playlistsCount) && (lib->playlists[index].persistentID == persistentID))
+	{
+		return (int32_t)index;
+	}
+	return -1;
+}
+
+// PLAYLIST POSITIONS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Playlists smaller than this are simply scanned, as building a table wouldn't pay off
+#define POSITION_INDEX_MIN_ITEMS  64
+
+/**
+ Returns the position of the given track within the playlist at the given index, or -1 if it's not in the playlist.
+ If the track is in the playlist more than once, the first position is returned.
+
+ The first lookup in a large playlist builds a trackID -> position table for that playlist.
+ Every following lookup in the same playlist is O(1).
+ The tables are kept until the library is freed, or ITunesLibraryClearPositionIndexes is called.
+
+ This method modifies the library's cache, so it must not be called from multiple threads at the same time.
+**/
+int32_t ITunesLibraryPositionOfTrack(ITunesLibrary *lib, uint32_t playlistIndex, int32_t trackID)
+{
+	if(playlistIndex >= lib->playlistsCount) return -1;
+	
+	const ITunesPlaylist *playlist = &lib->playlists[playlistIndex];
+	const int32_t *items = lib->items + playlist->itemsOffset;
+	
+	uint32_t i;
+	
+	if(playlist->itemsCount >= POSITION_INDEX_MIN_ITEMS)
+	{
+		if(lib->positionIndexes == NULL)
+		{
+			lib->positionIndexes = calloc(lib->playlistsCount, sizeof(ITunesHashTable));
+		}
+		
+		ITunesHashTable *table = (lib->positionIndexes != NULL) ? &lib->positionIndexes[playlistIndex] : NULL;
+		
+		if((table != NULL) && (table->slots == NULL) && ITunesHashTableCreate(table, playlist->itemsCount))
+		{
+			for(i = 0; i < playlist->itemsCount; i++)
+			{
+				ITunesHashTableInsert(table, (uint32_t)items[i], i);
+			}
+		}
+		
+		if((table != NULL) && (table->slots != NULL))
+		{
+			uint32_t position = ITunesHashTableFind(table, (uint32_t)trackID);
+			return (position == ITUNES_HASH_EMPTY) ? -1 : (int32_t)position;
+		}
+		
+		// Unable to allocate the table - fall back to scanning the playlist
+	}
+	
+	for(i = 0; i < playlist->itemsCount; i++)
+	{
+		if(items[i] == trackID) return (int32_t)i;
+	}
+	return -1;
+}
+
+/**
+ Frees all the trackID -> position tables.
+ This must be called whenever the playlists or their items change.
+**/
+void ITunesLibraryClearPositionIndexes(ITunesLibrary *lib)
+{
+	if(lib->positionIndexes == NULL) return;
+	
+	uint32_t i;
+	for(i = 0; i < lib->playlistsCount; i++)
+	{
+		free(lib->positionIndexes[i].slots);
+	}
+	free(lib->positionIndexes);
+	lib->positionIndexes = NULL;
+}
+
+// PERSISTENT ID'S
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Persistent ID's are 64 bit numbers, written by iTunes as 16 hex digits (IE - "2E4B0FB1C2D2B7E5").
+ We store them as integers, which are smaller and much faster to compare than strings.
+ Returns zero if the string isn't a valid persistent ID.
+**/
+uint64_t ITunesParsePersistentID(const char *str, size_t length)
+{
+	if((length == 0) || (length > 16)) return 0;
+	
+	uint64_t result = 0;
+	size_t i;
+	for(i = 0; i < length; i++)
+	{
+		char c = str[i];
+		uint64_t v;
+		
+		if(c >= '0' && c <= '9')      v = c - '0';
+		else if(c >= 'A' && c <= 'F') v = c - 'A' + 10;
+		else if(c >= 'a' && c <= 'f') v = c - 'a' + 10;
+		else return 0;
+		
+		result = (result << 4) | v;
+	}
+	
+	return result;
+}
+
+/**
+ Formats the persistent ID the same way iTunes does (16 uppercase hex digits).
+**/
+void ITunesFormatPersistentID(uint64_t persistentID, char buffer[17])
+{
+	snprintf(buffer, 17, "%08X%08X", (unsigned int)(persistentID >> 32), (unsigned int)(persistentID & 0xFFFFFFFF));
+}
@@ -0,0 +1,166 @@
+/**
+ Compact, native representation of the parts of the iTunes Music Library that we actually use.
+
+ The "iTunes Music Library.xml" file contains dozens of keys for every track and playlist.
+ We only need a handful of them (see the TRACK_* and PLAYLIST_* keys in ITunesData.h).
+ Instead of keeping a property list tree in memory, the parser fills the flat structures below.
+
+ All strings are stored (UTF-8, NUL terminated) in a single string pool, and referenced by offset.
+ All playlist items are stored (as track ID's) in a single items array, and referenced by offset and count.
+
+ This file is plain C so it may be used from background threads, and from command line tools.
+**/
+
+#ifndef ITUNES_LIBRARY_H
+#define ITUNES_LIBRARY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Offset into the string pool.
+// Offset zero always points to the empty string, and is used for missing values.
+typedef uint32_t ITunesStringRef;
+
+// Track flags
+#define ITUNES_TRACK_PROTECTED        (1 << 0)
+#define ITUNES_TRACK_FILE             (1 << 1)
+
+// Playlist flags
+// These correspond to the PLAYLIST_TYPE_* keys in ITunesData.h
+#define ITUNES_PLAYLIST_MASTER        (1 << 0)
+#define ITUNES_PLAYLIST_MUSIC         (1 << 1)
+#define ITUNES_PLAYLIST_MOVIES        (1 << 2)
+#define ITUNES_PLAYLIST_TVSHOWS       (1 << 3)
+#define ITUNES_PLAYLIST_PODCASTS      (1 << 4)
+#define ITUNES_PLAYLIST_VIDEOS        (1 << 5)
+#define ITUNES_PLAYLIST_AUDIOBOOKS    (1 << 6)
+#define ITUNES_PLAYLIST_PURCHASED     (1 << 7)
+#define ITUNES_PLAYLIST_PARTYSHUFFLE  (1 << 8)
+#define ITUNES_PLAYLIST_FOLDER        (1 << 9)
+#define ITUNES_PLAYLIST_SMART         (1 << 10)
+#define ITUNES_PLAYLIST_HAS_PARENT    (1 << 11)
+
+typedef struct ITunesTrack
+{
+	int32_t  trackID;
+	int32_t  totalTime;
+	int32_t  trackNumber;
+	int32_t  trackCount;
+	uint64_t persistentID;
+	ITunesStringRef name;
+	ITunesStringRef artist;
+	ITunesStringRef album;
+	ITunesStringRef location;
+	uint32_t flags;
+	uint32_t reserved;
+} ITunesTrack;
+
+typedef struct ITunesPlaylist
+{
+	int32_t  playlistID;
+	uint32_t flags;
+	uint64_t persistentID;
+	uint64_t parentPersistentID;
+	ITunesStringRef name;
+	uint32_t itemsOffset;
+	uint32_t itemsCount;
+	uint32_t reserved;
+} ITunesPlaylist;
+
+// Open addressing hash table, mapping 64 bit keys to 32 bit values (record indexes).
+// Empty slots have a value of ITUNES_HASH_EMPTY.
+#define ITUNES_HASH_EMPTY  0xFFFFFFFF
+
+typedef struct ITunesHashSlot
+{
+	uint64_t key;
+	uint32_t value;
+	uint32_t reserved;
+} ITunesHashSlot;
+
+typedef struct ITunesHashTable
+{
+	ITunesHashSlot *slots;
+	uint32_t mask;
+	uint32_t count;
+} ITunesHashTable;
+
+typedef struct ITunesLibrary
+{
+	ITunesTrack *tracks;
+	uint32_t tracksCount;
+	uint32_t tracksCapacity;
+	
+	ITunesPlaylist *playlists;
+	uint32_t playlistsCount;
+	uint32_t playlistsCapacity;
+	
+	int32_t *items;
+	uint32_t itemsCount;
+	uint32_t itemsCapacity;
+	
+	char *strings;
+	uint32_t stringsLength;
+	uint32_t stringsCapacity;
+	
+	ITunesStringRef libraryPersistentID;
+	ITunesStringRef musicFolder;
+	
+	// Indexes built by ITunesLibraryFinish
+	ITunesHashTable trackIndex;               // trackID -> index in tracks
+	ITunesHashTable trackPersistentIndex;     // persistentID -> index in tracks
+	ITunesHashTable playlistIndex;            // playlistID -> index in playlists
+	ITunesHashTable playlistPersistentIndex;  // persistentID -> index in playlists
+	
+	// Lazily built trackID -> position tables, one per playlist (see ITunesLibraryPositionOfTrack)
+	// These are never stored in a snapshot, and are always heap allocated.
+	ITunesHashTable *positionIndexes;
+	
+	// If the library was opened from a snapshot, the arrays above point into this read-only mapping.
+	// Such libraries can't be modified (their capacities are zero) until ITunesLibraryMakeMutable is called.
+	void *mapping;
+	size_t mappingLength;
+} ITunesLibrary;
+
+int      ITunesHashTableCreate(ITunesHashTable *table, uint32_t count);
+int      ITunesHashTableInsert(ITunesHashTable *table, uint64_t key, uint32_t value);
+void     ITunesHashTableSet(ITunesHashTable *table, uint64_t key, uint32_t value);
+void     ITunesHashTableRemove(ITunesHashTable *table, uint64_t key);
+uint32_t ITunesHashTableFind(const ITunesHashTable *table, uint64_t key);
+
+ITunesLibrary * ITunesLibraryCreate(void);
+void ITunesLibraryFree(ITunesLibrary *lib);
+int  ITunesLibraryMakeMutable(ITunesLibrary *lib);
+ITunesLibrary * ITunesLibraryCopy(const ITunesLibrary *lib);
+
+ITunesTrack    * ITunesLibraryAddTrack(ITunesLibrary *lib);
+ITunesPlaylist * ITunesLibraryAddPlaylist(ITunesLibrary *lib);
+int ITunesLibraryAddItem(ITunesLibrary *lib, int32_t trackID);
+int ITunesLibraryAddItems(ITunesLibrary *lib, const int32_t *trackIDs, uint32_t count);
+
+ITunesStringRef ITunesLibraryAddString(ITunesLibrary *lib, const char *utf8, size_t length);
+ITunesStringRef ITunesLibraryAddXMLString(ITunesLibrary *lib, const char *xml, size_t length);
+
+int ITunesLibraryFinish(ITunesLibrary *lib);
+
+const ITunesTrack * ITunesLibraryTrackForID(const ITunesLibrary *lib, int32_t trackID);
+const ITunesTrack * ITunesLibraryTrackForPersistentID(const ITunesLibrary *lib, uint64_t persistentID);
+
+int32_t ITunesLibraryPlaylistIndexForID(const ITunesLibrary *lib, int32_t playlistID);
+int32_t ITunesLibraryPlaylistIndexForPersistentID(const ITunesLibrary *lib, uint64_t persistentID);
+
+int32_t ITunesLibraryPositionOfTrack(ITunesLibrary *lib, uint32_t playlistIndex, int32_t trackID);
+void ITunesLibraryClearPositionIndexes(ITunesLibrary *lib);
+
+/**
+ Returns the (NUL terminated, UTF-8) string for the given reference.
+**/
+static inline const char * ITunesLibraryString(const ITunesLibrary *lib, ITunesStringRef ref)
+{
+	return lib->strings + ref;
+}
+
+uint64_t ITunesParsePersistentID(const char *str, size_t length);
+void ITunesFormatPersistentID(uint64_t persistentID, char buffer[17]);
+
+#endif
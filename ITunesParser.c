@@ -0,0 +1,637 @@
+#include "ITunesParser.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// While parsing a mapped file, consumed pages are handed back to the system in chunks of this size.
+// This keeps the resident size of the parse flat, no matter how big the XML file is.
+#define RELEASE_CHUNK   (8 * 1024 * 1024)
+
+// The amount of already parsed data that is kept mapped behind the current position.
+// The previous token (typically a key) may still be referenced while the next token is read.
+#define RELEASE_MARGIN  (1024 * 1024)
+
+typedef enum XMLTokenType
+{
+	XMLTokenEnd = 0,
+	XMLTokenError,
+	XMLTokenDictBegin,
+	XMLTokenDictEnd,
+	XMLTokenArrayBegin,
+	XMLTokenArrayEnd,
+	XMLTokenKey,
+	XMLTokenString,
+	XMLTokenInteger,
+	XMLTokenReal,
+	XMLTokenDate,
+	XMLTokenData,
+	XMLTokenTrue,
+	XMLTokenFalse
+} XMLTokenType;
+
+typedef struct XMLToken
+{
+	XMLTokenType type;
+	const char *text;
+	size_t length;
+} XMLToken;
+
+typedef struct XMLReader
+{
+	const char *bytes;
+	size_t length;
+	size_t pos;
+	
+	XMLTokenType pendingEnd;
+	
+	// Only used when parsing a memory mapped file
+	char *mapBase;
+	size_t mapReleased;
+	size_t pageSize;
+} XMLReader;
+
+#define KEY_IS(t, literal) (((t)->length == sizeof(literal) - 1) && (memcmp((t)->text, literal, sizeof(literal) - 1) == 0))
+
+// TOKENIZER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Unmaps the pages we've already parsed (minus a safety margin).
+ Every string we keep has already been copied into the library's string pool.
+**/
+static void ReleaseConsumed(XMLReader *r)
+{
+	if(r->mapBase == NULL) return;
+	if(r->pos < r->mapReleased + RELEASE_CHUNK + RELEASE_MARGIN) return;
+	
+	size_t end = r->pos - RELEASE_MARGIN;
+	end -= end % r->pageSize;
+	
+	if(end > r->mapReleased)
+	{
+		munmap(r->mapBase + r->mapReleased, end - r->mapReleased);
+		r->mapReleased = end;
+	}
+}
+
+/**
+ Moves the reader past the next occurrence of the given terminator.
+ Returns 0 if the terminator wasn't found.
+**/
+static int SkipPast(XMLReader *r, const char *terminator)
+{
+	size_t termLength = strlen(terminator);
+	
+	while(r->pos < r->length)
+	{
+		const char *p = memchr(r->bytes + r->pos, terminator[0], r->length - r->pos);
+		if(p == NULL) break;
+		
+		r->pos = p - r->bytes;
+		if((r->length - r->pos >= termLength) && (memcmp(p, terminator, termLength) == 0))
+		{
+			r->pos += termLength;
+			return 1;
+		}
+		r->pos++;
+	}
+	
+	r->pos = r->length;
+	return 0;
+}
+
+static int TagIs(const char *name, size_t length, const char *literal)
+{
+	size_t literalLength = strlen(literal);
+	return (length == literalLength) && (memcmp(name, literal, length) == 0);
+}
+
+/**
+ Reads the next token from the XML file.
+
+ Tokens are the structural elements of a property list:
+ dict and array boundaries, keys, scalar values (string, integer, etc), and the true/false elements.
+ The text of scalar tokens points directly into the file, and is NOT unescaped.
+**/
+static XMLTokenType NextToken(XMLReader *r, XMLToken *t)
+{
+	t->text = NULL;
+	t->length = 0;
+	
+	if(r->pendingEnd != XMLTokenEnd)
+	{
+		t->type = r->pendingEnd;
+		r->pendingEnd = XMLTokenEnd;
+		return t->type;
+	}
+	
+	ReleaseConsumed(r);
+	
+	while(1)
+	{
+		// Skip whitespace (or any other character data) until the next tag
+		const char *lt = NULL;
+		if(r->pos < r->length)
+		{
+			lt = memchr(r->bytes + r->pos, '<', r->length - r->pos);
+		}
+		if(lt == NULL)
+		{
+			t->type = XMLTokenEnd;
+			return t->type;
+		}
+		
+		r->pos = lt - r->bytes;
+		if(r->length - r->pos < 3)
+		{
+			t->type = XMLTokenError;
+			return t->type;
+		}
+		
+		char c = lt[1];
+		
+		if(c == '?')
+		{
+			// Processing instruction: <?xml version="1.0" encoding="UTF-8"?>
+			if(!SkipPast(r, "?>")) break;
+			continue;
+		}
+		if(c == '!')
+		{
+			// Comment or doctype: <!DOCTYPE plist ...>
+			if((r->length - r->pos >= 4) && (memcmp(lt, "<!--", 4) == 0))
+			{
+				if(!SkipPast(r, "-->")) break;
+			}
+			else
+			{
+				if(!SkipPast(r, ">")) break;
+			}
+			continue;
+		}
+		
+		// Find the end of the tag
+		const char *gt = memchr(lt, '>', r->length - r->pos);
+		if(gt == NULL) break;
+		
+		int isClosing = (c == '/');
+		const char *name = lt + (isClosing ? 2 : 1);
+		const char *nameEnd = name;
+		while((nameEnd < gt) && (*nameEnd != ' ') && (*nameEnd != '/') && (*nameEnd != '\t') && (*nameEnd != '\n') && (*nameEnd != '\r'))
+		{
+			nameEnd++;
+		}
+		size_t nameLength = nameEnd - name;
+		int isEmpty = (gt[-1] == '/');
+		
+		r->pos = (gt - r->bytes) + 1;
+		
+		if(isClosing)
+		{
+			if(TagIs(name, nameLength, "dict"))  { t->type = XMLTokenDictEnd;  return t->type; }
+			if(TagIs(name, nameLength, "array")) { t->type = XMLTokenArrayEnd; return t->type; }
+			if(TagIs(name, nameLength, "plist")) continue;
+			break;
+		}
+		
+		if(TagIs(name, nameLength, "dict"))
+		{
+			if(isEmpty) r->pendingEnd = XMLTokenDictEnd;
+			t->type = XMLTokenDictBegin;
+			return t->type;
+		}
+		if(TagIs(name, nameLength, "array"))
+		{
+			if(isEmpty) r->pendingEnd = XMLTokenArrayEnd;
+			t->type = XMLTokenArrayBegin;
+			return t->type;
+		}
+		if(TagIs(name, nameLength, "plist")) continue;
+		if(TagIs(name, nameLength, "true"))  { t->type = XMLTokenTrue;  return t->type; }
+		if(TagIs(name, nameLength, "false")) { t->type = XMLTokenFalse; return t->type; }
+		
+		if(TagIs(name, nameLength, "key"))          t->type = XMLTokenKey;
+		else if(TagIs(name, nameLength, "string"))  t->type = XMLTokenString;
+		else if(TagIs(name, nameLength, "integer")) t->type = XMLTokenInteger;
+		else if(TagIs(name, nameLength, "real"))    t->type = XMLTokenReal;
+		else if(TagIs(name, nameLength, "date"))    t->type = XMLTokenDate;
+		else if(TagIs(name, nameLength, "data"))    t->type = XMLTokenData;
+		else break;
+		
+		t->text = r->bytes + r->pos;
+		if(isEmpty) return t->type;
+		
+		// Character data can't contain a raw '<', so the next one starts the closing tag
+		const char *close = memchr(t->text, '<', r->length - r->pos);
+		if(close == NULL) break;
+		
+		t->length = close - t->text;
+		r->pos = close - r->bytes;
+		
+		if(!SkipPast(r, ">")) break;
+		
+		return t->type;
+	}
+	
+	t->type = XMLTokenError;
+	return t->type;
+}
+
+/**
+ Skips the rest of a dict or array, whose begin token has already been read.
+**/
+static int SkipContainer(XMLReader *r)
+{
+	int depth = 1;
+	XMLToken t;
+	
+	while(depth > 0)
+	{
+		switch(NextToken(r, &t))
+		{
+			case XMLTokenDictBegin:
+			case XMLTokenArrayBegin:
+				depth++;
+				break;
+			case XMLTokenDictEnd:
+			case XMLTokenArrayEnd:
+				depth--;
+				break;
+			case XMLTokenEnd:
+			case XMLTokenError:
+				return 0;
+			default:
+				break;
+		}
+	}
+	return 1;
+}
+
+/**
+ Skips the value token that was just read.
+ Scalars are already consumed, containers must be skipped entirely.
+**/
+static int SkipValue(XMLReader *r, XMLToken *value)
+{
+	if((value->type == XMLTokenDictBegin) || (value->type == XMLTokenArrayBegin))
+	{
+		return SkipContainer(r);
+	}
+	return (value->type != XMLTokenEnd) && (value->type != XMLTokenError);
+}
+
+static int32_t IntegerValue(XMLToken *t)
+{
+	const char *p = t->text;
+	const char *end = t->text + t->length;
+	int negative = 0;
+	int64_t value = 0;
+	
+	while((p < end) && (*p == ' ')) p++;
+	if((p < end) && (*p == '-'))
+	{
+		negative = 1;
+		p++;
+	}
+	while((p < end) && (*p >= '0') && (*p <= '9'))
+	{
+		value = (value * 10) + (*p - '0');
+		p++;
+	}
+	
+	if(negative) value = -value;
+	if(value > INT32_MAX) return INT32_MAX;
+	if(value < INT32_MIN) return INT32_MIN;
+	
+	return (int32_t)value;
+}
+
+// LIBRARY STRUCTURE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Parses a single track dictionary, whose begin token has already been read.
+ The track is only added to the library if the entire dictionary was read successfully.
+**/
+static int ParseTrack(XMLReader *r, ITunesLibrary *lib, int32_t keyID)
+{
+	ITunesTrack track;
+	memset(&track, 0, sizeof(ITunesTrack));
+	track.trackID = keyID;
+	
+	XMLToken key, value;
+	
+	while(NextToken(r, &key) == XMLTokenKey)
+	{
+		NextToken(r, &value);
+		
+		if(value.type == XMLTokenString)
+		{
+			if(KEY_IS(&key, "Name"))
+				track.name = ITunesLibraryAddXMLString(lib, value.text, value.length);
+			else if(KEY_IS(&key, "Artist"))
+				track.artist = ITunesLibraryAddXMLString(lib, value.text, value.length);
+			else if(KEY_IS(&key, "Album"))
+				track.album = ITunesLibraryAddXMLString(lib, value.text, value.length);
+			else if(KEY_IS(&key, "Location"))
+				track.location = ITunesLibraryAddXMLString(lib, value.text, value.length);
+			else if(KEY_IS(&key, "Persistent ID"))
+				track.persistentID = ITunesParsePersistentID(value.text, value.length);
+			else if(KEY_IS(&key, "Track Type"))
+			{
+				if((value.length == 4) && (memcmp(value.text, "File", 4) == 0))
+				{
+					track.flags |= ITUNES_TRACK_FILE;
+				}
+			}
+		}
+		else if(value.type == XMLTokenInteger)
+		{
+			if(KEY_IS(&key, "Track ID"))
+				track.trackID = IntegerValue(&value);
+			else if(KEY_IS(&key, "Total Time"))
+				track.totalTime = IntegerValue(&value);
+			else if(KEY_IS(&key, "Track Number"))
+				track.trackNumber = IntegerValue(&value);
+			else if(KEY_IS(&key, "Track Count"))
+				track.trackCount = IntegerValue(&value);
+		}
+		else if(value.type == XMLTokenTrue)
+		{
+			if(KEY_IS(&key, "Protected"))
+				track.flags |= ITUNES_TRACK_PROTECTED;
+		}
+		else if(!SkipValue(r, &value))
+		{
+			return 0;
+		}
+	}
+	
+	if(key.type != XMLTokenDictEnd) return 0;
+	
+	ITunesTrack *dst = ITunesLibraryAddTrack(lib);
+	if(dst == NULL) return 0;
+	
+	*dst = track;
+	return 1;
+}
+
+/**
+ Parses the "Playlist Items" array of a playlist, whose begin token has already been read.
+ Each item is a dictionary with a single "Track ID" key.
+**/
+static int ParsePlaylistItems(XMLReader *r, ITunesLibrary *lib)
+{
+	XMLToken t, key, value;
+	
+	while(NextToken(r, &t) == XMLTokenDictBegin)
+	{
+		while(NextToken(r, &key) == XMLTokenKey)
+		{
+			NextToken(r, &value);
+			
+			if((value.type == XMLTokenInteger) && KEY_IS(&key, "Track ID"))
+			{
+				if(!ITunesLibraryAddItem(lib, IntegerValue(&value))) return 0;
+			}
+			else if(!SkipValue(r, &value))
+			{
+				return 0;
+			}
+		}
+		if(key.type != XMLTokenDictEnd) return 0;
+	}
+	
+	return (t.type == XMLTokenArrayEnd);
+}
+
+/**
+ Parses a single playlist dictionary, whose begin token has already been read.
+
+ The category keys (Master, Music, Folder, Smart Info, etc) are treated as flags.
+ Just like the rest of the application, we only care whether the key is present, not what its value is.
+**/
+static int ParsePlaylist(XMLReader *r, ITunesLibrary *lib)
+{
+	ITunesPlaylist playlist;
+	memset(&playlist, 0, sizeof(ITunesPlaylist));
+	playlist.itemsOffset = lib->itemsCount;
+	
+	XMLToken key, value;
+	
+	while(NextToken(r, &key) == XMLTokenKey)
+	{
+		NextToken(r, &value);
+		
+		if(KEY_IS(&key, "Playlist Items"))
+		{
+			if(value.type == XMLTokenArrayBegin)
+			{
+				if(!ParsePlaylistItems(r, lib)) return 0;
+				continue;
+			}
+		}
+		else if(KEY_IS(&key, "Name"))
+		{
+			if(value.type == XMLTokenString)
+				playlist.name = ITunesLibraryAddXMLString(lib, value.text, value.length);
+		}
+		else if(KEY_IS(&key, "Playlist ID"))
+		{
+			if(value.type == XMLTokenInteger)
+				playlist.playlistID = IntegerValue(&value);
+		}
+		else if(KEY_IS(&key, "Playlist Persistent ID"))
+		{
+			if(value.type == XMLTokenString)
+				playlist.persistentID = ITunesParsePersistentID(value.text, value.length);
+		}
+		else if(KEY_IS(&key, "Parent Persistent ID"))
+		{
+			if(value.type == XMLTokenString)
+			{
+				playlist.parentPersistentID = ITunesParsePersistentID(value.text, value.length);
+				playlist.flags |= ITUNES_PLAYLIST_HAS_PARENT;
+			}
+		}
+		else if(KEY_IS(&key, "Master"))          playlist.flags |= ITUNES_PLAYLIST_MASTER;
+		else if(KEY_IS(&key, "Music"))           playlist.flags |= ITUNES_PLAYLIST_MUSIC;
+		else if(KEY_IS(&key, "Movies"))          playlist.flags |= ITUNES_PLAYLIST_MOVIES;
+		else if(KEY_IS(&key, "TV Shows"))        playlist.flags |= ITUNES_PLAYLIST_TVSHOWS;
+		else if(KEY_IS(&key, "Podcasts"))        playlist.flags |= ITUNES_PLAYLIST_PODCASTS;
+		else if(KEY_IS(&key, "Videos"))          playlist.flags |= ITUNES_PLAYLIST_VIDEOS;
+		else if(KEY_IS(&key, "Audiobooks"))      playlist.flags |= ITUNES_PLAYLIST_AUDIOBOOKS;
+		else if(KEY_IS(&key, "Purchased Music")) playlist.flags |= ITUNES_PLAYLIST_PURCHASED;
+		else if(KEY_IS(&key, "Party Shuffle"))   playlist.flags |= ITUNES_PLAYLIST_PARTYSHUFFLE;
+		else if(KEY_IS(&key, "Folder"))          playlist.flags |= ITUNES_PLAYLIST_FOLDER;
+		else if(KEY_IS(&key, "Smart Info"))      playlist.flags |= ITUNES_PLAYLIST_SMART;
+		
+		if(!SkipValue(r, &value)) return 0;
+	}
+	
+	if(key.type != XMLTokenDictEnd) return 0;
+	
+	playlist.itemsCount = lib->itemsCount - playlist.itemsOffset;
+	
+	ITunesPlaylist *dst = ITunesLibraryAddPlaylist(lib);
+	if(dst == NULL) return 0;
+	
+	*dst = playlist;
+	return 1;
+}
+
+static int ParseTracks(XMLReader *r, ITunesLibrary *lib)
+{
+	XMLToken key, value;
+	
+	while(NextToken(r, &key) == XMLTokenKey)
+	{
+		NextToken(r, &value);
+		
+		if(value.type == XMLTokenDictBegin)
+		{
+			if(!ParseTrack(r, lib, IntegerValue(&key))) return 0;
+		}
+		else if(!SkipValue(r, &value))
+		{
+			return 0;
+		}
+	}
+	
+	return (key.type == XMLTokenDictEnd);
+}
+
+static int ParsePlaylists(XMLReader *r, ITunesLibrary *lib)
+{
+	XMLToken t;
+	
+	while(NextToken(r, &t) != XMLTokenArrayEnd)
+	{
+		if(t.type == XMLTokenDictBegin)
+		{
+			if(!ParsePlaylist(r, lib)) return 0;
+		}
+		else if(!SkipValue(r, &t))
+		{
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+static int ParseRoot(XMLReader *r, ITunesLibrary *lib)
+{
+	XMLToken key, value;
+	
+	if(NextToken(r, &key) != XMLTokenDictBegin) return 0;
+	
+	while(NextToken(r, &key) == XMLTokenKey)
+	{
+		NextToken(r, &value);
+		
+		if(KEY_IS(&key, "Tracks") && (value.type == XMLTokenDictBegin))
+		{
+			if(!ParseTracks(r, lib)) return 0;
+		}
+		else if(KEY_IS(&key, "Playlists") && (value.type == XMLTokenArrayBegin))
+		{
+			if(!ParsePlaylists(r, lib)) return 0;
+		}
+		else if(KEY_IS(&key, "Library Persistent ID") && (value.type == XMLTokenString))
+		{
+			lib->libraryPersistentID = ITunesLibraryAddXMLString(lib, value.text, value.length);
+		}
+		else if(KEY_IS(&key, "Music Folder") && (value.type == XMLTokenString))
+		{
+			lib->musicFolder = ITunesLibraryAddXMLString(lib, value.text, value.length);
+		}
+		else if(!SkipValue(r, &value))
+		{
+			return 0;
+		}
+	}
+	
+	return (key.type == XMLTokenDictEnd);
+}
+
+static ITunesLibrary * Parse(XMLReader *r)
+{
+	ITunesLibrary *lib = ITunesLibraryCreate();
+	if(lib == NULL) return NULL;
+	
+	if(!ParseRoot(r, lib))
+	{
+		ITunesLibraryFree(lib);
+		return NULL;
+	}
+	
+	if(!ITunesLibraryFinish(lib))
+	{
+		ITunesLibraryFree(lib);
+		return NULL;
+	}
+	return lib;
+}
+
+// PUBLIC API
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Parses the library from the given bytes.
+ Returns NULL if the bytes aren't a valid iTunes library property list.
+**/
+ITunesLibrary * ITunesParseLibraryBytes(const char *bytes, size_t length)
+{
+	XMLReader r;
+	memset(&r, 0, sizeof(XMLReader));
+	r.bytes = bytes;
+	r.length = length;
+	
+	return Parse(&r);
+}
+
+/**
+ Parses the library file at the given path.
+ The file is memory mapped and read sequentially, so it is never entirely loaded into memory.
+ Returns NULL if the file can't be read, or isn't a valid iTunes library property list.
+**/
+ITunesLibrary * ITunesParseLibraryFile(const char *path)
+{
+	if(path == NULL) return NULL;
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size <= 0))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	size_t length = (size_t)st.st_size;
+	char *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if(map == MAP_FAILED) return NULL;
+	
+	madvise(map, length, MADV_SEQUENTIAL);
+	
+	XMLReader r;
+	memset(&r, 0, sizeof(XMLReader));
+	r.bytes = map;
+	r.length = length;
+	r.mapBase = map;
+	r.pageSize = (size_t)getpagesize();
+	
+	ITunesLibrary *lib = Parse(&r);
+	
+	munmap(map + r.mapReleased, length - r.mapReleased);
+	
+	return lib;
+}
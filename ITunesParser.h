@@ -0,0 +1,17 @@
+/**
+ Streaming parser for the "iTunes Music Library.xml" file.
+
+ The file is read token by token (SAX style), and only the keys we use are kept.
+ Everything else (play counts, dates, kinds, bit rates, smart playlist criteria, etc) is skipped without being copied.
+ This keeps parse time and memory usage proportional to what we keep, rather than to the size of the file.
+**/
+
+#ifndef ITUNES_PARSER_H
+#define ITUNES_PARSER_H
+
+#include "ITunesLibrary.h"
+
+ITunesLibrary * ITunesParseLibraryFile(const char *path);
+ITunesLibrary * ITunesParseLibraryBytes(const char *bytes, size_t length);
+
+#endif
@@ -0,0 +1,334 @@
+#include "ITunesPlayability.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC      "ACPLAY\0\0"
+#define CACHE_VERSION    1
+#define CACHE_BYTEORDER  0x01020304
+
+typedef struct ITunesPlayabilityHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t entriesCount;
+	uint32_t reserved;
+} ITunesPlayabilityHeader;
+
+// ENTRIES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Stores the state of the given track, replacing any previous entry for it.
+ Must be called with the mutex locked.
+**/
+static void SetEntry(ITunesPlayabilityCache *cache, uint64_t persistentID, int64_t modified, int64_t size, int state)
+{
+	uint32_t i = ITunesHashTableFind(&cache->index, persistentID);
+	
+	if(i == ITUNES_HASH_EMPTY)
+	{
+		if(cache->entriesCount == cache->entriesCapacity)
+		{
+			uint32_t capacity = (cache->entriesCapacity > 0) ? cache->entriesCapacity * 2 : 256;
+			ITunesPlayabilityEntry *entries = realloc(cache->entries, capacity * sizeof(ITunesPlayabilityEntry));
+			if(entries == NULL) return;
+			
+			cache->entries = entries;
+			cache->entriesCapacity = capacity;
+		}
+		
+		i = cache->entriesCount++;
+		cache->entries[i].persistentID = persistentID;
+		cache->entries[i].reserved = 0;
+		
+		ITunesHashTableInsert(&cache->index, persistentID, i);
+	}
+	else if((cache->entries[i].modified == modified) && (cache->entries[i].size == size) &&
+	        (cache->entries[i].state == (uint32_t)state))
+	{
+		return;
+	}
+	
+	cache->entries[i].modified = modified;
+	cache->entries[i].size = size;
+	cache->entries[i].state = (uint32_t)state;
+	
+	cache->isDirty = 1;
+}
+
+// CACHE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Creates an empty cache.
+**/
+ITunesPlayabilityCache * ITunesPlayabilityCacheCreate(void)
+{
+	ITunesPlayabilityCache *cache = calloc(1, sizeof(ITunesPlayabilityCache));
+	if(cache == NULL) return NULL;
+	
+	if(!ITunesHashTableCreate(&cache->index, 0))
+	{
+		free(cache);
+		return NULL;
+	}
+	
+	pthread_mutex_init(&cache->mutex, NULL);
+	return cache;
+}
+
+/**
+ Opens the cache saved in the given file.
+ If the file doesn't exist, or is from a different version, a different architecture, or corrupt,
+ an empty cache is returned instead. Returns NULL only if out of memory.
+**/
+ITunesPlayabilityCache * ITunesPlayabilityCacheOpen(const char *cachePath)
+{
+	ITunesPlayabilityCache *cache = ITunesPlayabilityCacheCreate();
+	if(cache == NULL) return NULL;
+	
+	FILE *f = fopen(cachePath, "rb");
+	if(f == NULL) return cache;
+	
+	ITunesPlayabilityHeader header;
+	
+	int isCurrent = (fread(&header, sizeof(ITunesPlayabilityHeader), 1, f) == 1) &&
+	                (memcmp(header.magic, CACHE_MAGIC, 8) == 0) &&
+	                (header.version == CACHE_VERSION) &&
+	                (header.byteOrder == CACHE_BYTEORDER);
+	
+	if(isCurrent && (header.entriesCount > 0))
+	{
+		ITunesPlayabilityEntry *entries = malloc(header.entriesCount * sizeof(ITunesPlayabilityEntry));
+		
+		if((entries != NULL) && (fread(entries, sizeof(ITunesPlayabilityEntry), header.entriesCount, f) == header.entriesCount))
+		{
+			uint32_t i;
+			for(i = 0; i < header.entriesCount; i++)
+			{
+				if((entries[i].persistentID != 0) && (entries[i].state <= ITUNES_PLAYABILITY_PROTECTED))
+				{
+					SetEntry(cache, entries[i].persistentID, entries[i].modified, entries[i].size, entries[i].state);
+				}
+			}
+		}
+		free(entries);
+	}
+	fclose(f);
+	
+	cache->isDirty = 0;
+	return cache;
+}
+
+void ITunesPlayabilityCacheFree(ITunesPlayabilityCache *cache)
+{
+	if(cache == NULL) return;
+	
+	pthread_mutex_destroy(&cache->mutex);
+	
+	free(cache->index.slots);
+	free(cache->entries);
+	free(cache);
+}
+
+/**
+ Saves the cache to the given file, if it has changed.
+
+ The cache is written to a temporary file, which then replaces the cache file,
+ so it's never seen half written.
+ Returns 0 on failure.
+**/
+int ITunesPlayabilityCacheWrite(ITunesPlayabilityCache *cache, const char *cachePath)
+{
+	pthread_mutex_lock(&cache->mutex);
+	
+	if(!cache->isDirty)
+	{
+		pthread_mutex_unlock(&cache->mutex);
+		return 1;
+	}
+	
+	ITunesPlayabilityHeader header;
+	memset(&header, 0, sizeof(ITunesPlayabilityHeader));
+	
+	memcpy(header.magic, CACHE_MAGIC, 8);
+	header.version      = CACHE_VERSION;
+	header.byteOrder    = CACHE_BYTEORDER;
+	header.entriesCount = cache->entriesCount;
+	
+	size_t pathLength = strlen(cachePath);
+	char *tempPath = malloc(pathLength + 8);
+	int result = 0;
+	
+	if(tempPath != NULL)
+	{
+		memcpy(tempPath, cachePath, pathLength);
+		memcpy(tempPath + pathLength, ".XXXXXX", 8);
+		
+		int fd = mkstemp(tempPath);
+		FILE *f = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+		
+		if(f != NULL)
+		{
+			result = (fwrite(&header, sizeof(ITunesPlayabilityHeader), 1, f) == 1) &&
+			         (fwrite(cache->entries, sizeof(ITunesPlayabilityEntry), cache->entriesCount, f) == cache->entriesCount);
+			
+			if(fclose(f) != 0) result = 0;
+			
+			if(result)
+			{
+				chmod(tempPath, 0644);
+				result = (rename(tempPath, cachePath) == 0);
+			}
+		}
+		else if(fd >= 0)
+		{
+			close(fd);
+		}
+		
+		if(!result && (fd >= 0))
+		{
+			unlink(tempPath);
+		}
+		free(tempPath);
+	}
+	
+	if(result)
+	{
+		cache->isDirty = 0;
+	}
+	
+	pthread_mutex_unlock(&cache->mutex);
+	return result;
+}
+
+/**
+ Returns the last known state of the given track, without checking it's file.
+**/
+int ITunesPlayabilityCacheState(ITunesPlayabilityCache *cache, uint64_t persistentID)
+{
+	int state = ITUNES_PLAYABILITY_UNKNOWN;
+	
+	pthread_mutex_lock(&cache->mutex);
+	
+	uint32_t i = ITunesHashTableFind(&cache->index, persistentID);
+	if(i != ITUNES_HASH_EMPTY)
+	{
+		state = (int)cache->entries[i].state;
+	}
+	
+	pthread_mutex_unlock(&cache->mutex);
+	return state;
+}
+
+/**
+ Returns non-zero if the given track is known not to be playable.
+**/
+int ITunesPlayabilityCacheIsBad(ITunesPlayabilityCache *cache, uint64_t persistentID)
+{
+	int state = ITunesPlayabilityCacheState(cache, persistentID);
+	
+	return (state != ITUNES_PLAYABILITY_UNKNOWN) && (state != ITUNES_PLAYABILITY_PLAYABLE);
+}
+
+/**
+ Returns non-zero if the given track (whose file is at the given path) is known not to be playable,
+ and it's file hasn't changed since.
+
+ Tracks that aren't known to be bad are answered from the cache alone. For the others, the file is stat'ed:
+ if a missing file has appeared, or a bad file has changed, the track's state is reset to unknown,
+ so it's checked again the next time (and played in the meantime). A file that has gone missing is marked as such.
+**/
+int ITunesPlayabilityCacheIsStillBad(ITunesPlayabilityCache *cache, uint64_t persistentID, const char *path)
+{
+	if(!ITunesPlayabilityCacheIsBad(cache, persistentID)) return 0;
+	
+	struct stat info;
+	int64_t modified = 0;
+	int64_t size = 0;
+	int exists = (path != NULL) && (stat(path, &info) == 0) && S_ISREG(info.st_mode);
+	
+	if(exists)
+	{
+		modified = (int64_t)info.st_mtime;
+		size = (int64_t)info.st_size;
+	}
+	
+	pthread_mutex_lock(&cache->mutex);
+	
+	int isBad = 0;
+	
+	uint32_t i = ITunesHashTableFind(&cache->index, persistentID);
+	if(i != ITUNES_HASH_EMPTY)
+	{
+		if(!exists)
+		{
+			isBad = 1;
+			SetEntry(cache, persistentID, 0, 0, ITUNES_PLAYABILITY_MISSING);
+		}
+		else if((cache->entries[i].state != ITUNES_PLAYABILITY_MISSING) &&
+		        (cache->entries[i].modified == modified) && (cache->entries[i].size == size))
+		{
+			isBad = 1;
+		}
+		else
+		{
+			SetEntry(cache, persistentID, modified, size, ITUNES_PLAYABILITY_UNKNOWN);
+		}
+	}
+	
+	pthread_mutex_unlock(&cache->mutex);
+	return isBad;
+}
+
+/**
+ Checks whether the given track (whose file is at the given path) is playable, updating the cache.
+
+ If the file is missing, the track is marked as such. If the file hasn't changed since it was last checked,
+ the cached state is returned. Otherwise the file is checked with the given function, which may be slow.
+**/
+int ITunesPlayabilityCacheCheck(ITunesPlayabilityCache *cache, uint64_t persistentID, const char *path,
+                                ITunesPlayabilityCheckFunction check, void *context)
+{
+	if(persistentID == 0) return ITUNES_PLAYABILITY_UNKNOWN;
+	
+	struct stat info;
+	int64_t modified = 0;
+	int64_t size = 0;
+	int state;
+	
+	if((path == NULL) || (stat(path, &info) != 0) || !S_ISREG(info.st_mode))
+	{
+		state = ITUNES_PLAYABILITY_MISSING;
+	}
+	else
+	{
+		modified = (int64_t)info.st_mtime;
+		size = (int64_t)info.st_size;
+		
+		pthread_mutex_lock(&cache->mutex);
+		
+		uint32_t i = ITunesHashTableFind(&cache->index, persistentID);
+		int isCurrent = (i != ITUNES_HASH_EMPTY) && (cache->entries[i].state != ITUNES_PLAYABILITY_UNKNOWN) &&
+		                (cache->entries[i].modified == modified) && (cache->entries[i].size == size);
+		
+		state = isCurrent ? (int)cache->entries[i].state : ITUNES_PLAYABILITY_UNKNOWN;
+		
+		pthread_mutex_unlock(&cache->mutex);
+		
+		if(isCurrent) return state;
+		
+		state = check(context, path);
+	}
+	
+	pthread_mutex_lock(&cache->mutex);
+	SetEntry(cache, persistentID, modified, size, state);
+	pthread_mutex_unlock(&cache->mutex);
+	
+	return state;
+}
@@ -0,0 +1,76 @@
+/**
+ Cache of whether the tracks of the iTunes library can actually be played.
+
+ A playlist alarm used to discover, one track at a time as it tried to play them, that a track's file is missing,
+ can't be decoded, or is protected and not authorized on this machine. A playlist with many dead entries
+ could stall the alarm for a long time before it played anything.
+
+ Instead, tracks are checked ahead of time (on a background thread), and the outcome is cached,
+ keyed by the persistent ID of the track. Along with the outcome, the modification date and size of the file
+ are stored, so a track is only checked again once it's file has changed. Rechecking an unchanged track
+ is therefore a single stat of it's file.
+
+ Looking up the last known state of a track is a single hash lookup. When setting up a playlist,
+ only the tracks known to be bad cost a stat of their file, to make sure they haven't been fixed since
+ (a missing file that was put back, or a file that was replaced).
+
+ The cache is saved to a file, in native byte order, and is used across runs of the application.
+ All functions may be called from any thread.
+**/
+
+#ifndef ITUNES_PLAYABILITY_H
+#define ITUNES_PLAYABILITY_H
+
+#include "ITunesLibrary.h"
+#include <pthread.h>
+
+#define ITUNES_PLAYABILITY_UNKNOWN      0   // Not checked yet, or couldn't be checked
+#define ITUNES_PLAYABILITY_PLAYABLE     1
+#define ITUNES_PLAYABILITY_MISSING      2   // There is no file at the track's location
+#define ITUNES_PLAYABILITY_UNDECODABLE  3   // The file isn't a movie, or has no sound
+#define ITUNES_PLAYABILITY_PROTECTED    4   // The file is protected, and not authorized on this machine
+
+typedef struct ITunesPlayabilityEntry
+{
+	uint64_t persistentID;
+	
+	// Modification date and size of the file when it was checked (zero if it was missing)
+	int64_t  modified;
+	int64_t  size;
+	
+	uint32_t state;
+	uint32_t reserved;
+} ITunesPlayabilityEntry;
+
+typedef struct ITunesPlayabilityCache
+{
+	ITunesPlayabilityEntry *entries;
+	uint32_t entriesCount;
+	uint32_t entriesCapacity;
+	
+	// persistentID -> index in entries
+	ITunesHashTable index;
+	
+	// Set when entries have changed since the cache was opened or written
+	int isDirty;
+	
+	pthread_mutex_t mutex;
+} ITunesPlayabilityCache;
+
+// Checks the (existing) file at the given path, returning one of the states above
+typedef int (*ITunesPlayabilityCheckFunction)(void *context, const char *path);
+
+ITunesPlayabilityCache * ITunesPlayabilityCacheCreate(void);
+ITunesPlayabilityCache * ITunesPlayabilityCacheOpen(const char *cachePath);
+void ITunesPlayabilityCacheFree(ITunesPlayabilityCache *cache);
+
+int ITunesPlayabilityCacheWrite(ITunesPlayabilityCache *cache, const char *cachePath);
+
+int ITunesPlayabilityCacheState(ITunesPlayabilityCache *cache, uint64_t persistentID);
+int ITunesPlayabilityCacheIsBad(ITunesPlayabilityCache *cache, uint64_t persistentID);
+int ITunesPlayabilityCacheIsStillBad(ITunesPlayabilityCache *cache, uint64_t persistentID, const char *path);
+
+int ITunesPlayabilityCacheCheck(ITunesPlayabilityCache *cache, uint64_t persistentID, const char *path,
+                                ITunesPlayabilityCheckFunction check, void *context);
+
+#endif
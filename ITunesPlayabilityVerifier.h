@@ -0,0 +1,21 @@
+#import <Cocoa/Cocoa.h>
+#import "ITunesPlayability.h"
+
+@class ITunesData;
+
+/**
+ Keeps the process-wide playability cache (see ITunesPlayability.h), and fills it in the background.
+
+ Before a playlist alarm goes off, the tracks of it's playlist are verified on the pre-warm thread:
+ the file exists, QuickTime can open it and it has sound, and it's not protected without being authorized.
+ The player then leaves the known-bad tracks out of the playlist (once a stat of their file shows they haven't changed),
+ instead of discovering them as it tries to play them.
+ The cache is saved alongside our preference file, so tracks are only checked again once their files change.
+**/
+@interface ITunesPlayabilityVerifier : NSObject
+
++ (BOOL)isUnplayableTrack:(const ITunesTrack *)track ofLibrary:(const ITunesLibrary *)library;
+
++ (void)verifyPlaylistWithID:(int)playlistID ofITunesData:(ITunesData *)iTunesData beforeDate:(NSDate *)deadline;
+
+@end
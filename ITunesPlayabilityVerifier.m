@@ -0,0 +1,208 @@
+#import "ITunesPlayabilityVerifier.h"
+#import "ITunesData.h"
+#import "ITunesPlayer.h"
+#import <QuickTime/QuickTime.h>
+#import <limits.h>
+
+// The playability cache, opened from it's file the first time it's needed
+static ITunesPlayabilityCache *cache;
+
+// Held while verifying, so only one thread verifies at a time
+static NSLock *verifyLock;
+
+// Declare private API
+@interface ITunesPlayabilityVerifier (PrivateAPI)
++ (NSString *)cachePath;
+@end
+
+@implementation ITunesPlayabilityVerifier
+
+// C STYLE METHODS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Checks whether QuickTime can play the (existing) file at the given path.
+ Runs on a background thread that has entered QuickTime (see EnterMoviesOnThread).
+
+ Only thread safe components may be used on a background thread. If the file needs any other component,
+ the file can't be checked here, and it's state is left unknown (so the player will simply try it).
+**/
+static int CheckMovieFile(void *context, const char *path)
+{
+	CFStringRef pathStr = CFStringCreateWithFileSystemRepresentation(NULL, path);
+	if(pathStr == NULL) return ITUNES_PLAYABILITY_UNKNOWN;
+	
+	Handle dataRef = NULL;
+	OSType dataRefType = 0;
+	OSErr err = QTNewDataReferenceFromFullPathCFString(pathStr, kQTNativeDefaultPathStyle, 0, &dataRef, &dataRefType);
+	CFRelease(pathStr);
+	
+	if(err != noErr) return ITUNES_PLAYABILITY_UNKNOWN;
+	
+	Movie movie = NULL;
+	short resID = 0;
+	err = NewMovieFromDataRef(&movie, newMovieDontAskUnresolvedDataRefs | newMovieDontInteractWithUser,
+	                          &resID, dataRef, dataRefType);
+	DisposeHandle(dataRef);
+	
+	if(err == componentNotThreadSafeErr) return ITUNES_PLAYABILITY_UNKNOWN;
+	if((err != noErr) || (movie == NULL)) return ITUNES_PLAYABILITY_UNDECODABLE;
+	
+	int state = ITUNES_PLAYABILITY_PLAYABLE;
+	
+	if(GetMovieIndTrackType(movie, 1, SoundMediaType, movieTrackMediaType | movieTrackEnabledOnly) == NULL)
+	{
+		state = ITUNES_PLAYABILITY_UNDECODABLE;
+	}
+	else
+	{
+		BOOL isProtected = NO;
+		BOOL isAuthorized = NO;
+		CheckDRM(movie, &isProtected, &isAuthorized);
+		
+		if(isProtected && !isAuthorized)
+		{
+			state = ITUNES_PLAYABILITY_PROTECTED;
+		}
+	}
+	
+	DisposeMovie(movie);
+	return state;
+}
+
+/**
+ Turns the location of the given track, a file URL, into a path. CFURL does this without involving Cocoa.
+ Returns NO if the track has no file, or it's location can't be turned into a path.
+**/
+static BOOL GetTrackPath(const ITunesLibrary *library, const ITunesTrack *track, char *path, CFIndex pathSize)
+{
+	if(!(track->flags & ITUNES_TRACK_FILE)) return NO;
+	
+	const char *location = ITunesLibraryString(library, track->location);
+	BOOL hasPath = NO;
+	
+	CFURLRef url = CFURLCreateWithBytes(NULL, (const UInt8 *)location, strlen(location), kCFStringEncodingUTF8, NULL);
+	if(url != NULL)
+	{
+		hasPath = CFURLGetFileSystemRepresentation(url, true, (UInt8 *)path, pathSize);
+		CFRelease(url);
+	}
+	
+	return hasPath;
+}
+
+// INITIALIZATION
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
++ (void)initialize
+{
+	static BOOL initialized = NO;
+	if(!initialized)
+	{
+		initialized = YES;
+		
+		cache = ITunesPlayabilityCacheOpen([[self cachePath] fileSystemRepresentation]);
+		verifyLock = [[NSLock alloc] init];
+	}
+}
+
+/**
+ Returns the path of the playability cache.
+ It's stored alongside our preference file:
+ ~/Library/Preferences/com.digitallity.alarmclock2.playability
+**/
++ (NSString *)cachePath
+{
+	NSString *libraryDir = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+	NSString *prefsDir = [libraryDir stringByAppendingPathComponent:@"Preferences"];
+	NSString *fileName = [[[NSBundle mainBundle] bundleIdentifier] stringByAppendingPathExtension:@"playability"];
+	
+	return [prefsDir stringByAppendingPathComponent:fileName];
+}
+
+// PLAYABILITY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns whether the given track was found to be unplayable the last time it was verified, and still is.
+ Tracks that aren't known to be unplayable are a single hash lookup, which doesn't touch the disk.
+ The others cost a stat of their file, so a file that has been put back or replaced since isn't left out.
+ May be invoked from any thread.
+**/
++ (BOOL)isUnplayableTrack:(const ITunesTrack *)track ofLibrary:(const ITunesLibrary *)library
+{
+	if(cache == NULL) return NO;
+	
+	if(!ITunesPlayabilityCacheIsBad(cache, track->persistentID)) return NO;
+	
+	char path[PATH_MAX];
+	BOOL hasPath = GetTrackPath(library, track, path, sizeof(path));
+	
+	return ITunesPlayabilityCacheIsStillBad(cache, track->persistentID, hasPath ? path : NULL) ? YES : NO;
+}
+
+/**
+ Verifies the tracks of the given playlist, updating (and saving) the playability cache.
+
+ Tracks whose files haven't changed since they were last verified only cost a stat of their file.
+ Verification stops early once the deadline (if any) passes; the remaining tracks keep their last known state.
+
+ This may take a while, and uses QuickTime from the calling thread, so it must be invoked from a background thread.
+**/
++ (void)verifyPlaylistWithID:(int)playlistID ofITunesData:(ITunesData *)iTunesData beforeDate:(NSDate *)deadline
+{
+	const ITunesLibrary *library = [iTunesData library];
+	int playlistIndex = [iTunesData playlistIndexForID:playlistID];
+	
+	if((cache == NULL) || (library == NULL) || (playlistIndex < 0)) return;
+	
+	[verifyLock lock];
+	
+	NSDate *start = [NSDate date];
+	
+	EnterMoviesOnThread(0);
+	CSSetComponentsThreadMode(kCSAcceptThreadSafeComponentsOnlyMode);
+	
+	const ITunesPlaylist *playlist = &library->playlists[playlistIndex];
+	uint32_t checkedCount = 0;
+	uint32_t badCount = 0;
+	uint32_t i;
+	
+	for(i = 0; i < playlist->itemsCount; i++)
+	{
+		if((deadline != nil) && ([deadline timeIntervalSinceNow] <= 0))
+		{
+			NSLog(@"Stopped verifying playlist at the deadline (%u of %u tracks)", i, playlist->itemsCount);
+			break;
+		}
+		
+		const ITunesTrack *track = ITunesLibraryTrackForID(library, library->items[playlist->itemsOffset + i]);
+		
+		if((track == NULL) || !(track->flags & ITUNES_TRACK_FILE)) continue;
+		
+		char path[PATH_MAX];
+		BOOL hasPath = GetTrackPath(library, track, path, sizeof(path));
+		
+		int state = ITunesPlayabilityCacheCheck(cache, track->persistentID, hasPath ? path : NULL, CheckMovieFile, NULL);
+		
+		checkedCount++;
+		if((state != ITUNES_PLAYABILITY_PLAYABLE) && (state != ITUNES_PLAYABILITY_UNKNOWN))
+		{
+			badCount++;
+		}
+	}
+	
+	ExitMoviesOnThread();
+	
+	if(!ITunesPlayabilityCacheWrite(cache, [[self cachePath] fileSystemRepresentation]))
+	{
+		NSLog(@"Unable to save playability cache");
+	}
+	
+	NSLog(@"Verified %u tracks, %u unplayable (time: %f seconds)",
+		  checkedCount, badCount, [[NSDate date] timeIntervalSinceDate:start]);
+	
+	[verifyLock unlock];
+}
+
+@end
@@ -1,5 +1,9 @@
 #import <Cocoa/Cocoa.h>
 #import <QTKit/QTKit.h>
+#import "ITunesPrefetch.h"
+#import "ITunesShuffle.h"
+#import "ITunesPlaylistCursor.h"
+#import "AudioOutput.h"
 
 @class ITunesData;
 
@@ -12,6 +16,10 @@
 	// The current movie this object is playing
 	QTMovie *movie;
 	
+	// Files (the default alarm) are played from memory instead, if they can be decoded (see setFileWithPath:)
+	AudioOutput *sound;
+	BOOL usesSound;
+	
 	// Volume percentage at which to play movies
 	float volumePercentage;
 	
@@ -21,8 +29,21 @@
 	
 	// Playlist Information
 	BOOL shouldShuffle;
-	int  playlistIndex;
-	NSMutableArray *playlist;
+	int32_t *playlist;
+	
+	// Position in the playlist (in play order), and how it moves through it (see ITunesPlaylistCursor.h)
+	ITunesPlaylistCursor cursor;
+	
+	// Shuffled play order of the playlist (used if shouldShuffle)
+	ITunesShuffle *shuffle;
+	
+	// Look-ahead of the upcoming playlist entries, whose files are checked in the background,
+	// and the movie of the next playable entry, opened and prerolled while the current one plays
+	ITunesPrefetch *prefetch;
+	int lookaheadIndex;
+	QTMovie *upcomingMovie;
+	NSDictionary *upcomingTrack;
+	int upcomingPlaylistIndex;
 	
 	// Delegate
 	id delegate;
@@ -33,6 +54,7 @@
 - (void)setFileWithPath:(NSString *)file;
 - (void)setTrackWithTrackID:(int)trackID;
 - (void)setPlaylistWithPlaylistID:(int)playlistID usesShuffle:(BOOL)shuffleFlag;
+- (void)setShuffleSeed:(uint64_t)seed;
 
 - (BOOL)isPlaying;
 - (BOOL)isFile;
@@ -48,6 +70,7 @@
 - (NSDictionary *)currentTrack;
 
 - (void)setVolume:(float)volume;
+- (BOOL)setRamp:(GainRamp *)ramp;
 
 - (void)setDelegate:(id)delegate;
 - (id)delegate;
@@ -60,3 +83,5 @@
 @interface NSObject (ITunesPlayerDelegate)
 - (void)iTunesPlayerChangedSong;
 @end
+
+OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized);
@@ -7,16 +7,35 @@
 
 #import "ITunesPlayer.h"
 #import "ITunesData.h"
+#import "ITunesPlayabilityVerifier.h"
+#import "MemoryAudioOutput.h"
 #import <stdlib.h>
+#import <time.h>
 
 #define TYPE_FILE      0
 #define TYPE_TRACK     1
 #define TYPE_PLAYLIST  2
 
+// Number of upcoming playlist entries that are checked ahead of time
+#define LOOKAHEAD_DEPTH  3
+
+// Delay (in seconds) after a track starts, before the movie of the next one is opened,
+// so opening it doesn't compete with starting the current one
+#define UPCOMING_MOVIE_DELAY  1.0
+
+// Interval (in seconds) at which to retry, while the next entry is still being checked
+#define UPCOMING_MOVIE_RETRY  0.5
+
 @interface ITunesPlayer (PrivateAPI)
+- (QTMovie *)newMovieWithTrack:(NSDictionary *)track;
 - (void)setMovieWithTrack:(NSDictionary *)track;
-- (void)shufflePlaylist;
-- (double)randomDouble;
+- (BOOL)fillLookahead;
+- (void)resetLookahead;
+- (void)scheduleUpcomingMovie;
+- (void)prepareUpcomingMovie;
+- (BOOL)switchToUpcomingMovie;
+- (void)discardUpcomingMovie;
+- (BOOL)openPlaylistTrackWithID:(int)trackID;
 @end
 
 
@@ -95,23 +114,13 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
     return err;
 }
 
-// INITIALIZATION
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
 /**
- This method is automatically called (courtesy of Cocoa) before the first instantiation of this class.
- We use it to seed the random number generator.
+ Open function of the playlist cursor (see ITunesPlaylistCursor.h).
+ Sets the movie to the track with the given trackID, and returns whether it could be opened.
 **/
-+ (void)initialize
+static int OpenPlaylistEntry(void *context, int32_t trackID)
 {
-	static BOOL initialized = NO;
-	if(!initialized)
-	{
-		// Seed the random number generator with the time
-		srandom(time(NULL));
-		
-		initialized = YES;
-	}
+	return [(ITunesPlayer *)context openPlaylistTrackWithID:trackID];
 }
 
 // INIT, DEALLOC
@@ -130,6 +139,16 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 		// Configure default volume
 		volumePercentage = 1.0;
 		
+		// There's no playlist yet
+		ITunesPlaylistCursorInit(&cursor, NULL, 0, NULL);
+		
+		// Create the look-ahead of upcoming playlist entries
+		// If this fails, tracks are simply opened when they're needed
+		prefetch = ITunesPrefetchCreate(LOOKAHEAD_DEPTH, ITunesPrefetchCheckFile, NULL, NULL);
+		
+		// Each player shuffles with it's own generator, seeded with the time (see setShuffleSeed:)
+		shuffle = ITunesShuffleCreate(((uint64_t)time(NULL) << 32) ^ (uint64_t)(uintptr_t)self);
+		
 		// Register for notifications
 		[[NSNotificationCenter defaultCenter] addObserver:self
 												 selector:@selector(movieFinished:)
@@ -154,11 +173,19 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	// Remove notification observers
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	
+	// Stop the look-ahead
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(prepareUpcomingMovie) object:nil];
+	ITunesPrefetchFree(prefetch);
+	
 	// Remove any objects we created
 	[iTunesData release];
 	[movie release];
+	AudioOutputFree(sound);
 	[currentTrack release];
-	[playlist release];
+	free(playlist);
+	ITunesShuffleFree(shuffle);
+	[upcomingMovie release];
+	[upcomingTrack release];
 	
 	// Move up the inheritance chain
 	[super dealloc];
@@ -174,6 +201,10 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
  * If the player is currently playing a movie, the player is stopped, and the movie is released.
  * The player is automatically properly configured to repeat the track.
  * 
+ * The file is decoded into memory the first time it's played (or ahead of time, see MemoryAudioOutputLoadSound),
+ * and played from there, so starting it (and falling back to it when a track fails) involves no I/O.
+ * If it can't be decoded, it's played as a movie instead.
+ * 
  * @param file - String that points to a file on the local filesystem.
 **/
 - (void)setFileWithPath:(NSString *)filepath
@@ -188,13 +219,29 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	
 	// Save playlist information
 	type = TYPE_FILE;
+	[self resetLookahead];
 	
-	// Set the movie
-	NSURL *url = [NSURL fileURLWithPath:filepath];
+	// Set the sound, or the movie if the sound can't be played from memory
+	if(sound == NULL)
+	{
+		sound = MemoryAudioOutputCreate();
+	}
 	
-	movie = [[QTMovie alloc] initWithURL:url error:nil];
-	[movie setVolume:volumePercentage];
-	[movie setAttribute:[NSNumber numberWithBool:YES] forKey:QTMovieLoopsAttribute];
+	usesSound = (sound != NULL) && AudioOutputOpen(sound, [filepath fileSystemRepresentation]);
+	
+	if(usesSound)
+	{
+		AudioOutputSetVolume(sound, volumePercentage);
+		AudioOutputSetLooping(sound, 1);
+	}
+	else
+	{
+		NSURL *url = [NSURL fileURLWithPath:filepath];
+		
+		movie = [[QTMovie alloc] initWithURL:url error:nil];
+		[movie setVolume:volumePercentage];
+		[movie setAttribute:[NSNumber numberWithBool:YES] forKey:QTMovieLoopsAttribute];
+	}
 	
 	// Create a dictionary with "track" information
 	NSString *defaultStr = NSLocalizedStringFromTable(@"Default Alarm", @"AlarmEditor", @"Song label when no track/playlist is selected.");
@@ -209,52 +256,69 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 }
 
 /**
- * Private method to set the movie from the given track.
+ * Private method to create a movie for the given track.
  * 
- * If the player is currently playing a movie, the player is stopped, and the movie is released.
+ * Returns a retained movie, or nil if the track isn't a file, or isn't authorized to be played on this machine.
  * Does not configure the movie's attributes.
- * Does not configure playlist information, or type variable.
  * 
  * @param track - An extracted track from the iTunesData dictionary.
 **/
-- (void)setMovieWithTrack:(NSDictionary *)track
+- (QTMovie *)newMovieWithTrack:(NSDictionary *)track
 {
-	// Stop and release the current movie if needed
-	if(movie != nil)
-	{
-		[movie stop];
-		[movie release];
-		movie = nil;
-	}
+	QTMovie *result = nil;
 	
-	// Save reference to this track
-	[currentTrack release];
-	currentTrack = [track retain];
-	
-	// And double-check we're not working with a nil track
+	// Double-check we're not working with a nil track
 	// This would be the case if we encountered a bogus trackID
 	if(track != nil)
 	{
-		if([[track objectForKey:@"Track Type"] isEqualToString:@"File"])
+		if([[track objectForKey:TRACK_TYPE] isEqualToString:@"File"])
 		{
 			// Assume the location points to a standard audio file
-			NSURL *url = [NSURL URLWithString:[track objectForKey:@"Location"]];
+			NSURL *url = [NSURL URLWithString:[track objectForKey:TRACK_LOCATION]];
 			
-			movie = [[QTMovie alloc] initWithURL:url error:nil];
+			result = [[QTMovie alloc] initWithURL:url error:nil];
 			
 			// Now we check for any DRM, if necessary
 			BOOL isProtected = NO;
 			BOOL isAuthorized = NO;
-			CheckDRM([movie quickTimeMovie], &isProtected, &isAuthorized);
+			CheckDRM([result quickTimeMovie], &isProtected, &isAuthorized);
 				
 			if(isProtected && !isAuthorized)
 			{
 				NSLog(@"Not authorized to play track: %@", [track objectForKey:TRACK_NAME]);
-				[movie release];
-				movie = nil;
+				[result release];
+				result = nil;
 			}
 		}
 	}
+	
+	return result;
+}
+
+/**
+ * Private method to set the movie from the given track.
+ * 
+ * If the player is currently playing a movie, the player is stopped, and the movie is released.
+ * Does not configure the movie's attributes.
+ * Does not configure playlist information, or type variable.
+ * 
+ * @param track - An extracted track from the iTunesData dictionary.
+**/
+- (void)setMovieWithTrack:(NSDictionary *)track
+{
+	// Stop and release the current movie if needed
+	if(movie != nil)
+	{
+		[movie stop];
+		[movie release];
+		movie = nil;
+	}
+	
+	// Save reference to this track
+	[currentTrack release];
+	currentTrack = [track retain];
+	
+	movie = [self newMovieWithTrack:track];
 }
 
 /**
@@ -275,8 +339,16 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 		movie = nil;
 	}
 	
+	// Stop the sound played from memory, if the player was used for a file before
+	if(usesSound)
+	{
+		AudioOutputClose(sound);
+		usesSound = NO;
+	}
+	
 	// Save playlist information
 	type = TYPE_TRACK;
+	[self resetLookahead];
 	
 	// Get the specified track from the iTunesData, and use it to set the movie
 	[self setMovieWithTrack:[iTunesData trackForID:trackID]];
@@ -305,62 +377,79 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 		movie = nil;
 	}
 	
+	// Stop the sound played from memory, if the player was used for a file before
+	if(usesSound)
+	{
+		AudioOutputClose(sound);
+		usesSound = NO;
+	}
+	
 	// Save playlist information
 	type = TYPE_PLAYLIST;
 	shouldShuffle = shuffleFlag;
 	
-	// Fetch the desired playlist
-	NSDictionary *playlistDict = [iTunesData playlistForID:playlistID];
-	NSArray *playlistArray = [playlistDict objectForKey:@"Playlist Items"];
+	// Fetch the trackIDs of the desired playlist
+	int count;
+	const int32_t *trackIDs = [iTunesData trackIDsForPlaylistIndex:[iTunesData playlistIndexForID:playlistID]
+	                                                          count:&count];
 	
-	// Copy the playlistArray into our own playlist array
+	// Copy the trackIDs into our own playlist array
 	// And don't forget to recycle the old playlist (since this method may be called multiple times)
-	[playlist autorelease];
-	playlist = [[NSMutableArray alloc] initWithCapacity:[playlistArray count]];
+	free(playlist);
+	playlist = malloc(MAX(count, 1) * sizeof(int32_t));
+	int playlistCount = 0;
 	
-	int i;
-	for(i = 0; i < [playlistArray count]; i++)
+	if(playlist == NULL)
 	{
-		[playlist addObject:[playlistArray objectAtIndex:i]];
+		NSLog(@"Unable to allocate playlist of %i tracks", count);
+		count = 0;
 	}
 	
-	// Shuffle the playlist if needed
-	if(shouldShuffle)
+	// Tracks that were found to be unplayable ahead of time (see ITunesPlayabilityVerifier) are left out,
+	// unless their files have changed since
+	const ITunesLibrary *library = [iTunesData library];
+	
+	int i;
+	for(i = 0; i < count; i++)
 	{
-		[self shufflePlaylist];
+		const ITunesTrack *track = ITunesLibraryTrackForID(library, trackIDs[i]);
+		
+		if((track == NULL) || ![ITunesPlayabilityVerifier isUnplayableTrack:track ofLibrary:library])
+		{
+			playlist[playlistCount++] = trackIDs[i];
+		}
 	}
 	
-	
-	// We can stop now if the playlist is empty
-	// This also avoids a divide by zero crash when doing modulus division
-	if([playlist count] > 0)
+	// If every track is known to be unplayable, they're tried anyway (something may have changed since)
+	if((playlistCount == 0) && (count > 0))
 	{
-		// Setup playlistIndex
-		// playlistIndex always points the the currently playing song in the playlist
-		// -1 because it's immediately incremented in the loop below
-		playlistIndex = -1;
-		
-		int loopCount = 0;
-		do
+		NSLog(@"Every track of the playlist is known to be unplayable");
+		for(i = 0; i < count; i++)
 		{
-			// Increment playlistIndex, looping if needed
-			playlistIndex = ++playlistIndex % [playlist count];
-			
-			// Extract the trackID of the playlistIndex out of the playlistArray
-			NSDictionary *dict = [playlist objectAtIndex:playlistIndex];
-			int trackID = [[dict objectForKey:@"Track ID"] intValue];
-			
-			// Get the specified track from the iTunesData, and use it to set the movie
-			[self setMovieWithTrack:[iTunesData trackForID:trackID]];
-			
-			// We don't configure the movie to loop, but we still need to set it's volume
-			[movie setVolume:volumePercentage];
-			
-			// Increment loopCount
-			// We use a loopCount for simplicity (think about a playlist with only 1 item)
-			loopCount++;
+			playlist[playlistCount++] = trackIDs[i];
 		}
-		while((movie == nil) && (loopCount < [playlist count]));
+	}
+	
+	// Shuffle the playlist if needed
+	// The shuffled order always starts from the playlist order, so a given seed always gives the same orders
+	ITunesPlaylistCursorInit(&cursor, playlist, playlistCount, shouldShuffle ? shuffle : NULL);
+	
+	// Move to the first track that can be played (there's nothing to do if the playlist is empty)
+	ITunesPlaylistCursorNext(&cursor, OpenPlaylistEntry, self);
+	
+	// Start looking ahead from the first track
+	[self resetLookahead];
+}
+
+/**
+ Seeds the generator used to shuffle playlists (which is otherwise seeded with the time).
+ Players given the same seed before their playlist is set play it in the same order.
+**/
+- (void)setShuffleSeed:(uint64_t)seed
+{
+	if(shuffle != NULL)
+	{
+		ITunesShuffleSeed(shuffle, seed);
 	}
 }
 
@@ -370,6 +459,10 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 
 - (BOOL)isPlaying
 {
+	if(usesSound)
+	{
+		return AudioOutputIsPlaying(sound);
+	}
 	return (movie != nil) && ([movie rate] != 0);
 }
 
@@ -401,7 +494,11 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 **/
 - (void)play
 {
-	if(movie != nil)
+	if(usesSound)
+	{
+		AudioOutputPlay(sound);
+	}
+	else if(movie != nil)
 	{
 		[movie play];
 	}
@@ -416,7 +513,11 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 */
 - (void)stop
 {
-	if(movie != nil)
+	if(usesSound)
+	{
+		AudioOutputStop(sound);
+	}
+	else if(movie != nil)
 	{
 		[movie stop];
 	}
@@ -429,8 +530,8 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 **/
 - (void)nextTrack
 {
-	// Ignore the command if no movie is loaded
-	if(movie == nil)
+	// Ignore the command if no movie (or sound) is loaded
+	if((movie == nil) && !usesSound)
 	{
 		NSLog(@"Ignoring nextTrack message because movie isn't configured yet.");
 		return;
@@ -440,7 +541,10 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	if(type != TYPE_PLAYLIST)
 	{
 		// In this case all we can do is start the song over from the beginning
-		[movie gotoBeginning];
+		if(usesSound)
+			AudioOutputSetCurrentTime(sound, 0.0);
+		else
+			[movie gotoBeginning];
 		return;
 	}
 	
@@ -448,35 +552,27 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	// If it's playing, then after we switch tracks, we should continue playing
 	BOOL wasPlaying = [self isPlaying];
 	
-	// Perform the standard procedure for moving to the next track
-	int loopCount = 0;
-	do
+	// The movie of the next playable track is normally opened while the current one plays,
+	// in which case moving to it is just a matter of swapping movies.
+	// If it's not there yet (such as when skipping right after a track started), try to open it now.
+	if(upcomingMovie == nil)
 	{
-		// Increment playlistIndex, looping if needed
-		playlistIndex = ++playlistIndex % [playlist count];
-		
-		// If we've made it all the way back to the beginning of the playlist
-		// And we're using shuffle, then follow iTunes' lead, and reshuffle
-		if((playlistIndex == 0) && shouldShuffle)
-		{
-			[self shufflePlaylist];
-		}
-		
-		// Extract the trackID of the currentPlaylistIndex out of the currentPlaylist
-		NSDictionary *dict = [playlist objectAtIndex:playlistIndex];
-		int trackID = [[dict objectForKey:@"Track ID"] intValue];
-		
-		// Get the specified track from the iTunesData, and use it to set the movie
-		[self setMovieWithTrack:[iTunesData trackForID:trackID]];
-		
-		// We don't configure the movie to loop, but we still need to set it's volume
-		[movie setVolume:volumePercentage];
+		[self prepareUpcomingMovie];
+	}
+	
+	if([self switchToUpcomingMovie])
+	{
+		[self scheduleUpcomingMovie];
+	}
+	else
+	{
+		// Perform the standard procedure for moving to the next track
+		// If we make it all the way back to the beginning of the playlist, the cursor reshuffles it (if shuffling)
+		ITunesPlaylistCursorNext(&cursor, OpenPlaylistEntry, self);
 		
-		// Increment loopCount
-		// We use a loopCount because playlistIndex doesn't start from the beginning
-		loopCount++;
+		// Start looking ahead from the new track
+		[self resetLookahead];
 	}
-	while((movie == nil) && (loopCount < [playlist count]));
 	
 	// If we were playing before we switched tracks, we should continue playing now
 	if(wasPlaying) [self play];
@@ -495,8 +591,8 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 **/
 - (void)previousTrack
 {
-	// Ignore the command if no movie is loaded
-	if(movie == nil)
+	// Ignore the command if no movie (or sound) is loaded
+	if((movie == nil) && !usesSound)
 	{
 		NSLog(@"Ignoring previousTrack message because movie isn't configured yet.");
 		return;
@@ -506,7 +602,10 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	if(type != TYPE_PLAYLIST)
 	{
 		// In this case all we can do is start the song over from the beginning
-		[movie gotoBeginning];
+		if(usesSound)
+			AudioOutputSetCurrentTime(sound, 0.0);
+		else
+			[movie gotoBeginning];
 		return;
 	}
 	
@@ -531,31 +630,10 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	BOOL wasPlaying = [self isPlaying];
 	
 	// Perform the standard procedure for moving to the previous track
-	int loopCount = 0;
-	do
-	{
-		// Decrement playlistIndex, looping if needed
-		playlistIndex--;
-		if(playlistIndex < 0)
-		{
-			playlistIndex = [playlist count] - 1;
-		}
-		
-		// Extract the trackID of the currentPlaylistIndex out of the currentPlaylist
-		NSDictionary *dict = [playlist objectAtIndex:playlistIndex];
-		int trackID = [[dict objectForKey:@"Track ID"] intValue];
-		
-		// Get the specified track from the iTunesData, and use it to set the movie
-		[self setMovieWithTrack:[iTunesData trackForID:trackID]];
-		
-		// We don't configure the movie to loop, but we still need to set it's volume
-		[movie setVolume:volumePercentage];
-		
-		// Increment loopCount
-		// We use a loopCount because playlistIndex doesn't start from the beginning
-		loopCount++;
-	}
-	while((movie == nil) && (loopCount < [playlist count]));
+	ITunesPlaylistCursorPrevious(&cursor, OpenPlaylistEntry, self);
+	
+	// The look-ahead was for the tracks after the previous one, so start over from this one
+	[self resetLookahead];
 	
 	// If we were playing before we switched tracks, we should continue playing now
 	if(wasPlaying) [self play];
@@ -596,6 +674,26 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 	{
 		[movie setVolume:volumePercentage];
 	}
+	[upcomingMovie setVolume:volumePercentage];
+	
+	if(sound != NULL)
+	{
+		AudioOutputSetVolume(sound, volumePercentage);
+	}
+}
+
+/**
+ Has the sound played from memory follow the given gain ramp (see GainRamp.h), on top of the volume.
+ The gain is interpolated for every sample, so the sound fades in without steps.
+ The ramp is copied as it is now, and from then on advances as the sound plays. NULL removes it.
+ 
+ Returns NO if the player isn't playing a sound from memory, as the ramp can't be applied to movies.
+**/
+- (BOOL)setRamp:(GainRamp *)ramp
+{
+	if(!usesSound) return NO;
+	
+	return AudioOutputSetRamp(sound, ramp);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -688,40 +786,199 @@ OSStatus CheckDRM(Movie inMovie, BOOL *outIsProtected, BOOL *outIsAuthorized)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-#pragma mark Helper Methods:
+#pragma mark Look-Ahead Methods:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**
- Shuffles the playlist mutable array.
- This method assume that the playlist array is already setup.
+ Queues the upcoming playlist entries (after the last one queued), to be checked in the background,
+ until the look-ahead is full, or the whole playlist has been queued.
+ 
+ Returns whether any entries were queued.
 **/
-- (void)shufflePlaylist
+- (BOOL)fillLookahead
 {
-	NSMutableArray *shuffledPlaylist = [NSMutableArray arrayWithCapacity:[playlist count]];
+	if((type != TYPE_PLAYLIST) || (prefetch == NULL) || (cursor.count == 0))
+	{
+		return NO;
+	}
 	
-	while([playlist count] > 0)
+	BOOL added = NO;
+	
+	while(ITunesPrefetchCount(prefetch) < ITunesPrefetchCapacity(prefetch))
 	{
-		// Randomly choose an index in the playlist
-		int randomIndex = [self randomDouble] * [playlist count];
+		int index = lookaheadIndex + 1;
+		if(index >= (int)cursor.count)
+		{
+			// The playlist is reshuffled once it's been played through, so we can't look past it's end
+			if(cursor.shuffle != NULL) break;
+			
+			index = 0;
+		}
+		
+		// Don't look further than all the way around the playlist
+		if(index == cursor.position) break;
 		
-		// Then add the index to playlist, and remove it from tempArray
-		[shuffledPlaylist addObject:[playlist objectAtIndex:randomIndex]];
-		[playlist removeObjectAtIndex:randomIndex];
+		NSDictionary *track = [iTunesData trackForID:ITunesPlaylistCursorEntry(&cursor, index)];
+		
+		// Entries that aren't files are queued without a path, so they're skipped in order
+		const char *path = NULL;
+		if([[track objectForKey:TRACK_TYPE] isEqualToString:@"File"])
+		{
+			path = [[[NSURL URLWithString:[track objectForKey:TRACK_LOCATION]] path] fileSystemRepresentation];
+		}
+		
+		ITunesPrefetchAdd(prefetch, index, path);
+		
+		lookaheadIndex = index;
+		added = YES;
+	}
+	
+	return added;
+}
+
+/**
+ Discards the look-ahead, and starts over from the current playlist entry.
+ This is needed whenever the player moves to another track than the upcoming one.
+**/
+- (void)resetLookahead
+{
+	[self discardUpcomingMovie];
+	
+	if(prefetch != NULL)
+	{
+		ITunesPrefetchClear(prefetch);
 	}
+	lookaheadIndex = cursor.position;
 	
-	[playlist release];
-	playlist = [shuffledPlaylist retain];
+	[self scheduleUpcomingMovie];
 }
 
 /**
- Returns a double in the range (0, 1]
- IE - from 0 (inclusive) to 1 (non inclusive).
+ Keeps the look-ahead filled, and opens the movie of the upcoming track shortly.
+**/
+- (void)scheduleUpcomingMovie
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(prepareUpcomingMovie) object:nil];
+	
+	if((type == TYPE_PLAYLIST) && (prefetch != NULL))
+	{
+		[self fillLookahead];
+		[self performSelector:@selector(prepareUpcomingMovie) withObject:nil afterDelay:UPCOMING_MOVIE_DELAY];
+	}
+}
+
+/**
+ Opens and prerolls the movie of the first playable entry in the look-ahead,
+ skipping the entries whose files are missing, or that can't be played.
+ 
+ Movies must be created on the main thread, but by the time this is called,
+ the files have already been checked (and read from) in the background, so this doesn't wait on the disk.
+ If the next entry hasn't been checked yet, this tries again a little later.
+**/
+- (void)prepareUpcomingMovie
+{
+	if((type != TYPE_PLAYLIST) || (prefetch == NULL) || (upcomingMovie != nil))
+	{
+		return;
+	}
+	
+	int result = ITUNES_PREFETCH_EMPTY;
+	
+	while(upcomingMovie == nil)
+	{
+		BOOL added = [self fillLookahead];
+		
+		int32_t index;
+		result = ITunesPrefetchTake(prefetch, NO, &index, NULL);
+		
+		if(result == ITUNES_PREFETCH_READY)
+		{
+			NSDictionary *track = [iTunesData trackForID:ITunesPlaylistCursorEntry(&cursor, index)];
+			QTMovie *candidate = [self newMovieWithTrack:track];
+			
+			if(candidate != nil)
+			{
+				[candidate setVolume:volumePercentage];
+				
+				// Preroll the movie, so it's media is loaded, and it starts playing without delay
+				PrerollMovie([candidate quickTimeMovie], 0, fixed1);
+				
+				upcomingMovie = candidate;
+				upcomingTrack = [track retain];
+				upcomingPlaylistIndex = index;
+			}
+		}
+		else if((result == ITUNES_PREFETCH_PENDING) || !added)
+		{
+			break;
+		}
+	}
+	
+	// Keep checking the entries after the upcoming one
+	[self fillLookahead];
+	
+	if((upcomingMovie == nil) && (result == ITUNES_PREFETCH_PENDING))
+	{
+		[self performSelector:@selector(prepareUpcomingMovie) withObject:nil afterDelay:UPCOMING_MOVIE_RETRY];
+	}
+}
+
+/**
+ Makes the upcoming movie the current one, if it has been prepared.
+ The current movie is stopped and released.
+ 
+ Returns whether the player moved to the upcoming track.
+**/
+- (BOOL)switchToUpcomingMovie
+{
+	if(upcomingMovie == nil) return NO;
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(prepareUpcomingMovie) object:nil];
+	
+	[movie stop];
+	[movie release];
+	movie = upcomingMovie;
+	upcomingMovie = nil;
+	
+	[currentTrack release];
+	currentTrack = upcomingTrack;
+	upcomingTrack = nil;
+	
+	cursor.position = upcomingPlaylistIndex;
+	
+	return YES;
+}
+
+- (void)discardUpcomingMovie
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(prepareUpcomingMovie) object:nil];
+	
+	[upcomingMovie release];
+	upcomingMovie = nil;
+	
+	[upcomingTrack release];
+	upcomingTrack = nil;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Helper Methods:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Sets the movie to the track with the given trackID, as an entry of the playlist (so it doesn't loop).
+ Called by the playlist cursor, as it looks for a track that can be played.
  
- Note: The random number generator was seeded upon initilization of this class.
+ Returns whether the movie could be opened.
 **/
-- (double)randomDouble
+- (BOOL)openPlaylistTrackWithID:(int)trackID
 {
-	return random() / (RAND_MAX + 1.0);
+	// Get the specified track from the iTunesData, and use it to set the movie
+	[self setMovieWithTrack:[iTunesData trackForID:trackID]];
+	
+	// We don't configure the movie to loop, but we still need to set it's volume
+	[movie setVolume:volumePercentage];
+	
+	return (movie != nil);
 }
 
 @end
@@ -0,0 +1,92 @@
+#include "ITunesPlaylistCursor.h"
+
+#include <stddef.h>
+
+/**
+ Sets up the cursor before the first entry of the given playlist.
+ If a shuffle is given, it starts over with a new order of the playlist.
+ If the shuffle can't hold the playlist, the playlist is played in order instead.
+**/
+void ITunesPlaylistCursorInit(ITunesPlaylistCursor *cursor, const int32_t *entries, uint32_t count,
+                              ITunesShuffle *shuffle)
+{
+	cursor->entries = entries;
+	cursor->count = count;
+	cursor->shuffle = shuffle;
+	cursor->position = -1;
+	cursor->wraps = 0;
+	cursor->skipped = 0;
+	
+	if((shuffle != NULL) && !ITunesShuffleSetCount(shuffle, count))
+	{
+		cursor->shuffle = NULL;
+	}
+}
+
+/**
+ Returns the entry at the given position, in play order.
+**/
+int32_t ITunesPlaylistCursorEntry(const ITunesPlaylistCursor *cursor, int32_t position)
+{
+	if(cursor->shuffle != NULL)
+	{
+		int32_t shuffledPosition = ITunesShuffleIndex(cursor->shuffle, (uint32_t)position);
+		if(shuffledPosition >= 0)
+		{
+			return cursor->entries[shuffledPosition];
+		}
+	}
+	return cursor->entries[position];
+}
+
+/**
+ Moves to the next entry that can be opened, wrapping around (and reshuffling) at the end of the playlist.
+ Returns 0 if no entry of the playlist can be opened (or it's empty), having tried each of them once.
+**/
+int ITunesPlaylistCursorNext(ITunesPlaylistCursor *cursor, ITunesPlaylistOpenFunction open, void *context)
+{
+	uint32_t loopCount;
+	for(loopCount = 0; loopCount < cursor->count; loopCount++)
+	{
+		int isWrapping = (cursor->position >= 0) && ((uint32_t)cursor->position + 1 >= cursor->count);
+		
+		cursor->position = isWrapping ? 0 : cursor->position + 1;
+		
+		// Follow iTunes' lead, and reshuffle once the playlist has been played all the way through
+		if(isWrapping)
+		{
+			cursor->wraps++;
+			if(cursor->shuffle != NULL) ITunesShuffleReshuffle(cursor->shuffle);
+		}
+		
+		if(open(context, ITunesPlaylistCursorEntry(cursor, cursor->position)))
+		{
+			return 1;
+		}
+		cursor->skipped++;
+	}
+	
+	return 0;
+}
+
+/**
+ Moves to the previous entry that can be opened, wrapping around at the start of the playlist.
+ Moving back doesn't reshuffle, so the entries before the current one are the ones that were played before it.
+ Returns 0 if no entry of the playlist can be opened (or it's empty), having tried each of them once.
+**/
+int ITunesPlaylistCursorPrevious(ITunesPlaylistCursor *cursor, ITunesPlaylistOpenFunction open, void *context)
+{
+	uint32_t loopCount;
+	for(loopCount = 0; loopCount < cursor->count; loopCount++)
+	{
+		cursor->position = (cursor->position <= 0) ? (int32_t)cursor->count - 1 : cursor->position - 1;
+		
+		if(open(context, ITunesPlaylistCursorEntry(cursor, cursor->position)))
+		{
+			return 1;
+		}
+		cursor->skipped++;
+	}
+	
+	return 0;
+}
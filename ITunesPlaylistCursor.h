@@ -0,0 +1,50 @@
+/**
+ Position of the player in a playlist, and how it moves through it.
+
+ ITunesPlayer used to step through it's playlist in three places (setting the playlist, next and previous track),
+ each with it's own loop, wrapping around, reshuffling, and skipping the tracks that can't be played.
+ None of it could run without QuickTime, so the benchmarks had to copy it, and the copy could drift from the player.
+
+ The cursor keeps the position in play order, and moves it forward or back to the next entry that can be played,
+ asking an open function given by the player. It wraps around at either end of the playlist,
+ and starts a new shuffled order (see ITunesShuffle.h) whenever it wraps forward from the last entry.
+ Every entry is tried at most once per move, so a playlist without any playable entry doesn't loop forever.
+
+ The cursor doesn't own the entries, nor the shuffle.
+**/
+
+#ifndef ITUNES_PLAYLIST_CURSOR_H
+#define ITUNES_PLAYLIST_CURSOR_H
+
+#include <stdint.h>
+#include "ITunesShuffle.h"
+
+// Opens the given entry (typically a trackID). Returns non-zero if it can be played.
+typedef int (*ITunesPlaylistOpenFunction)(void *context, int32_t entry);
+
+typedef struct ITunesPlaylistCursor
+{
+	// Entries of the playlist, in playlist order
+	const int32_t *entries;
+	uint32_t count;
+	
+	// Play order, if shuffling (NULL otherwise)
+	ITunesShuffle *shuffle;
+	
+	// Position of the current entry, in play order (-1 before the first move)
+	int32_t position;
+	
+	// Number of times the playlist wrapped around forward, and entries skipped because they couldn't be opened
+	uint32_t wraps;
+	uint32_t skipped;
+} ITunesPlaylistCursor;
+
+void ITunesPlaylistCursorInit(ITunesPlaylistCursor *cursor, const int32_t *entries, uint32_t count,
+                              ITunesShuffle *shuffle);
+
+int32_t ITunesPlaylistCursorEntry(const ITunesPlaylistCursor *cursor, int32_t position);
+
+int ITunesPlaylistCursorNext(ITunesPlaylistCursor *cursor, ITunesPlaylistOpenFunction open, void *context);
+int ITunesPlaylistCursorPrevious(ITunesPlaylistCursor *cursor, ITunesPlaylistOpenFunction open, void *context);
+
+#endif
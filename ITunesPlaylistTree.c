@@ -0,0 +1,170 @@
+#include "ITunesPlaylistTree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Flag of each category (except normal playlists, which have none of them)
+static const uint32_t categoryFlags[ITUNES_PLAYLIST_CATEGORY_NORMAL] = {
+	ITUNES_PLAYLIST_MASTER,
+	ITUNES_PLAYLIST_MUSIC,
+	ITUNES_PLAYLIST_MOVIES,
+	ITUNES_PLAYLIST_TVSHOWS,
+	ITUNES_PLAYLIST_PODCASTS,
+	ITUNES_PLAYLIST_VIDEOS,
+	ITUNES_PLAYLIST_AUDIOBOOKS,
+	ITUNES_PLAYLIST_PURCHASED,
+	ITUNES_PLAYLIST_PARTYSHUFFLE,
+	ITUNES_PLAYLIST_FOLDER,
+	ITUNES_PLAYLIST_SMART
+};
+
+// Playlists with none of these flags are normal playlists
+#define NORMAL_EXCLUDED_FLAGS  (ITUNES_PLAYLIST_MASTER | ITUNES_PLAYLIST_MUSIC | ITUNES_PLAYLIST_MOVIES |        \
+                                ITUNES_PLAYLIST_TVSHOWS | ITUNES_PLAYLIST_PODCASTS | ITUNES_PLAYLIST_VIDEOS |    \
+                                ITUNES_PLAYLIST_AUDIOBOOKS | ITUNES_PLAYLIST_PURCHASED |                        \
+                                ITUNES_PLAYLIST_PARTYSHUFFLE | ITUNES_PLAYLIST_FOLDER | ITUNES_PLAYLIST_SMART | \
+                                ITUNES_PLAYLIST_HAS_PARENT)
+
+/**
+ Returns whether the given playlist belongs in the given category.
+**/
+static int InCategory(const ITunesPlaylist *playlist, int category)
+{
+	if(category == ITUNES_PLAYLIST_CATEGORY_NORMAL)
+	{
+		return (playlist->flags & NORMAL_EXCLUDED_FLAGS) == 0;
+	}
+	if(category == ITUNES_PLAYLIST_CATEGORY_FOLDER)
+	{
+		// Only top level folders, as the others are listed within their parent
+		return (playlist->flags & (ITUNES_PLAYLIST_FOLDER | ITUNES_PLAYLIST_HAS_PARENT)) == ITUNES_PLAYLIST_FOLDER;
+	}
+	return (playlist->flags & categoryFlags[category]) != 0;
+}
+
+/**
+ Returns the index of the parent of the given playlist, or -1 if it doesn't have one (that's in the library).
+**/
+static int32_t ParentIndex(const ITunesLibrary *lib, const ITunesPlaylist *playlist)
+{
+	if(!(playlist->flags & ITUNES_PLAYLIST_HAS_PARENT)) return -1;
+	
+	int32_t parentIndex = ITunesLibraryPlaylistIndexForPersistentID(lib, playlist->parentPersistentID);
+	
+	// A playlist can't contain itself
+	if(parentIndex == (playlist - lib->playlists)) return -1;
+	
+	return parentIndex;
+}
+
+/**
+ Builds the hierarchy index of the playlists in the given library.
+ The library must be finished (it's persistentID index is used to find the parents).
+
+ Returns NULL if the memory could not be allocated.
+**/
+ITunesPlaylistTree * ITunesPlaylistTreeCreate(const ITunesLibrary *lib)
+{
+	ITunesPlaylistTree *tree = calloc(1, sizeof(ITunesPlaylistTree));
+	if(tree == NULL) return NULL;
+	
+	uint32_t count = lib->playlistsCount;
+	tree->playlistsCount = count;
+	
+	uint32_t *categoryCounts = calloc(ITUNES_PLAYLIST_CATEGORY_COUNT, sizeof(uint32_t));
+	int32_t *parents = malloc((count + 1) * sizeof(int32_t));
+	
+	tree->childrenOffsets = calloc(count + 2, sizeof(uint32_t));
+	tree->children = malloc((count + 1) * sizeof(uint32_t));
+	
+	if(!categoryCounts || !parents || !tree->childrenOffsets || !tree->children)
+	{
+		goto failed;
+	}
+	
+	// Count the playlists in each category, and the children of each playlist
+	// The child counts are stored one place ahead, so the prefix sums below turn them into start offsets
+	uint32_t i;
+	int category;
+	uint32_t categoryTotal = 0;
+	
+	for(i = 0; i < count; i++)
+	{
+		const ITunesPlaylist *playlist = &lib->playlists[i];
+		
+		for(category = 0; category < ITUNES_PLAYLIST_CATEGORY_COUNT; category++)
+		{
+			if(InCategory(playlist, category))
+			{
+				categoryCounts[category]++;
+				categoryTotal++;
+			}
+		}
+		
+		parents[i] = ParentIndex(lib, playlist);
+		if(parents[i] >= 0)
+		{
+			tree->childrenOffsets[parents[i] + 2]++;
+		}
+	}
+	
+	tree->categoryPlaylists = malloc((categoryTotal + 1) * sizeof(uint32_t));
+	if(tree->categoryPlaylists == NULL)
+	{
+		goto failed;
+	}
+	
+	tree->categoryOffsets[0] = 0;
+	for(category = 0; category < ITUNES_PLAYLIST_CATEGORY_COUNT; category++)
+	{
+		tree->categoryOffsets[category + 1] = tree->categoryOffsets[category] + categoryCounts[category];
+		categoryCounts[category] = tree->categoryOffsets[category];
+	}
+	
+	for(i = 2; i <= count + 1; i++)
+	{
+		tree->childrenOffsets[i] += tree->childrenOffsets[i - 1];
+	}
+	
+	// Fill in the buckets, in library order
+	// Each child is written at childrenOffsets[parent + 1], which is bumped past it,
+	// so once every child is written, childrenOffsets[p] is the start of the children of p
+	for(i = 0; i < count; i++)
+	{
+		const ITunesPlaylist *playlist = &lib->playlists[i];
+		
+		for(category = 0; category < ITUNES_PLAYLIST_CATEGORY_COUNT; category++)
+		{
+			if(InCategory(playlist, category))
+			{
+				tree->categoryPlaylists[categoryCounts[category]++] = i;
+			}
+		}
+		
+		if(parents[i] >= 0)
+		{
+			tree->children[tree->childrenOffsets[parents[i] + 1]++] = i;
+		}
+	}
+	
+	free(categoryCounts);
+	free(parents);
+	return tree;
+
+failed:
+	
+	free(categoryCounts);
+	free(parents);
+	ITunesPlaylistTreeFree(tree);
+	return NULL;
+}
+
+void ITunesPlaylistTreeFree(ITunesPlaylistTree *tree)
+{
+	if(tree == NULL) return;
+	
+	free(tree->categoryPlaylists);
+	free(tree->childrenOffsets);
+	free(tree->children);
+	free(tree);
+}
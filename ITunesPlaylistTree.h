@@ -0,0 +1,70 @@
+/**
+ Hierarchy index of the playlists in the library, used to build the playlist menu.
+
+ The menu lists the playlists by category (library, music, movies, ..., folders, smart playlists, normal playlists),
+ in the order iTunes does, with the contents of each folder indented beneath it.
+ Rather than scanning every playlist once per category, and again for every folder,
+ the index is built in a single pass over the playlists:
+
+ - Category buckets: the playlist indexes of each category, in library order.
+ - Children: for every playlist, the indexes of the playlists whose parent it is, in library order.
+
+ Both are stored as offsets into a single packed array, so walking the menu is linear in the number of playlists.
+**/
+
+#ifndef ITUNES_PLAYLIST_TREE_H
+#define ITUNES_PLAYLIST_TREE_H
+
+#include "ITunesLibrary.h"
+
+// Categories, in menu order
+// A playlist is in every category it has the flag of (except folders, which must be top level)
+#define ITUNES_PLAYLIST_CATEGORY_MASTER        0
+#define ITUNES_PLAYLIST_CATEGORY_MUSIC         1
+#define ITUNES_PLAYLIST_CATEGORY_MOVIES        2
+#define ITUNES_PLAYLIST_CATEGORY_TVSHOWS       3
+#define ITUNES_PLAYLIST_CATEGORY_PODCASTS      4
+#define ITUNES_PLAYLIST_CATEGORY_VIDEOS        5
+#define ITUNES_PLAYLIST_CATEGORY_AUDIOBOOKS    6
+#define ITUNES_PLAYLIST_CATEGORY_PURCHASED     7
+#define ITUNES_PLAYLIST_CATEGORY_PARTYSHUFFLE  8
+#define ITUNES_PLAYLIST_CATEGORY_FOLDER        9
+#define ITUNES_PLAYLIST_CATEGORY_SMART         10
+#define ITUNES_PLAYLIST_CATEGORY_NORMAL        11
+#define ITUNES_PLAYLIST_CATEGORY_COUNT         12
+
+typedef struct ITunesPlaylistTree
+{
+	// The playlists of category c are categoryPlaylists[categoryOffsets[c], categoryOffsets[c + 1])
+	uint32_t categoryOffsets[ITUNES_PLAYLIST_CATEGORY_COUNT + 1];
+	uint32_t *categoryPlaylists;
+	
+	// The children of playlist p are children[childrenOffsets[p], childrenOffsets[p + 1])
+	uint32_t *childrenOffsets;
+	uint32_t *children;
+	
+	uint32_t playlistsCount;
+} ITunesPlaylistTree;
+
+ITunesPlaylistTree * ITunesPlaylistTreeCreate(const ITunesLibrary *lib);
+void ITunesPlaylistTreeFree(ITunesPlaylistTree *tree);
+
+/**
+ Returns the playlist indexes of the given category, and their number via countPtr.
+**/
+static inline const uint32_t * ITunesPlaylistTreeCategory(const ITunesPlaylistTree *tree, int category, uint32_t *countPtr)
+{
+	*countPtr = tree->categoryOffsets[category + 1] - tree->categoryOffsets[category];
+	return tree->categoryPlaylists + tree->categoryOffsets[category];
+}
+
+/**
+ Returns the playlist indexes of the children of the given playlist, and their number via countPtr.
+**/
+static inline const uint32_t * ITunesPlaylistTreeChildren(const ITunesPlaylistTree *tree, uint32_t playlistIndex, uint32_t *countPtr)
+{
+	*countPtr = tree->childrenOffsets[playlistIndex + 1] - tree->childrenOffsets[playlistIndex];
+	return tree->children + tree->childrenOffsets[playlistIndex];
+}
+
+#endif
@@ -0,0 +1,359 @@
+#include "ITunesPrefetch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef enum EntryState
+{
+	EntryPending = 0,
+	EntryOpening,
+	EntryPlayable,
+	EntryUnplayable
+} EntryState;
+
+typedef struct PrefetchEntry
+{
+	int32_t tag;
+	EntryState state;
+	char *path;
+	void *handle;
+	
+	// Identifies the entry, so the thread can tell whether it's still queued once it has been opened
+	uint32_t serial;
+} PrefetchEntry;
+
+struct ITunesPrefetch
+{
+	ITunesPrefetchOpenFunction open;
+	ITunesPrefetchCloseFunction close;
+	void *context;
+	
+	// Ring of queued entries, in playing order
+	PrefetchEntry *entries;
+	uint32_t capacity;
+	uint32_t first;
+	uint32_t count;
+	uint32_t nextSerial;
+	
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	int threadStarted;
+	int shouldQuit;
+};
+
+// QUEUE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static PrefetchEntry * EntryAt(ITunesPrefetch *prefetch, uint32_t i)
+{
+	return &prefetch->entries[(prefetch->first + i) % prefetch->capacity];
+}
+
+static void DisposeEntry(ITunesPrefetch *prefetch, PrefetchEntry *entry)
+{
+	if((entry->state == EntryPlayable) && (entry->handle != NULL) && (prefetch->close != NULL))
+	{
+		prefetch->close(prefetch->context, entry->handle);
+	}
+	free(entry->path);
+	
+	entry->path = NULL;
+	entry->handle = NULL;
+}
+
+static void RemoveFirstEntry(ITunesPrefetch *prefetch)
+{
+	prefetch->first = (prefetch->first + 1) % prefetch->capacity;
+	prefetch->count--;
+}
+
+// THREAD
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Opens the queued entries, in order, as they are added.
+**/
+static void * PrefetchThread(void *arg)
+{
+	ITunesPrefetch *prefetch = (ITunesPrefetch *)arg;
+	
+	pthread_mutex_lock(&prefetch->mutex);
+	
+	while(!prefetch->shouldQuit)
+	{
+		PrefetchEntry *entry = NULL;
+		uint32_t i;
+		for(i = 0; i < prefetch->count; i++)
+		{
+			if(EntryAt(prefetch, i)->state == EntryPending)
+			{
+				entry = EntryAt(prefetch, i);
+				break;
+			}
+		}
+		
+		if(entry == NULL)
+		{
+			pthread_cond_wait(&prefetch->changed, &prefetch->mutex);
+			continue;
+		}
+		
+		// The entry may be removed (or the queue cleared) while it's being opened, so work on a copy of it's path
+		uint32_t serial = entry->serial;
+		char *path = (entry->path != NULL) ? strdup(entry->path) : NULL;
+		entry->state = EntryOpening;
+		
+		pthread_mutex_unlock(&prefetch->mutex);
+		
+		void *handle = NULL;
+		int playable = (path != NULL) ? prefetch->open(prefetch->context, path, &handle) : 0;
+		free(path);
+		
+		pthread_mutex_lock(&prefetch->mutex);
+		
+		entry = NULL;
+		for(i = 0; i < prefetch->count; i++)
+		{
+			if(EntryAt(prefetch, i)->serial == serial)
+			{
+				entry = EntryAt(prefetch, i);
+				break;
+			}
+		}
+		
+		if(entry != NULL)
+		{
+			entry->state = playable ? EntryPlayable : EntryUnplayable;
+			entry->handle = handle;
+		}
+		else if(playable && (handle != NULL) && (prefetch->close != NULL))
+		{
+			prefetch->close(prefetch->context, handle);
+		}
+		
+		pthread_cond_broadcast(&prefetch->changed);
+	}
+	
+	pthread_mutex_unlock(&prefetch->mutex);
+	return NULL;
+}
+
+// PREFETCH
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Creates a look-ahead queue of up to the given number of entries, which are opened with the given function.
+ Returns NULL if the queue (or it's thread) couldn't be created.
+**/
+ITunesPrefetch * ITunesPrefetchCreate(uint32_t capacity, ITunesPrefetchOpenFunction open,
+                                      ITunesPrefetchCloseFunction close, void *context)
+{
+	if((capacity == 0) || (open == NULL)) return NULL;
+	
+	ITunesPrefetch *prefetch = calloc(1, sizeof(ITunesPrefetch));
+	if(prefetch == NULL) return NULL;
+	
+	prefetch->entries = calloc(capacity, sizeof(PrefetchEntry));
+	if(prefetch->entries == NULL)
+	{
+		free(prefetch);
+		return NULL;
+	}
+	
+	prefetch->open = open;
+	prefetch->close = close;
+	prefetch->context = context;
+	prefetch->capacity = capacity;
+	
+	pthread_mutex_init(&prefetch->mutex, NULL);
+	pthread_cond_init(&prefetch->changed, NULL);
+	
+	if(pthread_create(&prefetch->thread, NULL, PrefetchThread, prefetch) != 0)
+	{
+		ITunesPrefetchFree(prefetch);
+		return NULL;
+	}
+	prefetch->threadStarted = 1;
+	
+	return prefetch;
+}
+
+/**
+ Stops the thread (after it's done opening the current entry), and disposes of all queued entries.
+**/
+void ITunesPrefetchFree(ITunesPrefetch *prefetch)
+{
+	if(prefetch == NULL) return;
+	
+	if(prefetch->threadStarted)
+	{
+		pthread_mutex_lock(&prefetch->mutex);
+		prefetch->shouldQuit = 1;
+		pthread_cond_broadcast(&prefetch->changed);
+		pthread_mutex_unlock(&prefetch->mutex);
+		
+		pthread_join(prefetch->thread, NULL);
+	}
+	
+	while(prefetch->count > 0)
+	{
+		DisposeEntry(prefetch, EntryAt(prefetch, 0));
+		RemoveFirstEntry(prefetch);
+	}
+	
+	pthread_cond_destroy(&prefetch->changed);
+	pthread_mutex_destroy(&prefetch->mutex);
+	
+	free(prefetch->entries);
+	free(prefetch);
+}
+
+/**
+ Queues an entry to be opened, after the ones already queued.
+ The path is copied. A NULL path makes an entry that is never playable, but still occupies it's position.
+ Returns 0 if the queue is full.
+**/
+int ITunesPrefetchAdd(ITunesPrefetch *prefetch, int32_t tag, const char *path)
+{
+	int added = 0;
+	
+	pthread_mutex_lock(&prefetch->mutex);
+	
+	if(prefetch->count < prefetch->capacity)
+	{
+		PrefetchEntry *entry = EntryAt(prefetch, prefetch->count);
+		entry->tag = tag;
+		entry->path = (path != NULL) ? strdup(path) : NULL;
+		entry->handle = NULL;
+		entry->serial = ++prefetch->nextSerial;
+		entry->state = ((path != NULL) && (entry->path != NULL)) ? EntryPending : EntryUnplayable;
+		
+		prefetch->count++;
+		added = 1;
+		
+		pthread_cond_broadcast(&prefetch->changed);
+	}
+	
+	pthread_mutex_unlock(&prefetch->mutex);
+	return added;
+}
+
+/**
+ Removes all queued entries, such as when the player moves to another track than the next one.
+ Does not wait for an entry that is being opened.
+**/
+void ITunesPrefetchClear(ITunesPrefetch *prefetch)
+{
+	pthread_mutex_lock(&prefetch->mutex);
+	
+	while(prefetch->count > 0)
+	{
+		DisposeEntry(prefetch, EntryAt(prefetch, 0));
+		RemoveFirstEntry(prefetch);
+	}
+	
+	pthread_mutex_unlock(&prefetch->mutex);
+}
+
+uint32_t ITunesPrefetchCount(ITunesPrefetch *prefetch)
+{
+	pthread_mutex_lock(&prefetch->mutex);
+	uint32_t count = prefetch->count;
+	pthread_mutex_unlock(&prefetch->mutex);
+	
+	return count;
+}
+
+uint32_t ITunesPrefetchCapacity(ITunesPrefetch *prefetch)
+{
+	return prefetch->capacity;
+}
+
+/**
+ Takes the first playable entry off the queue, discarding any unplayable entries before it.
+ The caller owns the returned handle.
+
+ If the entry at the front of the queue hasn't been opened yet, this waits for it (if wait is non-zero),
+ or returns ITUNES_PREFETCH_PENDING, leaving the queue as it is from that entry on.
+**/
+int ITunesPrefetchTake(ITunesPrefetch *prefetch, int wait, int32_t *tag, void **handle)
+{
+	int result = ITUNES_PREFETCH_EMPTY;
+	
+	pthread_mutex_lock(&prefetch->mutex);
+	
+	while(prefetch->count > 0)
+	{
+		PrefetchEntry *entry = EntryAt(prefetch, 0);
+		
+		if((entry->state == EntryPending) || (entry->state == EntryOpening))
+		{
+			if(!wait)
+			{
+				result = ITUNES_PREFETCH_PENDING;
+				break;
+			}
+			pthread_cond_wait(&prefetch->changed, &prefetch->mutex);
+			continue;
+		}
+		
+		if(entry->state == EntryPlayable)
+		{
+			if(tag) *tag = entry->tag;
+			if(handle)
+				*handle = entry->handle;
+			else if((entry->handle != NULL) && (prefetch->close != NULL))
+				prefetch->close(prefetch->context, entry->handle);
+			
+			free(entry->path);
+			entry->path = NULL;
+			entry->handle = NULL;
+			
+			RemoveFirstEntry(prefetch);
+			result = ITUNES_PREFETCH_READY;
+			break;
+		}
+		
+		DisposeEntry(prefetch, entry);
+		RemoveFirstEntry(prefetch);
+	}
+	
+	pthread_mutex_unlock(&prefetch->mutex);
+	return result;
+}
+
+// OPEN FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Open function that checks whether the file of an upcoming entry is there, and can be read. It returns no handle.
+ This is what ITunesPlayer queues it's upcoming entries with: it can't open movies on the prefetch thread,
+ so it only uses the queue to skip missing files, and opens the movie itself.
+
+ Reading the start of the file also wakes up the disk it's on (if it was sleeping),
+ and brings the first part of the file into the cache, so opening the movie later doesn't block on it.
+**/
+int ITunesPrefetchCheckFile(void *context, const char *path, void **handle)
+{
+	struct stat info;
+	if((stat(path, &info) != 0) || !S_ISREG(info.st_mode) || (info.st_size == 0))
+	{
+		return 0;
+	}
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return 0;
+	
+	char *buffer = malloc(ITUNES_PREFETCH_READ_SIZE);
+	ssize_t length = (buffer != NULL) ? read(fd, buffer, ITUNES_PREFETCH_READ_SIZE) : 0;
+	
+	free(buffer);
+	close(fd);
+	
+	return (length > 0);
+}
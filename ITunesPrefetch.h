@@ -0,0 +1,52 @@
+/**
+ Look-ahead queue of the upcoming entries of a playlist.
+
+ Changing tracks used to mean opening the next file on the main thread, when the current one had already finished.
+ Every track change had an audible gap, and a missing or unplayable file (or a disk that has to spin up)
+ made it longer, as the candidates were tried one by one.
+
+ Instead, the player queues the next few entries (a tag, typically the position in the playlist, and a file path)
+ while the current track plays. A background thread opens them in order, with a function given by the player,
+ which decides whether the entry is playable, and may return a handle to whatever it opened (decoder, buffered data...).
+ When the track changes, the player takes the first playable entry, skipping the unplayable ones,
+ which is usually ready by then.
+
+ All functions, except for the open and close functions, must be called from the same (owning) thread.
+**/
+
+#ifndef ITUNES_PREFETCH_H
+#define ITUNES_PREFETCH_H
+
+#include <stdint.h>
+
+// Amount of the file read by ITunesPrefetchCheckFile
+#define ITUNES_PREFETCH_READ_SIZE  (64 * 1024)
+
+// Returned by ITunesPrefetchTake
+#define ITUNES_PREFETCH_EMPTY    0   // No playable entry left in the queue
+#define ITUNES_PREFETCH_READY    1   // The first playable entry was taken
+#define ITUNES_PREFETCH_PENDING  2   // The next entry hasn't been opened yet
+
+// Called on the prefetch thread. Returns non-zero if the file at the given path is playable.
+typedef int (*ITunesPrefetchOpenFunction)(void *context, const char *path, void **handle);
+
+// Called to dispose of the handle of an entry that was opened, but never taken. May be NULL.
+typedef void (*ITunesPrefetchCloseFunction)(void *context, void *handle);
+
+typedef struct ITunesPrefetch ITunesPrefetch;
+
+ITunesPrefetch * ITunesPrefetchCreate(uint32_t capacity, ITunesPrefetchOpenFunction open,
+                                      ITunesPrefetchCloseFunction close, void *context);
+void ITunesPrefetchFree(ITunesPrefetch *prefetch);
+
+int  ITunesPrefetchAdd(ITunesPrefetch *prefetch, int32_t tag, const char *path);
+void ITunesPrefetchClear(ITunesPrefetch *prefetch);
+
+uint32_t ITunesPrefetchCount(ITunesPrefetch *prefetch);
+uint32_t ITunesPrefetchCapacity(ITunesPrefetch *prefetch);
+
+int ITunesPrefetchTake(ITunesPrefetch *prefetch, int wait, int32_t *tag, void **handle);
+
+int ITunesPrefetchCheckFile(void *context, const char *path, void **handle);
+
+#endif
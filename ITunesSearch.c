@@ -0,0 +1,652 @@
+#include "ITunesSearch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define NOT_FOUND  ((size_t)-1)
+
+// Bytes of padding after each blob, so vector loads near the end never leave the allocation
+#define BLOB_PADDING  32
+
+// Filtering more than 1/FULL_SCAN_RATIO of the corpus scans entire columns, rather than checking row by row
+#define FULL_SCAN_RATIO  8
+
+// Searches aren't split into chunks of fewer blocks than this, as starting a thread costs more than searching them
+#define MIN_CHUNK_BLOCKS  4
+
+// Upper limit on the threads used by a single search
+#define MAX_THREADS  16
+
+// FOLDING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Folded forms of U+00C0 through U+017F (Latin-1 Supplement and Latin Extended-A)
+// NULL entries are not letters, and are copied as is
+static const char *latinFolds[] = {
+	"a",  "a",  "a",  "a",  "a",  "a",  "ae", "c",   // U+00C0
+	"e",  "e",  "e",  "e",  "i",  "i",  "i",  "i",   // U+00C8
+	"d",  "n",  "o",  "o",  "o",  "o",  "o",  NULL,  // U+00D0
+	"o",  "u",  "u",  "u",  "u",  "y",  "th", "ss",  // U+00D8
+	"a",  "a",  "a",  "a",  "a",  "a",  "ae", "c",   // U+00E0
+	"e",  "e",  "e",  "e",  "i",  "i",  "i",  "i",   // U+00E8
+	"d",  "n",  "o",  "o",  "o",  "o",  "o",  NULL,  // U+00F0
+	"o",  "u",  "u",  "u",  "u",  "y",  "th", "y",   // U+00F8
+	"a",  "a",  "a",  "a",  "a",  "a",  "c",  "c",   // U+0100
+	"c",  "c",  "c",  "c",  "c",  "c",  "d",  "d",   // U+0108
+	"d",  "d",  "e",  "e",  "e",  "e",  "e",  "e",   // U+0110
+	"e",  "e",  "e",  "e",  "g",  "g",  "g",  "g",   // U+0118
+	"g",  "g",  "g",  "g",  "h",  "h",  "h",  "h",   // U+0120
+	"i",  "i",  "i",  "i",  "i",  "i",  "i",  "i",   // U+0128
+	"i",  "i",  "ij", "ij", "j",  "j",  "k",  "k",   // U+0130
+	"k",  "l",  "l",  "l",  "l",  "l",  "l",  "l",   // U+0138
+	"l",  "l",  "l",  "n",  "n",  "n",  "n",  "n",   // U+0140
+	"n",  "n",  "n",  "n",  "o",  "o",  "o",  "o",   // U+0148
+	"o",  "o",  "oe", "oe", "r",  "r",  "r",  "r",   // U+0150
+	"r",  "r",  "s",  "s",  "s",  "s",  "s",  "s",   // U+0158
+	"s",  "s",  "t",  "t",  "t",  "t",  "t",  "t",   // U+0160
+	"u",  "u",  "u",  "u",  "u",  "u",  "u",  "u",   // U+0168
+	"u",  "u",  "u",  "u",  "w",  "w",  "y",  "y",   // U+0170
+	"y",  "z",  "z",  "z",  "z",  "z",  "z",  "s"    // U+0178
+};
+
+/**
+ Folds the given UTF-8 string for searching, writing the result to the given buffer.
+
+ ASCII, Latin, Greek and Cyrillic letters are lowercased, diacritics are removed from Latin letters,
+ and combining marks are dropped (so decomposed strings fold the same as precomposed ones).
+ Control characters become spaces, so the result never contains a NUL.
+ Everything else (including invalid UTF-8) is copied as is.
+
+ The folded string is never longer than the original, so the buffer must hold at least length bytes.
+ Returns the length of the folded string.
+**/
+size_t ITunesSearchFold(const char *utf8, size_t length, char *buffer)
+{
+	const unsigned char *s = (const unsigned char *)utf8;
+	char *out = buffer;
+	size_t i = 0;
+	
+	while(i < length)
+	{
+		unsigned char c = s[i];
+		
+		if(c < 0x80)
+		{
+			if(c < 0x20)
+				*out++ = ' ';
+			else if((c >= 'A') && (c <= 'Z'))
+				*out++ = c + ('a' - 'A');
+			else
+				*out++ = c;
+			i++;
+			continue;
+		}
+		
+		// Everything we fold is a 2 byte sequence
+		if(((c & 0xE0) != 0xC0) || (i + 1 >= length) || ((s[i + 1] & 0xC0) != 0x80))
+		{
+			*out++ = c;
+			i++;
+			continue;
+		}
+		
+		uint32_t cp = ((c & 0x1F) << 6) | (s[i + 1] & 0x3F);
+		
+		if((cp >= 0xC0) && (cp <= 0x17F) && (latinFolds[cp - 0xC0] != NULL))
+		{
+			const char *fold = latinFolds[cp - 0xC0];
+			while(*fold)
+			{
+				*out++ = *fold++;
+			}
+		}
+		else if((cp >= 0x300) && (cp <= 0x36F))
+		{
+			// Combining diacritical mark
+		}
+		else
+		{
+			// Greek and Cyrillic capitals
+			if((cp >= 0x391) && (cp <= 0x3AB))
+				cp += 0x20;
+			else if((cp >= 0x410) && (cp <= 0x42F))
+				cp += 0x20;
+			else if((cp >= 0x400) && (cp <= 0x40F))
+				cp += 0x50;
+			
+			*out++ = 0xC0 | (cp >> 6);
+			*out++ = 0x80 | (cp & 0x3F);
+		}
+		i += 2;
+	}
+	
+	return out - buffer;
+}
+
+// CORPUS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static ITunesStringRef ColumnRef(const ITunesTrack *track, int column)
+{
+	switch(column)
+	{
+		case ITUNES_SEARCH_COLUMN_NAME   : return track->name;
+		case ITUNES_SEARCH_COLUMN_ARTIST : return track->artist;
+		default                          : return track->album;
+	}
+}
+
+/**
+ Creates the search corpus for the given library.
+ Row numbers are the indexes of the tracks in the library.
+
+ Returns NULL if the memory could not be allocated.
+**/
+ITunesSearchCorpus * ITunesSearchCorpusCreate(const ITunesLibrary *lib)
+{
+	ITunesSearchCorpus *corpus = calloc(1, sizeof(ITunesSearchCorpus));
+	if(corpus == NULL) return NULL;
+	
+	corpus->rowsCount = lib->tracksCount;
+	
+	int column;
+	for(column = 0; column < ITUNES_SEARCH_COLUMN_COUNT; column++)
+	{
+		ITunesSearchColumn *col = &corpus->columns[column];
+		uint32_t i;
+		
+		// Folding never makes a string longer, so the unfolded lengths (plus separators) are an upper bound
+		size_t capacity = BLOB_PADDING;
+		for(i = 0; i < lib->tracksCount; i++)
+		{
+			capacity += strlen(ITunesLibraryString(lib, ColumnRef(&lib->tracks[i], column))) + 1;
+		}
+		
+		col->blob = malloc(capacity);
+		col->offsets = malloc((lib->tracksCount + 1) * sizeof(uint32_t));
+		
+		if((col->blob == NULL) || (col->offsets == NULL) || (capacity > UINT32_MAX))
+		{
+			ITunesSearchCorpusFree(corpus);
+			return NULL;
+		}
+		
+		uint32_t length = 0;
+		for(i = 0; i < lib->tracksCount; i++)
+		{
+			const char *str = ITunesLibraryString(lib, ColumnRef(&lib->tracks[i], column));
+			
+			col->offsets[i] = length;
+			length += ITunesSearchFold(str, strlen(str), col->blob + length);
+			col->blob[length++] = '\0';
+		}
+		col->offsets[lib->tracksCount] = length;
+		col->length = length;
+		
+		memset(col->blob + length, 0, BLOB_PADDING);
+	}
+	
+	return corpus;
+}
+
+void ITunesSearchCorpusFree(ITunesSearchCorpus *corpus)
+{
+	if(corpus == NULL) return;
+	
+	int column;
+	for(column = 0; column < ITUNES_SEARCH_COLUMN_COUNT; column++)
+	{
+		free(corpus->columns[column].blob);
+		free(corpus->columns[column].offsets);
+	}
+	free(corpus);
+}
+
+// SCANNING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the position of the first occurrence of the needle in text[start, length), or NOT_FOUND.
+
+ The vectorized paths compare blocks of candidate positions against both the first and last byte of the needle,
+ and only compare the rest of the needle for positions where both match.
+ This rejects nearly every position in the folded text without a branch.
+**/
+static size_t FindNeedle(const char *text, size_t length, size_t start, const char *needle, size_t n)
+{
+	if((n == 0) || (length < n) || (start > length - n)) return NOT_FOUND;
+	
+	// Last valid starting position
+	const size_t last = length - n;
+	size_t i = start;
+
+#if defined(__AVX2__)
+	
+	const __m256i first32 = _mm256_set1_epi8(needle[0]);
+	const __m256i last32  = _mm256_set1_epi8(needle[n - 1]);
+	
+	while(i + 31 <= last)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)(text + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(text + i + n - 1));
+		
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first32),
+		                                                      _mm256_cmpeq_epi8(b, last32)));
+		while(mask)
+		{
+			unsigned bit = __builtin_ctz(mask);
+			if((n <= 2) || (memcmp(text + i + bit + 1, needle + 1, n - 2) == 0))
+			{
+				return i + bit;
+			}
+			mask &= mask - 1;
+		}
+		i += 32;
+	}
+
+#endif
+#if defined(__SSE2__)
+	
+	const __m128i first16 = _mm_set1_epi8(needle[0]);
+	const __m128i last16  = _mm_set1_epi8(needle[n - 1]);
+	
+	while(i + 15 <= last)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(text + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(text + i + n - 1));
+		
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first16), _mm_cmpeq_epi8(b, last16)));
+		while(mask)
+		{
+			unsigned bit = __builtin_ctz(mask);
+			if((n <= 2) || (memcmp(text + i + bit + 1, needle + 1, n - 2) == 0))
+			{
+				return i + bit;
+			}
+			mask &= mask - 1;
+		}
+		i += 16;
+	}
+	
+	for(; i <= last; i++)
+	{
+		if((text[i] == needle[0]) && (memcmp(text + i + 1, needle + 1, n - 1) == 0))
+		{
+			return i;
+		}
+	}
+
+#else
+	
+	// No vector unit (or at least not one we know about), so we let memchr find the candidates
+	while(i <= last)
+	{
+		const char *p = memchr(text + i, needle[0], last - i + 1);
+		if(p == NULL) break;
+		
+		i = p - text;
+		if(memcmp(p + 1, needle + 1, n - 1) == 0)
+		{
+			return i;
+		}
+		i++;
+	}
+
+#endif
+	
+	return NOT_FOUND;
+}
+
+/**
+ Sets the bit of every row in [start, end) of the column that contains the needle.
+ After each match, scanning resumes at the start of the next row, as the row is already known to match.
+**/
+static void ScanColumn(const ITunesSearchColumn *col, uint32_t start, uint32_t end,
+                       const char *needle, size_t n, uint32_t *bits)
+{
+	const size_t length = col->offsets[end];
+	uint32_t row = start;
+	size_t pos = col->offsets[start];
+	
+	while((pos = FindNeedle(col->blob, length, pos, needle, n)) != NOT_FOUND)
+	{
+		while(col->offsets[row + 1] <= pos)
+		{
+			row++;
+		}
+		bits[row >> 5] |= (1u << (row & 31));
+		
+		pos = col->offsets[row + 1];
+	}
+}
+
+/**
+ Returns whether any column of the given row contains the needle.
+ The needle must already be folded.
+**/
+int ITunesSearchRowContains(const ITunesSearchCorpus *corpus, uint32_t row, const char *needle, size_t n)
+{
+	int column;
+	for(column = 0; column < ITUNES_SEARCH_COLUMN_COUNT; column++)
+	{
+		const ITunesSearchColumn *col = &corpus->columns[column];
+		
+		// Excluding the separator
+		size_t length = col->offsets[row + 1] - col->offsets[row] - 1;
+		
+		if(FindNeedle(col->blob + col->offsets[row], length, 0, needle, n) != NOT_FOUND)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// BLOCKS AND CHUNKS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct Chunk
+{
+	const ITunesSearchOptions *options;
+	ITunesSearchBlockFunction function;
+	void *context;
+	int32_t *result;
+	
+	uint32_t start;
+	uint32_t end;
+	
+	uint32_t resultCount;
+	pthread_t thread;
+} Chunk;
+
+/**
+ Returns whether the search with the given options has been cancelled.
+ The options may be NULL.
+**/
+int ITunesSearchIsCancelled(const ITunesSearchOptions *options)
+{
+	return (options != NULL) && (options->generation != NULL) && (*options->generation != options->expectedGeneration);
+}
+
+/**
+ Runs the blocks of the given chunk, packing their results to the start of the chunk.
+ Stops early (with a result count of ITUNES_SEARCH_CANCELLED) if the search is cancelled.
+**/
+static void * RunChunk(void *arg)
+{
+	Chunk *chunk = arg;
+	uint32_t start;
+	
+	chunk->resultCount = 0;
+	
+	for(start = chunk->start; start < chunk->end; start += ITUNES_SEARCH_BLOCK_ROWS)
+	{
+		if(ITunesSearchIsCancelled(chunk->options))
+		{
+			chunk->resultCount = ITUNES_SEARCH_CANCELLED;
+			break;
+		}
+		
+		uint32_t end = start + ITUNES_SEARCH_BLOCK_ROWS;
+		if(end > chunk->end) end = chunk->end;
+		
+		if(chunk->result == NULL)
+		{
+			chunk->function(chunk->context, start, end, NULL);
+			continue;
+		}
+		
+		uint32_t count = chunk->function(chunk->context, start, end, chunk->result + start);
+		
+		if(start != chunk->start + chunk->resultCount)
+		{
+			memmove(chunk->result + chunk->start + chunk->resultCount, chunk->result + start, count * sizeof(int32_t));
+		}
+		chunk->resultCount += count;
+	}
+	return NULL;
+}
+
+/**
+ Runs the given function over the range [0, count), in blocks of ITUNES_SEARCH_BLOCK_ROWS.
+
+ Each block [start, end) writes it's results to (result + start), and returns the number written.
+ The results of every block are packed together in order at the start of result, and their total is returned.
+ If result is NULL, the function is expected to write it's results elsewhere (IE - a bitmap), and 0 is returned.
+
+ When there are enough blocks, contiguous chunks of them are run on separate threads.
+ Block boundaries are multiples of ITUNES_SEARCH_BLOCK_ROWS (and so of 32), so blocks may safely set bits
+ of a shared bitmap of rows.
+
+ Returns ITUNES_SEARCH_CANCELLED if the search was cancelled before every block was run.
+**/
+uint32_t ITunesSearchRunBlocks(const ITunesSearchOptions *options, uint32_t count,
+                               ITunesSearchBlockFunction function, void *context, int32_t *result)
+{
+	uint32_t blocksCount = (count + ITUNES_SEARCH_BLOCK_ROWS - 1) / ITUNES_SEARCH_BLOCK_ROWS;
+	uint32_t chunksCount = blocksCount / MIN_CHUNK_BLOCKS;
+	
+	uint32_t maxThreads = (options != NULL) ? options->threadsCount : 1;
+	if(maxThreads > MAX_THREADS) maxThreads = MAX_THREADS;
+	
+	if(chunksCount > maxThreads) chunksCount = maxThreads;
+	if(chunksCount < 1) chunksCount = 1;
+	
+	Chunk chunks[MAX_THREADS];
+	int threaded[MAX_THREADS];
+	uint32_t i;
+	
+	for(i = 0; i < chunksCount; i++)
+	{
+		chunks[i].options = options;
+		chunks[i].function = function;
+		chunks[i].context = context;
+		chunks[i].result = result;
+		
+		uint32_t firstBlock = (uint32_t)(((uint64_t)blocksCount * i) / chunksCount);
+		uint32_t lastBlock = (uint32_t)(((uint64_t)blocksCount * (i + 1)) / chunksCount);
+		
+		chunks[i].start = firstBlock * ITUNES_SEARCH_BLOCK_ROWS;
+		chunks[i].end = (lastBlock * ITUNES_SEARCH_BLOCK_ROWS < count) ? (lastBlock * ITUNES_SEARCH_BLOCK_ROWS) : count;
+	}
+	
+	// The first chunk is run on the calling thread
+	// If a thread can't be started, it's chunk is run on the calling thread as well
+	for(i = 1; i < chunksCount; i++)
+	{
+		threaded[i] = (pthread_create(&chunks[i].thread, NULL, RunChunk, &chunks[i]) == 0);
+	}
+	
+	RunChunk(&chunks[0]);
+	
+	for(i = 1; i < chunksCount; i++)
+	{
+		if(threaded[i])
+			pthread_join(chunks[i].thread, NULL);
+		else
+			RunChunk(&chunks[i]);
+	}
+	
+	// Merge the results of the chunks, in order
+	uint32_t resultCount = 0;
+	
+	for(i = 0; i < chunksCount; i++)
+	{
+		if(chunks[i].resultCount == ITUNES_SEARCH_CANCELLED)
+		{
+			return ITUNES_SEARCH_CANCELLED;
+		}
+		
+		if((result != NULL) && (resultCount != chunks[i].start))
+		{
+			memmove(result + resultCount, result + chunks[i].start, chunks[i].resultCount * sizeof(int32_t));
+		}
+		resultCount += chunks[i].resultCount;
+	}
+	
+	return (result != NULL) ? resultCount : 0;
+}
+
+// FILTERING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct WordSearch
+{
+	const ITunesSearchCorpus *corpus;
+	const char *word;
+	size_t n;
+	
+	// Rows to check (for CheckBlock), or the bitmap of matching rows (for ScanBlock)
+	const int32_t *rows;
+	uint32_t *bits;
+} WordSearch;
+
+/**
+ Scans the rows [start, end) of the corpus for the word, setting the bits of the rows that contain it.
+**/
+static uint32_t ScanBlock(void *context, uint32_t start, uint32_t end, int32_t *result)
+{
+	WordSearch *search = context;
+	
+	int column;
+	for(column = 0; column < ITUNES_SEARCH_COLUMN_COUNT; column++)
+	{
+		ScanColumn(&search->corpus->columns[column], start, end, search->word, search->n, search->bits);
+	}
+	return 0;
+}
+
+/**
+ Checks the rows [start, end) of the rows being filtered one by one, keeping those that contain the word.
+**/
+static uint32_t CheckBlock(void *context, uint32_t start, uint32_t end, int32_t *result)
+{
+	WordSearch *search = context;
+	uint32_t resultCount = 0;
+	uint32_t i;
+	
+	for(i = start; i < end; i++)
+	{
+		if(ITunesSearchRowContains(search->corpus, search->rows[i], search->word, search->n))
+		{
+			result[resultCount++] = search->rows[i];
+		}
+	}
+	return resultCount;
+}
+
+/**
+ Filters the given rows, keeping those that match the query.
+
+ The query is folded, and split into words on spaces.
+ A row matches if every word is found in at least one of it's columns (name, artist or album).
+ Rows that aren't in the corpus never match.
+
+ The matching rows are written to result (which must hold count rows, and may be the same array as rows)
+ in their original order, and the number of matching rows is returned.
+ If the query contains no words, every row matches.
+
+ The options may be NULL, in which case the search runs on the calling thread, and can't be cancelled.
+ If the search is cancelled, ITUNES_SEARCH_CANCELLED is returned, and the contents of result are undefined.
+**/
+uint32_t ITunesSearchFilter(const ITunesSearchCorpus *corpus, const ITunesSearchOptions *options,
+                            const char *query, size_t queryLength,
+                            const int32_t *rows, uint32_t count, int32_t *result)
+{
+	char *folded = malloc(queryLength + 1);
+	uint32_t *bits = NULL;
+	uint32_t resultCount = 0;
+	uint32_t i;
+	
+	if(folded == NULL) return 0;
+	
+	size_t foldedLength = ITunesSearchFold(query, queryLength, folded);
+	folded[foldedLength] = '\0';
+	
+	// Start with every valid row, and narrow the results down with each word
+	for(i = 0; i < count; i++)
+	{
+		if((rows[i] >= 0) && ((uint32_t)rows[i] < corpus->rowsCount))
+		{
+			result[resultCount++] = rows[i];
+		}
+	}
+	
+	char *word = folded;
+	while((resultCount > 0) && (*word != '\0'))
+	{
+		if(*word == ' ')
+		{
+			word++;
+			continue;
+		}
+		
+		size_t n = 0;
+		while((word[n] != ' ') && (word[n] != '\0'))
+		{
+			n++;
+		}
+		
+		WordSearch search = { corpus, word, n, result, NULL };
+		uint32_t matchCount = 0;
+		
+		if(resultCount >= (corpus->rowsCount / FULL_SCAN_RATIO))
+		{
+			// Many rows to check, so it's cheaper to scan the columns in one go
+			size_t bitsLength = ((corpus->rowsCount + 31) / 32) * sizeof(uint32_t);
+			
+			if(bits == NULL)
+			{
+				bits = malloc(bitsLength);
+				if(bits == NULL)
+				{
+					resultCount = 0;
+					break;
+				}
+			}
+			memset(bits, 0, bitsLength);
+			
+			search.bits = bits;
+			if(ITunesSearchRunBlocks(options, corpus->rowsCount, ScanBlock, &search, NULL) == ITUNES_SEARCH_CANCELLED)
+			{
+				resultCount = ITUNES_SEARCH_CANCELLED;
+				break;
+			}
+			
+			for(i = 0; i < resultCount; i++)
+			{
+				uint32_t row = result[i];
+				if(bits[row >> 5] & (1u << (row & 31)))
+				{
+					result[matchCount++] = row;
+				}
+			}
+		}
+		else
+		{
+			// Each block only writes over rows it's already checked, so the rows may be filtered in place
+			matchCount = ITunesSearchRunBlocks(options, resultCount, CheckBlock, &search, result);
+			if(matchCount == ITUNES_SEARCH_CANCELLED)
+			{
+				resultCount = ITUNES_SEARCH_CANCELLED;
+				break;
+			}
+		}
+		
+		resultCount = matchCount;
+		word += n;
+	}
+	
+	free(bits);
+	free(folded);
+	
+	return resultCount;
+}
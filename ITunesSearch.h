@@ -0,0 +1,78 @@
+/**
+ Columnar search corpus for the iTunes library.
+
+ Searching the library used to mean creating an NSDictionary per track, and calling rangeOfString on it's name,
+ artist and album. Instead, the searchable columns (name, artist and album) are folded once, when the library is
+ loaded, into a contiguous blob per column. Folding lowercases the text and strips diacritics,
+ so "Beyoncé" matches "beyonce", and "ÆON" matches "aeon".
+
+ Each row (track index in the library) occupies the range [offsets[row], offsets[row + 1]) of the blob,
+ terminated by a NUL separator so matches never span rows.
+
+ Searching is a vectorized substring scan over the blobs (AVX2 or SSE2 where available, memchr otherwise).
+ Results are packed arrays of rows, in the same order as the rows they were filtered from.
+
+ Large searches are split into chunks of rows that are searched on several threads, and merged in order.
+ Searches may be cancelled from another thread, by changing the generation they were started with.
+
+ The corpus is immutable once created, so it may be searched from multiple threads at once.
+**/
+
+#ifndef ITUNES_SEARCH_H
+#define ITUNES_SEARCH_H
+
+#include "ITunesLibrary.h"
+
+#define ITUNES_SEARCH_COLUMN_NAME    0
+#define ITUNES_SEARCH_COLUMN_ARTIST  1
+#define ITUNES_SEARCH_COLUMN_ALBUM   2
+#define ITUNES_SEARCH_COLUMN_COUNT   3
+
+typedef struct ITunesSearchColumn
+{
+	char     *blob;
+	uint32_t *offsets;
+	uint32_t length;
+} ITunesSearchColumn;
+
+typedef struct ITunesSearchCorpus
+{
+	uint32_t rowsCount;
+	ITunesSearchColumn columns[ITUNES_SEARCH_COLUMN_COUNT];
+} ITunesSearchCorpus;
+
+// Returned instead of a count of rows when a search is cancelled
+#define ITUNES_SEARCH_CANCELLED  0xFFFFFFFF
+
+// Rows are searched in blocks of this many rows, between which cancellation is checked
+#define ITUNES_SEARCH_BLOCK_ROWS  4096
+
+typedef struct ITunesSearchOptions
+{
+	// Maximum number of threads to search with (including the calling thread)
+	uint32_t threadsCount;
+	
+	// The search is cancelled once *generation no longer equals expectedGeneration
+	// If generation is NULL, the search can't be cancelled
+	volatile const uint32_t *generation;
+	uint32_t expectedGeneration;
+} ITunesSearchOptions;
+
+typedef uint32_t (*ITunesSearchBlockFunction)(void *context, uint32_t start, uint32_t end, int32_t *result);
+
+ITunesSearchCorpus * ITunesSearchCorpusCreate(const ITunesLibrary *lib);
+void ITunesSearchCorpusFree(ITunesSearchCorpus *corpus);
+
+size_t ITunesSearchFold(const char *utf8, size_t length, char *buffer);
+
+int ITunesSearchRowContains(const ITunesSearchCorpus *corpus, uint32_t row, const char *needle, size_t n);
+
+int ITunesSearchIsCancelled(const ITunesSearchOptions *options);
+uint32_t ITunesSearchRunBlocks(const ITunesSearchOptions *options, uint32_t count,
+                               ITunesSearchBlockFunction function, void *context, int32_t *result);
+
+uint32_t ITunesSearchFilter(const ITunesSearchCorpus *corpus, const ITunesSearchOptions *options,
+                            const char *query, size_t queryLength,
+                            const int32_t *rows, uint32_t count, int32_t *result);
+
+#endif
@@ -0,0 +1,333 @@
+#include "ITunesSearchCache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// KEYS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CompareWords(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/**
+ Returns the normalized key for the given query, or NULL if the memory could not be allocated.
+
+ The key is the list of folded words (sorted, without duplicates), each terminated by a NUL,
+ followed by an empty word. The length of the key (including the final NUL) is returned via keyLength.
+**/
+static char * CreateKey(const char *query, size_t queryLength, size_t *keyLength)
+{
+	char *folded = malloc(queryLength + 1);
+	char **words = malloc(((queryLength / 2) + 1) * sizeof(char *));
+	char *key = malloc(queryLength + 2);
+	
+	if((folded == NULL) || (words == NULL) || (key == NULL))
+	{
+		free(folded);
+		free(words);
+		free(key);
+		return NULL;
+	}
+	
+	size_t foldedLength = ITunesSearchFold(query, queryLength, folded);
+	folded[foldedLength] = '\0';
+	
+	// Split the folded query into words
+	size_t wordsCount = 0;
+	size_t i = 0;
+	while(i < foldedLength)
+	{
+		if(folded[i] == ' ')
+		{
+			folded[i++] = '\0';
+			continue;
+		}
+		
+		words[wordsCount++] = folded + i;
+		while((i < foldedLength) && (folded[i] != ' '))
+		{
+			i++;
+		}
+	}
+	
+	qsort(words, wordsCount, sizeof(char *), CompareWords);
+	
+	size_t length = 0;
+	for(i = 0; i < wordsCount; i++)
+	{
+		if((i > 0) && (strcmp(words[i], words[i - 1]) == 0)) continue;
+		
+		size_t wordLength = strlen(words[i]) + 1;
+		memcpy(key + length, words[i], wordLength);
+		length += wordLength;
+	}
+	key[length++] = '\0';
+	
+	free(folded);
+	free(words);
+	
+	*keyLength = length;
+	return key;
+}
+
+/**
+ Returns whether the results for query are a subset of the results for cached.
+ This is the case if every word of cached is contained in some word of query.
+**/
+static int KeyRefines(const char *cached, const char *query)
+{
+	const char *c;
+	for(c = cached; *c != '\0'; c += strlen(c) + 1)
+	{
+		int found = 0;
+		
+		const char *q;
+		for(q = query; (*q != '\0') && !found; q += strlen(q) + 1)
+		{
+			found = (strstr(q, c) != NULL);
+		}
+		
+		if(!found) return 0;
+	}
+	return 1;
+}
+
+/**
+ Writes the words of query that aren't implied by cached (contained in one of it's words) to the given buffer,
+ separated by spaces. The buffer must be at least as long as the query key.
+ Returns the length of the written query.
+**/
+static size_t RemainingWords(const char *cached, const char *query, char *buffer)
+{
+	size_t length = 0;
+	
+	const char *q;
+	for(q = query; *q != '\0'; q += strlen(q) + 1)
+	{
+		int implied = 0;
+		
+		const char *c;
+		for(c = cached; (*c != '\0') && !implied; c += strlen(c) + 1)
+		{
+			implied = (strstr(c, q) != NULL);
+		}
+		
+		if(!implied)
+		{
+			size_t wordLength = strlen(q);
+			memcpy(buffer + length, q, wordLength);
+			length += wordLength;
+			buffer[length++] = ' ';
+		}
+	}
+	return length;
+}
+
+// INIT, DEALLOC
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ITunesSearchCache * ITunesSearchCacheCreate(size_t maxBytes)
+{
+	ITunesSearchCache *cache = calloc(1, sizeof(ITunesSearchCache));
+	if(cache == NULL) return NULL;
+	
+	cache->maxBytes = maxBytes;
+	return cache;
+}
+
+void ITunesSearchCacheFree(ITunesSearchCache *cache)
+{
+	if(cache == NULL) return;
+	
+	ITunesSearchCacheClear(cache);
+	free(cache->entries);
+	free(cache);
+}
+
+/**
+ Removes every entry from the cache.
+ The statistics are kept.
+**/
+void ITunesSearchCacheClear(ITunesSearchCache *cache)
+{
+	uint32_t i;
+	for(i = 0; i < cache->entriesCount; i++)
+	{
+		free(cache->entries[i].key);
+		free(cache->entries[i].rows);
+	}
+	cache->entriesCount = 0;
+	cache->bytes = 0;
+}
+
+// ENTRIES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void MoveToFront(ITunesSearchCache *cache, uint32_t index)
+{
+	if(index == 0) return;
+	
+	ITunesSearchCacheEntry entry = cache->entries[index];
+	memmove(cache->entries + 1, cache->entries, index * sizeof(ITunesSearchCacheEntry));
+	cache->entries[0] = entry;
+}
+
+/**
+ Adds an entry for the given key (which the cache takes ownership of) and rows (which are copied).
+ Least recently used entries are evicted until the cache is within it's byte limit.
+**/
+static void AddEntry(ITunesSearchCache *cache, char *key, size_t keyLength, const int32_t *rows, uint32_t count)
+{
+	size_t bytes = sizeof(ITunesSearchCacheEntry) + keyLength + (count * sizeof(int32_t));
+	
+	if(bytes > cache->maxBytes)
+	{
+		free(key);
+		return;
+	}
+	
+	if(cache->entriesCount == cache->entriesCapacity)
+	{
+		uint32_t newCapacity = (cache->entriesCapacity == 0) ? 16 : (cache->entriesCapacity * 2);
+		ITunesSearchCacheEntry *newEntries = realloc(cache->entries, newCapacity * sizeof(ITunesSearchCacheEntry));
+		
+		if(newEntries == NULL)
+		{
+			free(key);
+			return;
+		}
+		cache->entries = newEntries;
+		cache->entriesCapacity = newCapacity;
+	}
+	
+	int32_t *copy = malloc((count + 1) * sizeof(int32_t));
+	if(copy == NULL)
+	{
+		free(key);
+		return;
+	}
+	memcpy(copy, rows, count * sizeof(int32_t));
+	
+	memmove(cache->entries + 1, cache->entries, cache->entriesCount * sizeof(ITunesSearchCacheEntry));
+	cache->entriesCount++;
+	
+	cache->entries[0].key = key;
+	cache->entries[0].keyLength = keyLength;
+	cache->entries[0].rows = copy;
+	cache->entries[0].rowsCount = count;
+	cache->entries[0].bytes = bytes;
+	
+	cache->bytes += bytes;
+	
+	while(cache->bytes > cache->maxBytes)
+	{
+		ITunesSearchCacheEntry *last = &cache->entries[--cache->entriesCount];
+		
+		cache->bytes -= last->bytes;
+		free(last->key);
+		free(last->rows);
+	}
+}
+
+// FILTERING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Same as ITunesTrigramIndexFilter, but uses (and updates) the cache.
+ The index may be NULL (IE - if it hasn't been built yet).
+ Cancelled searches return ITUNES_SEARCH_CANCELLED, and aren't cached.
+
+ The given rows must be the same for every call, until the cache is cleared.
+ Unlike ITunesSearchFilter, result must not be the same array as rows.
+**/
+uint32_t ITunesSearchCacheFilter(ITunesSearchCache *cache, const ITunesSearchCorpus *corpus,
+                                 const ITunesTrigramIndex *index, const ITunesSearchOptions *options,
+                                 const char *query, size_t queryLength,
+                                 const int32_t *rows, uint32_t count, int32_t *result)
+{
+	size_t keyLength;
+	char *key = CreateKey(query, queryLength, &keyLength);
+	
+	if(key == NULL)
+	{
+		return ITunesTrigramIndexFilter(index, corpus, options, query, queryLength, rows, count, result);
+	}
+	
+	// Exact hit
+	uint32_t i;
+	for(i = 0; i < cache->entriesCount; i++)
+	{
+		ITunesSearchCacheEntry *entry = &cache->entries[i];
+		
+		if((entry->keyLength == keyLength) && (memcmp(entry->key, key, keyLength) == 0))
+		{
+			uint32_t resultCount = entry->rowsCount;
+			memcpy(result, entry->rows, resultCount * sizeof(int32_t));
+			
+			MoveToFront(cache, i);
+			cache->hits++;
+			
+			free(key);
+			return resultCount;
+		}
+	}
+	
+	// The smallest cached result that the new results must be a subset of
+	int32_t best = -1;
+	for(i = 0; i < cache->entriesCount; i++)
+	{
+		ITunesSearchCacheEntry *entry = &cache->entries[i];
+		
+		if(((best < 0) || (entry->rowsCount < cache->entries[best].rowsCount)) && KeyRefines(entry->key, key))
+		{
+			best = i;
+		}
+	}
+	
+	uint32_t resultCount;
+	
+	if(best >= 0)
+	{
+		ITunesSearchCacheEntry *entry = &cache->entries[best];
+		
+		// Every cached row already contains the cached words, so only the remaining words need to be searched for
+		char *remaining = malloc(keyLength);
+		if(remaining != NULL)
+		{
+			size_t remainingLength = RemainingWords(entry->key, key, remaining);
+			resultCount = ITunesTrigramIndexFilter(index, corpus, options, remaining, remainingLength, entry->rows, entry->rowsCount, result);
+			free(remaining);
+		}
+		else
+		{
+			resultCount = ITunesTrigramIndexFilter(index, corpus, options, query, queryLength, entry->rows, entry->rowsCount, result);
+		}
+		
+	}
+	else
+	{
+		resultCount = ITunesTrigramIndexFilter(index, corpus, options, query, queryLength, rows, count, result);
+	}
+	
+	if(resultCount == ITUNES_SEARCH_CANCELLED)
+	{
+		free(key);
+		return resultCount;
+	}
+	
+	if(best >= 0)
+	{
+		MoveToFront(cache, best);
+		cache->refinements++;
+	}
+	else
+	{
+		cache->misses++;
+	}
+	
+	AddEntry(cache, key, keyLength, result, resultCount);
+	
+	return resultCount;
+}
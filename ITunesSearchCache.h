@@ -0,0 +1,55 @@
+/**
+ Cache of search results, for incremental typing.
+
+ Queries are normalized into a key: the folded words of the query, without duplicates, sorted.
+ So "John  Mayer", "mayer john" and "JOHN MAYER" are all the same query.
+
+ Besides exact hits, the cache is used to refine earlier results.
+ If every word of a cached query is contained in some word of the new query ("john ma" -> "john may"),
+ then the results of the new query are a subset of the cached ones, and only the cached rows need to be filtered.
+ When several cached queries qualify, the one with the fewest rows is used.
+
+ Entries are evicted (least recently used first) when the total size of the cache exceeds it's byte limit.
+ The results depend on the rows that were searched, so the cache must be cleared when they change.
+**/
+
+#ifndef ITUNES_SEARCH_CACHE_H
+#define ITUNES_SEARCH_CACHE_H
+
+#include "ITunesTrigram.h"
+
+typedef struct ITunesSearchCacheEntry
+{
+	char     *key;
+	size_t   keyLength;
+	int32_t  *rows;
+	uint32_t rowsCount;
+	size_t   bytes;
+} ITunesSearchCacheEntry;
+
+typedef struct ITunesSearchCache
+{
+	// Entries, most recently used first
+	ITunesSearchCacheEntry *entries;
+	uint32_t entriesCount;
+	uint32_t entriesCapacity;
+	
+	size_t bytes;
+	size_t maxBytes;
+	
+	// Statistics
+	uint32_t hits;
+	uint32_t refinements;
+	uint32_t misses;
+} ITunesSearchCache;
+
+ITunesSearchCache * ITunesSearchCacheCreate(size_t maxBytes);
+void ITunesSearchCacheFree(ITunesSearchCache *cache);
+void ITunesSearchCacheClear(ITunesSearchCache *cache);
+
+uint32_t ITunesSearchCacheFilter(ITunesSearchCache *cache, const ITunesSearchCorpus *corpus,
+                                 const ITunesTrigramIndex *index, const ITunesSearchOptions *options,
+                                 const char *query, size_t queryLength,
+                                 const int32_t *rows, uint32_t count, int32_t *result);
+
+#endif
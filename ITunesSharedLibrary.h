@@ -0,0 +1,71 @@
+#import <Cocoa/Cocoa.h>
+#import "ITunesLibrary.h"
+#import "ITunesSnapshot.h"
+#import "ITunesDelta.h"
+#import "ITunesPlaylistTree.h"
+#import "ITunesTrackStore.h"
+#import "ITunesSearch.h"
+#import "ITunesTrigram.h"
+
+/**
+ An immutable version of the iTunes library, shared by every window that displays or plays from it.
+
+ Every editor and alarm window used to parse (or open the snapshot of) the library itself,
+ and build it's own track store, search corpus and trigram index on top of it.
+ Instead, the process keeps a single version of the library per xml file, which the windows retain.
+ A version is only created when the xml file changes (at most once per version of the file),
+ and is freed once the last window lets go of it.
+
+ The records of a version are never modified. When iTunes rewrites the xml file,
+ a new version is created in the background (by applying the changes to a copy of the current version),
+ and windows switch over to it (see -[ITunesData reloadIfNeeded]).
+
+ The derived data (playlist tree, track store, search corpus and trigram index) is built the first time it's needed,
+ and may be requested from any thread, unless noted otherwise.
+**/
+@interface ITunesSharedLibrary : NSObject
+{
+	// The xml file this version was loaded from, and the key (path, date, size) of that version of the file
+	NSString *xmlPath;
+	ITunesSnapshotKey xmlKey;
+	
+	// Compact records parsed from the xml file (or opened from it's snapshot)
+	ITunesLibrary *library;
+	
+	// Hierarchy index of the playlists (categories and folder contents)
+	ITunesPlaylistTree *playlistTree;
+	
+	// Track ID, name, artist and duration columns, used for displaying tables
+	ITunesTrackStore *trackStore;
+	
+	// NSString for each interned string of the track store, created the first time it's displayed
+	NSString **trackStrings;
+	
+	// Folded name, artist and album columns, used for searching
+	ITunesSearchCorpus *corpus;
+	
+	// Trigram index of the corpus (NULL until it has been built in the background)
+	ITunesTrigramIndex *trigramIndex;
+	BOOL isIndexing;
+	
+	// Held while building any of the above, and while using the library's position indexes
+	NSLock *lock;
+}
+
++ (ITunesSharedLibrary *)currentLibrary;
++ (ITunesSharedLibrary *)libraryWithXMLPath:(NSString *)path;
+
+- (NSString *)xmlPath;
+- (const ITunesLibrary *)library;
+
+- (ITunesDelta *)createDeltaFromLibrary:(ITunesSharedLibrary *)older;
+
+- (int)positionOfTrackID:(int)trackID inPlaylistIndex:(int)playlistIndex;
+
+- (const ITunesPlaylistTree *)playlistTree;
+- (const ITunesTrackStore *)trackStore;
+- (NSString *)trackStringForHandle:(ITunesStringHandle)handle;
+- (const ITunesSearchCorpus *)corpus;
+- (const ITunesTrigramIndex *)trigramIndex;
+
+@end
@@ -0,0 +1,589 @@
+#import "ITunesSharedLibrary.h"
+#import "ITunesParser.h"
+#import "Prefs.h"
+#import "RHAliasHandler.h"
+
+// Libraries smaller than this are scanned quickly enough that the trigram index isn't worth it's memory
+#define TRIGRAM_INDEX_MIN_TRACKS  10000
+
+// The current version of the library for each xml file, the key of the file it was last checked against,
+// and the xml files being parsed in the background.
+// All are only accessed while holding the registry lock
+static NSMutableDictionary *libraries;
+static NSMutableDictionary *libraryKeys;
+static NSMutableSet *reloadingPaths;
+static NSLock *registryLock;
+
+// Declare private API
+@interface ITunesSharedLibrary (PrivateAPI)
++ (NSString *)locateITunesMusicLibrary;
++ (NSString *)snapshotPath;
++ (ITunesLibrary *)loadLibraryWithXMLPath:(NSString *)path key:(ITunesSnapshotKey *)keyPtr;
++ (void)reloadThread:(NSString *)path;
+- (id)initWithLibrary:(ITunesLibrary *)lib xmlPath:(NSString *)path key:(const ITunesSnapshotKey *)key;
+- (ITunesLibrary *)createLibraryByApplyingDelta:(ITunesDelta *)delta;
+- (void)startIndexing;
+- (void)indexingThread:(id)sender;
+@end
+
+@implementation ITunesSharedLibrary
+
++ (void)initialize
+{
+	static BOOL initialized = NO;
+	if(!initialized)
+	{
+		initialized = YES;
+		
+		libraries = [[NSMutableDictionary alloc] init];
+		libraryKeys = [[NSMutableDictionary alloc] init];
+		reloadingPaths = [[NSMutableSet alloc] init];
+		registryLock = [[NSLock alloc] init];
+	}
+}
+
+// SHARED VERSIONS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the current version of the user's iTunes library.
+
+ The xml file is the one configured in the preferences, or if there isn't one, the one iTunes itself uses.
+ If the file is missing or corrupt, an empty library is returned.
+ May be invoked from any thread.
+**/
++ (ITunesSharedLibrary *)currentLibrary
+{
+	// First we check the preferences to see if an override exists
+	NSString *xmlPath = [Prefs xmlPath];
+	
+	// If an override doesn't exist, we search for the location of the file
+	if([xmlPath isEqualToString:@""])
+	{
+		xmlPath = [self locateITunesMusicLibrary];
+	}
+	
+	return [self libraryWithXMLPath:xmlPath];
+}
+
+/**
+ Returns the current version of the library for the given xml file.
+
+ The first time the file is requested, it's loaded right away (from it's snapshot if possible),
+ so windows opened (or alarms fired) at the same time share a single load.
+ After that, if the file has changed since the current version was created, it's parsed on a background thread,
+ and the current version is returned until the new one is ready (see reloadThread:).
+ Windows that retain an older version keep using it until they switch over to the new one.
+
+ May be invoked from any thread. Other than for the first load, it doesn't wait for the file to be parsed.
+**/
++ (ITunesSharedLibrary *)libraryWithXMLPath:(NSString *)path
+{
+	if(path == nil)
+	{
+		ITunesSnapshotKey key;
+		memset(&key, 0, sizeof(ITunesSnapshotKey));
+		
+		return [[[ITunesSharedLibrary alloc] initWithLibrary:ITunesLibraryCreate() xmlPath:nil key:&key] autorelease];
+	}
+	
+	[registryLock lock];
+	
+	ITunesSharedLibrary *current = [libraries objectForKey:path];
+	NSValue *currentKey = [libraryKeys objectForKey:path];
+	
+	ITunesSnapshotKey key;
+	BOOL hasKey = ITunesSnapshotKeyForFile([path fileSystemRepresentation], &key);
+	
+	ITunesSnapshotKey lastKey;
+	memset(&lastKey, 0, sizeof(ITunesSnapshotKey));
+	[currentKey getValue:&lastKey];
+	
+	if((current != nil) && (!hasKey || (memcmp(&key, &lastKey, sizeof(ITunesSnapshotKey)) == 0)))
+	{
+		// Nothing has changed (or the file is missing, in which case we stick with what we have)
+	}
+	else if(current == nil)
+	{
+		ITunesLibrary *lib = [self loadLibraryWithXMLPath:path key:&key];
+		
+		// If the file is missing or corrupt, we act as if the library is empty
+		// The zero key doesn't match any file, so the file is tried again next time
+		if(lib == NULL)
+		{
+			NSLog(@"Unable to parse iTunes library: %@", path);
+			lib = ITunesLibraryCreate();
+			memset(&key, 0, sizeof(ITunesSnapshotKey));
+		}
+		
+		current = [[[ITunesSharedLibrary alloc] initWithLibrary:lib xmlPath:path key:&key] autorelease];
+		
+		[libraries setObject:current forKey:path];
+		[libraryKeys setObject:[NSValue valueWithBytes:&key objCType:@encode(ITunesSnapshotKey)] forKey:path];
+	}
+	else if(![reloadingPaths containsObject:path])
+	{
+		// Only one parse of the file runs at a time
+		[reloadingPaths addObject:path];
+		[NSThread detachNewThreadSelector:@selector(reloadThread:) toTarget:self withObject:path];
+	}
+	
+	// The registry may replace it's version at any time, so the caller gets it's own reference
+	[[current retain] autorelease];
+	
+	[registryLock unlock];
+	
+	return current;
+}
+
+/**
+ Background thread method.
+ Parses the changed xml file, and makes the new version of the library the current one.
+
+ Rather than building the new version from the parse, the changes are applied to a copy of the current version,
+ which takes time in proportion to the number of changes (plus the copy itself, which is a handful of memcpy's).
+ If the file has merely been touched (nothing we use has changed), the current version is kept.
+
+ The registry lock is only held while looking up the current version, and while swapping in the new one.
+**/
++ (void)reloadThread:(NSString *)path
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	[registryLock lock];
+	ITunesSharedLibrary *current = [[[libraries objectForKey:path] retain] autorelease];
+	[registryLock unlock];
+	
+	ITunesSharedLibrary *latest = nil;
+	
+	// The key is taken before the parse, so if the file changes again in the meantime, it's parsed again next time
+	ITunesSnapshotKey key;
+	BOOL hasKey = ITunesSnapshotKeyForFile([path fileSystemRepresentation], &key);
+	
+	// If iTunes is in the middle of writing the file, the parse will fail, and we'll simply try again next time
+	ITunesLibrary *source = hasKey ? ITunesParseLibraryFile([path fileSystemRepresentation]) : NULL;
+	BOOL isParsed = (source != NULL);
+	
+	if(isParsed)
+	{
+		// The snapshot is written for the next launch
+		if(!ITunesSnapshotWrite([[self snapshotPath] fileSystemRepresentation], &key, source))
+		{
+			NSLog(@"Unable to write iTunes library snapshot");
+		}
+		
+		ITunesDelta *delta = ITunesDeltaCreate(current->library, source);
+		
+		if((delta != NULL) && (ITunesDeltaChangeCount(delta) == 0) && !delta->playlistsChanged)
+		{
+			// The file was touched, but nothing we use has changed
+		}
+		else
+		{
+			ITunesLibrary *lib = (delta != NULL) ? [current createLibraryByApplyingDelta:delta] : NULL;
+			
+			// If the changes couldn't be applied, the parsed library is used as is
+			if(lib == NULL)
+			{
+				lib = source;
+				source = NULL;
+			}
+			
+			latest = [[[ITunesSharedLibrary alloc] initWithLibrary:lib xmlPath:path key:&key] autorelease];
+		}
+		
+		ITunesDeltaFree(delta);
+		ITunesLibraryFree(source);
+	}
+	
+	[registryLock lock];
+	
+	if(latest != nil)
+	{
+		[libraries setObject:latest forKey:path];
+	}
+	if(isParsed)
+	{
+		[libraryKeys setObject:[NSValue valueWithBytes:&key objCType:@encode(ITunesSnapshotKey)] forKey:path];
+	}
+	[reloadingPaths removeObject:path];
+	
+	[registryLock unlock];
+	
+	[pool release];
+}
+
+// LOCATING AND LOADING THE LIBRARY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Searches for the location of the "iTunes Music Library.xml" file.
+ In order to do this, it follows the same search pattern that iTunes follows.
+ Most of the logic behind this search is based on the information from here:
+ http://www.indyjt.com/blog/?p=51
+*/
++ (NSString *)locateITunesMusicLibrary
+{
+	NSString *xmlPath1 = [@"~/Music/iTunes/iTunes Music Library.xml" stringByExpandingTildeInPath];
+	NSString *xmlPath2 = [@"~/Documents/iTunes/iTunes Music Library.xml" stringByExpandingTildeInPath];
+	NSArray *locations = [NSArray arrayWithObjects:xmlPath1, xmlPath2, nil];
+	
+	int i;
+	BOOL found = NO;
+	NSString *xmlPath = nil;
+	for(i = 0; i < [locations count] && !found; i++)
+	{
+		xmlPath = [RHAliasHandler resolvePath:[locations objectAtIndex:i]];
+		
+		found = [[NSFileManager defaultManager] fileExistsAtPath:xmlPath];
+	}
+	
+	if(found)
+		return xmlPath;
+	else
+		return nil;
+}
+
+/**
+ Returns the path of the library snapshot.
+ It's stored alongside our preference file:
+ ~/Library/Preferences/com.digitallity.alarmclock2.library
+**/
++ (NSString *)snapshotPath
+{
+	NSString *libraryDir = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+	NSString *prefsDir = [libraryDir stringByAppendingPathComponent:@"Preferences"];
+	NSString *fileName = [[[NSBundle mainBundle] bundleIdentifier] stringByAppendingPathExtension:@"library"];
+	
+	return [prefsDir stringByAppendingPathComponent:fileName];
+}
+
+/**
+ Loads the library records for the given XML file, returning the key of the version that was loaded via keyPtr.
+
+ If the XML file hasn't changed since the last time it was parsed, the snapshot from that parse is used.
+ Otherwise the XML file is parsed (only the information we actually use is extracted from the file),
+ and a new snapshot is written for next time.
+
+ Returns NULL if the file couldn't be read or parsed.
+**/
++ (ITunesLibrary *)loadLibraryWithXMLPath:(NSString *)path key:(ITunesSnapshotKey *)keyPtr
+{
+	const char *xmlFile = [path fileSystemRepresentation];
+	const char *snapshotFile = [[self snapshotPath] fileSystemRepresentation];
+	
+	NSLog(@"Loading iTunes library: %@", path);
+	
+	if(!ITunesSnapshotKeyForFile(xmlFile, keyPtr))
+	{
+		return NULL;
+	}
+	
+	ITunesLibrary *lib = ITunesSnapshotOpen(snapshotFile, keyPtr);
+	if(lib != NULL)
+	{
+		return lib;
+	}
+	
+	lib = ITunesParseLibraryFile(xmlFile);
+	if(lib != NULL)
+	{
+		if(!ITunesSnapshotWrite(snapshotFile, keyPtr, lib))
+		{
+			NSLog(@"Unable to write iTunes library snapshot");
+		}
+	}
+	return lib;
+}
+
+// INIT, DEALLOC
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Creates a version for the given library, which it takes ownership of.
+**/
+- (id)initWithLibrary:(ITunesLibrary *)lib xmlPath:(NSString *)path key:(const ITunesSnapshotKey *)key
+{
+	if(self = [super init])
+	{
+		library = lib;
+		xmlPath = [path copy];
+		xmlKey = *key;
+		
+		lock = [[NSLock alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	NSLog(@"Destroying %@", self);
+	
+	if(trackStrings != NULL)
+	{
+		uint32_t i;
+		for(i = 0; i < trackStore->stringsCount; i++)
+		{
+			[trackStrings[i] release];
+		}
+		free(trackStrings);
+	}
+	
+	ITunesTrackStoreFree(trackStore);
+	ITunesTrigramIndexFree(trigramIndex);
+	ITunesSearchCorpusFree(corpus);
+	ITunesPlaylistTreeFree(playlistTree);
+	ITunesLibraryFree(library);
+	[xmlPath release];
+	[lock release];
+	[super dealloc];
+}
+
+// LIBRARY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the xml file this version was loaded from, or nil if there isn't one (the library is empty).
+**/
+- (NSString *)xmlPath
+{
+	return xmlPath;
+}
+
+/**
+ Returns the native library records.
+ These are never modified, so they may be read from any thread for as long as the version is retained.
+**/
+- (const ITunesLibrary *)library
+{
+	return library;
+}
+
+/**
+ Returns the changes from the given older version to this one,
+ which may be used to map the older version's track ID's and playlist indexes onto this one's.
+
+ The delta must be freed with ITunesDeltaFree, and must not be used once this version has been released.
+ Returns NULL if the memory could not be allocated.
+**/
+- (ITunesDelta *)createDeltaFromLibrary:(ITunesSharedLibrary *)older
+{
+	ITunesDelta *delta = ITunesDeltaCreate(older->library, library);
+	
+	if((delta != NULL) && !ITunesDeltaMap(delta, older->library))
+	{
+		ITunesDeltaFree(delta);
+		delta = NULL;
+	}
+	return delta;
+}
+
+/**
+ Returns a copy of this version's records with the given changes applied to it, which the caller must free.
+ The delta must have been created from this version's records.
+
+ Every applied delta adds the strings that changed to the string pool, without removing the ones they replace.
+ Once most of the pool is made up of such strings, NULL is returned, so the caller starts over from the parse.
+ Returns NULL if the memory could not be allocated.
+**/
+- (ITunesLibrary *)createLibraryByApplyingDelta:(ITunesDelta *)delta
+{
+	if((uint64_t)library->stringsLength > (uint64_t)delta->source->stringsLength * 2)
+	{
+		return NULL;
+	}
+	
+	// The position indexes aren't copied, but may be built by another thread while the copy is made
+	[lock lock];
+	ITunesLibrary *lib = ITunesLibraryCopy(library);
+	[lock unlock];
+	
+	if((lib != NULL) && !ITunesDeltaApply(delta, lib))
+	{
+		ITunesLibraryFree(lib);
+		lib = NULL;
+	}
+	return lib;
+}
+
+/**
+ Returns the position of the given track within the playlist at the given index, or -1 if it isn't in the playlist.
+ The position tables of large playlists are built (and cached) by the first lookup, so lookups are serialized.
+**/
+- (int)positionOfTrackID:(int)trackID inPlaylistIndex:(int)playlistIndex
+{
+	if((playlistIndex < 0) || (playlistIndex >= library->playlistsCount))
+	{
+		return -1;
+	}
+	
+	[lock lock];
+	int position = ITunesLibraryPositionOfTrack(library, playlistIndex, trackID);
+	[lock unlock];
+	
+	return position;
+}
+
+// DERIVED DATA
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the hierarchy index of the playlists, used to list them by category, and folders by their contents.
+ Returns NULL if the memory could not be allocated.
+**/
+- (const ITunesPlaylistTree *)playlistTree
+{
+	[lock lock];
+	
+	if(playlistTree == NULL)
+	{
+		playlistTree = ITunesPlaylistTreeCreate(library);
+	}
+	
+	[lock unlock];
+	
+	return playlistTree;
+}
+
+/**
+ Returns the displayed columns (trackID, name, artist and duration) of the library, indexed by track index.
+ Returns NULL if the memory could not be allocated, in which case tables are displayed without them.
+**/
+- (const ITunesTrackStore *)trackStore
+{
+	[lock lock];
+	
+	if(trackStore == NULL)
+	{
+		trackStore = ITunesTrackStoreCreate(library);
+		
+		if(trackStore != NULL)
+		{
+			trackStrings = calloc(trackStore->stringsCount, sizeof(NSString *));
+		}
+		
+		if((trackStore == NULL) || (trackStrings == NULL))
+		{
+			NSLog(@"Unable to create iTunes track store");
+			
+			ITunesTrackStoreFree(trackStore);
+			trackStore = NULL;
+		}
+	}
+	
+	[lock unlock];
+	
+	return trackStore;
+}
+
+/**
+ Returns the NSString for the given interned string of the track store.
+ Each string is only created once, the first time any window displays it.
+
+ Must be invoked on the main thread, after trackStore has returned the store.
+**/
+- (NSString *)trackStringForHandle:(ITunesStringHandle)handle
+{
+	if(trackStrings[handle] == nil)
+	{
+		trackStrings[handle] = [[NSString alloc] initWithBytes:ITunesTrackStoreString(trackStore, handle)
+														length:ITunesTrackStoreStringLength(trackStore, handle)
+													  encoding:NSUTF8StringEncoding];
+		
+		// Invalid UTF-8 shouldn't make it through the parser, but if it does, display nothing rather than nil
+		if(trackStrings[handle] == nil)
+		{
+			trackStrings[handle] = @"";
+		}
+	}
+	return trackStrings[handle];
+}
+
+/**
+ Returns the searchable columns of the library, folded for searching.
+ The first request starts building the trigram index in the background (for large libraries).
+**/
+- (const ITunesSearchCorpus *)corpus
+{
+	[lock lock];
+	
+	if(corpus == NULL)
+	{
+		corpus = ITunesSearchCorpusCreate(library);
+		
+		// If we're out of memory, searches simply won't find anything
+		if(corpus == NULL)
+		{
+			NSLog(@"Unable to create iTunes search corpus");
+			corpus = calloc(1, sizeof(ITunesSearchCorpus));
+		}
+	}
+	
+	[self startIndexing];
+	
+	[lock unlock];
+	
+	return corpus;
+}
+
+/**
+ Returns the trigram index of the corpus, or NULL if it hasn't been built (yet).
+ The index returns identical results to a scan, so searches may start using it at any time.
+**/
+- (const ITunesTrigramIndex *)trigramIndex
+{
+	[lock lock];
+	const ITunesTrigramIndex *index = trigramIndex;
+	[lock unlock];
+	
+	return index;
+}
+
+// TRIGRAM INDEX
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Starts building the trigram index of the corpus on a background thread, unless it's been built (or started) already.
+ The lock must be held.
+**/
+- (void)startIndexing
+{
+	if(isIndexing || (trigramIndex != NULL)) return;
+	if((corpus == NULL) || (corpus->rowsCount < TRIGRAM_INDEX_MIN_TRACKS)) return;
+	
+	isIndexing = YES;
+	
+	// The thread retains us, so the corpus can't be freed while it's being indexed
+	[NSThread detachNewThreadSelector:@selector(indexingThread:) toTarget:self withObject:nil];
+}
+
+/**
+ Background thread method.
+ Builds the trigram index of the corpus, which every window's searches then use.
+**/
+- (void)indexingThread:(id)sender
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	NSDate *start = [NSDate date];
+	ITunesTrigramIndex *index = ITunesTrigramIndexCreate(corpus);
+	
+	if(index != NULL)
+	{
+		NSLog(@"Built trigram index: %.1f ms, %u KB", [start timeIntervalSinceNow] * -1000.0,
+			  (unsigned)(ITunesTrigramIndexSize(index) / 1024));
+	}
+	else
+	{
+		NSLog(@"Unable to build trigram index");
+	}
+	
+	[lock lock];
+	trigramIndex = index;
+	isIndexing = NO;
+	[lock unlock];
+	
+	[pool release];
+}
+
+@end
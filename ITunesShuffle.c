@@ -0,0 +1,186 @@
+#include "ITunesShuffle.h"
+
+#include <stdlib.h>
+
+// RANDOM
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline uint32_t RotateLeft(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+/**
+ Seeds the generator. Any seed (including zero) is fine.
+ The seed is spread over the state with splitmix64, so similar seeds still give unrelated sequences.
+**/
+void ITunesRandomSeed(ITunesRandom *random, uint64_t seed)
+{
+	int i;
+	for(i = 0; i < 2; i++)
+	{
+		seed += 0x9E3779B97F4A7C15ULL;
+		
+		uint64_t z = seed;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z = z ^ (z >> 31);
+		
+		random->s[i * 2]     = (uint32_t)z;
+		random->s[i * 2 + 1] = (uint32_t)(z >> 32);
+	}
+}
+
+/**
+ Returns the next number of the xoshiro128** sequence.
+**/
+uint32_t ITunesRandomNext(ITunesRandom *random)
+{
+	uint32_t *s = random->s;
+	uint32_t result = RotateLeft(s[1] * 5, 7) * 9;
+	uint32_t t = s[1] << 9;
+	
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	
+	s[2] ^= t;
+	s[3] = RotateLeft(s[3], 11);
+	
+	return result;
+}
+
+/**
+ Returns a number in 0 ..< bound, without the bias of a plain modulo.
+ The bound must not be zero.
+**/
+uint32_t ITunesRandomBelow(ITunesRandom *random, uint32_t bound)
+{
+	// Numbers below the threshold would make the low results slightly more likely
+	uint32_t threshold = (0 - bound) % bound;
+	uint32_t x;
+	
+	do
+	{
+		x = ITunesRandomNext(random);
+	}
+	while(x < threshold);
+	
+	return x % bound;
+}
+
+// SHUFFLE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ITunesShuffle * ITunesShuffleCreate(uint64_t seed)
+{
+	ITunesShuffle *shuffle = calloc(1, sizeof(ITunesShuffle));
+	if(shuffle == NULL) return NULL;
+	
+	ITunesRandomSeed(&shuffle->random, seed);
+	return shuffle;
+}
+
+void ITunesShuffleFree(ITunesShuffle *shuffle)
+{
+	if(shuffle == NULL) return;
+	
+	free(shuffle->order);
+	free(shuffle);
+}
+
+/**
+ Reseeds the generator, and puts the order back in playlist order,
+ so the following shuffles are the same as those of a new shuffle created with the given seed.
+**/
+void ITunesShuffleSeed(ITunesShuffle *shuffle, uint64_t seed)
+{
+	ITunesRandomSeed(&shuffle->random, seed);
+	ITunesShuffleSetCount(shuffle, shuffle->count);
+}
+
+/**
+ Sets the number of items in the playlist, and puts the order back in playlist order.
+ Nothing is drawn yet, so the first positions asked for will be shuffled.
+ Returns 0 if out of memory (the previous count is kept).
+**/
+int ITunesShuffleSetCount(ITunesShuffle *shuffle, uint32_t count)
+{
+	if(count > shuffle->capacity)
+	{
+		int32_t *order = realloc(shuffle->order, count * sizeof(int32_t));
+		if(order == NULL) return 0;
+		
+		shuffle->order = order;
+		shuffle->capacity = count;
+	}
+	
+	uint32_t i;
+	for(i = 0; i < count; i++)
+	{
+		shuffle->order[i] = (int32_t)i;
+	}
+	
+	shuffle->count = count;
+	shuffle->drawnCount = 0;
+	return 1;
+}
+
+/**
+ Starts over with a new order. This is O(1), as nothing is drawn until it's needed.
+
+ The new order doesn't depend on the previous one: Fisher-Yates gives a uniform permutation
+ whatever permutation it starts from.
+**/
+void ITunesShuffleReshuffle(ITunesShuffle *shuffle)
+{
+	shuffle->drawnCount = 0;
+}
+
+/**
+ Draws the positions of the order up to the given count (which is clipped to the number of items).
+ Drawing everything is a complete Fisher-Yates shuffle.
+**/
+void ITunesShuffleDraw(ITunesShuffle *shuffle, uint32_t count)
+{
+	if(count > shuffle->count)
+	{
+		count = shuffle->count;
+	}
+	
+	int32_t *order = shuffle->order;
+	uint32_t i;
+	
+	for(i = shuffle->drawnCount; i < count; i++)
+	{
+		// Swap a random item from the undrawn ones into position i
+		uint32_t j = i + ITunesRandomBelow(&shuffle->random, shuffle->count - i);
+		
+		int32_t temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+	
+	if(count > shuffle->drawnCount)
+	{
+		shuffle->drawnCount = count;
+	}
+}
+
+/**
+ Returns the index in the playlist of the item played at the given position of the shuffled order,
+ or -1 if the position is out of range.
+ Positions that haven't been drawn yet are drawn first, so asking for the next position costs O(1).
+**/
+int32_t ITunesShuffleIndex(ITunesShuffle *shuffle, uint32_t position)
+{
+	if(position >= shuffle->count) return -1;
+	
+	if(position >= shuffle->drawnCount)
+	{
+		ITunesShuffleDraw(shuffle, position + 1);
+	}
+	
+	return shuffle->order[position];
+}
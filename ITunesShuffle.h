@@ -0,0 +1,54 @@
+/**
+ Shuffled play order of a playlist.
+
+ The player used to shuffle a playlist by repeatedly removing a random item from an array of numbers,
+ which costs O(n^2) moves, and was done again every time the playlist wrapped around.
+
+ Instead, the order is kept as a permutation of the positions in the playlist (an array of int32),
+ which is shuffled with the Fisher-Yates algorithm, in O(n).
+ The shuffle is also lazy: reshuffling only forgets the order, and positions are drawn as they're asked for,
+ so starting over with a new order costs nothing, no matter how long the playlist is.
+
+ Each shuffle has it's own random number generator (xoshiro128**, which only needs 32 bit arithmetic),
+ so a given seed always produces the same orders.
+**/
+
+#ifndef ITUNES_SHUFFLE_H
+#define ITUNES_SHUFFLE_H
+
+#include <stdint.h>
+
+typedef struct ITunesRandom
+{
+	uint32_t s[4];
+} ITunesRandom;
+
+typedef struct ITunesShuffle
+{
+	// A permutation of 0 ..< count
+	int32_t *order;
+	uint32_t count;
+	uint32_t capacity;
+	
+	// Number of positions (from the start of order) that have been drawn since the last reshuffle
+	uint32_t drawnCount;
+	
+	ITunesRandom random;
+} ITunesShuffle;
+
+void     ITunesRandomSeed(ITunesRandom *random, uint64_t seed);
+uint32_t ITunesRandomNext(ITunesRandom *random);
+uint32_t ITunesRandomBelow(ITunesRandom *random, uint32_t bound);
+
+ITunesShuffle * ITunesShuffleCreate(uint64_t seed);
+void ITunesShuffleFree(ITunesShuffle *shuffle);
+
+void ITunesShuffleSeed(ITunesShuffle *shuffle, uint64_t seed);
+int  ITunesShuffleSetCount(ITunesShuffle *shuffle, uint32_t count);
+
+void ITunesShuffleReshuffle(ITunesShuffle *shuffle);
+void ITunesShuffleDraw(ITunesShuffle *shuffle, uint32_t count);
+
+int32_t ITunesShuffleIndex(ITunesShuffle *shuffle, uint32_t position);
+
+#endif
@@ -0,0 +1,396 @@
+#include "ITunesSnapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC      "ACITLIB\0"
+#define SNAPSHOT_VERSION    2
+#define SNAPSHOT_BYTEORDER  0x01020304
+
+// Sections are aligned so the records may be used directly from the mapping
+#define SNAPSHOT_ALIGNMENT  8
+
+// Number of hash indexes stored in the snapshot
+#define SNAPSHOT_INDEXES    4
+
+typedef struct ITunesSnapshotIndex
+{
+	uint32_t mask;
+	uint32_t count;
+	uint64_t offset;
+} ITunesSnapshotIndex;
+
+typedef struct ITunesSnapshotHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	
+	// Identifies the XML file the snapshot was created from
+	uint64_t pathHash;
+	int64_t  modified;
+	int64_t  size;
+	
+	uint32_t tracksCount;
+	uint32_t playlistsCount;
+	uint32_t itemsCount;
+	uint32_t stringsLength;
+	
+	ITunesStringRef libraryPersistentID;
+	ITunesStringRef musicFolder;
+	
+	uint64_t tracksOffset;
+	uint64_t playlistsOffset;
+	uint64_t itemsOffset;
+	uint64_t stringsOffset;
+	uint64_t fileLength;
+	
+	// Hash indexes, in the order returned by LibraryIndexes()
+	ITunesSnapshotIndex indexes[SNAPSHOT_INDEXES];
+	
+	// Checksum of all the header fields above
+	uint64_t checksum;
+} ITunesSnapshotHeader;
+
+/**
+ 64 bit FNV-1a hash.
+**/
+static uint64_t Hash(const void *bytes, size_t length)
+{
+	const unsigned char *p = bytes;
+	uint64_t hash = 14695981039346656037ULL;
+	
+	size_t i;
+	for(i = 0; i < length; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static uint64_t Align(uint64_t offset)
+{
+	return (offset + (SNAPSHOT_ALIGNMENT - 1)) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+}
+
+static void LibraryIndexes(ITunesLibrary *lib, ITunesHashTable *indexes[SNAPSHOT_INDEXES])
+{
+	indexes[0] = &lib->trackIndex;
+	indexes[1] = &lib->trackPersistentIndex;
+	indexes[2] = &lib->playlistIndex;
+	indexes[3] = &lib->playlistPersistentIndex;
+}
+
+// KEY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Fills in the snapshot key for the given XML file.
+ Returns 0 if the file doesn't exist.
+**/
+int ITunesSnapshotKeyForFile(const char *xmlPath, ITunesSnapshotKey *key)
+{
+	struct stat st;
+	if((xmlPath == NULL) || (stat(xmlPath, &st) != 0)) return 0;
+	
+	key->pathHash = Hash(xmlPath, strlen(xmlPath));
+	key->modified = (int64_t)st.st_mtime;
+	key->size     = (int64_t)st.st_size;
+	
+	return 1;
+}
+
+// WRITING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int WriteSection(FILE *f, uint64_t *position, uint64_t offset, const void *bytes, size_t length)
+{
+	static const char zeros[SNAPSHOT_ALIGNMENT] = {0};
+	
+	if(offset > *position)
+	{
+		if(fwrite(zeros, 1, (size_t)(offset - *position), f) != (size_t)(offset - *position)) return 0;
+	}
+	if((length > 0) && (fwrite(bytes, 1, length, f) != length)) return 0;
+	
+	*position = offset + length;
+	return 1;
+}
+
+/**
+ Writes a snapshot of the given library.
+
+ The snapshot is written to a temporary file, which then replaces the snapshot file.
+ This way a snapshot is never seen half written, even if multiple processes or threads write it at the same time.
+ Returns 0 on failure, in which case there is no snapshot at all.
+**/
+int ITunesSnapshotWrite(const char *snapshotPath, const ITunesSnapshotKey *key, const ITunesLibrary *lib)
+{
+	ITunesSnapshotHeader header;
+	memset(&header, 0, sizeof(ITunesSnapshotHeader));
+	
+	memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+	header.version   = SNAPSHOT_VERSION;
+	header.byteOrder = SNAPSHOT_BYTEORDER;
+	
+	header.pathHash = key->pathHash;
+	header.modified = key->modified;
+	header.size     = key->size;
+	
+	header.tracksCount    = lib->tracksCount;
+	header.playlistsCount = lib->playlistsCount;
+	header.itemsCount     = lib->itemsCount;
+	header.stringsLength  = lib->stringsLength;
+	
+	header.libraryPersistentID = lib->libraryPersistentID;
+	header.musicFolder         = lib->musicFolder;
+	
+	header.tracksOffset    = Align(sizeof(ITunesSnapshotHeader));
+	header.playlistsOffset = Align(header.tracksOffset + (uint64_t)lib->tracksCount * sizeof(ITunesTrack));
+	header.itemsOffset     = Align(header.playlistsOffset + (uint64_t)lib->playlistsCount * sizeof(ITunesPlaylist));
+	
+	uint64_t offset = Align(header.itemsOffset + (uint64_t)lib->itemsCount * sizeof(int32_t));
+	
+	ITunesHashTable *indexes[SNAPSHOT_INDEXES];
+	LibraryIndexes((ITunesLibrary *)lib, indexes);
+	
+	int i;
+	for(i = 0; i < SNAPSHOT_INDEXES; i++)
+	{
+		header.indexes[i].mask   = indexes[i]->mask;
+		header.indexes[i].count  = indexes[i]->count;
+		header.indexes[i].offset = offset;
+		
+		if(indexes[i]->slots != NULL)
+		{
+			offset = Align(offset + ((uint64_t)indexes[i]->mask + 1) * sizeof(ITunesHashSlot));
+		}
+	}
+	
+	header.stringsOffset   = offset;
+	header.fileLength      = header.stringsOffset + lib->stringsLength;
+	
+	header.checksum = Hash(&header, offsetof(ITunesSnapshotHeader, checksum));
+	
+	size_t pathLength = strlen(snapshotPath);
+	char *tempPath = malloc(pathLength + 8);
+	if(tempPath == NULL) return 0;
+	
+	memcpy(tempPath, snapshotPath, pathLength);
+	memcpy(tempPath + pathLength, ".XXXXXX", 8);
+	
+	int fd = mkstemp(tempPath);
+	if(fd < 0)
+	{
+		free(tempPath);
+		return 0;
+	}
+	
+	FILE *f = fdopen(fd, "wb");
+	if(f == NULL)
+	{
+		close(fd);
+		unlink(tempPath);
+		free(tempPath);
+		return 0;
+	}
+	
+	uint64_t position = 0;
+	int result = WriteSection(f, &position, 0, &header, sizeof(ITunesSnapshotHeader)) &&
+	             WriteSection(f, &position, header.tracksOffset,
+	                          lib->tracks, lib->tracksCount * sizeof(ITunesTrack)) &&
+	             WriteSection(f, &position, header.playlistsOffset,
+	                          lib->playlists, lib->playlistsCount * sizeof(ITunesPlaylist)) &&
+	             WriteSection(f, &position, header.itemsOffset,
+	                          lib->items, lib->itemsCount * sizeof(int32_t));
+	
+	for(i = 0; i < SNAPSHOT_INDEXES && result; i++)
+	{
+		if(indexes[i]->slots != NULL)
+		{
+			result = WriteSection(f, &position, header.indexes[i].offset,
+			                      indexes[i]->slots, (indexes[i]->mask + 1) * sizeof(ITunesHashSlot));
+		}
+	}
+	
+	result = result && WriteSection(f, &position, header.stringsOffset, lib->strings, lib->stringsLength);
+	
+	if(fclose(f) != 0) result = 0;
+	
+	if(result)
+	{
+		chmod(tempPath, 0644);
+		result = (rename(tempPath, snapshotPath) == 0);
+	}
+	if(!result)
+	{
+		unlink(tempPath);
+	}
+	
+	free(tempPath);
+	return result;
+}
+
+// READING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int SectionIsValid(const ITunesSnapshotHeader *header, uint64_t offset, uint64_t count, size_t elementSize)
+{
+	if((offset % SNAPSHOT_ALIGNMENT) != 0) return 0;
+	if(offset < sizeof(ITunesSnapshotHeader)) return 0;
+	if(offset > header->fileLength) return 0;
+	
+	return (count * elementSize) <= (header->fileLength - offset);
+}
+
+/**
+ Verifies every reference within the snapshot, so a corrupt snapshot can never cause out of bounds reads.
+ This touches the track and playlist records once, but not the (much bigger) string pool.
+**/
+static int SnapshotIsValid(const ITunesSnapshotHeader *header, const char *base)
+{
+	if(!SectionIsValid(header, header->tracksOffset, header->tracksCount, sizeof(ITunesTrack))) return 0;
+	if(!SectionIsValid(header, header->playlistsOffset, header->playlistsCount, sizeof(ITunesPlaylist))) return 0;
+	if(!SectionIsValid(header, header->itemsOffset, header->itemsCount, sizeof(int32_t))) return 0;
+	if(!SectionIsValid(header, header->stringsOffset, header->stringsLength, 1)) return 0;
+	
+	// The hash tables must have a power of two size
+	// Lookups verify the record they find, so the contents of the tables needn't be checked here
+	int j;
+	for(j = 0; j < SNAPSHOT_INDEXES; j++)
+	{
+		uint64_t capacity = (uint64_t)header->indexes[j].mask + 1;
+		
+		if((capacity & (capacity - 1)) != 0) return 0;
+		if(!SectionIsValid(header, header->indexes[j].offset, capacity, sizeof(ITunesHashSlot))) return 0;
+	}
+	
+	uint32_t stringsLength = header->stringsLength;
+	const char *strings = base + header->stringsOffset;
+	
+	// The pool must start with the empty string, and end with a terminator
+	if((stringsLength == 0) || (strings[0] != '\0') || (strings[stringsLength - 1] != '\0')) return 0;
+	
+	if(header->libraryPersistentID >= stringsLength) return 0;
+	if(header->musicFolder >= stringsLength) return 0;
+	
+	const ITunesTrack *tracks = (const ITunesTrack *)(base + header->tracksOffset);
+	uint32_t i;
+	for(i = 0; i < header->tracksCount; i++)
+	{
+		const ITunesTrack *track = &tracks[i];
+		
+		if((track->name >= stringsLength) || (track->artist >= stringsLength) ||
+		   (track->album >= stringsLength) || (track->location >= stringsLength))
+		{
+			return 0;
+		}
+	}
+	
+	const ITunesPlaylist *playlists = (const ITunesPlaylist *)(base + header->playlistsOffset);
+	for(i = 0; i < header->playlistsCount; i++)
+	{
+		const ITunesPlaylist *playlist = &playlists[i];
+		
+		if(playlist->name >= stringsLength) return 0;
+		if(playlist->itemsOffset > header->itemsCount) return 0;
+		if(playlist->itemsCount > header->itemsCount - playlist->itemsOffset) return 0;
+	}
+	
+	return 1;
+}
+
+/**
+ Opens the snapshot at the given path, if it matches the given key.
+
+ The returned library references the mapped snapshot directly, and must not be modified.
+ Returns NULL if the snapshot doesn't exist, is stale, or is corrupt.
+**/
+ITunesLibrary * ITunesSnapshotOpen(const char *snapshotPath, const ITunesSnapshotKey *key)
+{
+	int fd = open(snapshotPath, O_RDONLY);
+	if(fd < 0) return NULL;
+	
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(ITunesSnapshotHeader)))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	// Check the header before mapping the whole file
+	ITunesSnapshotHeader header;
+	if(read(fd, &header, sizeof(ITunesSnapshotHeader)) != sizeof(ITunesSnapshotHeader))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	int isCurrent = (memcmp(header.magic, SNAPSHOT_MAGIC, 8) == 0) &&
+	                (header.version == SNAPSHOT_VERSION) &&
+	                (header.byteOrder == SNAPSHOT_BYTEORDER) &&
+	                (header.checksum == Hash(&header, offsetof(ITunesSnapshotHeader, checksum))) &&
+	                (header.fileLength == (uint64_t)st.st_size) &&
+	                (header.pathHash == key->pathHash) &&
+	                (header.modified == key->modified) &&
+	                (header.size == key->size);
+	
+	if(!isCurrent)
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	size_t length = (size_t)st.st_size;
+	char *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if(map == MAP_FAILED) return NULL;
+	
+	if(!SnapshotIsValid(&header, map))
+	{
+		munmap(map, length);
+		return NULL;
+	}
+	
+	ITunesLibrary *lib = calloc(1, sizeof(ITunesLibrary));
+	if(lib == NULL)
+	{
+		munmap(map, length);
+		return NULL;
+	}
+	
+	lib->tracks         = (ITunesTrack *)(map + header.tracksOffset);
+	lib->tracksCount    = header.tracksCount;
+	lib->playlists      = (ITunesPlaylist *)(map + header.playlistsOffset);
+	lib->playlistsCount = header.playlistsCount;
+	lib->items          = (int32_t *)(map + header.itemsOffset);
+	lib->itemsCount     = header.itemsCount;
+	lib->strings        = map + header.stringsOffset;
+	lib->stringsLength  = header.stringsLength;
+	
+	lib->libraryPersistentID = header.libraryPersistentID;
+	lib->musicFolder         = header.musicFolder;
+	
+	ITunesHashTable *indexes[SNAPSHOT_INDEXES];
+	LibraryIndexes(lib, indexes);
+	
+	int i;
+	for(i = 0; i < SNAPSHOT_INDEXES; i++)
+	{
+		indexes[i]->slots = (ITunesHashSlot *)(map + header.indexes[i].offset);
+		indexes[i]->mask  = header.indexes[i].mask;
+		indexes[i]->count = header.indexes[i].count;
+	}
+	
+	lib->mapping       = map;
+	lib->mappingLength = length;
+	
+	return lib;
+}
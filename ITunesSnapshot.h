@@ -0,0 +1,30 @@
+/**
+ Binary snapshot of a parsed iTunes library.
+
+ Parsing the "iTunes Music Library.xml" file is only necessary when the file has changed.
+ After a parse, the library records are written to a snapshot file, along with the path, modification date and size
+ of the XML file they came from. The next time the library is needed, and the XML file hasn't changed,
+ the snapshot is simply memory mapped. No parsing or copying is required.
+
+ The snapshot is versioned, and written in native byte order.
+ Snapshots that are stale, from a different version, from a different architecture, or corrupt are ignored.
+**/
+
+#ifndef ITUNES_SNAPSHOT_H
+#define ITUNES_SNAPSHOT_H
+
+#include "ITunesLibrary.h"
+
+typedef struct ITunesSnapshotKey
+{
+	uint64_t pathHash;
+	int64_t  modified;
+	int64_t  size;
+} ITunesSnapshotKey;
+
+int ITunesSnapshotKeyForFile(const char *xmlPath, ITunesSnapshotKey *key);
+
+ITunesLibrary * ITunesSnapshotOpen(const char *snapshotPath, const ITunesSnapshotKey *key);
+int ITunesSnapshotWrite(const char *snapshotPath, const ITunesSnapshotKey *key, const ITunesLibrary *lib);
+
+#endif
@@ -1,21 +1,63 @@
 #import <Cocoa/Cocoa.h>
 #import "ITunesData.h"
+#import "ITunesSearchCache.h"
 
+// Posted (on the main thread) when a search started with searchInBackground: has updated the table
+#define ITunesTableSearchDidFinishNotification  @"ITunesTableSearchDidFinish"
+
+/**
+ A view of the shared library for a single editor window: the current playlist, search and search results.
+ The track store, search corpus and trigram index are shared with every other window (see ITunesSharedLibrary).
+**/
 @interface ITunesTable : ITunesData
 {
-	// Holds the indexes of the tracks currently being displayed
+	// Rows (track indexes in the library) of the current playlist
+	int32_t *playlistRows;
+	int playlistRowsCount;
+	
+	// Rows of the tracks currently being displayed (a subset of the playlist rows, in the same order)
+	int32_t *rows;
+	int rowsCount;
+	
+	// Array view of the rows (as trackIDs)
 	NSArray *table;
 	
 	// Current playlist index
 	int playlistIndex;
 	
-	// Search cache
-	NSMutableArray *strCache;
-	NSMutableArray *cache;
+	// Current search criteria (nil if not searching)
+	NSString *searchCriteria;
+	
+	// Track ID, name, artist and duration columns of the shared library, used for displaying the table
+	const ITunesTrackStore *trackStore;
+	
+	// Folded name, artist and album columns of the shared library, used for searching
+	const ITunesSearchCorpus *corpus;
+	
+	// Search results for the current playlist, used to refine results while the user types
+	ITunesSearchCache *searchCache;
+	
+	// Held while searching, and while changing anything a search uses (playlist rows, shared library and cache)
+	NSLock *searchLock;
+	
+	// Incremented (on the main thread) by every search and playlist change
+	// Searches still running for an older generation have been superseded, and cancel themselves
+	volatile uint32_t searchGeneration;
+	
+	// Number of threads each search is split across
+	uint32_t searchThreadsCount;
 }
 
 - (NSArray *)table;
+- (int)numberOfRows;
+- (int)trackIDAtRow:(int)row;
+- (NSString *)nameAtRow:(int)row;
+- (NSString *)artistAtRow:(int)row;
+- (NSString *)durationAtRow:(int)row;
+
+- (int)playlistIndex;
 - (void)setPlaylist:(int)index;
 - (void)setSearchCriteria:(NSString *)searchStr;
+- (void)searchInBackground:(NSString *)searchStr;
 
 @end
@@ -1,5 +1,11 @@
 #import "ITunesTable.h"
+#import <unistd.h>
 
+// Maximum size of the search cache
+#define SEARCH_CACHE_BYTES  (4 * 1024 * 1024)
+
+// Upper limit on the threads a single search is split across
+#define SEARCH_MAX_THREADS  8
 
 // Declare private methods
 @interface ITunesTable (PrivateAPI)
@@ -7,13 +13,64 @@
 // Private Methods
 - (void)resetPlaylist;
 
+// Searching
+- (uint32_t)filterPlaylist:(NSString *)searchStr into:(int32_t *)result generation:(uint32_t)generation;
+- (void)searchThread:(NSDictionary *)search;
+- (void)searchDidFinish:(NSDictionary *)search;
+
 // Search Cache
-- (BOOL)searchCache:(NSString *)criteria;
-- (void)addToCache:(NSString *)criteria array:(NSArray *)result;
 - (void)clearCache;
 
 @end
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Table Array:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ An immutable array view of the rows currently being displayed.
+ Each object is an NSNumber containing the trackID of the row, created on demand.
+
+ This view is cached by (and does not retain) the ITunesTable, so it's only valid as long as it is.
+**/
+@interface ITunesTableArray : NSArray
+{
+	ITunesTable *data;
+}
+- (id)initWithITunesTable:(ITunesTable *)owner;
+@end
+
+@implementation ITunesTableArray
+
+- (id)initWithITunesTable:(ITunesTable *)owner
+{
+	if(self = [super init])
+	{
+		data = owner;
+	}
+	return self;
+}
+
+- (unsigned)count
+{
+	return [data numberOfRows];
+}
+
+- (id)objectAtIndex:(unsigned)index
+{
+	if(index >= [data numberOfRows])
+	{
+		[NSException raise:NSRangeException format:@"Index %u beyond bounds [0 .. %i]", index, [data numberOfRows] - 1];
+	}
+	return [NSNumber numberWithInt:[data trackIDAtRow:index]];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark ITunesTable:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 @implementation ITunesTable
 
 /*!
@@ -24,12 +81,24 @@
 {
 	if(self = [super init])
 	{
+		// Split searches across every processor
+		searchLock = [[NSLock alloc] init];
+		
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		searchThreadsCount = (processors > 1) ? MIN(processors, SEARCH_MAX_THREADS) : 1;
+		
+		// The displayed columns, and folded searchable columns, are shared with every other window
+		// They're only built if no other window has built them already
+		trackStore = [[self sharedLibrary] trackStore];
+		corpus = [[self sharedLibrary] corpus];
+		
+		// Initialize search cache
+		searchCache = ITunesSearchCacheCreate(SEARCH_CACHE_BYTES);
+		
 		// Set current table to be entire library
 		[self setPlaylist:0];
 		
-		// Initialize search cache
-		cache = [[NSMutableArray alloc] initWithCapacity:20];
-		strCache = [[NSMutableArray alloc] initWithCapacity:20];
+		table = [[ITunesTableArray alloc] initWithITunesTable:self];
 	}
 	return self;
 }
@@ -42,8 +111,11 @@
 {
 	// NSLog(@"Destroying %@", self);
 	[table release];
-	[cache release];
-	[strCache release];
+	[searchCriteria release];
+	ITunesSearchCacheFree(searchCache);
+	free(playlistRows);
+	free(rows);
+	[searchLock release];
 	[super dealloc];
 }
 
@@ -51,11 +123,15 @@
 /*!
  @abstract   Returns table that is currently being displayed.
  @discussion
- 
+
  The table represents the table that is currently being displayed.
  It may be a subset of the entire library, such as a playlist,
  or even a subset of the playlist, such as when the user is searching for something.
- When writing the table display code, use this method to access the displayable rows.
+ Each object in the table is an NSNumber containing a trackID.
+
+ The table is a view of the current rows, so it always reflects the current playlist and search.
+ Use numberOfRows and trackIDAtRow: to avoid creating the NSNumber objects,
+ and nameAtRow:, artistAtRow: and durationAtRow: to display the rows.
 */
 - (NSArray *)table
 {
@@ -63,12 +139,87 @@
 }
 
 
+/*!
+ Returns the number of rows currently being displayed.
+*/
+- (int)numberOfRows
+{
+	return rowsCount;
+}
+
+
+/*!
+ Returns the trackID of the given row, or -1 if the row is invalid.
+*/
+- (int)trackIDAtRow:(int)row
+{
+	if((row < 0) || (row >= rowsCount))
+	{
+		return -1;
+	}
+	if(trackStore == NULL)
+	{
+		return [self library]->tracks[rows[row]].trackID;
+	}
+	return trackStore->trackIDs[rows[row]];
+}
+
+
+/*!
+ Returns the name of the track at the given row, or nil if the row is invalid.
+ The string is cached, so displaying the table doesn't allocate anything once every row has been shown.
+*/
+- (NSString *)nameAtRow:(int)row
+{
+	if((row < 0) || (row >= rowsCount) || (trackStore == NULL))
+	{
+		return nil;
+	}
+	return [[self sharedLibrary] trackStringForHandle:trackStore->names[rows[row]]];
+}
+
+
+/*!
+ Returns the artist of the track at the given row, or nil if the row is invalid.
+*/
+- (NSString *)artistAtRow:(int)row
+{
+	if((row < 0) || (row >= rowsCount) || (trackStore == NULL))
+	{
+		return nil;
+	}
+	return [[self sharedLibrary] trackStringForHandle:trackStore->artists[rows[row]]];
+}
+
+
+/*!
+ Returns the duration of the track at the given row, formatted as "m:ss", or nil if the row is invalid.
+*/
+- (NSString *)durationAtRow:(int)row
+{
+	if((row < 0) || (row >= rowsCount) || (trackStore == NULL))
+	{
+		return nil;
+	}
+	return [[self sharedLibrary] trackStringForHandle:trackStore->durations[rows[row]]];
+}
+
+
+/*!
+ Returns the index of the playlist currently being displayed.
+*/
+- (int)playlistIndex
+{
+	return playlistIndex;
+}
+
+
 /*!
  Sets the table to be the indicated playlist.
- 
+
  The displayable table is reset to contain all track in the specified playlist.
  The search cache is also cleared so incorrect cache hits to not occur.
- 
+
  @param  index - Index (in array) of playlist to use.
  @result Table now contains all tracks in specified playlist.
 */
@@ -77,46 +228,68 @@
 	// Store playlist index
 	playlistIndex = index;
 	
+	// Switching playlists ends any search (including any still running in the background)
+	[searchCriteria release];
+	searchCriteria = nil;
+	
+	searchGeneration++;
+	[searchLock lock];
+	
+	// Convert the trackIDs of the playlist into rows
+	// Tracks that are missing from the library are skipped
+	const ITunesLibrary *lib = [self library];
+	
+	int count;
+	const int32_t *trackIDs = [self trackIDsForPlaylistIndex:playlistIndex count:&count];
+	
+	free(playlistRows);
+	free(rows);
+	playlistRows = malloc((count + 1) * sizeof(int32_t));
+	rows = malloc((count + 1) * sizeof(int32_t));
+	playlistRowsCount = 0;
+	
+	int i;
+	for(i = 0; i < count; i++)
+	{
+		const ITunesTrack *track = ITunesLibraryTrackForID(lib, trackIDs[i]);
+		if(track != NULL)
+		{
+			playlistRows[playlistRowsCount++] = track - lib->tracks;
+		}
+	}
+	
 	// Setup current table to be the entire playlist
 	[self resetPlaylist];
 	
 	// Clear the search cache
 	// This is so that repeat searches in different playlists don't result in incorrect cache hits
 	[self clearCache];
+	
+	[searchLock unlock];
 }
 
 
 /*!
  Resets the table to be the entire current playlist.
- 
+
  @result Table now contains all tracks in current playlist.
 */
 - (void)resetPlaylist
 {
-	NSMutableArray *temp = [NSMutableArray array];
-	
-	NSArray *tracks = [[self playlistForIndex:playlistIndex] objectForKey:PLAYLIST_ITEMS];
-	int i;
-	for(i=0; i<[tracks count]; i++)
-	{
-		NSNumber *trackID = [[tracks objectAtIndex:i] objectForKey:TRACK_ID];
-		[temp addObject:trackID];
-	}
-	
-	[table release];
-	table = [temp retain];
+	memcpy(rows, playlistRows, playlistRowsCount * sizeof(int32_t));
+	rowsCount = playlistRowsCount;
 }
 
 
 /*!
- @abstract   Sets the table to be the indicated playlist.
+ @abstract   Filters the table using the given search string.
  @discussion
- 
- The displayable table is reset to contain all track in the specified playlist.
- The search cache is also cleared so incorrect cache hits to not occur.
- 
- @param  index - Index (in array) of playlist to use.
- @result Table now contains all tracks in specified playlist.
+
+ The search string is split into words, and the table is reset to contain only the tracks in the current playlist
+ where every word appears in the name, artist or album. Case and diacritics are ignored.
+
+ @param  searchStr - The string typed into the search field.
+ @result Table now contains the matching tracks in the current playlist.
 */
 - (void)setSearchCriteria:(NSString *)searchStr
 {
@@ -127,102 +300,204 @@
 		return;
 	}
 	
-	// Search cache
-	if([self searchCache:searchStr])
+	// Remember the search, so it may be redone if the library changes
+	[searchCriteria autorelease];
+	searchCriteria = [searchStr copy];
+	
+	// Filter the entire playlist
+	// The words are folded and split within the search itself
+	// If the search extends an earlier one (the user is typing), only the earlier results are filtered
+	// Once the trigram index has been built, it's used to find candidate rows instead of scanning them all
+	// Any search still running in the background is superseded
+	// Only the main thread supersedes searches, so this one is never cancelled
+	searchGeneration++;
+	[searchLock lock];
+	
+	rowsCount = [self filterPlaylist:searchStr into:rows generation:searchGeneration];
+	
+	[searchLock unlock];
+}
+
+
+/*!
+ @abstract   Filters the table using the given search string, on a background thread.
+ @discussion
+
+ Same as setSearchCriteria:, except the search runs on a background thread, so the user can keep typing
+ while large playlists are searched. Each call supersedes (and cancels) any search still running,
+ so only the results of the latest search are ever put into the table.
+
+ An ITunesTableSearchDidFinishNotification is posted on the main thread once the table has been updated.
+ Must be invoked on the main thread.
+
+ @param  searchStr - The string typed into the search field.
+*/
+- (void)searchInBackground:(NSString *)searchStr
+{
+	// Clearing the search is immediate
+	if([searchStr isEqualToString:@""])
 	{
-		// A Cache Hit occured
-		// The cache method already took care of updating the table
+		[self setPlaylist:playlistIndex];
+		[[NSNotificationCenter defaultCenter] postNotificationName:ITunesTableSearchDidFinishNotification object:self];
 		return;
 	}
 	
-	// Reset the table to the entire playlist for searching
-	[self resetPlaylist];
+	// Remember the search right away, so it's redone if the library changes before it finishes
+	[searchCriteria autorelease];
+	searchCriteria = [searchStr copy];
+	
+	searchGeneration++;
+	
+	NSDictionary *search = [NSDictionary dictionaryWithObjectsAndKeys:
+		searchCriteria, @"Criteria",
+		[NSNumber numberWithUnsignedInt:searchGeneration], @"Generation", nil];
+	
+	// Note that the thread retains us until it's finished
+	[NSThread detachNewThreadSelector:@selector(searchThread:) toTarget:self withObject:search];
+}
+
+// SEARCHING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ Filters the rows of the current playlist using the given search string, writing the matching rows to result.
+ The search is split across every processor, and cancelled if the search generation changes from the given one.
+
+ The search lock must be held.
+
+ @result The number of matching rows, or ITUNES_SEARCH_CANCELLED.
+*/
+- (uint32_t)filterPlaylist:(NSString *)searchStr into:(int32_t *)result generation:(uint32_t)generation
+{
+	const char *query = [searchStr UTF8String];
+	ITunesSearchOptions options = { searchThreadsCount, &searchGeneration, generation };
+	
+	// The trigram index is built in the background, and used as soon as it's ready
+	const ITunesTrigramIndex *trigramIndex = [[self sharedLibrary] trigramIndex];
+	
+	if(searchCache)
+		return ITunesSearchCacheFilter(searchCache, corpus, trigramIndex, &options, query, strlen(query),
+									   playlistRows, playlistRowsCount, result);
+	else
+		return ITunesTrigramIndexFilter(trigramIndex, corpus, &options, query, strlen(query),
+										playlistRows, playlistRowsCount, result);
+}
+
+/*!
+ Background thread method.
+ Runs the given search, unless it's been superseded, and hands the results over to the main thread.
+
+ The results are written to a buffer of our own, as the main thread is free to display the table meanwhile.
+*/
+- (void)searchThread:(NSDictionary *)search
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 	
-	// Seperate searchStr by its components - IE: ["John", "Mayer", "Wonderland"]
-	NSArray *temp = [searchStr componentsSeparatedByString:@" "];
+	uint32_t generation = [[search objectForKey:@"Generation"] unsignedIntValue];
 	
-	// For some bizarre reason, temp contains empty strings...get rid of that shit!
-	NSMutableArray *components = [NSMutableArray arrayWithArray:temp];
-	[components removeObject:@""];
+	[searchLock lock];
 	
-	// Perform search for each component, narrowing results each time
-	int i, j;
-	for(i=0; i<[components count]; i++)
+	// Newer searches may have been started while we waited for the lock
+	if(generation == searchGeneration)
 	{
-		NSAutoreleasePool *innerPool = [[NSAutoreleasePool alloc] init];
+		NSMutableData *result = [NSMutableData dataWithLength:((playlistRowsCount + 1) * sizeof(int32_t))];
 		
-		NSString *str = [components objectAtIndex:i];
+		uint32_t resultCount = [self filterPlaylist:[search objectForKey:@"Criteria"]
+											   into:[result mutableBytes]
+										 generation:generation];
 		
-		NSMutableArray *array = [NSMutableArray array];
-		
-		for(j=0; j<[table count]; j++)
+		if(resultCount != ITUNES_SEARCH_CANCELLED)
 		{
-			int index = [[table objectAtIndex:j] intValue];
+			[result setLength:(resultCount * sizeof(int32_t))];
 			
-			NSDictionary *track = [self trackForID:index];
-			NSString *name   = [track objectForKey:TRACK_NAME];
-			NSString *artist = [track objectForKey:TRACK_ARTIST];
-			NSString *album  = [track objectForKey:TRACK_ALBUM];
+			NSDictionary *results = [NSDictionary dictionaryWithObjectsAndKeys:
+				[search objectForKey:@"Generation"], @"Generation",
+				result, @"Rows", nil];
 			
-			if((name != nil) && ([name rangeOfString:str options:NSCaseInsensitiveSearch].location != NSNotFound))
-			{
-				[array addObject:[NSNumber numberWithInt:index]];
-			}
-			else if((artist != nil) && ([artist rangeOfString:str options:NSCaseInsensitiveSearch].location != NSNotFound))
-			{
-				[array addObject:[NSNumber numberWithInt:index]];
-			}
-			else if((album != nil) && ([album rangeOfString:str options:NSCaseInsensitiveSearch].location != NSNotFound))
-			{
-				[array addObject:[NSNumber numberWithInt:index]];
-			}
+			[self performSelectorOnMainThread:@selector(searchDidFinish:) withObject:results waitUntilDone:NO];
 		}
-		
-		// Save current table and continue searching and narrowing results
-		[table release];
-		table = [array retain];
-		
-		[innerPool release];
 	}
 	
-	[self addToCache:searchStr array:table];
+	[searchLock unlock];
+	
+	[pool release];
 }
 
-// CACHE
+/*!
+ Called on the main thread when a background search has finished.
+ The results are put into the table, unless the playlist has been changed or another search started meanwhile.
+*/
+- (void)searchDidFinish:(NSDictionary *)results
+{
+	if([[results objectForKey:@"Generation"] unsignedIntValue] != searchGeneration) return;
+	
+	// The results are a subset of the playlist rows, so they always fit
+	NSData *result = [results objectForKey:@"Rows"];
+	
+	memcpy(rows, [result bytes], [result length]);
+	rowsCount = [result length] / sizeof(int32_t);
+	
+	[[NSNotificationCenter defaultCenter] postNotificationName:ITunesTableSearchDidFinishNotification object:self];
+}
+
+// LIBRARY CHANGES
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-- (BOOL)searchCache:(NSString *)criteria
-{	
-	int i;
-	for(i=0; i<[strCache count]; i++)
-	{
-		if([criteria caseInsensitiveCompare:[strCache objectAtIndex:i]] == NSOrderedSame)
-		{
-			[table release];
-			table = [[cache objectAtIndex:i] retain];
-			return YES;
-		}
-	}
+/*!
+ Switches over to the given version of the library.
+ Any search still running is cancelled, and we wait for it to let go of the old version first.
+*/
+- (void)setSharedLibrary:(ITunesSharedLibrary *)newSharedLibrary
+{
+	searchGeneration++;
+	[searchLock lock];
+	
+	[super setSharedLibrary:newSharedLibrary];
+	
+	trackStore = [newSharedLibrary trackStore];
+	corpus = [newSharedLibrary corpus];
 	
-	return NO;
+	// The rows are track indexes of the old version, so they're dropped until the playlist is set again
+	playlistRowsCount = 0;
+	rowsCount = 0;
+	
+	[searchLock unlock];
 }
 
-- (void)addToCache:(NSString *)criteria array:(NSArray *)result
+/*!
+ Called after the library has been reloaded.
+
+ The current playlist is followed to it's new index (falling back to the entire library if it was deleted),
+ and the table is rebuilt, redoing the current search if there is one.
+*/
+- (void)libraryDidChange:(ITunesDelta *)delta
 {
-	[strCache insertObject:criteria atIndex:0];
-	[cache insertObject:result atIndex:0];
+	int newPlaylistIndex = (delta != NULL) ? ITunesDeltaPlaylistIndexForOldIndex(delta, playlistIndex) : 0;
+	
+	if(newPlaylistIndex < 0)
+	{
+		newPlaylistIndex = 0;
+	}
+	
+	NSString *criteria = [[searchCriteria retain] autorelease];
+	
+	[self setPlaylist:newPlaylistIndex];
 	
-	if([strCache count] > 20)
+	if(criteria != nil)
 	{
-		[strCache removeObjectAtIndex:20];
-		[cache removeObjectAtIndex:20];
+		[self setSearchCriteria:criteria];
 	}
 }
 
+// CACHE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 - (void)clearCache
 {
-	[strCache removeAllObjects];
-	[cache removeAllObjects];
+	if(searchCache)
+	{
+		ITunesSearchCacheClear(searchCache);
+	}
 }
 
 @end
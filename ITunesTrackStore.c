@@ -0,0 +1,192 @@
+#include "ITunesTrackStore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Interner
+{
+	ITunesTrackStore *store;
+	ITunesHashTable table;
+	
+	uint32_t poolCapacity;
+	uint32_t offsetsCapacity;
+} Interner;
+
+/**
+ 64 bit FNV-1a hash of the given string.
+**/
+static uint64_t HashString(const char *str, size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+	
+	for(i = 0; i < length; i++)
+	{
+		hash ^= (uint8_t)str[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ Returns the handle of the given string, adding it to the pool if it isn't there already.
+ Returns ITUNES_HASH_EMPTY if the memory could not be allocated.
+**/
+static ITunesStringHandle Intern(Interner *interner, const char *str, size_t length)
+{
+	ITunesTrackStore *store = interner->store;
+	uint64_t hash = HashString(str, length);
+	
+	uint32_t handle = ITunesHashTableFind(&interner->table, hash);
+	if(handle != ITUNES_HASH_EMPTY)
+	{
+		if((ITunesTrackStoreStringLength(store, handle) == length) &&
+		   (memcmp(ITunesTrackStoreString(store, handle), str, length) == 0))
+		{
+			return handle;
+		}
+		
+		// Two strings with the same hash (very unlikely)
+		// The new string is simply added without being interned
+	}
+	
+	if(store->poolLength + length + 1 > interner->poolCapacity)
+	{
+		uint32_t newCapacity = interner->poolCapacity * 2;
+		while(store->poolLength + length + 1 > newCapacity)
+		{
+			newCapacity *= 2;
+		}
+		
+		char *newPool = realloc(store->pool, newCapacity);
+		if(newPool == NULL) return ITUNES_HASH_EMPTY;
+		
+		store->pool = newPool;
+		interner->poolCapacity = newCapacity;
+	}
+	
+	// The offsets array always has room for the end offset of the last string
+	if(store->stringsCount + 2 > interner->offsetsCapacity)
+	{
+		uint32_t newCapacity = interner->offsetsCapacity * 2;
+		
+		uint32_t *newOffsets = realloc(store->offsets, newCapacity * sizeof(uint32_t));
+		if(newOffsets == NULL) return ITUNES_HASH_EMPTY;
+		
+		store->offsets = newOffsets;
+		interner->offsetsCapacity = newCapacity;
+	}
+	
+	memcpy(store->pool + store->poolLength, str, length);
+	store->pool[store->poolLength + length] = '\0';
+	store->poolLength += length + 1;
+	
+	handle = store->stringsCount++;
+	store->offsets[store->stringsCount] = store->poolLength;
+	
+	// If another string already has this hash, it keeps it
+	ITunesHashTableInsert(&interner->table, hash, handle);
+	
+	return handle;
+}
+
+/**
+ Formats the given duration (in milliseconds) the way iTunes does: "m:ss".
+ Returns the length of the formatted string.
+**/
+static int FormatDuration(int32_t millis, char buffer[16])
+{
+	int32_t totalSeconds = (millis > 0) ? (millis / 1000) : 0;
+	
+	return snprintf(buffer, 16, "%i:%02i", (int)(totalSeconds / 60), (int)(totalSeconds % 60));
+}
+
+/**
+ Creates the track store for the given library.
+ The rows of the store are the track indexes of the library.
+
+ Returns NULL if the memory could not be allocated.
+**/
+ITunesTrackStore * ITunesTrackStoreCreate(const ITunesLibrary *lib)
+{
+	ITunesTrackStore *store = calloc(1, sizeof(ITunesTrackStore));
+	if(store == NULL) return NULL;
+	
+	uint32_t count = lib->tracksCount;
+	store->count = count;
+	
+	store->trackIDs   = malloc((count + 1) * sizeof(int32_t));
+	store->totalTimes = malloc((count + 1) * sizeof(int32_t));
+	store->names      = malloc((count + 1) * sizeof(ITunesStringHandle));
+	store->artists    = malloc((count + 1) * sizeof(ITunesStringHandle));
+	store->durations  = malloc((count + 1) * sizeof(ITunesStringHandle));
+	
+	Interner interner;
+	interner.store = store;
+	interner.poolCapacity = 1024;
+	interner.offsetsCapacity = 1024;
+	
+	store->pool = malloc(interner.poolCapacity);
+	store->offsets = malloc(interner.offsetsCapacity * sizeof(uint32_t));
+	
+	// Most names are distinct, while artists and durations repeat
+	int tableCreated = ITunesHashTableCreate(&interner.table, count + 1024);
+	
+	if(!store->trackIDs || !store->totalTimes || !store->names || !store->artists || !store->durations ||
+	   !store->pool || !store->offsets || !tableCreated)
+	{
+		goto failed;
+	}
+	
+	store->offsets[0] = 0;
+	
+	// Handle zero is the empty string
+	if(Intern(&interner, "", 0) == ITUNES_HASH_EMPTY) goto failed;
+	
+	uint32_t i;
+	for(i = 0; i < count; i++)
+	{
+		const ITunesTrack *track = &lib->tracks[i];
+		const char *name = ITunesLibraryString(lib, track->name);
+		const char *artist = ITunesLibraryString(lib, track->artist);
+		
+		char duration[16];
+		int durationLength = FormatDuration(track->totalTime, duration);
+		
+		store->trackIDs[i] = track->trackID;
+		store->totalTimes[i] = track->totalTime;
+		store->names[i] = Intern(&interner, name, strlen(name));
+		store->artists[i] = Intern(&interner, artist, strlen(artist));
+		store->durations[i] = Intern(&interner, duration, durationLength);
+		
+		if((store->names[i] == ITUNES_HASH_EMPTY) || (store->artists[i] == ITUNES_HASH_EMPTY) ||
+		   (store->durations[i] == ITUNES_HASH_EMPTY))
+		{
+			goto failed;
+		}
+	}
+	
+	free(interner.table.slots);
+	return store;
+
+failed:
+	
+	if(tableCreated) free(interner.table.slots);
+	ITunesTrackStoreFree(store);
+	return NULL;
+}
+
+void ITunesTrackStoreFree(ITunesTrackStore *store)
+{
+	if(store == NULL) return;
+	
+	free(store->trackIDs);
+	free(store->totalTimes);
+	free(store->names);
+	free(store->artists);
+	free(store->durations);
+	free(store->pool);
+	free(store->offsets);
+	free(store);
+}
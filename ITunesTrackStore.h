@@ -0,0 +1,63 @@
+/**
+ Compact, display oriented store of the tracks in the library.
+
+ The track table in the alarm editor displays the name, artist and duration of every track.
+ Looking these up through the library's track dictionaries (and formatting the duration) for every visible cell
+ is far too slow for libraries with 100,000 tracks. Instead, the columns are stored as parallel arrays,
+ indexed by row (track index in the library), so scrolling only touches the arrays of the visible rows.
+
+ Strings are interned: every distinct name, artist and formatted duration ("m:ss") is stored once,
+ and referenced by handle. Handles are dense (0 to stringsCount - 1), so the Objective-C side
+ can cache one NSString per handle in a plain array, and never creates the same string twice.
+
+ The store is immutable once created.
+**/
+
+#ifndef ITUNES_TRACK_STORE_H
+#define ITUNES_TRACK_STORE_H
+
+#include "ITunesLibrary.h"
+
+// Index of an interned string
+// Handle zero is always the empty string
+typedef uint32_t ITunesStringHandle;
+
+typedef struct ITunesTrackStore
+{
+	uint32_t count;
+	
+	// Columns, indexed by row
+	int32_t *trackIDs;
+	int32_t *totalTimes;
+	ITunesStringHandle *names;
+	ITunesStringHandle *artists;
+	ITunesStringHandle *durations;
+	
+	// Interned strings
+	// String h occupies [offsets[h], offsets[h + 1]) of the pool, including it's NUL terminator
+	char *pool;
+	uint32_t poolLength;
+	uint32_t *offsets;
+	uint32_t stringsCount;
+} ITunesTrackStore;
+
+ITunesTrackStore * ITunesTrackStoreCreate(const ITunesLibrary *lib);
+void ITunesTrackStoreFree(ITunesTrackStore *store);
+
+/**
+ Returns the (NUL terminated, UTF-8) string for the given handle.
+**/
+static inline const char * ITunesTrackStoreString(const ITunesTrackStore *store, ITunesStringHandle handle)
+{
+	return store->pool + store->offsets[handle];
+}
+
+/**
+ Returns the length (in bytes, excluding the NUL terminator) of the string for the given handle.
+**/
+static inline uint32_t ITunesTrackStoreStringLength(const ITunesTrackStore *store, ITunesStringHandle handle)
+{
+	return store->offsets[handle + 1] - store->offsets[handle] - 1;
+}
+
+#endif
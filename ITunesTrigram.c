@@ -0,0 +1,523 @@
+#include "ITunesTrigram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIGRAM(p)  (((uint32_t)(uint8_t)(p)[0] << 16) | ((uint32_t)(uint8_t)(p)[1] << 8) | (uint32_t)(uint8_t)(p)[2])
+
+// Filtering fewer than 1/INDEX_RATIO of the corpus rows checks them one by one, as that's cheaper than the index
+#define INDEX_RATIO  8
+
+// Once the candidates are this many times smaller than the next list, verifying them is cheaper than intersecting
+#define INTERSECT_RATIO  16
+
+static int HasSpace(const char *p)
+{
+	return (p[0] == ' ') || (p[1] == ' ') || (p[2] == ' ');
+}
+
+// BUILDING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Writes the trigrams of every column of the given row to the buffer, and returns how many were written.
+ Trigrams that contain a space are skipped, as query words never contain spaces.
+ The buffer must have room for one trigram per byte of the row.
+**/
+static uint32_t RowTrigrams(const ITunesSearchCorpus *corpus, uint32_t row, uint32_t *trigrams)
+{
+	uint32_t count = 0;
+	
+	int column;
+	for(column = 0; column < ITUNES_SEARCH_COLUMN_COUNT; column++)
+	{
+		const ITunesSearchColumn *col = &corpus->columns[column];
+		const char *text = col->blob + col->offsets[row];
+		
+		// Excluding the separator
+		uint32_t length = col->offsets[row + 1] - col->offsets[row] - 1;
+		
+		uint32_t i;
+		for(i = 0; i + 3 <= length; i++)
+		{
+			if(!HasSpace(text + i))
+			{
+				trigrams[count++] = TRIGRAM(text + i);
+			}
+		}
+	}
+	return count;
+}
+
+/**
+ Returns the length of the longest row (all columns together).
+**/
+static uint32_t MaxRowLength(const ITunesSearchCorpus *corpus)
+{
+	uint32_t max = 0;
+	uint32_t row;
+	
+	for(row = 0; row < corpus->rowsCount; row++)
+	{
+		uint32_t length = 0;
+		
+		int column;
+		for(column = 0; column < ITUNES_SEARCH_COLUMN_COUNT; column++)
+		{
+			length += corpus->columns[column].offsets[row + 1] - corpus->columns[column].offsets[row];
+		}
+		if(length > max)
+		{
+			max = length;
+		}
+	}
+	return max;
+}
+
+static int GrowTerms(uint32_t **counts, int32_t **lastRows, uint32_t *capacity)
+{
+	uint32_t newCapacity = (*capacity == 0) ? 4096 : (*capacity * 2);
+	
+	uint32_t *newCounts = realloc(*counts, newCapacity * sizeof(uint32_t));
+	if(newCounts == NULL) return 0;
+	*counts = newCounts;
+	
+	int32_t *newLastRows = realloc(*lastRows, newCapacity * sizeof(int32_t));
+	if(newLastRows == NULL) return 0;
+	*lastRows = newLastRows;
+	
+	*capacity = newCapacity;
+	return 1;
+}
+
+static uint8_t * WriteVarint(uint8_t *p, uint32_t value)
+{
+	while(value >= 0x80)
+	{
+		*p++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (uint8_t)value;
+	return p;
+}
+
+static const uint8_t * ReadVarint(const uint8_t *p, uint32_t *value)
+{
+	uint32_t result = 0;
+	int shift = 0;
+	
+	while(*p & 0x80)
+	{
+		result |= (uint32_t)(*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	result |= (uint32_t)(*p++) << shift;
+	
+	*value = result;
+	return p;
+}
+
+/**
+ Creates the trigram index for the given corpus.
+
+ The rows of each trigram are first counted (so the lists can be laid out without reallocating),
+ then collected, and finally delta + varint encoded.
+
+ Returns NULL if the memory could not be allocated.
+**/
+ITunesTrigramIndex * ITunesTrigramIndexCreate(const ITunesSearchCorpus *corpus)
+{
+	ITunesTrigramIndex *index = calloc(1, sizeof(ITunesTrigramIndex));
+	uint32_t *counts = NULL;
+	int32_t *lastRows = NULL;
+	uint32_t *starts = NULL;
+	uint32_t *raw = NULL;
+	uint32_t *trigrams = NULL;
+	uint32_t capacity = 0;
+	uint32_t row, i;
+	
+	if((index == NULL) || !ITunesHashTableCreate(&index->terms, 4096))
+	{
+		free(index);
+		return NULL;
+	}
+	index->rowsCount = corpus->rowsCount;
+	
+	// Pass 1: Number the trigrams, and count the rows containing each one
+	
+	trigrams = malloc((MaxRowLength(corpus) + 1) * sizeof(uint32_t));
+	if(trigrams == NULL) goto failed;
+	
+	for(row = 0; row < corpus->rowsCount; row++)
+	{
+		uint32_t trigramsCount = RowTrigrams(corpus, row, trigrams);
+		
+		for(i = 0; i < trigramsCount; i++)
+		{
+			uint32_t term = ITunesHashTableFind(&index->terms, trigrams[i]);
+			
+			if(term == ITUNES_HASH_EMPTY)
+			{
+				if((index->termsCount == capacity) && !GrowTerms(&counts, &lastRows, &capacity))
+				{
+					goto failed;
+				}
+				
+				// If the trigram can't be numbered, the index is incomplete, and the caller falls back to scanning
+				if(!ITunesHashTableInsert(&index->terms, trigrams[i], index->termsCount))
+				{
+					goto failed;
+				}
+				
+				term = index->termsCount++;
+				counts[term] = 0;
+				lastRows[term] = -1;
+			}
+			
+			// A trigram may appear more than once in a row
+			if(lastRows[term] != (int32_t)row)
+			{
+				lastRows[term] = row;
+				counts[term]++;
+			}
+		}
+	}
+	
+	// Pass 2: Collect the rows of each trigram (in ascending order, as the rows are visited in order)
+	
+	uint64_t total = 0;
+	starts = malloc((index->termsCount + 1) * sizeof(uint32_t));
+	if(starts == NULL) goto failed;
+	
+	for(i = 0; i < index->termsCount; i++)
+	{
+		starts[i] = (uint32_t)total;
+		total += counts[i];
+		lastRows[i] = -1;
+	}
+	if(total >= UINT32_MAX / 5) goto failed;
+	
+	raw = malloc((total + 1) * sizeof(uint32_t));
+	if(raw == NULL) goto failed;
+	
+	for(row = 0; row < corpus->rowsCount; row++)
+	{
+		uint32_t trigramsCount = RowTrigrams(corpus, row, trigrams);
+		
+		for(i = 0; i < trigramsCount; i++)
+		{
+			uint32_t term = ITunesHashTableFind(&index->terms, trigrams[i]);
+			
+			if(lastRows[term] != (int32_t)row)
+			{
+				lastRows[term] = row;
+				raw[starts[term]++] = row;
+			}
+		}
+	}
+	
+	// Pass 3: Encode each list as varint deltas
+	// After pass 2, starts[i] points to the end of list i
+	
+	index->postings = malloc((total * 5) + 1);
+	index->listOffsets = malloc((index->termsCount + 1) * sizeof(uint32_t));
+	if((index->postings == NULL) || (index->listOffsets == NULL)) goto failed;
+	
+	uint8_t *p = index->postings;
+	for(i = 0; i < index->termsCount; i++)
+	{
+		const uint32_t *list = raw + (starts[i] - counts[i]);
+		uint32_t previous = 0;
+		uint32_t j;
+		
+		index->listOffsets[i] = p - index->postings;
+		
+		for(j = 0; j < counts[i]; j++)
+		{
+			p = WriteVarint(p, list[j] - previous);
+			previous = list[j];
+		}
+	}
+	index->postingsLength = p - index->postings;
+	
+	uint8_t *postings = realloc(index->postings, index->postingsLength + 1);
+	if(postings != NULL)
+	{
+		index->postings = postings;
+	}
+	
+	index->listCounts = counts;
+	
+	free(trigrams);
+	free(lastRows);
+	free(starts);
+	free(raw);
+	
+	return index;
+
+failed:
+	
+	free(trigrams);
+	free(counts);
+	free(lastRows);
+	free(starts);
+	free(raw);
+	ITunesTrigramIndexFree(index);
+	
+	return NULL;
+}
+
+void ITunesTrigramIndexFree(ITunesTrigramIndex *index)
+{
+	if(index == NULL) return;
+	
+	free(index->terms.slots);
+	free(index->listOffsets);
+	free(index->listCounts);
+	free(index->postings);
+	free(index);
+}
+
+/**
+ Returns the number of bytes used by the index.
+**/
+size_t ITunesTrigramIndexSize(const ITunesTrigramIndex *index)
+{
+	return sizeof(ITunesTrigramIndex) +
+	       ((index->terms.mask + 1) * sizeof(ITunesHashSlot)) +
+	       (index->termsCount * 2 * sizeof(uint32_t)) +
+	       index->postingsLength;
+}
+
+// SEARCHING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t DecodeList(const ITunesTrigramIndex *index, uint32_t term, uint32_t *rows)
+{
+	const uint8_t *p = index->postings + index->listOffsets[term];
+	uint32_t row = 0;
+	uint32_t i;
+	
+	for(i = 0; i < index->listCounts[term]; i++)
+	{
+		uint32_t delta;
+		p = ReadVarint(p, &delta);
+		
+		row += delta;
+		rows[i] = row;
+	}
+	return index->listCounts[term];
+}
+
+/**
+ Removes the candidates that aren't in the list of the given term.
+ Both are in ascending order, so the list is decoded and merged in a single pass.
+**/
+static uint32_t IntersectList(const ITunesTrigramIndex *index, uint32_t term, uint32_t *candidates, uint32_t count)
+{
+	const uint8_t *p = index->postings + index->listOffsets[term];
+	uint32_t remaining = index->listCounts[term];
+	uint32_t row = 0;
+	uint32_t resultCount = 0;
+	uint32_t i = 0;
+	
+	if(remaining == 0) return 0;
+	
+	uint32_t delta;
+	p = ReadVarint(p, &delta);
+	row = delta;
+	remaining--;
+	
+	while(i < count)
+	{
+		if(candidates[i] < row)
+		{
+			i++;
+		}
+		else if(candidates[i] == row)
+		{
+			candidates[resultCount++] = row;
+			i++;
+		}
+		else
+		{
+			if(remaining == 0) break;
+			
+			p = ReadVarint(p, &delta);
+			row += delta;
+			remaining--;
+		}
+	}
+	return resultCount;
+}
+
+typedef struct Verification
+{
+	const ITunesSearchCorpus *corpus;
+	const char *folded;
+	const uint32_t *bits;
+	const int32_t *rows;
+} Verification;
+
+/**
+ Keeps the rows [start, end) of the rows being filtered that are candidates, and contain every word of the query.
+**/
+static uint32_t VerifyBlock(void *context, uint32_t start, uint32_t end, int32_t *result)
+{
+	Verification *verification = context;
+	const ITunesSearchCorpus *corpus = verification->corpus;
+	uint32_t resultCount = 0;
+	uint32_t i;
+	
+	for(i = start; i < end; i++)
+	{
+		uint32_t row = verification->rows[i];
+		
+		if((row >= corpus->rowsCount) || !(verification->bits[row >> 5] & (1u << (row & 31)))) continue;
+		
+		int matches = 1;
+		
+		const char *word = verification->folded;
+		while(matches && (*word != '\0'))
+		{
+			if(*word == ' ')
+			{
+				word++;
+				continue;
+			}
+			
+			size_t n = 0;
+			while((word[n] != ' ') && (word[n] != '\0'))
+			{
+				n++;
+			}
+			
+			matches = ITunesSearchRowContains(corpus, row, word, n);
+			word += n;
+		}
+		
+		if(matches)
+		{
+			result[resultCount++] = row;
+		}
+	}
+	return resultCount;
+}
+
+/**
+ Same as ITunesSearchFilter, but uses the index to find the candidate rows (when it pays off).
+ The index may be NULL, in which case this is exactly ITunesSearchFilter.
+**/
+uint32_t ITunesTrigramIndexFilter(const ITunesTrigramIndex *index, const ITunesSearchCorpus *corpus,
+                                  const ITunesSearchOptions *options, const char *query, size_t queryLength,
+                                  const int32_t *rows, uint32_t count, int32_t *result)
+{
+	if((index == NULL) || (index->rowsCount != corpus->rowsCount) || (count < (corpus->rowsCount / INDEX_RATIO)))
+	{
+		return ITunesSearchFilter(corpus, options, query, queryLength, rows, count, result);
+	}
+	
+	char *folded = malloc(queryLength + 1);
+	uint32_t *terms = malloc((queryLength + 1) * sizeof(uint32_t));
+	uint32_t *candidates = NULL;
+	uint32_t *bits = NULL;
+	uint32_t termsCount = 0;
+	uint32_t resultCount = 0;
+	uint32_t i, j;
+	
+	if((folded == NULL) || (terms == NULL))
+	{
+		free(folded);
+		free(terms);
+		return ITunesSearchFilter(corpus, options, query, queryLength, rows, count, result);
+	}
+	
+	size_t foldedLength = ITunesSearchFold(query, queryLength, folded);
+	folded[foldedLength] = '\0';
+	
+	// Collect the (distinct) terms of every trigram in the query
+	// If any trigram isn't in the index, no row can match
+	
+	for(i = 0; i + 3 <= foldedLength; i++)
+	{
+		if(HasSpace(folded + i)) continue;
+		
+		uint32_t term = ITunesHashTableFind(&index->terms, TRIGRAM(folded + i));
+		if(term == ITUNES_HASH_EMPTY)
+		{
+			goto done;
+		}
+		
+		int duplicate = 0;
+		for(j = 0; j < termsCount; j++)
+		{
+			duplicate = duplicate || (terms[j] == term);
+		}
+		
+		if(!duplicate)
+		{
+			terms[termsCount++] = term;
+		}
+	}
+	
+	if(termsCount == 0)
+	{
+		// Only short words, so the index can't help
+		free(folded);
+		free(terms);
+		return ITunesSearchFilter(corpus, options, query, queryLength, rows, count, result);
+	}
+	
+	// Intersect the lists, shortest first
+	// There are only a handful of terms, so an insertion sort will do
+	
+	for(i = 1; i < termsCount; i++)
+	{
+		uint32_t term = terms[i];
+		for(j = i; (j > 0) && (index->listCounts[term] < index->listCounts[terms[j - 1]]); j--)
+		{
+			terms[j] = terms[j - 1];
+		}
+		terms[j] = term;
+	}
+	
+	candidates = malloc((index->listCounts[terms[0]] + 1) * sizeof(uint32_t));
+	bits = calloc((corpus->rowsCount + 31) / 32, sizeof(uint32_t));
+	if((candidates == NULL) || (bits == NULL))
+	{
+		free(folded);
+		free(terms);
+		free(candidates);
+		free(bits);
+		return ITunesSearchFilter(corpus, options, query, queryLength, rows, count, result);
+	}
+	
+	uint32_t candidatesCount = DecodeList(index, terms[0], candidates);
+	
+	for(i = 1; (i < termsCount) && (candidatesCount > 0); i++)
+	{
+		if(((uint64_t)candidatesCount * INTERSECT_RATIO) < index->listCounts[terms[i]]) break;
+		
+		candidatesCount = IntersectList(index, terms[i], candidates, candidatesCount);
+	}
+	
+	for(i = 0; i < candidatesCount; i++)
+	{
+		bits[candidates[i] >> 5] |= (1u << (candidates[i] & 31));
+	}
+	
+	// Restrict the candidates to the given rows (in their order), and verify them
+	// The rows are only read by the block that writes over them, so the rows may be filtered in place
+	
+	Verification verification = { corpus, folded, bits, rows };
+	resultCount = ITunesSearchRunBlocks(options, count, VerifyBlock, &verification, result);
+
+done:
+	
+	free(folded);
+	free(terms);
+	free(candidates);
+	free(bits);
+	
+	return resultCount;
+}
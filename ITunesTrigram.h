@@ -0,0 +1,49 @@
+/**
+ Trigram index over the search corpus.
+
+ For every 3 byte sequence (trigram) in the folded name, artist and album columns, the index stores the sorted
+ list of rows containing it. The lists are delta encoded, and each delta is stored as a varint,
+ so most rows cost a single byte per trigram.
+
+ A query word of at least 3 bytes can only match rows that contain every one of it's trigrams,
+ so intersecting their lists yields a (usually very small) set of candidate rows.
+ The candidates are then verified exactly against the corpus (in parallel, for large searches),
+ so the results are identical to a scan.
+ Words shorter than 3 bytes don't narrow the candidates, and are only verified.
+ If the query has no words of at least 3 bytes, the corpus is simply scanned.
+
+ The index is immutable once created, so it may be built on a background thread,
+ and searched from multiple threads at once.
+**/
+
+#ifndef ITUNES_TRIGRAM_H
+#define ITUNES_TRIGRAM_H
+
+#include "ITunesSearch.h"
+
+typedef struct ITunesTrigramIndex
+{
+	// Trigram -> term number
+	ITunesHashTable terms;
+	uint32_t termsCount;
+	
+	// For each term, the offset of it's encoded list within postings, and the number of rows in it
+	uint32_t *listOffsets;
+	uint32_t *listCounts;
+	
+	uint8_t  *postings;
+	uint32_t postingsLength;
+	
+	uint32_t rowsCount;
+} ITunesTrigramIndex;
+
+ITunesTrigramIndex * ITunesTrigramIndexCreate(const ITunesSearchCorpus *corpus);
+void ITunesTrigramIndexFree(ITunesTrigramIndex *index);
+
+size_t ITunesTrigramIndexSize(const ITunesTrigramIndex *index);
+
+uint32_t ITunesTrigramIndexFilter(const ITunesTrigramIndex *index, const ITunesSearchCorpus *corpus,
+                                  const ITunesSearchOptions *options, const char *query, size_t queryLength,
+                                  const int32_t *rows, uint32_t count, int32_t *result);
+
+#endif
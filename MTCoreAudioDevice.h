@@ -38,6 +38,7 @@ typedef struct _MTCoreAudioVolumeInfo {
 
 - (Float32) volumeForChannel:(UInt32)theChannel forDirection:(MTCoreAudioDirection)theDirection;
 - (void)    setVolume:(Float32)theVolume forChannel:(UInt32)theChannel forDirection:(MTCoreAudioDirection)theDirection;
+- (BOOL)    isMutedForChannel:(UInt32)theChannel forDirection:(MTCoreAudioDirection)theDirection;
 - (void)    setMute:(BOOL)isMuted forChannel:(UInt32)theChannel forDirection:(MTCoreAudioDirection)theDirection;
 
 
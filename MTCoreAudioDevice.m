@@ -71,6 +71,20 @@
 	theStatus = AudioDeviceSetProperty ( myDevice, NULL, theChannel, theDirection, kAudioDevicePropertyVolumeScalar, theSize, &theVolume );
 }
 
+- (BOOL) isMutedForChannel:(UInt32)theChannel forDirection:(MTCoreAudioDirection)theDirection
+{
+	OSStatus theStatus;
+	UInt32 theSize;
+	UInt32 theMuteVal;
+	
+	theSize = sizeof(UInt32);
+	theStatus = AudioDeviceGetProperty ( myDevice, theChannel, theDirection, kAudioDevicePropertyMute, &theSize, &theMuteVal );
+	if (theStatus == 0)
+		return (theMuteVal != 0);
+	else
+		return NO;
+}
+
 - (void) setMute:(BOOL)isMuted forChannel:(UInt32)theChannel forDirection:(MTCoreAudioDirection)theDirection
 {
 	OSStatus theStatus;
@@ -0,0 +1,497 @@
+#include "MemoryAudioOutput.h"
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <AudioUnit/AudioUnit.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sounds are decoded to (and played as) stereo
+#define SOUND_CHANNELS     2
+
+// Number of different sounds kept in memory, and the longest sound worth keeping there
+#define MAX_SOUNDS         8
+#define MAX_SOUND_SECONDS  300
+
+typedef struct CachedSound
+{
+	char *path;
+	SoundBuffer *buffer;
+} CachedSound;
+
+static CachedSound sounds[MAX_SOUNDS];
+static uint32_t soundsCount;
+static pthread_mutex_t soundsLock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct MemoryOutput
+{
+	// The default output unit, and the sample rate of the audio it's given (0 until a sound is opened)
+	AudioUnit unit;
+	double unitSampleRate;
+	
+	// The current sound (owned by the cache), and the next frame of it to play
+	// These are only changed while the unit is stopped, as they're read by the render callback
+	SoundBuffer *sound;
+	uint64_t position;
+	
+	volatile float volume;
+	volatile int isLooping;
+	volatile int isPlaying;
+	
+	// The gain ramp applied on top of the volume, if hasRamp is set, at the sound's sample rate
+	// It's a copy of the one given, as it's advanced by the render callback, and only changed while the unit is stopped
+	GainRamp ramp;
+	int hasRamp;
+	
+	// Set by the render callback when the sound ends, which then signals the source,
+	// so the finished function is called on the run loop of the thread that created the output
+	volatile int didFinish;
+	CFRunLoopSourceRef finishedSource;
+	CFRunLoopRef runLoop;
+} MemoryOutput;
+
+// DECODING
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Decodes the whole file into a new buffer, at it's own sample rate.
+ Returns NULL if the file can't be decoded, or is too long to keep in memory.
+**/
+static SoundBuffer * DecodeFile(const char *path)
+{
+	CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8 *)path, strlen(path), false);
+	if(url == NULL) return NULL;
+	
+	FSRef ref;
+	Boolean hasRef = CFURLGetFSRef(url, &ref);
+	CFRelease(url);
+	
+	ExtAudioFileRef file;
+	if(!hasRef || (ExtAudioFileOpen(&ref, &file) != noErr))
+	{
+		fprintf(stderr, "MemoryAudioOutput: Unable to open %s\n", path);
+		return NULL;
+	}
+	
+	AudioStreamBasicDescription fileFormat;
+	SInt64 fileFrames = 0;
+	UInt32 size;
+	
+	size = sizeof(fileFormat);
+	OSStatus err = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileDataFormat, &size, &fileFormat);
+	
+	if(err == noErr)
+	{
+		size = sizeof(fileFrames);
+		err = ExtAudioFileGetProperty(file, kExtAudioFileProperty_FileLengthFrames, &size, &fileFrames);
+	}
+	
+	// Have ExtAudioFile decode it to 16 bit interleaved stereo
+	AudioStreamBasicDescription format;
+	memset(&format, 0, sizeof(format));
+	format.mSampleRate       = fileFormat.mSampleRate;
+	format.mFormatID         = kAudioFormatLinearPCM;
+	format.mFormatFlags      = kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+	format.mChannelsPerFrame = SOUND_CHANNELS;
+	format.mBitsPerChannel   = 16;
+	format.mFramesPerPacket  = 1;
+	format.mBytesPerFrame    = SOUND_CHANNELS * sizeof(int16_t);
+	format.mBytesPerPacket   = format.mBytesPerFrame;
+	
+	if(err == noErr)
+	{
+		err = ExtAudioFileSetProperty(file, kExtAudioFileProperty_ClientDataFormat, sizeof(format), &format);
+	}
+	
+	SoundBuffer *buffer = NULL;
+	
+	if((err == noErr) && (fileFrames > 0) && (fileFrames <= MAX_SOUND_SECONDS * format.mSampleRate))
+	{
+		buffer = SoundBufferCreate((uint32_t)fileFrames, SOUND_CHANNELS, format.mSampleRate);
+	}
+	
+	if(buffer != NULL)
+	{
+		// The length of compressed files is only an estimate, so read until the decoder runs out
+		uint32_t decoded = 0;
+		
+		while(decoded < buffer->frames)
+		{
+			AudioBufferList list;
+			UInt32 frames = buffer->frames - decoded;
+			
+			list.mNumberBuffers = 1;
+			list.mBuffers[0].mNumberChannels = SOUND_CHANNELS;
+			list.mBuffers[0].mDataByteSize = frames * format.mBytesPerFrame;
+			list.mBuffers[0].mData = buffer->samples + (decoded * SOUND_CHANNELS);
+			
+			if((ExtAudioFileRead(file, &frames, &list) != noErr) || (frames == 0)) break;
+			
+			decoded += frames;
+		}
+		
+		if(decoded == 0)
+		{
+			SoundBufferFree(buffer);
+			buffer = NULL;
+		}
+		else
+		{
+			buffer->frames = decoded;
+		}
+	}
+	
+	if(buffer == NULL)
+	{
+		fprintf(stderr, "MemoryAudioOutput: Unable to decode %s\n", path);
+	}
+	
+	ExtAudioFileDispose(file);
+	return buffer;
+}
+
+/**
+ Returns the sound in the given file, decoding it if this is the first time it's asked for.
+ Returns NULL if the file can't be decoded.
+
+ This may be called from any thread. If the sound is being decoded by another thread, this waits for it.
+**/
+SoundBuffer * MemoryAudioOutputLoadSound(const char *path)
+{
+	SoundBuffer *buffer = NULL;
+	uint32_t i;
+	
+	pthread_mutex_lock(&soundsLock);
+	
+	for(i = 0; i < soundsCount; i++)
+	{
+		if(strcmp(sounds[i].path, path) == 0)
+		{
+			buffer = sounds[i].buffer;
+			break;
+		}
+	}
+	
+	if((buffer == NULL) && (soundsCount < MAX_SOUNDS))
+	{
+		char *pathCopy = strdup(path);
+		
+		if(pathCopy != NULL)
+		{
+			buffer = DecodeFile(path);
+		}
+		
+		if(buffer != NULL)
+		{
+			sounds[soundsCount].path = pathCopy;
+			sounds[soundsCount].buffer = buffer;
+			soundsCount++;
+		}
+		else
+		{
+			free(pathCopy);
+		}
+	}
+	
+	pthread_mutex_unlock(&soundsLock);
+	
+	return buffer;
+}
+
+// C STYLE METHODS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Called by the output unit (on it's own thread) whenever it needs audio.
+**/
+static OSStatus RenderSound(void *context, AudioUnitRenderActionFlags *flags, const AudioTimeStamp *timeStamp,
+                            UInt32 bus, UInt32 frames, AudioBufferList *data)
+{
+	MemoryOutput *m = (MemoryOutput *)context;
+	float *samples = (float *)data->mBuffers[0].mData;
+	uint32_t written = 0;
+	
+	if(m->isPlaying && (m->sound != NULL))
+	{
+		int isLooping = m->isLooping;
+		
+		written = SoundBufferRead(m->sound, &m->position, samples, frames, SOUND_CHANNELS, m->volume, isLooping);
+		
+		if(m->hasRamp)
+		{
+			GainRampProcess(&m->ramp, samples, written, SOUND_CHANNELS);
+		}
+		
+		if((written < frames) && !isLooping)
+		{
+			m->isPlaying = 0;
+			m->didFinish = 1;
+			
+			CFRunLoopSourceSignal(m->finishedSource);
+			CFRunLoopWakeUp(m->runLoop);
+		}
+	}
+	
+	if(written < frames)
+	{
+		memset(samples + (written * SOUND_CHANNELS), 0, (frames - written) * SOUND_CHANNELS * sizeof(float));
+		
+		if(written == 0) *flags |= kAudioUnitRenderAction_OutputIsSilence;
+	}
+	
+	return noErr;
+}
+
+/**
+ Called on the output's run loop, after the render callback has reached the end of the sound.
+**/
+static void SoundFinished(void *info)
+{
+	AudioOutput *output = (AudioOutput *)info;
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	if(!m->didFinish) return;
+	m->didFinish = 0;
+	
+	AudioOutputUnitStop(m->unit);
+	
+	if(output->finished != NULL)
+	{
+		output->finished(output->context, output);
+	}
+}
+
+// BACKEND
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Gives the unit audio at the given sample rate (the unit converts it to the device's rate).
+**/
+static int SetUnitSampleRate(MemoryOutput *m, double sampleRate)
+{
+	if(m->unitSampleRate == sampleRate) return 1;
+	
+	AudioStreamBasicDescription format;
+	memset(&format, 0, sizeof(format));
+	format.mSampleRate       = sampleRate;
+	format.mFormatID         = kAudioFormatLinearPCM;
+	format.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked;
+	format.mChannelsPerFrame = SOUND_CHANNELS;
+	format.mBitsPerChannel   = 32;
+	format.mFramesPerPacket  = 1;
+	format.mBytesPerFrame    = SOUND_CHANNELS * sizeof(float);
+	format.mBytesPerPacket   = format.mBytesPerFrame;
+	
+	AudioUnitUninitialize(m->unit);
+	
+	OSStatus err = AudioUnitSetProperty(m->unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0,
+	                                    &format, sizeof(format));
+	if(err == noErr)
+	{
+		err = AudioUnitInitialize(m->unit);
+	}
+	
+	m->unitSampleRate = (err == noErr) ? sampleRate : 0.0;
+	return (err == noErr);
+}
+
+static void MemoryClose(AudioOutput *output)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	AudioOutputUnitStop(m->unit);
+	
+	m->sound = NULL;
+	m->position = 0;
+	m->isPlaying = 0;
+	m->didFinish = 0;
+}
+
+static int MemoryOpen(AudioOutput *output, const char *path)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	MemoryClose(output);
+	
+	SoundBuffer *sound = MemoryAudioOutputLoadSound(path);
+	if((sound == NULL) || !SetUnitSampleRate(m, sound->sampleRate)) return 0;
+	
+	m->sound = sound;
+	
+	// The ramp is counted in frames of the sound, which may be at a different rate than the last one
+	if(m->hasRamp)
+	{
+		GainRampSetSampleRate(&m->ramp, sound->sampleRate);
+	}
+	return 1;
+}
+
+static void MemoryPlay(AudioOutput *output)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	if((m->sound == NULL) || m->isPlaying) return;
+	
+	// A sound that played to it's end starts over, like a movie does
+	if(m->position >= m->sound->frames) m->position = 0;
+	
+	m->isPlaying = 1;
+	AudioOutputUnitStart(m->unit);
+}
+
+static void MemoryStop(AudioOutput *output)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	AudioOutputUnitStop(m->unit);
+	m->isPlaying = 0;
+}
+
+static int MemoryIsPlaying(AudioOutput *output)
+{
+	return ((MemoryOutput *)output->state)->isPlaying;
+}
+
+static double MemoryDuration(AudioOutput *output)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	return (m->sound != NULL) ? SoundBufferDuration(m->sound) : 0.0;
+}
+
+static double MemoryCurrentTime(AudioOutput *output)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	return (m->sound != NULL) ? m->position / m->sound->sampleRate : 0.0;
+}
+
+static void MemorySetCurrentTime(AudioOutput *output, double time)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	if(m->sound == NULL) return;
+	
+	// The unit is stopped while the position changes, since the render callback moves it too
+	int wasPlaying = m->isPlaying;
+	AudioOutputUnitStop(m->unit);
+	
+	uint64_t frame = (time > 0.0) ? (uint64_t)(time * m->sound->sampleRate) : 0;
+	m->position = (frame < m->sound->frames) ? frame : m->sound->frames;
+	
+	if(wasPlaying) AudioOutputUnitStart(m->unit);
+}
+
+static void MemorySetVolume(AudioOutput *output, float volume)
+{
+	((MemoryOutput *)output->state)->volume = volume;
+}
+
+static void MemorySetLooping(AudioOutput *output, int isLooping)
+{
+	((MemoryOutput *)output->state)->isLooping = isLooping;
+}
+
+static int MemorySetRamp(AudioOutput *output, GainRamp *ramp)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	// The unit is stopped while the ramp changes, since the render callback advances it
+	int wasPlaying = m->isPlaying;
+	AudioOutputUnitStop(m->unit);
+	
+	if(ramp != NULL)
+	{
+		m->ramp = *ramp;
+		
+		if(m->sound != NULL)
+		{
+			GainRampSetSampleRate(&m->ramp, m->sound->sampleRate);
+		}
+	}
+	m->hasRamp = (ramp != NULL);
+	
+	if(wasPlaying) AudioOutputUnitStart(m->unit);
+	return 1;
+}
+
+static void MemoryFree(AudioOutput *output)
+{
+	MemoryOutput *m = (MemoryOutput *)output->state;
+	
+	AudioOutputUnitStop(m->unit);
+	AudioUnitUninitialize(m->unit);
+	CloseComponent(m->unit);
+	
+	CFRunLoopSourceInvalidate(m->finishedSource);
+	CFRelease(m->finishedSource);
+	CFRelease(m->runLoop);
+	
+	free(m);
+	free(output);
+}
+
+static const AudioOutputBackend memoryBackend = {
+	"Memory",
+	MemoryOpen, MemoryClose, MemoryPlay, MemoryStop, MemoryIsPlaying,
+	MemoryDuration, MemoryCurrentTime, MemorySetCurrentTime, MemorySetVolume, MemorySetLooping,
+	MemorySetRamp, NULL, MemoryFree
+};
+
+/**
+ Creates an output that plays sounds from memory, on the default audio device.
+ Returns NULL if the default output unit isn't available.
+**/
+AudioOutput * MemoryAudioOutputCreate(void)
+{
+	AudioOutput *output = calloc(1, sizeof(AudioOutput));
+	MemoryOutput *m = calloc(1, sizeof(MemoryOutput));
+	
+	if((output == NULL) || (m == NULL))
+	{
+		free(output);
+		free(m);
+		return NULL;
+	}
+	
+	ComponentDescription description;
+	description.componentType         = kAudioUnitType_Output;
+	description.componentSubType      = kAudioUnitSubType_DefaultOutput;
+	description.componentManufacturer = kAudioUnitManufacturer_Apple;
+	description.componentFlags        = 0;
+	description.componentFlagsMask    = 0;
+	
+	Component component = FindNextComponent(NULL, &description);
+	
+	if((component == NULL) || (OpenAComponent(component, &m->unit) != noErr))
+	{
+		fprintf(stderr, "MemoryAudioOutput: Unable to open the default output unit\n");
+		free(output);
+		free(m);
+		return NULL;
+	}
+	
+	AURenderCallbackStruct callback;
+	callback.inputProc = RenderSound;
+	callback.inputProcRefCon = m;
+	
+	AudioUnitSetProperty(m->unit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0,
+	                     &callback, sizeof(callback));
+	
+	CFRunLoopSourceContext context;
+	memset(&context, 0, sizeof(context));
+	context.info = output;
+	context.perform = SoundFinished;
+	
+	m->volume = 1.0f;
+	m->runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+	m->finishedSource = CFRunLoopSourceCreate(NULL, 0, &context);
+	CFRunLoopAddSource(m->runLoop, m->finishedSource, kCFRunLoopCommonModes);
+	
+	output->backend = &memoryBackend;
+	output->state = m;
+	
+	return output;
+}
@@ -0,0 +1,28 @@
+/**
+ The memory backend of AudioOutput (see AudioOutput.h), which plays sounds decoded into memory (see SoundBuffer.h)
+ through Core Audio's default output unit.
+
+ Sounds are decoded once (with ExtAudioFile), the first time they're asked for, and kept for the life of the process.
+ After that, opening a sound does no I/O at all, and looping it is just reading the buffer as a ring.
+ This is meant for the few short sounds of the application itself (the default alarm, and the timer),
+ not for iTunes tracks, which are played with QuickTime.
+
+ As the samples go through the render callback, a gain ramp (AudioOutputSetRamp) is applied to each of them,
+ so Easy Wake fades the default alarm in smoothly, rather than in steps of the device volume.
+
+ The output must be created, and used, on a thread with a run loop (normally the main thread),
+ which is where the finished function is called.
+ MemoryAudioOutputLoadSound may be called from any thread, to decode a sound ahead of time.
+**/
+
+#ifndef MEMORY_AUDIO_OUTPUT_H
+#define MEMORY_AUDIO_OUTPUT_H
+
+#include "AudioOutput.h"
+#include "SoundBuffer.h"
+
+AudioOutput * MemoryAudioOutputCreate(void);
+
+SoundBuffer * MemoryAudioOutputLoadSound(const char *path);
+
+#endif
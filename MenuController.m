@@ -5,6 +5,9 @@
 #import "WindowManager.h"
 #import "RHDateToStringTransformer.h"
 
+// The most alarm times listed in the status item's tooltip
+#define UPCOMING_ALARMS_LIMIT  5
+
 @interface MenuController (PrivateAPI)
 - (void)updateMenuItems:(NSNotification *)notification;
 @end
@@ -183,6 +186,33 @@
 		else
 			[statusItem setImage:[NSImage imageNamed:@"trayIconGray.png"]];
 	}
+	
+	// List the next few times alarms go off this week in the tooltip
+	// Alarms repeating by a recurrence rule only show the next one in the menu, and may go off on more days than it shows
+	NSCalendarDate *now = [NSCalendarDate calendarDate];
+	NSCalendarDate *weekLater = [now dateByAddingYears:0 months:0 days:7 hours:0 minutes:0 seconds:0];
+	
+	NSArray *upcoming = [AlarmScheduler alarmDatesFrom:now to:weekLater limit:UPCOMING_ALARMS_LIMIT];
+	
+	if([upcoming count] > 0)
+	{
+		NSDateFormatter *formatter = [[[NSDateFormatter alloc] init] autorelease];
+		[formatter setFormatterBehavior:NSDateFormatterBehavior10_4];
+		[formatter setDateStyle:NSDateFormatterMediumStyle];
+		[formatter setTimeStyle:NSDateFormatterShortStyle];
+		
+		NSMutableArray *lines = [NSMutableArray arrayWithCapacity:[upcoming count]];
+		
+		for(i = 0; i < [upcoming count]; i++)
+		{
+			[lines addObject:[formatter stringFromDate:[upcoming objectAtIndex:i]]];
+		}
+		[statusItem setToolTip:[lines componentsJoinedByString:@"\n"]];
+	}
+	else
+	{
+		[statusItem setToolTip:nil];
+	}
 }
 
 // EDITING AND ADDING ALARMS
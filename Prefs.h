@@ -53,4 +53,8 @@
 
 + (BOOL)digitalAudio;
 
++ (int)prewarmLeadTime;
+
++ (int)easyWakeCurve;
+
 @end
\ No newline at end of file
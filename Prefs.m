@@ -22,6 +22,8 @@
 #define FIRST_RUN_KEY          @"FirstRun"
 #define XML_PATH_KEY           @"XMLPath"
 #define DIGITAL_AUDIO_KEY      @"DigitalAudio"
+#define PREWARM_LEAD_TIME_KEY  @"PrewarmLeadTime"
+#define EASY_WAKE_CURVE_KEY    @"EasyWakeCurve"
 
 
 @implementation Prefs
@@ -66,6 +68,8 @@
 		[defaultValues setObject:[NSNumber numberWithBool:YES] forKey:FIRST_RUN_KEY];
 		[defaultValues setObject:@"" forKey:XML_PATH_KEY];
 		[defaultValues setObject:[NSNumber numberWithBool:NO] forKey:DIGITAL_AUDIO_KEY];
+		[defaultValues setObject:[NSNumber numberWithInt:120] forKey:PREWARM_LEAD_TIME_KEY];
+		[defaultValues setObject:[NSNumber numberWithInt:0] forKey:EASY_WAKE_CURVE_KEY];
 		
 		// Register default values
 		[[NSUserDefaults standardUserDefaults] registerDefaults:defaultValues];
@@ -241,4 +245,22 @@
 	return [[NSUserDefaults standardUserDefaults] boolForKey:DIGITAL_AUDIO_KEY];
 }
 
+/**
+ Returns the number of seconds before an alarm that the library and player are prepared for it.
+ Zero disables pre-warming.
+**/
++ (int)prewarmLeadTime
+{
+	return [[NSUserDefaults standardUserDefaults] integerForKey:PREWARM_LEAD_TIME_KEY];
+}
+
+/**
+ Returns the curve Easy Wake raises the volume along (one of the GAIN_RAMP_ curves in GainRamp.h).
+ Zero (the default) is linear.
+**/
++ (int)easyWakeCurve
+{
+	return [[NSUserDefaults standardUserDefaults] integerForKey:EASY_WAKE_CURVE_KEY];
+}
+
 @end
@@ -0,0 +1,11 @@
+#import <Cocoa/Cocoa.h>
+#import "AudioOutput.h"
+
+/**
+ The QuickTime backend of AudioOutput (see AudioOutput.h), which plays tracks with QTMovie,
+ on the default audio device, in real time.
+
+ QTMovie objects must be created on the main thread, so this backend must only be used from the main thread.
+ The gain ramp of AudioOutputSetRamp is ignored: QuickTime doesn't give access to the samples it plays.
+**/
+AudioOutput * QTAudioOutputCreate(void);
@@ -0,0 +1,209 @@
+#import "QTAudioOutput.h"
+#import <QTKit/QTKit.h>
+
+/**
+ Holds the movie of a QuickTime output, and forwards the end of the movie to the output's finished function.
+**/
+@interface QTAudioOutputState : NSObject
+{
+	AudioOutput *output;
+	QTMovie *movie;
+	float volume;
+	BOOL isLooping;
+}
+
+- (id)initWithOutput:(AudioOutput *)output;
+
+- (QTMovie *)movie;
+- (void)setMovie:(QTMovie *)movie;
+
+- (void)setVolume:(float)volume;
+- (void)setLooping:(BOOL)flag;
+
+@end
+
+@implementation QTAudioOutputState
+
+- (id)initWithOutput:(AudioOutput *)anOutput
+{
+	if(self = [super init])
+	{
+		output = anOutput;
+		volume = 1.0;
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(movieFinished:)
+													 name:QTMovieDidEndNotification
+												   object:nil];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	[movie stop];
+	[movie release];
+	
+	[super dealloc];
+}
+
+- (QTMovie *)movie
+{
+	return movie;
+}
+
+/**
+ Replaces the movie (stopping the current one), and configures the new one with the volume and looping.
+**/
+- (void)setMovie:(QTMovie *)newMovie
+{
+	if(movie != newMovie)
+	{
+		[movie stop];
+		[movie release];
+		movie = [newMovie retain];
+	}
+	
+	if(movie != nil)
+	{
+		[movie setVolume:volume];
+		[movie setAttribute:[NSNumber numberWithBool:isLooping] forKey:QTMovieLoopsAttribute];
+	}
+}
+
+- (void)setVolume:(float)newVolume
+{
+	volume = newVolume;
+	[movie setVolume:volume];
+}
+
+- (void)setLooping:(BOOL)flag
+{
+	isLooping = flag;
+	[movie setAttribute:[NSNumber numberWithBool:isLooping] forKey:QTMovieLoopsAttribute];
+}
+
+/**
+ Called when any movie in the application finishes playing.
+**/
+- (void)movieFinished:(NSNotification *)notification
+{
+	if((movie != nil) && (movie == [notification object]) && (output->finished != NULL))
+	{
+		output->finished(output->context, output);
+	}
+}
+
+@end
+
+// BACKEND
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static QTMovie * MovieOfOutput(AudioOutput *output)
+{
+	return [(QTAudioOutputState *)output->state movie];
+}
+
+static int QTOpen(AudioOutput *output, const char *path)
+{
+	NSString *file = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)];
+	QTMovie *movie = nil;
+	
+	if([QTMovie canInitWithFile:file])
+	{
+		movie = [[[QTMovie alloc] initWithFile:file error:nil] autorelease];
+	}
+	
+	[(QTAudioOutputState *)output->state setMovie:movie];
+	return (movie != nil);
+}
+
+static void QTClose(AudioOutput *output)
+{
+	[(QTAudioOutputState *)output->state setMovie:nil];
+}
+
+static void QTPlay(AudioOutput *output)
+{
+	[MovieOfOutput(output) play];
+}
+
+static void QTStop(AudioOutput *output)
+{
+	[MovieOfOutput(output) stop];
+}
+
+static int QTIsPlaying(AudioOutput *output)
+{
+	QTMovie *movie = MovieOfOutput(output);
+	
+	return (movie != nil) && ([movie rate] != 0);
+}
+
+static double QTDuration(AudioOutput *output)
+{
+	QTMovie *movie = MovieOfOutput(output);
+	NSTimeInterval duration = 0.0;
+	
+	if(movie != nil)
+	{
+		QTGetTimeInterval([movie duration], &duration);
+	}
+	return duration;
+}
+
+static double QTCurrentTime(AudioOutput *output)
+{
+	QTMovie *movie = MovieOfOutput(output);
+	NSTimeInterval time = 0.0;
+	
+	if(movie != nil)
+	{
+		QTGetTimeInterval([movie currentTime], &time);
+	}
+	return time;
+}
+
+static void QTSetCurrentTime(AudioOutput *output, double time)
+{
+	[MovieOfOutput(output) setCurrentTime:QTMakeTimeWithTimeInterval(time)];
+}
+
+static void QTSetVolume(AudioOutput *output, float volume)
+{
+	[(QTAudioOutputState *)output->state setVolume:volume];
+}
+
+static void QTSetLooping(AudioOutput *output, int isLooping)
+{
+	[(QTAudioOutputState *)output->state setLooping:(isLooping != 0)];
+}
+
+static void QTFree(AudioOutput *output)
+{
+	[(QTAudioOutputState *)output->state release];
+	free(output);
+}
+
+static const AudioOutputBackend quickTimeBackend = {
+	"QuickTime",
+	QTOpen, QTClose, QTPlay, QTStop, QTIsPlaying,
+	QTDuration, QTCurrentTime, QTSetCurrentTime, QTSetVolume, QTSetLooping,
+	NULL, NULL, QTFree
+};
+
+/**
+ Creates an output that plays through QuickTime. Must be called on the main thread.
+**/
+AudioOutput * QTAudioOutputCreate(void)
+{
+	AudioOutput *output = calloc(1, sizeof(AudioOutput));
+	if(output == NULL) return NULL;
+	
+	output->backend = &quickTimeBackend;
+	output->state = [[QTAudioOutputState alloc] initWithOutput:output];
+	
+	return output;
+}
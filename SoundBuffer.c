@@ -0,0 +1,143 @@
+#include "SoundBuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ Creates a buffer of the given number of frames (initially silent), which the caller fills in.
+ Returns NULL if the memory can't be allocated.
+**/
+SoundBuffer * SoundBufferCreate(uint32_t frames, uint32_t channels, double sampleRate)
+{
+	if((frames == 0) || (channels == 0)) return NULL;
+	
+	SoundBuffer *buffer = calloc(1, sizeof(SoundBuffer));
+	if(buffer == NULL) return NULL;
+	
+	buffer->samples = calloc((size_t)frames * channels, sizeof(int16_t));
+	if(buffer->samples == NULL)
+	{
+		free(buffer);
+		return NULL;
+	}
+	
+	buffer->frames = frames;
+	buffer->channels = channels;
+	buffer->sampleRate = sampleRate;
+	
+	return buffer;
+}
+
+void SoundBufferFree(SoundBuffer *buffer)
+{
+	if(buffer == NULL) return;
+	
+	free(buffer->samples);
+	free(buffer);
+}
+
+double SoundBufferDuration(const SoundBuffer *buffer)
+{
+	return buffer->frames / buffer->sampleRate;
+}
+
+/**
+ Copies frames out of the buffer, starting at the given position (which is moved past them),
+ as interleaved float samples with the given number of channels, multiplied by the gain.
+ A mono buffer is copied to every channel; extra channels of the buffer are dropped.
+
+ If looping, the buffer is read as a ring, and all the frames asked for are copied.
+ Otherwise, the copy stops at the end of the buffer, and the number of frames copied is returned.
+**/
+uint32_t SoundBufferRead(const SoundBuffer *buffer, uint64_t *position, float *samples, uint32_t frames,
+                         uint32_t channels, float gain, int isLooping)
+{
+	const float scale = gain / 32768.0f;
+	uint32_t written = 0;
+	
+	uint64_t frame = *position;
+	if(isLooping) frame %= buffer->frames;
+	
+	while((written < frames) && (frame < buffer->frames))
+	{
+		// Copy up to the end of the buffer, or as much as was asked for, whichever comes first
+		uint32_t count = buffer->frames - (uint32_t)frame;
+		if(count > frames - written) count = frames - written;
+		
+		const int16_t *in = buffer->samples + (frame * buffer->channels);
+		float *out = samples + (written * channels);
+		uint32_t i, c;
+		
+		for(i = 0; i < count; i++)
+		{
+			for(c = 0; c < channels; c++)
+			{
+				uint32_t source = (c < buffer->channels) ? c : (buffer->channels - 1);
+				out[c] = in[source] * scale;
+			}
+			in += buffer->channels;
+			out += channels;
+		}
+		
+		written += count;
+		frame += count;
+		
+		if(isLooping && (frame == buffer->frames)) frame = 0;
+	}
+	
+	*position = frame;
+	return written;
+}
+
+// DECODER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void * BufferOpen(void *context, const char *path, uint32_t sampleRate, double *duration, double *latency)
+{
+	SoundBuffer *buffer = (SoundBuffer *)context;
+	
+	uint64_t *position = calloc(1, sizeof(uint64_t));
+	if(position == NULL) return NULL;
+	
+	*duration = SoundBufferDuration(buffer);
+	*latency = 0.0;
+	
+	return position;
+}
+
+static uint32_t BufferRender(void *context, void *handle, float *samples, uint32_t frames, int *isEnd)
+{
+	SoundBuffer *buffer = (SoundBuffer *)context;
+	uint64_t *position = (uint64_t *)handle;
+	
+	uint32_t count = SoundBufferRead(buffer, position, samples, frames, AUDIO_OUTPUT_CHANNELS, 1.0f, 0);
+	
+	*isEnd = (*position >= buffer->frames);
+	return count;
+}
+
+static void BufferSeek(void *context, void *handle, double time)
+{
+	SoundBuffer *buffer = (SoundBuffer *)context;
+	uint64_t frame = (time > 0.0) ? (uint64_t)(time * buffer->sampleRate) : 0;
+	
+	*(uint64_t *)handle = (frame < buffer->frames) ? frame : buffer->frames;
+}
+
+static void BufferClose(void *context, void *handle)
+{
+	free(handle);
+}
+
+/**
+ Sets up a decoder (for the virtual audio outputs) that plays the buffer, whatever path is opened,
+ without any latency. The buffer is played at the output's sample rate, whatever it's own is.
+**/
+void SoundBufferGetDecoder(SoundBuffer *buffer, AudioOutputDecoder *decoder)
+{
+	decoder->open = BufferOpen;
+	decoder->render = BufferRender;
+	decoder->seek = BufferSeek;
+	decoder->close = BufferClose;
+	decoder->context = buffer;
+}
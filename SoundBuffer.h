@@ -0,0 +1,36 @@
+/**
+ A sound decoded into memory, as 16 bit interleaved PCM.
+
+ The default alarm and timer sounds are short, and are played over and over (looping),
+ and as the fallback when the chosen track fails. Decoding them once, and playing them from memory,
+ takes the file system and the decoder off that path entirely: playing is just copying samples out of a ring.
+
+ Buffers are immutable once filled, so any number of threads may read from one at the same time,
+ each with it's own position.
+**/
+
+#ifndef SOUND_BUFFER_H
+#define SOUND_BUFFER_H
+
+#include <stdint.h>
+#include "AudioOutput.h"
+
+typedef struct SoundBuffer
+{
+	int16_t *samples;
+	uint32_t frames;
+	uint32_t channels;
+	double   sampleRate;
+} SoundBuffer;
+
+SoundBuffer * SoundBufferCreate(uint32_t frames, uint32_t channels, double sampleRate);
+void SoundBufferFree(SoundBuffer *buffer);
+
+double SoundBufferDuration(const SoundBuffer *buffer);
+
+uint32_t SoundBufferRead(const SoundBuffer *buffer, uint64_t *position, float *samples, uint32_t frames,
+                         uint32_t channels, float gain, int isLooping);
+
+void SoundBufferGetDecoder(SoundBuffer *buffer, AudioOutputDecoder *decoder);
+
+#endif
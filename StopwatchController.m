@@ -1,4 +1,5 @@
 #import "StopwatchController.h"
+#import "WindowManager.h"
 
 #define WINDOW_KEY           @"StopwatchWindow"
 #define ORIGINAL_WINDOW_KEY  @"StopwatchWindowOriginal"
@@ -11,6 +12,7 @@
 - (void)reset;
 - (void)openConfigPanel;
 - (NSString *)formatTime:(float)timeInterval;
+- (void)publishDeadline;
 @end
 
 @implementation StopwatchController
@@ -447,6 +449,15 @@
 	[transparentView setNeedsDisplay:YES];
 }
 
+/**
+ Publishes whether the stopwatch is keeping the system from sleeping into the WindowManager's deadline registry.
+ A stopwatch never needs to wake the system, so it has no deadline.
+**/
+- (void)publishDeadline
+{
+	[WindowManager setDeadline:nil preventsSleep:![self canSystemSleep] forOwner:self];
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark Action Methods
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -478,6 +489,9 @@
 		// Set status as started
 		isStarted = YES;
 	}
+	
+	// A running stopwatch keeps the system from sleeping
+	[self publishDeadline];
 }
 
 - (void)pause
@@ -489,6 +503,9 @@
 	
 	// Stop the timer
 	[timer invalidate];
+	
+	// A paused stopwatch doesn't keep the system from sleeping
+	[self publishDeadline];
 }
 
 - (void)lapSplit
@@ -532,6 +549,9 @@
 	// Stop the timer
 	[timer invalidate];
 	
+	// A reset stopwatch doesn't keep the system from sleeping
+	[self publishDeadline];
+	
 	// And open up the config panel, so the user is able to set a new name for the stopwatch window if they want
 	[self openConfigPanel];
 }
@@ -1,7 +1,7 @@
 /* TimerController */
 
 #import <Cocoa/Cocoa.h>
-#import <QTKit/QTKit.h>
+#import "AudioOutput.h"
 
 #import "TransparentController.h"
 
@@ -11,7 +11,9 @@
 	NSTimer *timer;
 	
 	// For tracking time
+	// The timer only runs while counting down in a window that can be seen, so isRunning says if it's counting down
 	BOOL isStarted;
+	BOOL isRunning;
 	float totalTime;
 	float elapsedTime;
 	NSDate *startDate;
@@ -19,8 +21,8 @@
 	// Options
 	BOOL useAlarmVolume;
 	
-	// Movie for playing sound
-	QTMovie *movie;
+	// Output for playing sound
+	AudioOutput *output;
 	
 	// Initial system volumes
 	// This is the volume the system was at before the alarm went off
@@ -50,4 +52,7 @@
 }
 - (IBAction)closeConfigPanel:(id)sender;
 - (IBAction)nameDidChange:(id)sender;
+
+- (NSCalendarDate *)nextDeadline;
+- (void)updateAndCheck:(NSTimer *)aTimer;
 @end
@@ -1,6 +1,10 @@
 #import "TimerController.h"
 #import "Prefs.h"
 #import "MTCoreAudioDevice.h"
+#import "QTAudioOutput.h"
+#import "MemoryAudioOutput.h"
+#import "WindowManager.h"
+#import "AlarmTasks.h"
 #import <math.h>
 
 #define WINDOW_KEY               @"TimerWindow"
@@ -19,10 +23,25 @@
 - (void)reset;
 - (void)edit:(BOOL)isInitialSetup;
 - (NSString *)formatTime:(float)timeInterval;
+- (void)soundFinished;
+- (void)publishDeadline;
+- (void)updateTimer;
+- (void)applicationDidHideOrUnhide:(NSNotification *)notification;
 @end
 
 @implementation TimerController
 
+// C STYLE METHODS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Called by the output when the sound has finished playing.
+**/
+static void TimerSoundFinished(void *context, AudioOutput *output)
+{
+	[(TimerController *)context soundFinished];
+}
+
 // INIT, DEALLOC
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -35,15 +54,26 @@
 	{
 		// Initialize time tracking info
 		isStarted = NO;
+		isRunning = NO;
 		elapsedTime = 0.0;
 		
 		// Default time is 15 minutes
 		totalTime = 15 * 60;
 		
-		// Intialize movie
+		// Intialize output, and open the sound
+		// The sound is decoded into memory now, so it starts instantly when the timer goes off
+		// If that doesn't work, it's played through QuickTime instead
 		NSBundle *thisBundle = [NSBundle bundleForClass:[self class]];
 		NSString *filePath = [[thisBundle resourcePath] stringByAppendingPathComponent:@"defaultTimer.m4a"];
-		movie = [[QTMovie alloc] initWithFile:filePath error:nil];
+		output = MemoryAudioOutputCreate();
+		
+		if((output == NULL) || !AudioOutputOpen(output, [filePath fileSystemRepresentation]))
+		{
+			AudioOutputFree(output);
+			output = QTAudioOutputCreate();
+			AudioOutputOpen(output, [filePath fileSystemRepresentation]);
+		}
+		AudioOutputSetFinishedFunction(output, TimerSoundFinished, self);
 		
 		// Initialize localized strings
 		titleStr     = [NSLocalizedStringFromTable(@"Timer", @"TimerWindow", @"Initial title of timer") retain];
@@ -52,12 +82,6 @@
 		pauseStr     = [NSLocalizedStringFromTable(@"Pause", @"TimerWindow", @"Button in Timer") retain];
 		resetStr     = [NSLocalizedStringFromTable(@"Reset", @"TimerWindow", @"Button in Timer") retain];
 		editStr      = [NSLocalizedStringFromTable(@"Edit",  @"TimerWindow", @"Button in Timer") retain];
-		
-		// Register for notifications
-		[[NSNotificationCenter defaultCenter] addObserver:self
-												 selector:@selector(movieFinished:)
-													 name:QTMovieDidEndNotification
-												   object:nil];
 	}
 	return self;
 }
@@ -151,8 +175,8 @@
 	// Release startDate
 	[startDate release];
 	
-	// Release movie
-	[movie release];
+	// Free output
+	AudioOutputFree(output);
 	
 	// Release stored and localized strings
 	[titleStr release];
@@ -198,6 +222,16 @@
 		totalTime = [[mostRecent objectForKey:RECENT_TIME_KEY] floatValue];
 	}
 	
+	// The timer is only needed while the window can be seen
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(applicationDidHideOrUnhide:)
+												 name:NSApplicationDidHideNotification
+											   object:nil];
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(applicationDidHideOrUnhide:)
+												 name:NSApplicationDidUnhideNotification
+											   object:nil];
+	
 	// Now we call edit, which opens up the config sheet
 	[self edit:YES];
 }
@@ -255,7 +289,10 @@
 
 - (void)windowDidMiniaturize:(NSNotification *)aNotification
 {
-	if([timer isValid])
+	// The dock icon is updated instead, once a second
+	[self updateTimer];
+	
+	if(isRunning)
 	{
 		miniWindowTimer = [[NSTimer scheduledTimerWithTimeInterval:1.0
 															target:self
@@ -270,6 +307,18 @@
 	[miniWindowTimer invalidate];
 	[miniWindowTimer release];
 	miniWindowTimer = nil;
+	
+	[self updateTimer];
+	[transparentView setNeedsDisplay:YES];
+}
+
+/**
+ Called when the application is hidden or unhidden, which hides or shows this window along with it.
+**/
+- (void)applicationDidHideOrUnhide:(NSNotification *)notification
+{
+	[self updateTimer];
+	[transparentView setNeedsDisplay:YES];
 }
 
 /**
@@ -280,6 +329,9 @@
 	// Stop the timer
 	[timer invalidate];
 	
+	// Stop listening for the application being hidden or unhidden
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
 	// Post notification for closed timer
 	// This informs the WindowManager to remove the timer from it's list of open timer windows
 	[[NSNotificationCenter defaultCenter] postNotificationName:@"TimerClosed" object:self];
@@ -334,7 +386,7 @@
 
 - (NSString *)timeStr
 {
-	if([timer isValid])
+	if(isRunning)
 	{
 		float timeLeft = totalTime - (elapsedTime + [[NSDate date] timeIntervalSinceDate:startDate]);
 		return [self formatTime:timeLeft];
@@ -348,7 +400,7 @@
 
 - (NSString *)leftButtonStr
 {
-	if([timer isValid])
+	if(isRunning)
 		return pauseStr;
 	else
 		return startStr;
@@ -356,7 +408,7 @@
 
 - (NSString *)rightButtonStr
 {
-	if([timer isValid])
+	if(isRunning)
 		return resetStr;
 	else
 		return editStr;
@@ -390,7 +442,7 @@
 		// So the timeLeft is simply the totalTime
 		timeLeft = totalTime;
 	}
-	else if([timer isValid])
+	else if(isRunning)
 	{
 		// The timer is active, so the timeLeft is calculated traditionally, using the startDate
 		timeLeft = totalTime - (elapsedTime + [[NSDate date] timeIntervalSinceDate:startDate]);
@@ -411,6 +463,9 @@
 	if((timeLeft > amountToDecrease) && (totalTime > amountToDecrease))
 	{
 		totalTime -= amountToDecrease;
+		
+		// The timer goes off at a different time, if it's counting down
+		[self publishDeadline];
 	}
 }
 
@@ -435,6 +490,9 @@
 		// This will have the effect of displaying the totalTime in the time field, just as if they clicked reset
 		elapsedTime = 0.0;
 	}
+	
+	// The timer goes off at a different time, if it's counting down
+	[self publishDeadline];
 }
 
 /**
@@ -442,7 +500,7 @@
 **/
 - (void)leftButtonClicked
 {
-	if([timer isValid])
+	if(isRunning)
 		[self pause];
 	else
 		[self start];
@@ -453,7 +511,7 @@
 **/
 - (void)rightButtonClicked
 {
-	if([timer isValid])
+	if(isRunning)
 		[self reset];
 	else
 		[self edit:NO];
@@ -462,7 +520,7 @@
 - (BOOL)canSystemSleep
 {
 	// The only reason to prevent sleep is if the timer is active
-	if([timer isValid])
+	if(isRunning)
 		return NO;
 	else
 		return YES;
@@ -474,7 +532,7 @@
 **/
 - (NSCalendarDate *)systemWillSleep
 {
-	if([timer isValid])
+	if(isRunning)
 	{
 		float timeLeft = totalTime - (elapsedTime + [[NSDate date] timeIntervalSinceDate:startDate]);
 		
@@ -502,6 +560,63 @@
 	[transparentView setNeedsDisplay:YES];
 }
 
+/**
+ Returns the time at which the timer goes off, or nil if it isn't counting down.
+ AlarmTasks wakes up at this time, and sets it off (via updateAndCheck:) without waiting for the next timer event.
+**/
+- (NSCalendarDate *)nextDeadline
+{
+	if(isRunning)
+	{
+		float timeLeft = totalTime - (elapsedTime + [[NSDate date] timeIntervalSinceDate:startDate]);
+		
+		NSDate *temp = [NSDate dateWithTimeIntervalSinceNow:timeLeft];
+		return [temp dateWithCalendarFormat:nil timeZone:nil];
+	}
+	else
+	{
+		return nil;
+	}
+}
+
+/**
+ Publishes the time at which the timer goes off, and whether it's keeping the system from sleeping,
+ into the WindowManager's deadline registry.
+ Called whenever the timer is started or stopped, or it's time is changed while it's counting down.
+**/
+- (void)publishDeadline
+{
+	[WindowManager setDeadline:[self nextDeadline] preventsSleep:![self canSystemSleep] forOwner:self];
+}
+
+/**
+ Starts or stops the timer, depending on whether it's needed.
+ It's only needed to keep the time shown up to date, while counting down in a window the user can see.
+ AlarmTasks wakes up when the time is up (see nextDeadline), whether the timer is running or not.
+ Called whenever the timer is started or stopped, or whether the window can be seen changes.
+**/
+- (void)updateTimer
+{
+	BOOL isVisible = [[self window] isVisible] && ![[self window] isMiniaturized] && ![NSApp isHidden];
+	BOOL needsTimer = isRunning && isVisible;
+	
+	if(needsTimer && (timer == nil))
+	{
+		timer = [[NSTimer scheduledTimerWithTimeInterval:0.5
+												  target:self
+												selector:@selector(updateAndCheck:)
+												userInfo:nil
+												 repeats:YES] retain];
+	}
+	else if(!needsTimer && (timer != nil))
+	{
+		// This may be called from the timer itself, so it's autoreleased rather than released
+		[timer invalidate];
+		[timer autorelease];
+		timer = nil;
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark Action Methods
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -516,12 +631,8 @@
 	startDate = [[NSDate date] retain];
 	
 	// Start the timer
-	[timer release];
-	timer = [[NSTimer scheduledTimerWithTimeInterval:0.5
-											  target:self
-											selector:@selector(updateAndCheck:)
-											userInfo:nil
-											 repeats:YES] retain];
+	isRunning = YES;
+	[self updateTimer];
 	
 	// If starting for the first time, or after a reset (as in not unpausing)
 	if(!isStarted)
@@ -532,6 +643,9 @@
 		// Set status as started
 		isStarted = YES;
 	}
+	
+	// The system needs to be awake when the timer goes off
+	[self publishDeadline];
 }
 
 /**
@@ -543,7 +657,11 @@
 	elapsedTime += [[NSDate date] timeIntervalSinceDate:startDate];
 	
 	// Stop the timer
-	[timer invalidate];
+	isRunning = NO;
+	[self updateTimer];
+	
+	// The timer no longer goes off, or keeps the system from sleeping
+	[self publishDeadline];
 }
 
 /**
@@ -558,7 +676,11 @@
 	elapsedTime = 0.0;
 	
 	// Stop the timer
-	[timer invalidate];
+	isRunning = NO;
+	[self updateTimer];
+	
+	// The timer no longer goes off, or keeps the system from sleeping
+	[self publishDeadline];
 }
 
 /**
@@ -726,6 +848,12 @@
 // Methods called by timer
 - (void)updateAndCheck:(NSTimer *)aTimer
 {
+	// Count the wakeup, unless we were called directly (by AlarmTasks when the timer goes off)
+	if(aTimer != nil)
+	{
+		[AlarmTasks countWindowWakeup];
+	}
+	
 	float timeLeft = totalTime - (elapsedTime + [[NSDate date] timeIntervalSinceDate:startDate]);
 	
 	// If we've counted all the way down to zero
@@ -738,11 +866,16 @@
 		elapsedTime = totalTime;
 		
 		// Stop the timer
-		[timer invalidate];
+		isRunning = NO;
+		[self updateTimer];
 		
 		// Set status as unstarted
 		isStarted = NO;
 		
+		// The timer no longer goes off, or keeps the system from sleeping
+		// Whichever of this timer and AlarmTasks got here first, the other doesn't need to wake up for it
+		[self publishDeadline];
+		
 		// If we're supposed to use the alarm volume, then we need to set that up...
 		if(useAlarmVolume)
 		{
@@ -772,7 +905,7 @@
 		}
 		
 		// And finally, play our little tune
-		[movie play];
+		AudioOutputPlay(output);
 	}
 	
 	// Notify NSView that it needs to redraw itself
@@ -788,7 +921,7 @@
 	
 	if([event keyCode] == 49)
 	{
-		if([timer isValid])
+		if(isRunning)
 			[self pause];
 		else
 			[self start];
@@ -797,26 +930,26 @@
 	}
 }
 
-- (void)movieFinished:(NSNotification *)notification
+/**
+ Called (via TimerSoundFinished) when our sound has finished playing.
+**/
+- (void)soundFinished
 {
-	// This method is called for every movie in the application finishing
-	// Check to make sure the movie is the one we're looking for
-	if(movie == [notification object])
+	// If we are using the alarm volume
+	if(useAlarmVolume)
 	{
-		// If we are using the alarm volume
-		if(useAlarmVolume)
-		{
-			// Reset the volume to what it was before the timer went off
-			MTCoreAudioDevice *outputDevice = [MTCoreAudioDevice defaultOutputDevice];
-			
-			[outputDevice setVolume:initialLeftVolume  forChannel:1 forDirection:kMTCoreAudioDevicePlaybackDirection];
-			[outputDevice setVolume:initialRightVolume forChannel:2 forDirection:kMTCoreAudioDevicePlaybackDirection];
-		}
+		// Reset the volume to what it was before the timer went off
+		MTCoreAudioDevice *outputDevice = [MTCoreAudioDevice defaultOutputDevice];
+		
+		[outputDevice setVolume:initialLeftVolume  forChannel:1 forDirection:kMTCoreAudioDevicePlaybackDirection];
+		[outputDevice setVolume:initialRightVolume forChannel:2 forDirection:kMTCoreAudioDevicePlaybackDirection];
 	}
 }
 
 - (void)updateMiniWindow:(NSTimer *)aTimer
 {
+	[AlarmTasks countWindowWakeup];
+	
 	if(bmpImageRep == nil)
 	{
 		bmpImageRep = [[transparentView bitmapImageRepForCachingDisplayInRect:[transparentView visibleRect]] retain];
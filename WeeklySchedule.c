@@ -0,0 +1,47 @@
+#include "WeeklySchedule.h"
+
+#define DAY_SECONDS  86400
+
+/**
+ Converts a local time to UTC, given a guess of the zone's offset then (such as the offset a day earlier).
+
+ If the local time happened twice (the clocks were moved back over it), either one may be returned,
+ depending on the guess. If it never happened (the clocks were moved forward over it), the time as far after
+ the change as the local time was after the old clock time is returned: 2:30 becomes 3:30, as it does when
+ adding days to an NSCalendarDate.
+**/
+int64_t WeeklyScheduleLocalToUTC(int64_t localTime, int32_t offsetGuess,
+                                 WeeklyScheduleOffsetFunction offsetAt, void *context)
+{
+	int32_t firstOffset = offsetAt(context, localTime - offsetGuess);
+	int64_t time = localTime - firstOffset;
+	
+	int32_t secondOffset = offsetAt(context, time);
+	if(secondOffset == firstOffset) return time;
+	
+	// The guess was on the other side of a change, so try the offset on this side of it
+	int64_t otherTime = localTime - secondOffset;
+	if(offsetAt(context, otherTime) == secondOffset) return otherTime;
+	
+	// Neither offset gives the local time back, so it's in the gap of a change
+	return localTime - ((firstOffset < secondOffset) ? firstOffset : secondOffset);
+}
+
+/**
+ Converts a local time to UTC, like WeeklyScheduleLocalToUTC, for an alarm going off after now.
+ If the local time is repeated, and the first of the two is not after now, the second is returned.
+ The time returned is not after now only if the local time has passed (for the last time).
+**/
+int64_t WeeklyScheduleLocalToUTCAfter(int64_t localTime, int64_t now, int32_t nowOffset,
+                                      WeeklyScheduleOffsetFunction offsetAt, void *context)
+{
+	int64_t time = WeeklyScheduleLocalToUTC(localTime, nowOffset, offsetAt, context);
+	if(time > now) return time;
+	
+	// The clocks may still be moved back over it (changes are never more than a day apart from what they affect)
+	int32_t laterOffset = offsetAt(context, time + DAY_SECONDS);
+	int64_t repeat = localTime - laterOffset;
+	
+	if((repeat > now) && (offsetAt(context, repeat) == laterOffset)) return repeat;
+	return time;
+}
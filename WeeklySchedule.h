@@ -0,0 +1,28 @@
+/**
+ Converts the local (wall clock) times of weekly repeating alarms to universal time, in constant time.
+
+ A weekly schedule is a 7 bit mask of days, as in -[Alarm schedule]: bit 0 is Sunday, bit 6 is Saturday.
+ The alarm goes off at the same local time on each of those days. The days themselves are worked out
+ by the recurrence rules (see AlarmRecurrence.h); only the conversions between local and universal time
+ depend on the time zone, and those take a few calls to the given offset function,
+ however long ago the alarm last went off.
+
+ Times are in seconds since 1970 (UTC). Local times are the same, plus the zone's offset from UTC at the time.
+**/
+
+#ifndef WEEKLY_SCHEDULE_H
+#define WEEKLY_SCHEDULE_H
+
+#include <stdint.h>
+
+#define WEEKLY_SCHEDULE_MASK  0x7F
+
+// Returns the offset from UTC (in seconds) of the time zone, at the given time
+typedef int32_t (*WeeklyScheduleOffsetFunction)(void *context, int64_t time);
+
+int64_t WeeklyScheduleLocalToUTC(int64_t localTime, int32_t offsetGuess,
+                                 WeeklyScheduleOffsetFunction offsetAt, void *context);
+int64_t WeeklyScheduleLocalToUTCAfter(int64_t localTime, int64_t now, int32_t nowOffset,
+                                      WeeklyScheduleOffsetFunction offsetAt, void *context);
+
+#endif
@@ -18,6 +18,11 @@
 + (void)openStopwatchWindow;
 + (NSArray *)stopwatchWindows;
 
++ (void)setDeadline:(NSCalendarDate *)deadline preventsSleep:(BOOL)flag forOwner:(id)owner;
++ (void)removeDeadlineForOwner:(id)owner;
++ (NSCalendarDate *)nextDeadline;
++ (BOOL)checkWindowDeadlines:(NSCalendarDate *)now;
+
 + (BOOL)canSystemSleep;
 + (NSCalendarDate *)systemWillSleep;
 + (void)systemDidWake;
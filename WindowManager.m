@@ -15,9 +15,21 @@
 #import "TimerController.h"
 #import "StopwatchController.h"
 #import "AppleRemote.h"
+#import "CalendarAdditions.h"
+#import "AlarmHeap.h"
 
 #import <IOKit/ps/IOPowerSources.h>
 #import <IOKit/ps/IOPSKeys.h>
+#import <math.h>
+
+// Key of the earliest deadline when there isn't one
+#define DEADLINE_NEVER  INT64_MAX
+
+
+// Declare private methods
+@interface WindowManager (PrivateAPI)
++ (int32_t)deadlineHandleForOwner:(id)owner;
+@end
 
 
 @implementation WindowManager
@@ -39,6 +51,20 @@ static NSMutableArray *alarmEditorWindows;
 
 static NSLock *lock;
 
+// Deadline registry
+// Each owner (an open window, or the AlarmScheduler) publishes the time it next needs the system awake, if any,
+// and whether it's keeping the system from sleeping, under a handle of it's own (see setDeadline:preventsSleep:forOwner:).
+// The deadlines are kept in a heap, and the owners keeping the system from sleeping are counted,
+// so the earliest deadline, and whether the system can sleep, are read without asking any window.
+static AlarmHeap *deadlines;
+static BOOL *preventsSleep;
+static int32_t preventingSleepCount;
+static int32_t handlesCount;
+static int32_t handlesCapacity;
+static int32_t *freeHandles;
+static int32_t freeHandlesCount;
+static NSMapTable *handlesByOwner;
+
 // INTIALIZATION, DEINITIALIZATION
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -95,6 +121,10 @@ static NSLock *lock;
 		// Initialize lock
 		lock = [[NSLock alloc] init];
 		
+		// Initialize the deadline registry
+		deadlines = AlarmHeapCreate(16);
+		handlesByOwner = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSIntMapValueCallBacks, 16);
+		
 		initialized = YES;
 	}
 }
@@ -127,6 +157,17 @@ static NSLock *lock;
 	
 	// Deregiester for notifications
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	// Tear down the deadline registry
+	// Anything published after this is ignored
+	NSFreeMapTable(handlesByOwner);
+	handlesByOwner = NULL;
+	AlarmHeapFree(deadlines);
+	deadlines = NULL;
+	free(preventsSleep);
+	preventsSleep = NULL;
+	free(freeHandles);
+	freeHandles = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -258,6 +299,9 @@ static NSLock *lock;
 	// Remove the alarmWindow from the list of alarm windows
 	[alarmWindows removeObject:[notification object]];
 	
+	// Remove the alarm's deadline, as it may have been snoozing
+	[self removeDeadlineForOwner:[notification object]];
+	
 	// If we don't have any alarm windows open, we can stop listening to the apple remote
 	if([alarmWindows count] == 0)
 	{
@@ -304,6 +348,9 @@ static NSLock *lock;
 {
 	// Remove the timerWindow from the list of timer windows
 	[timerWindows removeObject:[notification object]];
+	
+	// Remove the timer's deadline, as it may have been counting down
+	[self removeDeadlineForOwner:[notification object]];
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -345,6 +392,185 @@ static NSLock *lock;
 {
 	// Remove the stopwatchWindow from the list of stopwatch windows
 	[stopwatchWindows removeObject:[notification object]];
+	
+	// A running stopwatch keeps the system from sleeping, but not once it's closed
+	[self removeDeadlineForOwner:[notification object]];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Deadlines:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Returns the key of a deadline in the heap: it's time, in whole milliseconds since the reference date.
+ It's rounded up, so the deadline has always been reached by the time it's key has.
+**/
+static int64_t KeyForDeadline(NSDate *deadline)
+{
+	return (int64_t)ceil([deadline timeIntervalSinceReferenceDate] * 1000.0);
+}
+
+/**
+ Returns the key of the earliest deadline, or DEADLINE_NEVER if there isn't one.
+**/
+static int64_t EarliestKey(void)
+{
+	if(deadlines == NULL) return DEADLINE_NEVER;
+	
+	int32_t handle = AlarmHeapPeek(deadlines);
+	
+	if(handle >= 0)
+		return AlarmHeapKey(deadlines, handle);
+	else
+		return DEADLINE_NEVER;
+}
+
+/**
+ Publishes the time at which the owner next needs the system awake (nil if it doesn't),
+ and whether it needs to keep the system from sleeping until then.
+ 
+ Owners (open windows and the AlarmScheduler) call this whenever either may have changed,
+ and removeDeadlineForOwner: when they go away (which is done for closed windows automatically).
+ If the earliest deadline changes, a "DeadlineChanged" notification is posted.
+**/
++ (void)setDeadline:(NSCalendarDate *)deadline preventsSleep:(BOOL)flag forOwner:(id)owner
+{
+	int32_t handle = [self deadlineHandleForOwner:owner];
+	if(handle < 0) return;
+	
+	int64_t earliestKey = EarliestKey();
+	
+	if(deadline != nil)
+		AlarmHeapInsert(deadlines, handle, KeyForDeadline(deadline));
+	else
+		AlarmHeapRemove(deadlines, handle);
+	
+	if(flag != preventsSleep[handle])
+	{
+		preventsSleep[handle] = flag;
+		preventingSleepCount += flag ? 1 : -1;
+	}
+	
+	if(EarliestKey() != earliestKey)
+	{
+		[[NSNotificationCenter defaultCenter] postNotificationName:@"DeadlineChanged" object:self];
+	}
+}
+
+/**
+ Removes whatever the owner published, as if it had no deadline, and didn't need to keep the system from sleeping.
+**/
++ (void)removeDeadlineForOwner:(id)owner
+{
+	if(handlesByOwner == NULL) return;
+	
+	int32_t handle = (int32_t)(intptr_t)NSMapGet(handlesByOwner, owner) - 1;
+	if(handle < 0) return;
+	
+	[self setDeadline:nil preventsSleep:NO forOwner:owner];
+	
+	NSMapRemove(handlesByOwner, owner);
+	freeHandles[freeHandlesCount++] = handle;
+}
+
+/**
+ Returns the earliest time at which anything needs the system awake:
+ the next scheduled alarm, a snoozing alarm going off again, or a timer going off.
+ If nothing does, nil is returned.
+**/
++ (NSCalendarDate *)nextDeadline
+{
+	int64_t earliestKey = EarliestKey();
+	
+	if(earliestKey == DEADLINE_NEVER) return nil;
+	
+	return [NSCalendarDate dateWithTimeIntervalSinceReferenceDate:(earliestKey / 1000.0)];
+}
+
+/**
+ Called (by AlarmTasks) when a deadline may have been reached.
+ Each window whose deadline is at or before the given time is updated right away,
+ rather than waiting for it's own timer to notice.
+ Returns whether any deadline was reached.
+**/
++ (BOOL)checkWindowDeadlines:(NSCalendarDate *)now
+{
+	// Nothing is due yet, so there's no need to ask the windows
+	if(EarliestKey() > KeyForDeadline(now)) return NO;
+	
+	int i;
+	BOOL reached = NO;
+	
+	for(i = 0; i < [alarmWindows count]; i++)
+	{
+		AlarmController *alarmWindow = [alarmWindows objectAtIndex:i];
+		NSCalendarDate *deadline = [alarmWindow nextDeadline];
+		
+		if((deadline != nil) && ![deadline isLaterDate:now])
+		{
+			[alarmWindow updateAndCheck:nil];
+			reached = YES;
+		}
+	}
+	
+	for(i = 0; i < [timerWindows count]; i++)
+	{
+		TimerController *timerWindow = [timerWindows objectAtIndex:i];
+		NSCalendarDate *deadline = [timerWindow nextDeadline];
+		
+		if((deadline != nil) && ![deadline isLaterDate:now])
+		{
+			[timerWindow updateAndCheck:nil];
+			reached = YES;
+		}
+	}
+	
+	return reached;
+}
+
+/**
+ Returns the handle the owner's deadline is kept under, giving it one if it doesn't have one yet.
+ Returns -1 if the registry has been torn down, or the memory can't be allocated.
+**/
++ (int32_t)deadlineHandleForOwner:(id)owner
+{
+	if(handlesByOwner == NULL) return -1;
+	
+	int32_t handle = (int32_t)(intptr_t)NSMapGet(handlesByOwner, owner) - 1;
+	if(handle >= 0) return handle;
+	
+	if(freeHandlesCount > 0)
+	{
+		handle = freeHandles[--freeHandlesCount];
+	}
+	else
+	{
+		if(handlesCount == handlesCapacity)
+		{
+			int32_t capacity = (handlesCapacity > 0) ? (handlesCapacity * 2) : 16;
+			
+			BOOL *newPreventsSleep = realloc(preventsSleep, capacity * sizeof(BOOL));
+			if(newPreventsSleep != NULL) preventsSleep = newPreventsSleep;
+			
+			int32_t *newFreeHandles = realloc(freeHandles, capacity * sizeof(int32_t));
+			if(newFreeHandles != NULL) freeHandles = newFreeHandles;
+			
+			if((newPreventsSleep == NULL) || (newFreeHandles == NULL))
+			{
+				NSLog(@"Unable to allocate room for %i deadlines", capacity);
+				return -1;
+			}
+			
+			handlesCapacity = capacity;
+		}
+		
+		handle = handlesCount++;
+	}
+	
+	preventsSleep[handle] = NO;
+	NSMapInsert(handlesByOwner, owner, (void *)(intptr_t)(handle + 1));
+	
+	return handle;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -383,8 +609,18 @@ static NSLock *lock;
     return mBatteryPower;
 }
 
+/**
+ Called to determine if the system should be allowed to sleep.
+ This is read from the deadline registry, without asking any window.
+**/
 + (BOOL)canSystemSleep
 {
+	// No window (alarm going off, timer counting down, or stopwatch running) is keeping the system from sleeping
+	if(preventingSleepCount == 0)
+	{
+		return YES;
+	}
+	
 	if([self runningOnBattery] && [Prefs wakeFromSleep])
 	{
 		// The computer is running on battery power, and the app is properly configured to wake it from sleep
@@ -393,110 +629,28 @@ static NSLock *lock;
 		return YES;
 	}
 	
-	int i;
-	
-	// Loop through all the alarm windows, and see if any of them need to prevent sleep
-	for(i = 0; i < [alarmWindows count]; i++)
-	{
-		if(![[alarmWindows objectAtIndex:i] canSystemSleep])
-		{
-			return NO;
-		}
-	}
-	
-	// Loop through all the timer windows, and see if any of them need to prevent sleep
-	for(i = 0; i < [timerWindows count]; i++)
-	{
-		if(![[timerWindows objectAtIndex:i] canSystemSleep])
-		{
-			return NO;
-		}
-	}
-	
-	// Loop through all the stopwatch windows, and see if any of them need to prevent sleep
-	for(i = 0; i < [stopwatchWindows count]; i++)
-	{
-		if(![[stopwatchWindows objectAtIndex:i] canSystemSleep])
-		{
-			return NO;
-		}
-	}
-	
-	return YES;
+	return NO;
 }
 
 /**
  Called prior to the system going to sleep.
- Since there may be open windows that require the system to wake at a certain time,
- this method loops through all open windows, and calculates the earliest date at which the system should wake up.
- The earliest date is returned.
- If no windows require a system wake, nil is returned.
+ Returns the earliest date at which the system should wake up, for a scheduled alarm or an open window.
+ If nothing requires a system wake, nil is returned.
+ 
+ Every window (and the AlarmScheduler) publishes it's deadline as it changes, so this is read from the registry.
+ The only windows asked are alarms that are going off, which are snoozed, and so publish the time to wake up for them.
 **/
 + (NSCalendarDate *)systemWillSleep
 {
-	int i;
-	NSCalendarDate *wakeDate = nil;
-	
-	// Loop through all Alarms
-	// If an alarm is snoozing, the system needs to wake up when the snooze duration is over
-	
-	for(i = 0; i < [alarmWindows count]; i++)
-	{
-		// Get the alarm's desired startTime
-		NSCalendarDate *temp = [[alarmWindows objectAtIndex:i] systemWillSleep];
-		
-		if(temp != nil)
-		{
-			// Compare this with the existing wake date
-			// We want the wake date to be the closest time to now
-			if(wakeDate == nil)
-				wakeDate = temp;
-			else
-				wakeDate = (NSCalendarDate*)[wakeDate earlierDate:temp];
-		}
-	}
-	
-	// Loop through all Timers
-	// If a timer is active, the system needs to wake up when the timer is set to go off
-	
-	for(i = 0; i < [timerWindows count]; i++)
+	// An alarm going off keeps the system from sleeping, so if nothing is, there's nothing to snooze
+	if(preventingSleepCount > 0)
 	{
-		// Get the time at which the timer should go off
-		NSCalendarDate *temp = [[timerWindows objectAtIndex:i] systemWillSleep];
-		
-		// If a timer isn't active, temp will be nil
-		if(temp != nil)
-		{
-			// Compare this with the existing wake date
-			// We want the wake date to be the closest time to now
-			if(wakeDate == nil)
-				wakeDate = temp;
-			else
-				wakeDate = (NSCalendarDate*)[wakeDate earlierDate:temp];
-		}
+		// Call the alarm's systemWillSleep method
+		// If the alarm is active, this will snooze it
+		[alarmWindows makeObjectsPerformSelector:@selector(systemWillSleep)];
 	}
 	
-	// Loop through all Stopwatches
-	// Stopwatches generally don't have to wake the system from sleep, but they need to prepare for it
-	
-	for(i = 0; i < [stopwatchWindows count]; i++)
-	{
-		// Get the time at which the timer should go off
-		NSCalendarDate *temp = [[stopwatchWindows objectAtIndex:i] systemWillSleep];
-		
-		// If a timer isn't active, temp will be nil
-		if(temp != nil)
-		{
-			// Compare this with the existing wake date
-			// We want the wake date to be the closest time to now
-			if(wakeDate == nil)
-				wakeDate = temp;
-			else
-				wakeDate = (NSCalendarDate*)[wakeDate earlierDate:temp];
-		}
-	}
-	
-	return wakeDate;
+	return [self nextDeadline];
 }
 
 /**
@@ -506,25 +660,9 @@ static NSLock *lock;
 **/
 + (void)systemDidWake
 {
-	int i;
-	
-	// Loop through all Alarms
-	for(i = 0; i < [alarmWindows count]; i++)
-	{
-		[[alarmWindows objectAtIndex:i] systemDidWake];
-	}
-	
-	// Loop through all Timers
-	for(i = 0; i < [timerWindows count]; i++)
-	{
-		[[timerWindows objectAtIndex:i] systemDidWake];
-	}
-	
-	// Loop through all Stopwatches
-	for(i = 0; i < [stopwatchWindows count]; i++)
-	{
-		[[stopwatchWindows objectAtIndex:i] systemDidWake];
-	}
+	[alarmWindows makeObjectsPerformSelector:@selector(systemDidWake)];
+	[timerWindows makeObjectsPerformSelector:@selector(systemDidWake)];
+	[stopwatchWindows makeObjectsPerformSelector:@selector(systemDidWake)];
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////